@@ -17,6 +17,7 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -29,6 +30,8 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/file.h>
+#include <sys/stat.h>
+#include <stdbool.h>
 #include <linux/limits.h>
 #include <openbmc/log.h>
 #include <openbmc/ipmi.h>
@@ -39,89 +42,355 @@
 #define LAST_RECORD_ID 0xFFFF
 #define BYTES_ENTIRE_RECORD 0xFF
 
+/* Persistent copies of the FRU and SDR together with the signature of the
+ * BIC state they were read from. A copy is reused as long as the signature
+ * read back from the BIC matches, so a BMC reboot does not need to pull
+ * both repositories again. */
+#define CACHE_DIR "/mnt/data/bic-cache"
+#define MAX_SIG_LEN 64
+#define FRU_HDR_LEN 8
+#define FRU_MULTIREC_HDR_LEN 5
+
+static bool force_refresh = false;
+
+static int
+copy_fd(int in, int out) {
+  char buf[1024];
+  ssize_t len;
+
+  while ((len = read(in, buf, sizeof(buf))) > 0) {
+    if (write(out, buf, len) != len) {
+      return -1;
+    }
+  }
+  return len < 0 ? -1 : 0;
+}
+
+/* Atomically replace the persistent copy dst with the content of fd */
+static int
+cache_save(int fd, const char *dst) {
+  char tmp[PATH_MAX];
+  int out, ret;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", dst);
+  out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    return -1;
+  }
+  ret = (lseek(fd, 0, SEEK_SET) < 0) ? -1 : copy_fd(fd, out);
+  if (fsync(out) < 0) {
+    ret = -1;
+  }
+  close(out);
+  if (ret == 0 && rename(tmp, dst) == 0) {
+    return 0;
+  }
+  unlink(tmp);
+  return -1;
+}
+
+static int
+sig_save(const char *path, const uint8_t *sig, size_t len) {
+  char tmp[PATH_MAX];
+  int fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  if (write(fd, sig, len) != (ssize_t)len || fsync(fd) < 0) {
+    close(fd);
+    unlink(tmp);
+    return -1;
+  }
+  close(fd);
+  return rename(tmp, path);
+}
+
+/* Whether the persistent copy matches the BIC signature */
+static bool
+sig_match(const char *path, const uint8_t *sig, size_t len) {
+  uint8_t buf[MAX_SIG_LEN];
+  ssize_t rlen;
+  int fd;
+
+  if (force_refresh || len == 0) {
+    return false;
+  }
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  rlen = read(fd, buf, sizeof(buf));
+  close(fd);
+  return rlen == (ssize_t)len && memcmp(buf, sig, len) == 0;
+}
+
+static int
+sig_append(uint8_t *sig, size_t *len, const void *data, size_t size) {
+  if (*len + size > MAX_SIG_LEN) {
+    return -1;
+  }
+  memcpy(&sig[*len], data, size);
+  *len += size;
+  return 0;
+}
+
+/* The firmware version of the BIC is part of every signature, an update
+ * may change the repositories without touching their timestamps */
+static int
+sig_init(uint8_t slot_id, uint8_t *sig, size_t *len) {
+  uint8_t ver[8] = {0};
+
+  *len = 0;
+  if (bic_get_fw_ver(slot_id, FW_BIC, ver)) {
+    return -1;
+  }
+  return sig_append(sig, len, ver, sizeof(ver));
+}
+
+/*
+ * FRU signature: the inventory size, the common header and the header and
+ * checksum byte of every area. Any change to the content of an area
+ * changes its checksum, so this needs a handful of small reads instead
+ * of the whole FRU.
+ */
+static int
+fru_signature(uint8_t slot_id, uint8_t *sig, size_t *len) {
+  ipmi_fruid_info_t info;
+  uint8_t hdr[FRU_HDR_LEN], buf[FRU_MULTIREC_HDR_LEN], cksum = 0;
+  uint32_t offset;
+  size_t rlen;
+  int i;
+
+  if (sig_init(slot_id, sig, len) ||
+      bic_get_fruid_info(slot_id, 0, &info) ||
+      sig_append(sig, len, &info, sizeof(info))) {
+    return -1;
+  }
+
+  rlen = sizeof(hdr);
+  if (bic_read_fruid_data(slot_id, 0, 0, sizeof(hdr), hdr, &rlen) ||
+      rlen != sizeof(hdr)) {
+    return -1;
+  }
+  for (i = 0; i < FRU_HDR_LEN; i++) {
+    cksum += hdr[i];
+  }
+  if (cksum != 0 || sig_append(sig, len, hdr, sizeof(hdr))) {
+    return -1;
+  }
+
+  // Chassis, board and product info areas
+  for (i = 2; i <= 4; i++) {
+    if (hdr[i] == 0) {
+      continue;
+    }
+    offset = hdr[i] * 8;
+    rlen = 2;
+    if (bic_read_fruid_data(slot_id, 0, offset, 2, buf, &rlen) || rlen != 2 ||
+        sig_append(sig, len, buf, rlen)) {
+      return -1;
+    }
+    if (buf[1] == 0) {
+      continue;
+    }
+    rlen = 1;
+    if (bic_read_fruid_data(slot_id, 0, offset + buf[1] * 8 - 1, 1, buf, &rlen) ||
+        rlen != 1 || sig_append(sig, len, buf, rlen)) {
+      return -1;
+    }
+  }
+
+  // Header of the first multi record, it carries the record checksum
+  if (hdr[5]) {
+    rlen = sizeof(buf);
+    if (bic_read_fruid_data(slot_id, 0, hdr[5] * 8, sizeof(buf), buf, &rlen) ||
+        rlen != sizeof(buf) || sig_append(sig, len, buf, rlen)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* SDR signature: record count and the last add/erase timestamps */
+static int
+sdr_signature(uint8_t slot_id, uint8_t *sig, size_t *len) {
+  ipmi_sel_sdr_info_t info;
+
+  if (sig_init(slot_id, sig, len) || bic_get_sdr_info(slot_id, &info)) {
+    return -1;
+  }
+  if (sig_append(sig, len, &info.rec_count, sizeof(info.rec_count)) ||
+      sig_append(sig, len, info.add_ts, sizeof(info.add_ts)) ||
+      sig_append(sig, len, info.erase_ts, sizeof(info.erase_ts))) {
+    return -1;
+  }
+  return 0;
+}
+
 int
 fruid_cache_init(uint8_t slot_id) {
 
   int ret = 0;
-  int fru_size = 0;
+  int fd, fru_size = 0;
   char fruid_path[PATH_MAX];
+  char cache_path[PATH_MAX];
+  char sig_path[PATH_MAX];
   char fru_name[NAME_MAX];
+  uint8_t sig[MAX_SIG_LEN];
+  size_t sig_len = 0;
 
   pal_get_fru_name(slot_id + 1, fru_name);
   sprintf(fruid_path, "/tmp/fruid_%s.bin", fru_name);
+  snprintf(cache_path, sizeof(cache_path), CACHE_DIR "/fruid_%s.bin", fru_name);
+  snprintf(sig_path, sizeof(sig_path), CACHE_DIR "/fruid_%s.sig", fru_name);
+
+  if (fru_signature(slot_id, sig, &sig_len)) {
+    sig_len = 0;
+  }
+
+  if (sig_match(sig_path, sig, sig_len)) {
+    int in = open(cache_path, O_RDONLY);
+    if (in >= 0) {
+      unlink(fruid_path);
+      fd = open(fruid_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+      ret = (fd < 0) ? -1 : copy_fd(in, fd);
+      if (fd >= 0) {
+        close(fd);
+      }
+      close(in);
+      if (ret == 0) {
+        syslog(LOG_INFO, "%s: FRU unchanged, restored from %s", fru_name, cache_path);
+        return 0;
+      }
+    }
+  }
 
   ret = bic_read_fruid(slot_id, 0, fruid_path, &fru_size);
   if (ret) {
     syslog(LOG_WARNING, "failed to read fruid: ret=%d, fru_size: %d\n",
            ret, fru_size);
+    return ret;
+  }
+
+  // The signature is only written once the copy is complete
+  unlink(sig_path);
+  if (sig_len > 0 && (fd = open(fruid_path, O_RDONLY)) >= 0) {
+    if (cache_save(fd, cache_path) == 0) {
+      sig_save(sig_path, sig, sig_len);
+    }
+    close(fd);
   }
 
   return ret;
 }
 
-void
-sdr_cache_init(uint8_t slot_id) {
-  int fd, ret, retry;
+/* Walk the SDR repository into fd, returns 0 when the last record was read */
+static int
+sdr_fetch(uint8_t slot_id, int fd, const char *sdr_path) {
+  int ret, retry;
   size_t rlen;
   uint8_t rbuf[MAX_IPMB_RES_LEN];
-  char sdr_path[PATH_MAX];
-  char fru_name[NAME_MAX];
   ipmi_sel_sdr_req_t req;
   ipmi_sel_sdr_res_t *res = (ipmi_sel_sdr_res_t *) rbuf;
 
-  pal_get_fru_name(slot_id + 1, fru_name);
-  snprintf(sdr_path, sizeof(sdr_path), "/tmp/sdr_%s.bin", fru_name);
-
   req.rsv_id = 0;
   req.rec_id = 0;
   req.offset = 0;
   req.nbytes = BYTES_ENTIRE_RECORD;
 
-  /* Read SCM's SDR records and store */
-  unlink(sdr_path);
-  fd = open(sdr_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
-  if (fd < 0) {
-    syslog(LOG_WARNING, "failed to open %s: %s\n", sdr_path, strerror(errno));
-    return;
-  }
-
-  ret = pal_flock_retry(fd);
-  if (ret == -1) {
-   syslog(LOG_WARNING, "failed to flock %s: %s", sdr_path, strerror(errno));
-   close(fd);
-   return;
-  }
+  // One reservation for the whole walk, it is only renewed on failures
+  // as the BIC cancels it when the repository changes.
+  bic_reserve_sdr(slot_id, &req.rsv_id);
 
   retry = 3;
   while (1) {
     sdr_full_t *sdr;
 
-    ret = bic_get_sdr(slot_id, &req, res, &rlen);
+    ret = bic_get_sdr_record(slot_id, &req, res, &rlen);
     if (ret) {
       syslog(LOG_WARNING, "%s: bic_get_sdr returns %d\n", __func__, ret);
       if (retry-- > 0) {
         msleep(100);
+        bic_reserve_sdr(slot_id, &req.rsv_id);
         continue;
       }
 
-      break;
+      return -1;
     }
 
     sdr = (sdr_full_t *)res->data;
     ret = write(fd, sdr, sizeof(sdr_full_t));
     if (ret < 0) {
       OBMC_ERROR(errno, "write %s failed", sdr_path);
-      break;
+      return -1;
     } else if (ret != sizeof(sdr_full_t)) {
       OBMC_WARN("data truncated (write %s): expect %i, actual %d\n",
                 sdr_path, sizeof(sdr_full_t), ret);
-      break;
+      return -1;
     }
 
     req.rec_id = res->next_rec_id;
     if (req.rec_id == LAST_RECORD_ID) {
       // syslog(LOG_INFO, "This record is LAST record\n");
-      break;
+      return 0;
+    }
+  }
+}
+
+void
+sdr_cache_init(uint8_t slot_id) {
+  int fd, in, ret;
+  char sdr_path[PATH_MAX];
+  char cache_path[PATH_MAX];
+  char sig_path[PATH_MAX];
+  char fru_name[NAME_MAX];
+  uint8_t sig[MAX_SIG_LEN];
+  size_t sig_len = 0;
+  bool restored = false;
+
+  pal_get_fru_name(slot_id + 1, fru_name);
+  snprintf(sdr_path, sizeof(sdr_path), "/tmp/sdr_%s.bin", fru_name);
+  snprintf(cache_path, sizeof(cache_path), CACHE_DIR "/sdr_%s.bin", fru_name);
+  snprintf(sig_path, sizeof(sig_path), CACHE_DIR "/sdr_%s.sig", fru_name);
+
+  if (sdr_signature(slot_id, sig, &sig_len)) {
+    sig_len = 0;
+  }
+
+  /* Read SCM's SDR records and store */
+  unlink(sdr_path);
+  fd = open(sdr_path, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (fd < 0) {
+    syslog(LOG_WARNING, "failed to open %s: %s\n", sdr_path, strerror(errno));
+    return;
+  }
+
+  ret = pal_flock_retry(fd);
+  if (ret == -1) {
+   syslog(LOG_WARNING, "failed to flock %s: %s", sdr_path, strerror(errno));
+   close(fd);
+   return;
+  }
+
+  if (sig_match(sig_path, sig, sig_len) &&
+      (in = open(cache_path, O_RDONLY)) >= 0) {
+    restored = (copy_fd(in, fd) == 0);
+    close(in);
+    if (restored) {
+      syslog(LOG_INFO, "%s: SDR unchanged, restored from %s", fru_name, cache_path);
+    } else if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+      OBMC_ERROR(errno, "failed to reset %s", sdr_path);
+    }
+  }
+
+  if (!restored) {
+    unlink(sig_path);
+    if (sdr_fetch(slot_id, fd, sdr_path) == 0 && sig_len > 0 &&
+        cache_save(fd, cache_path) == 0) {
+      sig_save(sig_path, sig, sig_len);
     }
   }
 
@@ -142,6 +411,11 @@ main (int argc, char * const argv[])
   int retry = 0;
   int max_retry = 3;
 
+  if (argc == 3 && !strcmp(argv[1], "--force")) {
+    force_refresh = true;
+    argv++;
+    argc--;
+  }
   if (argc != 2) {
     syslog(LOG_WARNING,
            "invalid command line argument: <slot-id> is missing\n");
@@ -149,6 +423,9 @@ main (int argc, char * const argv[])
   }
 
   slot_id = atoi(argv[1]);
+  if (mkdir(CACHE_DIR, 0755) && errno != EEXIST) {
+    syslog(LOG_WARNING, "failed to create %s: %s", CACHE_DIR, strerror(errno));
+  }
 
   /* Check BIC Self Test Result */
   do {
@@ -18,6 +18,7 @@
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -30,6 +31,9 @@
 #include <termios.h>
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <openbmc/pal.h>
 
 #define BAUDRATE      B57600
@@ -37,6 +41,16 @@
 #define ASCII_ENTER   0x0D
 #define MAX_LOGFILE_LINES 1200 // Maximum lines based on carriage returns or new line
 #define MAX_LOGFILE_SIZE 102400 // 100KB size => 1200 lines of 80 characters each = ~108000B
+#define SCROLLBACK_SIZE (64 * 1024)
+#define MAX_CLIENTS 16
+#define SOCK_PATH "/var/run/consoled_%s.sock"
+
+/* Session modes, the first byte a client sends to the daemon */
+#define CLIENT_RO 'r'
+#define CLIENT_RW 'w'
+#define CLIENT_RO_SCROLLBACK 'R'  // starting with the scrollback
+#define CLIENT_RW_SCROLLBACK 'W'
+#define CLIENT_SCROLLBACK 's'     // only the scrollback
 static sig_atomic_t sigexit = 0;
 
 static void
@@ -66,7 +80,13 @@ exit_session(int sig)
 
 static void
 print_usage() {
-  printf("Usage: consoled [ %s ]\n", pal_server_list);
+  printf("Usage: consoled [ %s ] [ --buffer | --term | --daemon | --read | --scrollback ]\n"
+         "  --buffer     : buffer the console data into /tmp/consoled_<fru>_log\n"
+         "  --term       : console session, through the daemon if it is running\n"
+         "  --daemon     : buffer the console data and serve sessions on " SOCK_PATH "\n"
+         "  --read       : read-only session through the daemon\n"
+         "  --scrollback : print the daemon's scrollback\n",
+         pal_server_list, "<fru>");
 }
 
 static void
@@ -250,6 +270,398 @@ run_console(char* fru_name, int term) {
     remove(pid_file);
 }
 
+/* Daemon mode: the tty is opened once and its data read into a scrollback
+ * ring shared by the buffer file and all the clients. Each client only
+ * keeps its position in the ring, so no data is copied per client and a
+ * slow client skips ahead (the bytes are counted) instead of stalling the
+ * others. */
+static char ring[SCROLLBACK_SIZE];
+static uint64_t ring_end;   // bytes read from the tty so far
+
+struct console_client {
+  int fd;
+  char mode;          // CLIENT_*, 0 until the client sent it
+  uint64_t pos;       // next byte of the ring to send
+  uint64_t dropped;
+};
+
+static struct console_client clients[MAX_CLIENTS];
+
+static void
+close_client(struct console_client *c) {
+  if (c->dropped) {
+    syslog(LOG_WARNING, "consoled: client %d dropped %llu bytes",
+        c->fd, (unsigned long long)c->dropped);
+  }
+  close(c->fd);
+  c->fd = -1;
+}
+
+static void
+set_client_mode(struct console_client *c, char mode) {
+  uint64_t oldest = ring_end > SCROLLBACK_SIZE ? ring_end - SCROLLBACK_SIZE : 0;
+
+  switch (mode) {
+    case CLIENT_RO:
+    case CLIENT_RW:
+      c->pos = ring_end;
+      break;
+    case CLIENT_RO_SCROLLBACK:
+    case CLIENT_RW_SCROLLBACK:
+    case CLIENT_SCROLLBACK:
+      c->pos = oldest;
+      break;
+    default:
+      syslog(LOG_WARNING, "consoled: client %d unknown mode 0x%x", c->fd, mode);
+      close_client(c);
+      return;
+  }
+  c->mode = mode;
+  if (mode == CLIENT_SCROLLBACK && c->pos == ring_end) {
+    // Nothing to send, it would otherwise wait for the next console data
+    close_client(c);
+  }
+}
+
+/* Send the client what it has not got yet, straight out of the ring */
+static void
+flush_client(struct console_client *c) {
+  struct iovec vec[2];
+  struct msghdr msg = {0};
+  uint64_t oldest;
+  size_t off, len;
+  ssize_t rc;
+
+  if (ring_end > SCROLLBACK_SIZE && c->pos < ring_end - SCROLLBACK_SIZE) {
+    oldest = ring_end - SCROLLBACK_SIZE;
+    c->dropped += oldest - c->pos;
+    c->pos = oldest;
+  }
+  while (c->pos < ring_end) {
+    off = c->pos % SCROLLBACK_SIZE;
+    len = ring_end - c->pos;
+    vec[0].iov_base = ring + off;
+    vec[0].iov_len = len < SCROLLBACK_SIZE - off ? len : SCROLLBACK_SIZE - off;
+    vec[1].iov_base = ring;
+    vec[1].iov_len = len - vec[0].iov_len;
+    msg.msg_iov = vec;
+    msg.msg_iovlen = vec[1].iov_len ? 2 : 1;
+    rc = sendmsg(c->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close_client(c);
+      }
+      return;
+    }
+    c->pos += rc;
+  }
+  if (c->mode == CLIENT_SCROLLBACK) {
+    close_client(c);
+  }
+}
+
+static int
+open_server_socket(char *fru_name) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  int fd;
+
+  snprintf(addr.sun_path, sizeof(addr.sun_path), SOCK_PATH, fru_name);
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+    syslog(LOG_WARNING, "consoled: cannot create socket | errno: %d", errno);
+    return -1;
+  }
+  unlink(addr.sun_path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(fd, MAX_CLIENTS) < 0) {
+    syslog(LOG_WARNING, "consoled: cannot listen on %s | errno: %d",
+        addr.sun_path, errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void
+run_daemon(char* fru_name) {
+
+  int i, n;
+  int tty;    // serial port
+  int sock;   // clients listen socket
+  int buf_fd;  // Buffer File
+  int blen;
+  int nline = 0;
+  int nfd;
+  uint8_t fru;
+  char devtty[32];  // For tty dev path
+  char bfname[32];  // For buffer file path
+  char old_bfname[32];  // For old buffer file path
+  char sock_path[64];
+  char in[256];     // For client input
+  size_t off;
+  struct termios ottytio, nttytio;  // For the tty dev
+  struct stat buf_stat;
+  struct pollfd pfd[MAX_CLIENTS + 2];
+  struct console_client *pc[MAX_CLIENTS + 2];
+
+  daemon(0,1);
+  openlog("consoled", LOG_CONS, LOG_DAEMON);
+  syslog(LOG_INFO, "consoled: daemon started");
+
+  if (pal_get_fru_id(fru_name, &fru)) {
+    exit(-1);
+  }
+
+  if (pal_get_fru_devtty(fru, devtty)) {
+    exit(-1);
+  }
+
+  signal(SIGHUP, exit_session);
+  signal(SIGINT, exit_session);
+  signal(SIGTERM, exit_session);
+  signal(SIGQUIT, exit_session);
+  signal(SIGPIPE, SIG_IGN);
+
+  if ((tty = open(devtty, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+    syslog(LOG_WARNING, "Cannot open the file %s", devtty);
+    exit(-1);
+  }
+  // Reads only follow POLLIN, writes of the clients input must not be dropped
+  fcntl(tty, F_SETFL, O_RDWR);
+
+  /* Changing the attributes of the tty dev, once for all the sessions */
+  tcgetattr(tty, &ottytio);
+  memcpy(&nttytio, &ottytio, sizeof(struct termios));
+  cfmakeraw(&nttytio);
+  cfsetspeed(&nttytio, BAUDRATE);
+  tcflush(tty, TCIFLUSH);
+  tcsetattr(tty, TCSANOW, &nttytio);
+
+  /* Buffering the console data into a file */
+  sprintf(old_bfname, "/tmp/consoled_%s_log-old", fru_name);
+  sprintf(bfname, "/tmp/consoled_%s_log", fru_name);
+  if ((buf_fd = open(bfname, O_RDWR | O_APPEND | O_CREAT, 0666)) < 0) {
+    syslog(LOG_WARNING, "Cannot open the file %s", bfname);
+    exit(-1);
+  }
+
+  if ((sock = open_server_socket(fru_name)) < 0) {
+    exit(-1);
+  }
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    clients[i].fd = -1;
+  }
+
+  while (!sigexit) {
+    pfd[0].fd = tty;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = sock;
+    pfd[1].events = POLLIN;
+    nfd = 2;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      if (clients[i].fd < 0) {
+        continue;
+      }
+      pc[nfd] = &clients[i];
+      pfd[nfd].fd = clients[i].fd;
+      pfd[nfd].events = POLLIN;
+      if (clients[i].mode && clients[i].pos < ring_end) {
+        pfd[nfd].events |= POLLOUT;
+      }
+      nfd++;
+    }
+
+    if (poll(pfd, nfd, -1 /* Timeout */) < 0) {
+      continue;
+    }
+
+    /* Input from the tty dev, read straight into the ring */
+    if (pfd[0].revents) {
+      off = ring_end % SCROLLBACK_SIZE;
+      blen = read(tty, ring + off, SCROLLBACK_SIZE - off);
+      if (blen > 0) {
+        for (i = 0; i < blen; i++) {
+          if (ring[off + i] == 0xD || ring[off + i] == 0xA)
+            nline++;
+        }
+        ring_end += blen;
+        write_data(buf_fd, ring + off, blen, bfname);
+        fsync(buf_fd);
+
+        // Get File stat information
+        memset(&buf_stat, 0, sizeof(struct stat));
+        fstat(buf_fd, &buf_stat);
+
+        /* Log Rotation based on max number of lines or max file size */
+        if (nline >= MAX_LOGFILE_LINES || buf_stat.st_size >= MAX_LOGFILE_SIZE) {
+          close(buf_fd);
+          remove(old_bfname);
+          rename(bfname, old_bfname);
+          if ((buf_fd = open(bfname, O_RDWR | O_APPEND | O_CREAT, 0666)) < 0) {
+            syslog(LOG_WARNING, "Cannot open the file %s", bfname);
+            exit(-1);
+          }
+          nline = 0;
+        }
+
+        for (i = 0; i < MAX_CLIENTS; i++) {
+          if (clients[i].fd >= 0 && clients[i].mode) {
+            flush_client(&clients[i]);
+          }
+        }
+      } else if (blen < 0 && errno != EAGAIN && errno != EINTR) {
+        syslog(LOG_WARNING, "consoled: read from %s failed | errno: %d",
+            devtty, errno);
+        break;
+      }
+    }
+
+    /* New session */
+    if (pfd[1].revents & POLLIN) {
+      n = accept4(sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (n >= 0) {
+        for (i = 0; i < MAX_CLIENTS && clients[i].fd >= 0; i++)
+          ;
+        if (i == MAX_CLIENTS) {
+          syslog(LOG_WARNING, "consoled: too many clients");
+          close(n);
+        } else {
+          memset(&clients[i], 0, sizeof(clients[i]));
+          clients[i].fd = n;
+        }
+      }
+    }
+
+    for (i = 2; i < nfd; i++) {
+      struct console_client *c = pc[i];
+
+      if (c->fd < 0) {
+        continue;
+      }
+      if (pfd[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        blen = read(c->fd, in, sizeof(in));
+        if (blen == 0 || (blen < 0 && errno != EAGAIN && errno != EINTR)) {
+          close_client(c);
+          continue;
+        }
+        n = 0;
+        if (blen > 0 && !c->mode) {
+          // The first byte selects the session mode
+          set_client_mode(c, in[0]);
+          if (c->fd < 0) {
+            continue;
+          }
+          n = 1;
+        }
+        if (blen > n && (c->mode == CLIENT_RW || c->mode == CLIENT_RW_SCROLLBACK)) {
+          write_data(tty, in + n, blen - n, "tty");
+        }
+      }
+      if (c->mode && (pfd[i].revents & POLLOUT || c->pos < ring_end)) {
+        flush_client(c);
+      }
+    }
+  }
+
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].fd >= 0) {
+      close_client(&clients[i]);
+    }
+  }
+  close(sock);
+  snprintf(sock_path, sizeof(sock_path), SOCK_PATH, fru_name);
+  unlink(sock_path);
+
+  /* Close the console buffer file */
+  close(buf_fd);
+
+  /* Revert the tty dev to old attributes */
+  tcflush(tty, TCIFLUSH);
+  tcsetattr(tty, TCSANOW, &ottytio);
+  close(tty);
+}
+
+/* Attach to the consoled daemon of the fru, returns -1 if there is none */
+static int
+run_client(char* fru_name, char mode) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  struct termios ostditio, nstditio;  // For STDIN_FILENO
+  struct termios ostdotio, nstdotio;  // For STDOUT_FILENO
+  struct pollfd pfd[2];
+  int term = isatty(STDIN_FILENO);
+  int sock, nfd, blen;
+  char buf[4096];
+
+  snprintf(addr.sun_path, sizeof(addr.sun_path), SOCK_PATH, fru_name);
+  if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+    return -1;
+  }
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+  write_data(sock, &mode, sizeof(mode), "socket");
+
+  signal(SIGHUP, exit_session);
+  signal(SIGINT, exit_session);
+  signal(SIGTERM, exit_session);
+  signal(SIGPIPE, exit_session);
+  signal(SIGQUIT, exit_session);
+
+  if (term) {
+    tcgetattr(STDIN_FILENO, &ostditio);
+    memcpy(&nstditio, &ostditio, sizeof(struct termios));
+    cfmakeraw(&nstditio);
+    tcflush(STDIN_FILENO, TCIFLUSH);
+    tcsetattr(STDIN_FILENO, TCSANOW, &nstditio);
+
+    tcgetattr(STDOUT_FILENO, &ostdotio);
+    memcpy(&nstdotio, &ostdotio, sizeof(struct termios));
+    cfmakeraw(&nstdotio);
+    tcsetattr(STDOUT_FILENO, TCSANOW, &nstdotio);
+  }
+
+  pfd[0].fd = sock;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = STDIN_FILENO;
+  pfd[1].events = POLLIN;
+  nfd = mode == CLIENT_SCROLLBACK ? 1 : 2;
+
+  while (!sigexit && poll(pfd, nfd, -1) >= 0) {
+    if (pfd[0].revents) {
+      blen = read(sock, buf, sizeof(buf));
+      if (blen <= 0) {
+        break;
+      }
+      write_data(STDOUT_FILENO, buf, blen, "STDOUT_FILENO");
+    }
+    if (nfd > 1 && pfd[1].revents) {
+      blen = read(STDIN_FILENO, buf, sizeof(buf));
+      if (blen <= 0) {
+        nfd = 1;
+        continue;
+      }
+      if (memchr(buf, CTRL_X, blen)) {
+        break;
+      }
+      if (mode == CLIENT_RW || mode == CLIENT_RW_SCROLLBACK) {
+        write_data(sock, buf, blen, "socket");
+      }
+    }
+  }
+  close(sock);
+
+  if (term) {
+    tcflush(STDOUT_FILENO, TCIFLUSH);
+    tcsetattr(STDOUT_FILENO, TCSANOW, &ostdotio);
+    tcflush(STDIN_FILENO, TCIFLUSH);
+    tcsetattr(STDIN_FILENO, TCSANOW, &ostditio);
+  }
+  return 0;
+}
+
 int
 main(int argc, void **argv) {
   int dev, rc, lock_file;
@@ -262,6 +674,19 @@ main(int argc, void **argv) {
     exit(1);
   }
 
+  // Sessions go through the daemon when there is one
+  if (!strcmp(argv[2], "--term")) {
+    if (run_client(argv[1], CLIENT_RW) == 0) {
+      return sigexit;
+    }
+  } else if (!strcmp(argv[2], "--read") || !strcmp(argv[2], "--scrollback")) {
+    if (run_client(argv[1], strcmp(argv[2], "--read") ? CLIENT_SCROLLBACK : CLIENT_RO)) {
+      printf("consoled %s daemon is not running\n", (char *)argv[1]);
+      exit(-1);
+    }
+    return sigexit;
+  }
+
   // A lock file for one instance of consoled for each fru
   sprintf(file, "/var/lock/consoled_%s", argv[1]);
   lock_file = open(file, O_CREAT | O_RDWR, 0666);
@@ -279,6 +704,9 @@ main(int argc, void **argv) {
         term = 0;
     } else if (!strcmp(argv[2], "--term")) {
         term = 1;
+    } else if (!strcmp(argv[2], "--daemon")) {
+      run_daemon(fru_name);
+      return sigexit;
     } else {
       print_usage();
       exit(-1);
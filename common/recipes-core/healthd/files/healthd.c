@@ -35,6 +35,11 @@
 #include <openbmc/pal.h>
 #include <sys/sysinfo.h>
 #include <sys/reboot.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <dirent.h>
 #include <openbmc/watchdog.h>
 #include <openbmc/pal.h>
 #include <openbmc/kv.h>
@@ -92,6 +97,19 @@
 
 #define KV_KEY_IMAGE_VERSIONS "image_versions"
 
+#define WATCHDOG_KICK_INTERVAL 5000 /* ms */
+#define I2C_MONITOR_INTERVAL 30000  /* ms */
+#define CPU_MONITOR_DELAY 180000    /* ms, wait for BMC to idle stage */
+#define DEFAULT_TIMER_SLACK 50      /* ms */
+
+#define PSI_PATH "/proc/pressure"
+#define PSI_DEFAULT_WINDOW 2000     /* ms */
+#define PSI_SAMPLE_TIME 500         /* ms, per-process attribution window */
+#define PSI_DEFAULT_REPORT_INTERVAL 60
+#define PSI_DEFAULT_TOP_PROCESSES 3
+#define PSI_MAX_TOP_PROCESSES 10
+#define KV_KEY_PSI_STATUS "bmc_pressure"
+
 struct i2c_bus_s {
   uint32_t offset;
   char     *name;
@@ -144,6 +162,9 @@ enum ASSERT_BIT {
   BIT_UNRECOVERABLE_ECC  = 3,
 };
 
+/* Scheduler configuration */
+static unsigned int timer_slack = DEFAULT_TIMER_SLACK;
+
 /* Heartbeat configuration */
 static unsigned int hb_interval = 500;
 
@@ -195,6 +216,20 @@ static bool nm_monitor_enabled = false;
 static int nm_monitor_interval = DEFAULT_MONITOR_INTERVAL;
 static unsigned char nm_retry_threshold = 0;
 
+/* Pressure stall (PSI) monitor */
+enum psi_resource {
+  PSI_CPU = 0,
+  PSI_MEMORY,
+  PSI_IO,
+  PSI_RESOURCE_NUM,
+};
+static bool psi_monitor_enabled = false;
+static unsigned int psi_window = PSI_DEFAULT_WINDOW;
+static unsigned int psi_report_interval = PSI_DEFAULT_REPORT_INTERVAL;
+static unsigned int psi_top_processes = PSI_DEFAULT_TOP_PROCESSES;
+// Stall time (ms) per window which raises a trigger, 0 to not watch
+static unsigned int psi_threshold[PSI_RESOURCE_NUM] = {200, 100, 200};
+
 /* Verified-boot state check */
 static bool vboot_state_check = false;
 
@@ -290,6 +325,17 @@ static void initialize_thresholds(const char *target, json_t *array, struct thre
   }
 }
 
+static void
+initialize_scheduler_config(json_t *conf) {
+  json_t *tmp;
+
+  tmp = json_object_get(conf, "timer_slack");
+  if (!tmp || !json_is_number(tmp)) {
+    return;
+  }
+  timer_slack = json_integer_value(tmp);
+}
+
 static void
 initialize_hb_config(json_t *conf) {
   json_t *tmp;
@@ -509,6 +555,49 @@ error_bail:
   nm_monitor_enabled = false;
 }
 
+static void
+initialize_psi_config(json_t *conf)
+{
+  static const char *names[PSI_RESOURCE_NUM] = {"cpu", "memory", "io"};
+  json_t *tmp;
+  int i;
+
+  tmp = json_object_get(conf, "enabled");
+  if (!tmp || !json_is_boolean(tmp)) {
+    return;
+  }
+  psi_monitor_enabled = json_is_true(tmp);
+
+  tmp = json_object_get(conf, "window");
+  if (tmp && json_is_number(tmp)) {
+    psi_window = json_integer_value(tmp);
+    // limits of the kernel trigger interface
+    if (psi_window < 500 || psi_window > 10000) {
+      psi_window = PSI_DEFAULT_WINDOW;
+    }
+  }
+  tmp = json_object_get(conf, "report_interval");
+  if (tmp && json_is_number(tmp) && json_integer_value(tmp) > 0) {
+    psi_report_interval = json_integer_value(tmp);
+  }
+  tmp = json_object_get(conf, "top_processes");
+  if (tmp && json_is_number(tmp)) {
+    psi_top_processes = json_integer_value(tmp);
+    if (psi_top_processes > PSI_MAX_TOP_PROCESSES) {
+      psi_top_processes = PSI_MAX_TOP_PROCESSES;
+    }
+  }
+  for (i = 0; i < PSI_RESOURCE_NUM; i++) {
+    tmp = json_object_get(conf, names[i]);
+    if (tmp && json_is_number(tmp)) {
+      psi_threshold[i] = json_integer_value(tmp);
+      if (psi_threshold[i] >= psi_window) {
+        psi_threshold[i] = psi_window - 1;
+      }
+    }
+  }
+}
+
 static void initialize_vboot_config(json_t *obj)
 {
   json_t *tmp;
@@ -551,6 +640,7 @@ initialize_configuration(void) {
   if (v && json_is_string(v)) {
     syslog(LOG_INFO, "Loaded configuration version: %s\n", json_string_value(v));
   }
+  initialize_scheduler_config(json_object_get(conf, "scheduler"));
   initialize_hb_config(json_object_get(conf, "heartbeat"));
   initialize_cpu_config(json_object_get(conf, "bmc_cpu_utilization"));
   initialize_mem_config(json_object_get(conf, "bmc_mem_utilization"));
@@ -558,6 +648,7 @@ initialize_configuration(void) {
   initialize_ecc_config(json_object_get(conf, "ecc_monitoring"));
   initialize_bmc_health_config(json_object_get(conf, "bmc_health"));
   initialize_nm_monitor_config(json_object_get(conf, "nm_monitor"));
+  initialize_psi_config(json_object_get(conf, "psi_monitor"));
   initialize_pfr_monitor_config(json_object_get(conf, "pfr_monitor"));
   initialize_vboot_config(json_object_get(conf, "verified_boot"));
   initialize_bmc_timestamp_config(json_object_get(conf, "bmc_timestamp"));
@@ -702,22 +793,190 @@ initilize_all_kv() {
   pal_set_def_key_value();
 }
 
+/*
+ * The monitors are callbacks run by a scheduler: a single thread waiting on
+ * a timerfd (through epoll) armed for the earliest deadline of its monitors.
+ * Every monitor due within timer_slack of a wakeup is run in the same one,
+ * so monitors with related intervals share their wakeups.
+ *
+ * run() returns 0 to be run again after its interval, a positive number of
+ * milliseconds to be run again after that instead, or a negative number to
+ * stop the monitor.
+ *
+ * Event driven monitors add a watch on their fd instead, its handler is run
+ * by the scheduler thread whenever the fd reports one of the events.
+ */
+struct monitor_s {
+  const char *name;
+  int (*run)(void);
+  unsigned int interval; /* ms */
+  uint64_t next;         /* CLOCK_MONOTONIC, ms */
+  struct monitor_s *link;
+};
+
+struct watch_s {
+  const char *name;
+  int fd;
+  uint32_t events;
+  void (*handler)(struct watch_s *w);
+};
+
+struct scheduler_s {
+  int epfd;
+  int tfd;
+  struct monitor_s *monitors;
+};
+
+static struct scheduler_s main_sched;
+/* The watchdog is kicked by a scheduler of its own, the other monitors
+ * call into the platform library which may take long to return */
+static struct scheduler_s wdt_sched;
+/* Monitors which may block on slow buses (e.g. IPMB to the ME)
+ * are run by their own scheduler, away from the other monitors */
+static struct scheduler_s io_sched;
+
+static uint64_t
+monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int
+scheduler_init(struct scheduler_s *s) {
+  struct epoll_event ev = {.events = EPOLLIN};
+
+  s->monitors = NULL;
+  s->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (s->tfd < 0) {
+    syslog(LOG_CRIT, "%s: timerfd_create failed: %s", __func__, strerror(errno));
+    return -1;
+  }
+  s->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (s->epfd < 0 || epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->tfd, &ev)) {
+    syslog(LOG_CRIT, "%s: epoll setup failed: %s", __func__, strerror(errno));
+    close(s->tfd);
+    return -1;
+  }
+  return 0;
+}
+
+/* Add the monitor to the scheduler, run first after delay ms. Deadlines
+ * are aligned to the scheduler start, so monitors with intervals which are
+ * multiples of each other always wake up together. */
+static void
+schedule_monitor(struct scheduler_s *s, struct monitor_s *m,
+                 unsigned int delay, unsigned int interval) {
+  static uint64_t epoch = 0;
+
+  if (!epoch) {
+    epoch = monotonic_ms();
+  }
+  m->interval = interval ? interval : 1;
+  m->next = epoch + delay;
+  m->link = s->monitors;
+  s->monitors = m;
+}
+
+/* Run the monitor delay ms from now, whatever its schedule. Only to be
+ * called from the thread running its scheduler (e.g. a watch handler). */
+static void
+wake_monitor(struct monitor_s *m, unsigned int delay) {
+  uint64_t next = monotonic_ms() + delay;
+
+  if (next < m->next) {
+    m->next = next;
+  }
+}
+
+static int
+scheduler_watch(struct scheduler_s *s, struct watch_s *w) {
+  struct epoll_event ev = {.events = w->events, .data.ptr = w};
+
+  if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, w->fd, &ev)) {
+    syslog(LOG_WARNING, "%s: cannot watch %s: %s", __func__, w->name, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
 static void *
-hb_handler() {
-  while(1) {
-    /* Turn ON the HB Led*/
-    pal_set_hb_led(1);
-    msleep(hb_interval);
+scheduler_loop(void *arg) {
+  struct scheduler_s *s = arg;
+  struct monitor_s *m;
+  struct itimerspec its = {{0}};
+  struct epoll_event ev[8];
+  struct watch_s *w;
+  uint64_t now, next, expirations;
+  int ret, i, n;
+
+  // Let the kernel coalesce our wakeups with others' as well
+  prctl(PR_SET_TIMERSLACK, (unsigned long)timer_slack * 1000000UL);
 
-    /* Turn OFF the HB led */
-    pal_set_hb_led(0);
-    msleep(hb_interval);
+  while (1) {
+    now = monotonic_ms();
+    next = UINT64_MAX;
+    for (m = s->monitors; m != NULL; m = m->link) {
+      if (m->run == NULL) {
+        continue;
+      }
+      if (m->next <= now + timer_slack) {
+        ret = m->run();
+        if (ret < 0) {
+          syslog(LOG_WARNING, "%s monitor stopped", m->name);
+          m->run = NULL;
+          continue;
+        }
+        if (ret > 0) {
+          m->next = now + ret;
+        } else {
+          // a late run is not repeated to catch up
+          m->next += m->interval;
+          if (m->next <= now) {
+            m->next = now + m->interval;
+          }
+        }
+      }
+      if (m->next < next) {
+        next = m->next;
+      }
+    }
+    if (next == UINT64_MAX) {
+      break;
+    }
+
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    if (timerfd_settime(s->tfd, TFD_TIMER_ABSTIME, &its, NULL)) {
+      syslog(LOG_CRIT, "%s: timerfd_settime failed: %s", __func__, strerror(errno));
+      break;
+    }
+    n = epoll_wait(s->epfd, ev, sizeof(ev) / sizeof(ev[0]), -1);
+    for (i = 0; i < n; i++) {
+      w = ev[i].data.ptr;
+      if (w != NULL) {
+        w->handler(w);
+      } else if (read(s->tfd, &expirations, sizeof(expirations)) < 0) {
+        // nothing to do, the deadlines are checked again anyway
+      }
+    }
   }
   return NULL;
 }
 
-static void *
-watchdog_handler() {
+static int
+hb_handler(void) {
+  static int hb_led = 0;
+
+  /* Toggle the HB Led */
+  hb_led = !hb_led;
+  pal_set_hb_led(hb_led);
+  return 0;
+}
+
+static void
+watchdog_init(void) {
 
   /* Start watchdog in manual mode */
   open_watchdog(0, 0);
@@ -726,191 +985,181 @@ watchdog_handler() {
    * of this process's liveliness.
    */
   watchdog_disable_magic_close();
+}
 
-  while(1) {
-
-    sleep(5);
-
-    /*
-     * Restart the watchdog countdown. If this process is terminated,
-     * the persistent watchdog setting will cause the system to reboot after
-     * the watchdog timeout.
-     */
-    kick_watchdog();
-  }
-  return NULL;
+static int
+watchdog_handler(void) {
+  /*
+   * Restart the watchdog countdown. If this process is terminated,
+   * the persistent watchdog setting will cause the system to reboot after
+   * the watchdog timeout.
+   */
+  kick_watchdog();
+  return 0;
 }
 
-static void *
-i2c_mon_handler() {
+static int
+i2c_mon_handler(void) {
   char i2c_bus_device[16];
   int dev;
   int bus_status = 0;
-  int asserted_flag[I2C_BUS_NUM] = {};
+  static int asserted_flag[I2C_BUS_NUM] = {};
   bool assert_handle = 0;
   int i;
 
-  while (1) {
-    for (i = 0; i < I2C_BUS_NUM; i++) {
-      if (!ast_i2c_dev_offset[i].enabled) {
-        continue;
+  for (i = 0; i < I2C_BUS_NUM; i++) {
+    if (!ast_i2c_dev_offset[i].enabled) {
+      continue;
+    }
+    sprintf(i2c_bus_device, "/dev/i2c-%d", i);
+    dev = open(i2c_bus_device, O_RDWR);
+    if (dev < 0) {
+      syslog(LOG_DEBUG, "%s(): open() failed", __func__);
+      continue;
+    }
+    bus_status = i2c_smbus_status(dev);
+    close(dev);
+
+    assert_handle = 0;
+    if (bus_status == 0) {
+      /* Bus status is normal */
+      if (asserted_flag[i] != 0) {
+        asserted_flag[i] = 0;
+        syslog(LOG_CRIT, "DEASSERT: I2C(%d) Bus recoveried. (I2C bus index base 0)", i);
+        pal_i2c_crash_deassert_handle(i);
       }
-      sprintf(i2c_bus_device, "/dev/i2c-%d", i);
-      dev = open(i2c_bus_device, O_RDWR);
-      if (dev < 0) {
-        syslog(LOG_DEBUG, "%s(): open() failed", __func__);
-        continue;
+    } else {
+      /* Check each case */
+      if (GETBIT(bus_status, BUS_LOCK_RECOVER_ERROR)
+          && !GETBIT(asserted_flag[i], BUS_LOCK_RECOVER_ERROR)) {
+        asserted_flag[i] = SETBIT(asserted_flag[i], BUS_LOCK_RECOVER_ERROR);
+        syslog(LOG_CRIT, "ASSERT: I2C(%d) bus is locked (Master Lock or Slave Clock Stretch). "
+                         "Recovery error. (I2C bus index base 0)", i);
+        assert_handle = 1;
+      }
+      bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_ERROR);
+      if (GETBIT(bus_status, BUS_LOCK_RECOVER_TIMEOUT)
+          && !GETBIT(asserted_flag[i], BUS_LOCK_RECOVER_TIMEOUT)) {
+        asserted_flag[i] = SETBIT(asserted_flag[i], BUS_LOCK_RECOVER_TIMEOUT);
+        syslog(LOG_CRIT, "ASSERT: I2C(%d) bus is locked (Master Lock or Slave Clock Stretch). "
+                         "Recovery timed out. (I2C bus index base 0)", i);
+        assert_handle = 1;
+      }
+      bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_TIMEOUT);
+      if (GETBIT(bus_status, BUS_LOCK_RECOVER_SUCCESS)) {
+        syslog(LOG_CRIT, "I2C(%d) bus had been locked (Master Lock or Slave Clock Stretch) "
+                         "and has been recoveried successfully. (I2C bus index base 0)", i);
+      }
+      bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_SUCCESS);
+      if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_ERROR)
+          && !GETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_ERROR)) {
+        asserted_flag[i] = SETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_ERROR);
+        syslog(LOG_CRIT, "ASSERT: I2C(%d) Slave is dead (SDA keeps low). "
+                         "Bus recovery error. (I2C bus index base 0)", i);
+        assert_handle = 1;
+      }
+      bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_ERROR);
+      if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_TIMEOUT)
+          && !GETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_TIMEOUT)) {
+        asserted_flag[i] = SETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_TIMEOUT);
+        syslog(LOG_CRIT, "ASSERT: I2C(%d) Slave is dead (SDAs keep low). "
+                         "Bus recovery timed out. (I2C bus index base 0)", i);
+        assert_handle = 1;
+      }
+      bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_TIMEOUT);
+      if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_SUCCESS)) {
+        syslog(LOG_CRIT, "I2C(%d) Slave was dead. and bus has been recoveried successfully. "
+                         "(I2C bus index base 0)", i);
+      }
+      bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_SUCCESS);
+      /* Check if any undefined bit remain in bus_status */
+      if ((bus_status != 0) && !GETBIT(asserted_flag[i], UNDEFINED_CASE)) {
+        asserted_flag[i] = SETBIT(asserted_flag[i], 8);
+        syslog(LOG_CRIT, "ASSERT: I2C(%d) Undefined case. (I2C bus index base 0)", i);
+        assert_handle = 1;
       }
-      bus_status = i2c_smbus_status(dev);
-      close(dev);
-
-      assert_handle = 0;
-      if (bus_status == 0) {
-        /* Bus status is normal */
-        if (asserted_flag[i] != 0) {
-          asserted_flag[i] = 0;
-          syslog(LOG_CRIT, "DEASSERT: I2C(%d) Bus recoveried. (I2C bus index base 0)", i);
-          pal_i2c_crash_deassert_handle(i);
-        }
-      } else {
-        /* Check each case */
-        if (GETBIT(bus_status, BUS_LOCK_RECOVER_ERROR)
-            && !GETBIT(asserted_flag[i], BUS_LOCK_RECOVER_ERROR)) {
-          asserted_flag[i] = SETBIT(asserted_flag[i], BUS_LOCK_RECOVER_ERROR);
-          syslog(LOG_CRIT, "ASSERT: I2C(%d) bus is locked (Master Lock or Slave Clock Stretch). "
-                           "Recovery error. (I2C bus index base 0)", i);
-          assert_handle = 1;
-        }
-        bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_ERROR);
-        if (GETBIT(bus_status, BUS_LOCK_RECOVER_TIMEOUT)
-            && !GETBIT(asserted_flag[i], BUS_LOCK_RECOVER_TIMEOUT)) {
-          asserted_flag[i] = SETBIT(asserted_flag[i], BUS_LOCK_RECOVER_TIMEOUT);
-          syslog(LOG_CRIT, "ASSERT: I2C(%d) bus is locked (Master Lock or Slave Clock Stretch). "
-                           "Recovery timed out. (I2C bus index base 0)", i);
-          assert_handle = 1;
-        }
-        bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_TIMEOUT);
-        if (GETBIT(bus_status, BUS_LOCK_RECOVER_SUCCESS)) {
-          syslog(LOG_CRIT, "I2C(%d) bus had been locked (Master Lock or Slave Clock Stretch) "
-                           "and has been recoveried successfully. (I2C bus index base 0)", i);
-        }
-        bus_status = CLEARBIT(bus_status, BUS_LOCK_RECOVER_SUCCESS);
-        if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_ERROR)
-            && !GETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_ERROR)) {
-          asserted_flag[i] = SETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_ERROR);
-          syslog(LOG_CRIT, "ASSERT: I2C(%d) Slave is dead (SDA keeps low). "
-                           "Bus recovery error. (I2C bus index base 0)", i);
-          assert_handle = 1;
-        }
-        bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_ERROR);
-        if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_TIMEOUT)
-            && !GETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_TIMEOUT)) {
-          asserted_flag[i] = SETBIT(asserted_flag[i], SLAVE_DEAD_RECOVER_TIMEOUT);
-          syslog(LOG_CRIT, "ASSERT: I2C(%d) Slave is dead (SDAs keep low). "
-                           "Bus recovery timed out. (I2C bus index base 0)", i);
-          assert_handle = 1;
-        }
-        bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_TIMEOUT);
-        if (GETBIT(bus_status, SLAVE_DEAD_RECOVER_SUCCESS)) {
-          syslog(LOG_CRIT, "I2C(%d) Slave was dead. and bus has been recoveried successfully. "
-                           "(I2C bus index base 0)", i);
-        }
-        bus_status = CLEARBIT(bus_status, SLAVE_DEAD_RECOVER_SUCCESS);
-        /* Check if any undefined bit remain in bus_status */
-        if ((bus_status != 0) && !GETBIT(asserted_flag[i], UNDEFINED_CASE)) {
-          asserted_flag[i] = SETBIT(asserted_flag[i], 8);
-          syslog(LOG_CRIT, "ASSERT: I2C(%d) Undefined case. (I2C bus index base 0)", i);
-          assert_handle = 1;
-        }
 
-        if (assert_handle) {
-          pal_i2c_crash_assert_handle(i);
-        }
+      if (assert_handle) {
+        pal_i2c_crash_assert_handle(i);
       }
     }
-    sleep(30);
   }
-  return NULL;
+  return 0;
 }
 
-static void *
-CPU_usage_monitor() {
+/* CPU utilization samples over the window, allocated in main */
+static float *cpu_utilization;
+
+static int
+CPU_usage_monitor(void) {
   unsigned long long user, nice, system, idle, iowait, irq, softirq, steal, guest, guest_nice;
-  unsigned long long total_diff, idle_diff, non_idle, idle_time = 0, total = 0, pre_total = 0, pre_idle = 0;
+  unsigned long long total_diff, idle_diff, non_idle, idle_time = 0, total = 0;
+  static unsigned long long pre_total = 0, pre_idle = 0;
   char cpu[CPU_NAME_LENGTH] = {0};
-  int i, ready_flag = 0, timer = 0, retry = 0;
+  static int ready_flag = 0, timer = 0, retry = 0;
+  int i;
   float cpu_util_avg, cpu_util_total;
-  float cpu_utilization[cpu_window_size];
   FILE *fp;
   int ret;
 
-  sleep(180); //Wait 180s for BMC to idle stage.
-
-  memset(cpu_utilization, 0, sizeof(float) * cpu_window_size);
-
-  while (1) {
-
-    if (retry > HEALTHD_MAX_RETRY) {
-      syslog(LOG_CRIT, "Cannot get CPU statistics. Stop %s\n", __func__);
-      return NULL;
-    }
-
-    // Get CPU statistics. Time unit: jiffies
-    fp = fopen(CPU_INFO_PATH, "r");
-    if(!fp) {
-      syslog(LOG_WARNING, "Failed to get CPU statistics.\n");
-      retry++;
-      continue;
-    }
+  if (retry > HEALTHD_MAX_RETRY) {
+    syslog(LOG_CRIT, "Cannot get CPU statistics. Stop %s\n", __func__);
+    return -1;
+  }
 
-    ret = fscanf(fp, "%s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
-                cpu, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal, &guest, &guest_nice);
-    if (ret != 11) {
-      syslog(LOG_WARNING, "Cannot parse CPU statistic. Stop %s\n", __func__);
-      retry++;
-      continue;
-    }
-    retry = 0;
+  // Get CPU statistics. Time unit: jiffies
+  fp = fopen(CPU_INFO_PATH, "r");
+  if(!fp) {
+    syslog(LOG_WARNING, "Failed to get CPU statistics.\n");
+    retry++;
+    return 0;
+  }
 
-    fclose(fp);
+  ret = fscanf(fp, "%s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+              cpu, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal, &guest, &guest_nice);
+  fclose(fp);
+  if (ret != 11) {
+    syslog(LOG_WARNING, "Cannot parse CPU statistic. Stop %s\n", __func__);
+    retry++;
+    return 0;
+  }
+  retry = 0;
 
-    timer %= cpu_window_size;
+  timer %= cpu_window_size;
 
-    // Need more data to cacluate the avg. utilization. We average 60 records here.
-    if (timer == (cpu_window_size-1) && !ready_flag)
-      ready_flag = 1;
+  // Need more data to cacluate the avg. utilization. We average 60 records here.
+  if (timer == (cpu_window_size-1) && !ready_flag)
+    ready_flag = 1;
 
 
-    // guset and guest_nice are already accounted in user and nice so they are not included in total caculation
-    idle_time = idle + iowait;
-    non_idle = user + nice + system + irq + softirq + steal;
-    total = idle_time + non_idle;
+  // guset and guest_nice are already accounted in user and nice so they are not included in total caculation
+  idle_time = idle + iowait;
+  non_idle = user + nice + system + irq + softirq + steal;
+  total = idle_time + non_idle;
 
-    // For runtime caculation, we need to take into account previous value.
-    total_diff = total - pre_total;
-    idle_diff = idle_time - pre_idle;
+  // For runtime caculation, we need to take into account previous value.
+  total_diff = total - pre_total;
+  idle_diff = idle_time - pre_idle;
 
-    // These records are used to caculate the avg. utilization.
-    cpu_utilization[timer] = (float) (total_diff - idle_diff)/total_diff;
+  // These records are used to caculate the avg. utilization.
+  cpu_utilization[timer] = (float) (total_diff - idle_diff)/total_diff;
 
-    // Start to average the cpu utilization
-    if (ready_flag) {
-      cpu_util_total = 0;
-      for (i=0; i<cpu_window_size; i++) {
-        cpu_util_total += cpu_utilization[i];
-      }
-      cpu_util_avg = (cpu_util_total/cpu_window_size) * 100.0;
-      threshold_check(cpu_monitor_name, cpu_util_avg, cpu_threshold, cpu_threshold_num);
+  // Start to average the cpu utilization
+  if (ready_flag) {
+    cpu_util_total = 0;
+    for (i=0; i<cpu_window_size; i++) {
+      cpu_util_total += cpu_utilization[i];
     }
+    cpu_util_avg = (cpu_util_total/cpu_window_size) * 100.0;
+    threshold_check(cpu_monitor_name, cpu_util_avg, cpu_threshold, cpu_threshold_num);
+  }
 
-    // Record current value for next caculation
-    pre_total = total;
-    pre_idle  = idle_time;
+  // Record current value for next caculation
+  pre_total = total;
+  pre_idle  = idle_time;
 
-    timer++;
-    sleep(cpu_monitor_interval);
-  }
-  return NULL;
+  timer++;
+  return 0;
 }
 
 static int set_panic_on_oom(void) {
@@ -947,15 +1196,12 @@ static int set_panic_on_oom(void) {
   return 0;
 }
 
-static void *
-memory_usage_monitor() {
-  struct sysinfo s_info;
-  int i, error, timer = 0, ready_flag = 0, retry = 0;
-  float mem_util_avg, mem_util_total;
-  float mem_utilization[mem_window_size];
-  char cmd[128];
+/* Memory utilization samples over the window, allocated in main */
+static float *mem_utilization;
 
-  memset(mem_utilization, 0, sizeof(float) * mem_window_size);
+static void
+memory_monitor_init(void) {
+  char cmd[128];
 
   if (mem_enable_panic) {
     set_panic_on_oom();
@@ -967,53 +1213,57 @@ memory_usage_monitor() {
       syslog(LOG_ERR, "set min_free_kbytes failed");
     }
   }
+}
 
-  while (1) {
-
-    if (retry > HEALTHD_MAX_RETRY) {
-      syslog(LOG_CRIT, "Cannot get sysinfo. Stop the %s\n", __func__);
-      return NULL;
-    }
+static int
+memory_usage_monitor(void) {
+  struct sysinfo s_info;
+  int i, error;
+  static int timer = 0, ready_flag = 0, retry = 0;
+  float mem_util_avg, mem_util_total;
 
-    timer %= mem_window_size;
+  if (retry > HEALTHD_MAX_RETRY) {
+    syslog(LOG_CRIT, "Cannot get sysinfo. Stop the %s\n", __func__);
+    return -1;
+  }
 
-    // Need more data to cacluate the avg. utilization. We average 60 records here.
-    if (timer == (mem_window_size-1) && !ready_flag)
-      ready_flag = 1;
+  timer %= mem_window_size;
 
-    // Get sys info
-    error = sysinfo(&s_info);
-    if (error) {
-      syslog(LOG_WARNING, "%s Failed to get sys info. Error: %d\n", __func__, error);
-      retry++;
-      continue;
-    }
-    retry = 0;
+  // Need more data to cacluate the avg. utilization. We average 60 records here.
+  if (timer == (mem_window_size-1) && !ready_flag)
+    ready_flag = 1;
 
-    // These records are used to caculate the avg. utilization.
-    mem_utilization[timer] = (float) (s_info.totalram - s_info.freeram)/s_info.totalram;
+  // Get sys info
+  error = sysinfo(&s_info);
+  if (error) {
+    syslog(LOG_WARNING, "%s Failed to get sys info. Error: %d\n", __func__, error);
+    retry++;
+    return 0;
+  }
+  retry = 0;
 
-    // Start to average the memory utilization
-    if (ready_flag) {
-      mem_util_total = 0;
-      for (i=0; i<mem_window_size; i++)
-        mem_util_total += mem_utilization[i];
+  // These records are used to caculate the avg. utilization.
+  mem_utilization[timer] = (float) (s_info.totalram - s_info.freeram)/s_info.totalram;
 
-      mem_util_avg = (mem_util_total/mem_window_size) * 100.0;
+  // Start to average the memory utilization
+  if (ready_flag) {
+    mem_util_total = 0;
+    for (i=0; i<mem_window_size; i++)
+      mem_util_total += mem_utilization[i];
 
-      threshold_check(mem_monitor_name, mem_util_avg, mem_threshold, mem_threshold_num);
-    }
+    mem_util_avg = (mem_util_total/mem_window_size) * 100.0;
 
-    timer++;
-    sleep(mem_monitor_interval);
+    threshold_check(mem_monitor_name, mem_util_avg, mem_threshold, mem_threshold_num);
   }
-  return NULL;
+
+  timer++;
+  return 0;
 }
 
-// Thread to monitor the ECC counter
-static void *
-ecc_mon_handler() {
-  uint32_t mcr_fd = 0;
+// Monitor the ECC counter
+static int
+ecc_mon_handler(void) {
+  int mcr_fd;
   uint32_t ecc_status = 0;
   uint32_t unrecover_ecc_err_addr = 0;
   uint32_t recover_ecc_err_addr = 0;
@@ -1023,97 +1273,419 @@ ecc_mon_handler() {
   void *mcr50_addr;
   void *mcr58_addr;
   void *mcr5c_addr;
-  int retry_err = 0;
-
-  while (1) {
-    mcr_fd = open("/dev/mem", O_RDWR | O_SYNC );
-    if (mcr_fd < 0) {
-      // In case of error opening the file, sleep for 2 sec and retry.
-      // During continuous failures, log the error every 20 minutes.
-      sleep(2);
-      if (++retry_err >= 600) {
-        syslog(LOG_ERR, "%s - cannot open /dev/mem", __func__);
-        retry_err = 0;
-      }
-      continue;
+  static int retry_err = 0;
+
+  mcr_fd = open("/dev/mem", O_RDWR | O_SYNC );
+  if (mcr_fd < 0) {
+    // In case of error opening the file, retry after 2 sec.
+    // During continuous failures, log the error every 20 minutes.
+    if (++retry_err >= 600) {
+      syslog(LOG_ERR, "%s - cannot open /dev/mem", __func__);
+      retry_err = 0;
     }
+    return 2000;
+  }
 
-    retry_err = 0;
+  retry_err = 0;
 
-    mcr_base_addr = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, mcr_fd,
-        AST_MCR_BASE);
-    mcr50_addr = (char*)mcr_base_addr + INTR_CTRL_STS_OFFSET;
-    ecc_status = *(volatile uint32_t*) mcr50_addr;
-    if (ecc_addr_log) {
-      mcr58_addr = (char*)mcr_base_addr + ADDR_FIRST_UNRECOVER_ECC_OFFSET;
-      unrecover_ecc_err_addr = *(volatile uint32_t*) mcr58_addr;
-      mcr5c_addr = (char*)mcr_base_addr + ADDR_LAST_RECOVER_ECC_OFFSET;
-      recover_ecc_err_addr = *(volatile uint32_t*) mcr5c_addr;
-    }
-    munmap(mcr_base_addr, PAGE_SIZE);
-    close(mcr_fd);
+  mcr_base_addr = mmap(NULL, PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, mcr_fd,
+      AST_MCR_BASE);
+  mcr50_addr = (char*)mcr_base_addr + INTR_CTRL_STS_OFFSET;
+  ecc_status = *(volatile uint32_t*) mcr50_addr;
+  if (ecc_addr_log) {
+    mcr58_addr = (char*)mcr_base_addr + ADDR_FIRST_UNRECOVER_ECC_OFFSET;
+    unrecover_ecc_err_addr = *(volatile uint32_t*) mcr58_addr;
+    mcr5c_addr = (char*)mcr_base_addr + ADDR_LAST_RECOVER_ECC_OFFSET;
+    recover_ecc_err_addr = *(volatile uint32_t*) mcr5c_addr;
+  }
+  munmap(mcr_base_addr, PAGE_SIZE);
+  close(mcr_fd);
 
-    ecc_recoverable_error_counter = (ecc_status >> 16) & 0xFF;
-    ecc_unrecoverable_error_counter = (ecc_status >> 12) & 0xF;
+  ecc_recoverable_error_counter = (ecc_status >> 16) & 0xFF;
+  ecc_unrecoverable_error_counter = (ecc_status >> 12) & 0xF;
 
-    // Check ECC recoverable error counter
-    ecc_threshold_check(recoverable_ecc_name, ecc_recoverable_error_counter,
-                        recov_ecc_threshold, recov_ecc_threshold_num, recover_ecc_err_addr);
+  // Check ECC recoverable error counter
+  ecc_threshold_check(recoverable_ecc_name, ecc_recoverable_error_counter,
+                      recov_ecc_threshold, recov_ecc_threshold_num, recover_ecc_err_addr);
 
-    // Check ECC un-recoverable error counter
-    ecc_threshold_check(unrecoverable_ecc_name, ecc_unrecoverable_error_counter,
-                        unrec_ecc_threshold, unrec_ecc_threshold_num, unrecover_ecc_err_addr);
+  // Check ECC un-recoverable error counter
+  ecc_threshold_check(unrecoverable_ecc_name, ecc_unrecoverable_error_counter,
+                      unrec_ecc_threshold, unrec_ecc_threshold_num, unrecover_ecc_err_addr);
 
-    sleep(ecc_monitor_interval);
-  }
-  return NULL;
+  return 0;
 }
 
-static void *
-bmc_health_monitor()
+static int
+bmc_health_monitor(void)
 {
-  int bmc_health_last_state = 1;
+  static int bmc_health_last_state = 1;
   int bmc_health_kv_state = 1;
   char tmp_health[MAX_VALUE_LEN];
-  int relog_counter = 0;
+  static int relog_counter = 0;
   int relog_counter_criteria = regen_interval / bmc_health_monitor_interval;
   size_t i;
   int ret = 0;
 
-  while(1) {
-    // get current health status from kv_store
-    memset(tmp_health, 0, MAX_VALUE_LEN);
-    ret = pal_get_key_value(BMC_HEALTH_FILE, tmp_health);
-    if (ret){
-      syslog(LOG_ERR, " %s - kv get bmc_health status failed", __func__);
-    }
-    bmc_health_kv_state = atoi(tmp_health);
-
-    // If log-util clear all fru, cleaning CPU/MEM/ECC error status
-    // After doing it, daemon will regenerate asserted log
-    // Generage a syslog every regen_interval loop counter
-    if ((relog_counter >= relog_counter_criteria) ||
-        ((bmc_health_last_state == 0) && (bmc_health_kv_state == 1))) {
-
-      for(i = 0; i < cpu_threshold_num; i++)
-        cpu_threshold[i].asserted = false;
-      for(i = 0; i < mem_threshold_num; i++)
-        mem_threshold[i].asserted = false;
-      for(i = 0; i < recov_ecc_threshold_num; i++)
-        recov_ecc_threshold[i].asserted = false;
-      for(i = 0; i < unrec_ecc_threshold_num; i++)
-        unrec_ecc_threshold[i].asserted = false;
+  // get current health status from kv_store
+  memset(tmp_health, 0, MAX_VALUE_LEN);
+  ret = pal_get_key_value(BMC_HEALTH_FILE, tmp_health);
+  if (ret){
+    syslog(LOG_ERR, " %s - kv get bmc_health status failed", __func__);
+  }
+  bmc_health_kv_state = atoi(tmp_health);
+
+  // If log-util clear all fru, cleaning CPU/MEM/ECC error status
+  // After doing it, daemon will regenerate asserted log
+  // Generage a syslog every regen_interval loop counter
+  if ((relog_counter >= relog_counter_criteria) ||
+      ((bmc_health_last_state == 0) && (bmc_health_kv_state == 1))) {
+
+    for(i = 0; i < cpu_threshold_num; i++)
+      cpu_threshold[i].asserted = false;
+    for(i = 0; i < mem_threshold_num; i++)
+      mem_threshold[i].asserted = false;
+    for(i = 0; i < recov_ecc_threshold_num; i++)
+      recov_ecc_threshold[i].asserted = false;
+    for(i = 0; i < unrec_ecc_threshold_num; i++)
+      unrec_ecc_threshold[i].asserted = false;
+
+    pthread_mutex_lock(&global_error_mutex);
+    bmc_health = 0;
+    pthread_mutex_unlock(&global_error_mutex);
+    relog_counter = 0;
+  }
+  bmc_health_last_state = bmc_health_kv_state;
+  relog_counter++;
+  return 0;
+}
 
-      pthread_mutex_lock(&global_error_mutex);
-      bmc_health = 0;
-      pthread_mutex_unlock(&global_error_mutex);
-      relog_counter = 0;
+/* Per-process counters used to attribute pressure to processes:
+ * CPU ticks, major faults and block IO delay ticks */
+struct proc_sample_s {
+  pid_t pid;
+  char comm[16];
+  unsigned long long usage[PSI_RESOURCE_NUM];
+};
+
+struct proc_snapshot_s {
+  struct proc_sample_s *procs;
+  size_t num;
+  size_t size;
+};
+
+struct psi_s {
+  struct watch_s watch;
+  const char *name;
+  const char *label;
+  float avg10, avg60, avg300;
+  unsigned long long total;
+  unsigned long events;
+  uint64_t last_report;
+  size_t num_top;
+  struct proc_sample_s top[PSI_MAX_TOP_PROCESSES];
+};
+
+static struct psi_s psi[PSI_RESOURCE_NUM] = {
+  {.name = "cpu", .label = "CPU"},
+  {.name = "memory", .label = "Memory"},
+  {.name = "io", .label = "IO"},
+};
+static struct proc_snapshot_s psi_base, psi_curr;
+static unsigned int psi_pending; // resources waiting for attribution
+static int psi_monitor(void);
+static struct monitor_s psi_mon = {"pressure", psi_monitor};
+
+static int
+read_proc_sample(const char *pid, struct proc_sample_s *p) {
+  char path[64], buf[1024];
+  char *s, *e, *tok, *save;
+  int fd, field;
+  ssize_t len;
+
+  snprintf(path, sizeof(path), "/proc/%s/stat", pid);
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0) {
+    return -1;
+  }
+  buf[len] = '\0';
+
+  // The command name may contain spaces and parentheses
+  s = strchr(buf, '(');
+  e = strrchr(buf, ')');
+  if (!s || !e || e < s || e[1] == '\0') {
+    return -1;
+  }
+  p->pid = atoi(buf);
+  len = e - s - 1;
+  if (len >= (ssize_t)sizeof(p->comm)) {
+    len = sizeof(p->comm) - 1;
+  }
+  memcpy(p->comm, s + 1, len);
+  p->comm[len] = '\0';
+  memset(p->usage, 0, sizeof(p->usage));
+
+  // Fields after the command name, starting with the state (3), see proc(5)
+  field = 3;
+  for (tok = strtok_r(e + 2, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+    switch (field++) {
+      case 12: // majflt
+        p->usage[PSI_MEMORY] = strtoull(tok, NULL, 10);
+        break;
+      case 14: // utime
+      case 15: // stime
+        p->usage[PSI_CPU] += strtoull(tok, NULL, 10);
+        break;
+      case 42: // delayacct_blkio_ticks
+        p->usage[PSI_IO] = strtoull(tok, NULL, 10);
+        return 0;
     }
-    bmc_health_last_state = bmc_health_kv_state;
-    relog_counter++;
-    sleep(bmc_health_monitor_interval);
   }
-  return NULL;
+  return 0;
+}
+
+static int
+proc_sample_cmp(const void *a, const void *b) {
+  const struct proc_sample_s *pa = a, *pb = b;
+
+  return (pa->pid > pb->pid) - (pa->pid < pb->pid);
+}
+
+static void
+take_proc_snapshot(struct proc_snapshot_s *snap) {
+  struct proc_sample_s *procs;
+  struct dirent *ent;
+  DIR *dir;
+
+  snap->num = 0;
+  dir = opendir("/proc");
+  if (!dir) {
+    return;
+  }
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] < '0' || ent->d_name[0] > '9') {
+      continue;
+    }
+    if (snap->num == snap->size) {
+      procs = realloc(snap->procs, (snap->size + 64) * sizeof(*procs));
+      if (!procs) {
+        break;
+      }
+      snap->procs = procs;
+      snap->size += 64;
+    }
+    if (read_proc_sample(ent->d_name, &snap->procs[snap->num]) == 0) {
+      snap->num++;
+    }
+  }
+  closedir(dir);
+  qsort(snap->procs, snap->num, sizeof(*snap->procs), proc_sample_cmp);
+}
+
+/* Find the processes with the largest usage of the resource between
+ * the base and the current snapshot */
+static void
+psi_attribute(struct psi_s *p, int res) {
+  struct proc_sample_s *curr, *base;
+  unsigned long long delta;
+  size_t i, j;
+
+  p->num_top = 0;
+  for (i = 0; i < psi_curr.num; i++) {
+    curr = &psi_curr.procs[i];
+    base = bsearch(curr, psi_base.procs, psi_base.num, sizeof(*curr), proc_sample_cmp);
+    delta = curr->usage[res];
+    if (base) {
+      delta = delta > base->usage[res] ? delta - base->usage[res] : 0;
+    }
+    if (delta == 0) {
+      continue;
+    }
+    // Keep the top list sorted, largest first
+    for (j = p->num_top; j > 0 && p->top[j - 1].usage[res] < delta; j--) {
+      if (j < psi_top_processes) {
+        p->top[j] = p->top[j - 1];
+      }
+    }
+    if (j < psi_top_processes) {
+      p->top[j] = *curr;
+      p->top[j].usage[res] = delta;
+      if (p->num_top < psi_top_processes) {
+        p->num_top++;
+      }
+    }
+  }
+}
+
+static void
+psi_report(struct psi_s *p, int res) {
+  char buf[512] = {0};
+  size_t i, len = 0;
+
+  for (i = 0; i < p->num_top && len < sizeof(buf); i++) {
+    len += snprintf(buf + len, sizeof(buf) - len, "%s%s[%d]:%llu",
+                    i ? ", " : "", p->top[i].comm, p->top[i].pid,
+                    p->top[i].usage[res]);
+  }
+  syslog(LOG_WARNING, "BMC %s pressure - avg10: %.2f%%, avg60: %.2f%%, top: %s",
+         p->label, p->avg10, p->avg60, p->num_top ? buf : "none");
+}
+
+static int
+psi_read(struct psi_s *p) {
+  char path[64];
+  FILE *fp;
+  int ret;
+
+  snprintf(path, sizeof(path), "%s/%s", PSI_PATH, p->name);
+  fp = fopen(path, "r");
+  if (!fp) {
+    return -1;
+  }
+  ret = fscanf(fp, "some avg10=%f avg60=%f avg300=%f total=%llu",
+               &p->avg10, &p->avg60, &p->avg300, &p->total);
+  fclose(fp);
+  return ret == 4 ? 0 : -1;
+}
+
+/* Export the pressure of each resource to the kv store, a value per
+ * resource and the whole status as a JSON document */
+static void
+psi_export(void) {
+  json_t *status, *res, *top, *proc;
+  char key[MAX_KEY_LEN], value[32];
+  char *str;
+  size_t i, j;
+
+  status = json_object();
+  if (!status) {
+    return;
+  }
+  for (i = 0; i < PSI_RESOURCE_NUM; i++) {
+    if (psi[i].watch.fd < 0) {
+      continue;
+    }
+    snprintf(key, sizeof(key), "%s_%s", KV_KEY_PSI_STATUS, psi[i].name);
+    snprintf(value, sizeof(value), "%.2f", psi[i].avg10);
+    kv_set(key, value, 0, 0);
+
+    res = json_object();
+    top = json_array();
+    if (!res || !top) {
+      json_decref(res);
+      json_decref(top);
+      continue;
+    }
+    json_object_set_new(res, "avg10", json_real(psi[i].avg10));
+    json_object_set_new(res, "avg60", json_real(psi[i].avg60));
+    json_object_set_new(res, "avg300", json_real(psi[i].avg300));
+    json_object_set_new(res, "total", json_integer(psi[i].total));
+    json_object_set_new(res, "events", json_integer(psi[i].events));
+    for (j = 0; j < psi[i].num_top; j++) {
+      proc = json_object();
+      if (!proc) {
+        break;
+      }
+      json_object_set_new(proc, "pid", json_integer(psi[i].top[j].pid));
+      json_object_set_new(proc, "name", json_string(psi[i].top[j].comm));
+      json_object_set_new(proc, "usage", json_integer(psi[i].top[j].usage[i]));
+      json_array_append_new(top, proc);
+    }
+    json_object_set_new(res, "top", top);
+    json_object_set_new(status, psi[i].name, res);
+  }
+  str = json_dumps(status, JSON_COMPACT);
+  if (str) {
+    kv_set(KV_KEY_PSI_STATUS, str, 0, 0);
+    free(str);
+  }
+  json_decref(status);
+}
+
+/* A trigger fired: take the baseline for the per-process deltas and let
+ * the monitor take the second sample a moment later */
+static void
+psi_event_handler(struct watch_s *w) {
+  struct psi_s *p = (struct psi_s *)w;
+
+  p->events++;
+  if (!psi_pending) {
+    take_proc_snapshot(&psi_base);
+    wake_monitor(&psi_mon, PSI_SAMPLE_TIME);
+  }
+  psi_pending |= 1 << (p - psi);
+}
+
+static int
+psi_monitor(void) {
+  uint64_t now = monotonic_ms();
+  int i;
+
+  if (psi_pending) {
+    take_proc_snapshot(&psi_curr);
+  }
+  for (i = 0; i < PSI_RESOURCE_NUM; i++) {
+    if (psi[i].watch.fd < 0) {
+      continue;
+    }
+    psi_read(&psi[i]);
+    if (!(psi_pending & (1 << i))) {
+      continue;
+    }
+    psi_attribute(&psi[i], i);
+    // Rate limit the logs, the kv store always has the latest
+    if (!psi[i].last_report ||
+        now - psi[i].last_report >= psi_report_interval * 1000ULL) {
+      psi_report(&psi[i], i);
+      psi[i].last_report = now;
+    }
+  }
+  psi_pending = 0;
+  psi_export();
+  return 0;
+}
+
+/* Register a trigger on the stall time of each resource, see
+ * Documentation/accounting/psi.rst */
+static int
+psi_init(void) {
+  char path[64], trigger[64];
+  int i, fd, watched = 0;
+
+  for (i = 0; i < PSI_RESOURCE_NUM; i++) {
+    psi[i].watch.fd = -1;
+    if (psi_threshold[i] == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", PSI_PATH, psi[i].name);
+    fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+      syslog(LOG_WARNING, "%s: %s not available: %s", __func__, path, strerror(errno));
+      continue;
+    }
+    snprintf(trigger, sizeof(trigger), "some %u %u",
+             psi_threshold[i] * 1000, psi_window * 1000);
+    if (write(fd, trigger, strlen(trigger) + 1) < 0) {
+      syslog(LOG_WARNING, "%s: cannot set %s trigger: %s", __func__, psi[i].name, strerror(errno));
+      close(fd);
+      continue;
+    }
+    psi[i].watch.name = psi[i].name;
+    psi[i].watch.fd = fd;
+    psi[i].watch.events = EPOLLPRI;
+    psi[i].watch.handler = psi_event_handler;
+    if (scheduler_watch(&main_sched, &psi[i].watch)) {
+      close(fd);
+      psi[i].watch.fd = -1;
+      continue;
+    }
+    watched++;
+  }
+  return watched ? 0 : -1;
 }
 
 void check_nm_selftest_result(uint8_t fru, int result)
@@ -1189,8 +1761,8 @@ void check_nm_selftest_result(uint8_t fru, int result)
   }
 }
 
-static void *
-nm_monitor()
+static int
+nm_monitor(void)
 {
   int fru;
   int ret;
@@ -1198,36 +1770,31 @@ nm_monitor()
   const uint8_t normal_status[2] = {0x55, 0x00}; // If the selftest result is 55 00, the status of the controller is okay
   uint8_t data[2]={0x0};
 
-  while (1)
+  for ( fru = 1; fru <= MAX_NUM_FRUS; fru++)
   {
-    for ( fru = 1; fru <= MAX_NUM_FRUS; fru++)
+    if ( pal_is_slot_server(fru) )
     {
-      if ( pal_is_slot_server(fru) )
+      if ( pal_is_fw_update_ongoing(fru) )
       {
-        if ( pal_is_fw_update_ongoing(fru) )
-        {
-          continue;
-        }
+        continue;
+      }
 
-        ret = pal_get_nm_selftest_result(fru, data);
-        if ( PAL_EOK == ret )
-        {
-          //if nm has the response, check the status
-          result = memcmp(data, normal_status, sizeof(normal_status));
-        }
-        else
-        {
-          //if nm has no response, suppose it is in the not support state
-          result = PAL_ENOTSUP;
-        }
-        check_nm_selftest_result(fru, result);
+      ret = pal_get_nm_selftest_result(fru, data);
+      if ( PAL_EOK == ret )
+      {
+        //if nm has the response, check the status
+        result = memcmp(data, normal_status, sizeof(normal_status));
+      }
+      else
+      {
+        //if nm has no response, suppose it is in the not support state
+        result = PAL_ENOTSUP;
       }
+      check_nm_selftest_result(fru, result);
     }
-
-    sleep(nm_monitor_interval);
   }
 
-  return NULL;
+  return 0;
 }
 
 void
@@ -1266,37 +1833,33 @@ crit_proc_ongoing_handle(bool is_crit_proc_updating)
 }
 
 //Block reboot and shutdown commands in BMC during any FW updating
-static void *
-crit_proc_monitor() {
+static int
+crit_proc_monitor(void) {
 
   bool is_fw_updating = false;
   bool is_crashdump_ongoing = false;
   bool is_cplddump_ongoing = false;
 
-  while(1)
-  {
-    //if is_fw_updating == true, means BMC is Updating a Device FW
-    is_fw_updating = pal_is_fw_update_ongoing_system();
-
-    //if is_autodump_ongoing == true, modify the permission
-    is_crashdump_ongoing = pal_is_crashdump_ongoing_system();
+  //if is_fw_updating == true, means BMC is Updating a Device FW
+  is_fw_updating = pal_is_fw_update_ongoing_system();
 
-    //if is_cplddump_ongoing == true, modify the permission
-    is_cplddump_ongoing = pal_is_cplddump_ongoing_system();
+  //if is_autodump_ongoing == true, modify the permission
+  is_crashdump_ongoing = pal_is_crashdump_ongoing_system();
 
-    if ( (true == is_fw_updating) || (true == is_crashdump_ongoing) || (true == is_cplddump_ongoing) )
-    {
-      crit_proc_ongoing_handle(true);
-    }
+  //if is_cplddump_ongoing == true, modify the permission
+  is_cplddump_ongoing = pal_is_cplddump_ongoing_system();
 
-    if ( (false == is_fw_updating) && (false == is_crashdump_ongoing) && (false == is_cplddump_ongoing) )
-    {
-      crit_proc_ongoing_handle(false);
-    }
+  if ( (true == is_fw_updating) || (true == is_crashdump_ongoing) || (true == is_cplddump_ongoing) )
+  {
+    crit_proc_ongoing_handle(true);
+  }
 
-    sleep(1);
+  if ( (false == is_fw_updating) && (false == is_crashdump_ongoing) && (false == is_cplddump_ongoing) )
+  {
+    crit_proc_ongoing_handle(false);
   }
-  return NULL;
+
+  return 0;
 }
 
 static int log_count(const char *str)
@@ -1559,66 +2122,67 @@ log_reboot_cause(char *sled_off_time)
   close(mem_fd);
 }
 
-// Thread to monitor SLED Cycles by using time stamp
-static void *
-timestamp_handler()
+static long time_sled_off;
+
+static void
+timestamp_init(void)
 {
-  int count = 0;
-  struct timespec ts;
-  struct timespec mts;
   char tstr[MAX_VALUE_LEN] = {0};
   char buf[128] = {0};
-  uint8_t time_init = 0;
-  long time_sled_on;
-  long time_sled_off;
 
   // Read the last timestamp from KV storage
   pal_get_key_value("timestamp_sled", tstr);
   time_sled_off = (long) strtol(tstr, NULL, 10);
   ctime_r(&time_sled_off, buf);
   log_reboot_cause(buf);
+}
 
-  while (1) {
-
-    // Make sure the time is initialized properly
-    // Since there is no battery backup, the time could be reset to build time
-    // wait 100s at most, to prevent infinite waiting
-    if ( time_init < SLED_TS_TIMEOUT ) {
-      // Read current time
-      clock_gettime(CLOCK_REALTIME, &ts);
+// Monitor SLED Cycles by using time stamp
+static int
+timestamp_handler(void)
+{
+  static int count = 0;
+  static uint8_t time_init = 0;
+  struct timespec ts;
+  struct timespec mts;
+  char buf[128] = {0};
+  long time_sled_on;
 
-      if ( (ts.tv_sec < time_sled_off) && (++time_init < SLED_TS_TIMEOUT) ) {
-        sleep(1);
-        continue;
-      }
+  // Make sure the time is initialized properly
+  // Since there is no battery backup, the time could be reset to build time
+  // wait 100s at most, to prevent infinite waiting
+  if ( time_init < SLED_TS_TIMEOUT ) {
+    // Read current time
+    clock_gettime(CLOCK_REALTIME, &ts);
 
-      // If get the correct time or time sync timeout
-      time_init = SLED_TS_TIMEOUT;
+    if ( (ts.tv_sec < time_sled_off) && (++time_init < SLED_TS_TIMEOUT) ) {
+      return 1000;
+    }
 
-      // Need to log SLED ON event, if this is Power-On-Reset
-      if (pal_is_bmc_por()) {
-        // Get uptime
-        clock_gettime(CLOCK_MONOTONIC, &mts);
-        // To find out when SLED was on, subtract the uptime from current time
-        time_sled_on = ts.tv_sec - mts.tv_sec;
+    // If get the correct time or time sync timeout
+    time_init = SLED_TS_TIMEOUT;
 
-        ctime_r(&time_sled_on, buf);
-        // Log an event if this is Power-On-Reset
-        syslog(LOG_CRIT, "SLED Powered ON at %s", buf);
-      }
-      pal_update_ts_sled();
-    }
+    // Need to log SLED ON event, if this is Power-On-Reset
+    if (pal_is_bmc_por()) {
+      // Get uptime
+      clock_gettime(CLOCK_MONOTONIC, &mts);
+      // To find out when SLED was on, subtract the uptime from current time
+      time_sled_on = ts.tv_sec - mts.tv_sec;
 
-    // Store timestamp every one hour to keep track of SLED power
-    if (count++ == HB_TIMESTAMP_COUNT) {
-      pal_update_ts_sled();
-      count = 0;
+      ctime_r(&time_sled_on, buf);
+      // Log an event if this is Power-On-Reset
+      syslog(LOG_CRIT, "SLED Powered ON at %s", buf);
     }
+    pal_update_ts_sled();
+  }
 
-    sleep(HB_SLEEP_TIME);
+  // Store timestamp every one hour to keep track of SLED power
+  if (count++ == HB_TIMESTAMP_COUNT) {
+    pal_update_ts_sled();
+    count = 0;
   }
 
-  return NULL;
+  return HB_SLEEP_TIME * 1000;
 }
 
 void sig_handler(int signo) {
@@ -1629,17 +2193,19 @@ void sig_handler(int signo) {
 
 int
 main(int argc, char **argv) {
+  static struct monitor_s watchdog_mon = {"watchdog", watchdog_handler};
+  static struct monitor_s hb_mon = {"heartbeat", hb_handler};
+  static struct monitor_s cpu_mon = {"CPU usage", CPU_usage_monitor};
+  static struct monitor_s mem_mon = {"memory usage", memory_usage_monitor};
+  static struct monitor_s i2c_mon = {"I2C", i2c_mon_handler};
+  static struct monitor_s ecc_mon = {"ECC", ecc_mon_handler};
+  static struct monitor_s bmc_health_mon = {"BMC health", bmc_health_monitor};
+  static struct monitor_s nm_mon = {"nm", nm_monitor};
+  static struct monitor_s crit_proc_mon = {"FW update", crit_proc_monitor};
+  static struct monitor_s timestamp_mon = {"time stamp", timestamp_handler};
   pthread_t tid_watchdog;
-  pthread_t tid_hb_led;
-  pthread_t tid_i2c_mon;
-  pthread_t tid_cpu_monitor;
-  pthread_t tid_mem_monitor;
-  pthread_t tid_crit_proc_monitor;
-  pthread_t tid_ecc_monitor;
-  pthread_t tid_bmc_health_monitor;
-  pthread_t tid_nm_monitor;
+  pthread_t tid_io_sched;
   pthread_t tid_pfr_monitor;
-  pthread_t tid_timestamp_handler;
 
   if (argc > 1) {
     exit(1);
@@ -1661,57 +2227,71 @@ main(int argc, char **argv) {
     store_curr_version();
   }
 
+  if (scheduler_init(&main_sched) || scheduler_init(&wdt_sched) ||
+      scheduler_init(&io_sched)) {
+    exit(1);
+  }
+
 // For current platforms, we are using WDT from either fand or fscd
 // TODO: keeping this code until we make healthd as central daemon that
 //  monitors all the important daemons for the platforms.
-  if (pthread_create(&tid_watchdog, NULL, watchdog_handler, NULL)) {
+  watchdog_init();
+  schedule_monitor(&wdt_sched, &watchdog_mon, 0, WATCHDOG_KICK_INTERVAL);
+  if (pthread_create(&tid_watchdog, NULL, scheduler_loop, &wdt_sched)) {
     syslog(LOG_WARNING, "pthread_create for watchdog error\n");
     exit(1);
   }
 
-  if (pthread_create(&tid_hb_led, NULL, hb_handler, NULL)) {
-    syslog(LOG_WARNING, "pthread_create for heartbeat error\n");
-    exit(1);
-  }
+  schedule_monitor(&main_sched, &hb_mon, 0, hb_interval);
 
   if (cpu_monitor_enabled) {
-    if (pthread_create(&tid_cpu_monitor, NULL, CPU_usage_monitor, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for monitor CPU usage\n");
+    cpu_utilization = calloc(cpu_window_size, sizeof(float));
+    if (cpu_utilization == NULL) {
+      syslog(LOG_WARNING, "Failed to allocate CPU usage window\n");
       exit(1);
     }
+    schedule_monitor(&main_sched, &cpu_mon, CPU_MONITOR_DELAY,
+                     cpu_monitor_interval * 1000);
   }
 
   if (mem_monitor_enabled) {
-    if (pthread_create(&tid_mem_monitor, NULL, memory_usage_monitor, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for monitor memory usage\n");
+    mem_utilization = calloc(mem_window_size, sizeof(float));
+    if (mem_utilization == NULL) {
+      syslog(LOG_WARNING, "Failed to allocate memory usage window\n");
       exit(1);
     }
+    memory_monitor_init();
+    schedule_monitor(&main_sched, &mem_mon, 0, mem_monitor_interval * 1000);
   }
 
   if (i2c_monitor_enabled) {
-    // Add a thread for monitoring all I2C buses crash or not
-    if (pthread_create(&tid_i2c_mon, NULL, i2c_mon_handler, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for I2C errorr\n");
-      exit(1);
-    }
+    // Monitor all I2C buses crash or not
+    schedule_monitor(&main_sched, &i2c_mon, 0, I2C_MONITOR_INTERVAL);
   }
 
   if (ecc_monitor_enabled) {
-    if (pthread_create(&tid_ecc_monitor, NULL, ecc_mon_handler, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for ECC monitoring errorr\n");
-      exit(1);
-    }
+    schedule_monitor(&main_sched, &ecc_mon, 0, ecc_monitor_interval * 1000);
   }
 
   if (regen_log_enabled) {
-    if (pthread_create(&tid_bmc_health_monitor, NULL, bmc_health_monitor, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for BMC Health monitoring errorr\n");
-      exit(1);
-    }
+    schedule_monitor(&main_sched, &bmc_health_mon, 0,
+                     bmc_health_monitor_interval * 1000);
+  }
+
+  schedule_monitor(&main_sched, &crit_proc_mon, 0, 1000);
+
+  if (psi_monitor_enabled && psi_init() == 0) {
+    schedule_monitor(&main_sched, &psi_mon, 0, psi_report_interval * 1000);
+  }
+
+  if (bmc_timestamp_enabled) {
+    timestamp_init();
+    schedule_monitor(&main_sched, &timestamp_mon, 0, HB_SLEEP_TIME * 1000);
   }
 
   if (nm_monitor_enabled) {
-    if (pthread_create(&tid_nm_monitor, NULL, nm_monitor, NULL)) {
+    schedule_monitor(&io_sched, &nm_mon, 0, nm_monitor_interval * 1000);
+    if (pthread_create(&tid_io_sched, NULL, scheduler_loop, &io_sched)) {
       syslog(LOG_WARNING, "pthread_create for nm monitor error\n");
       exit(1);
     }
@@ -1724,55 +2304,17 @@ main(int argc, char **argv) {
     }
   }
 
-  if (pthread_create(&tid_crit_proc_monitor, NULL, crit_proc_monitor, NULL)) {
-    syslog(LOG_WARNING, "pthread_create for FW Update Monitor error\n");
-    exit(1);
-  }
-
-  if (bmc_timestamp_enabled) {
-    if (pthread_create(&tid_timestamp_handler, NULL, timestamp_handler, NULL)) {
-      syslog(LOG_WARNING, "pthread_create for time stamp handler error\n");
-      exit(1);
-    }
-  }
-
+  scheduler_loop(&main_sched);
 
   pthread_join(tid_watchdog, NULL);
 
-  pthread_join(tid_hb_led, NULL);
-
-  if (i2c_monitor_enabled) {
-    pthread_join(tid_i2c_mon, NULL);
-  }
-  if (cpu_monitor_enabled) {
-    pthread_join(tid_cpu_monitor, NULL);
-  }
-
-  if (mem_monitor_enabled) {
-    pthread_join(tid_mem_monitor, NULL);
-  }
-
-  if (ecc_monitor_enabled) {
-    pthread_join(tid_ecc_monitor, NULL);
-  }
-
-  if (regen_log_enabled) {
-    pthread_join(tid_bmc_health_monitor, NULL);
-  }
-
   if (nm_monitor_enabled) {
-    pthread_join(tid_nm_monitor, NULL);
+    pthread_join(tid_io_sched, NULL);
   }
 
   if (pfr_monitor_enabled) {
     pthread_join(tid_pfr_monitor, NULL);
   }
 
-  pthread_join(tid_crit_proc_monitor, NULL);
-
-  if (bmc_timestamp_enabled) {
-    pthread_join(tid_timestamp_handler, NULL);
-  }
-
   return 0;
 }
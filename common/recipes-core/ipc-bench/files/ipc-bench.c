@@ -0,0 +1,382 @@
+/*
+ * ipc-bench
+ *
+ * Copyright 2020-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "ipc-bench.h"
+
+#define MAX_RESP_LEN 1024
+#define MAX_DEPTH 64
+#define LAT_INIT_CAP 1024
+#define ECHO_WORKERS 64
+
+typedef struct {
+  const ipc_bench_cfg_t *cfg;
+  unsigned int seed;
+  unsigned int total_weight;
+  ipc_client_t **clis;     /* persistent connection per mix entry */
+  uint32_t *lat;           /* latency of every answered request */
+  size_t num_lat;
+  size_t cap_lat;
+  uint64_t errors;
+  uint64_t timeouts;
+} bench_worker_t;
+
+static uint64_t
+now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+hex_nibble(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  c = tolower(c);
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+int
+ipc_bench_parse_req(const char *spec, ipc_bench_req_t *req)
+{
+  const char *colon, *p;
+  char *end;
+  size_t len;
+  int hi, lo;
+
+  memset(req, 0, sizeof(*req));
+  req->weight = 1;
+
+  colon = strchr(spec, ':');
+  if (!colon || colon == spec || (size_t)(colon - spec) >= MAX_ENDPOINT_LEN - 1) {
+    return -1;
+  }
+  len = colon - spec;
+  memcpy(req->endpoint, spec, len);
+
+  for (p = colon + 1; *p && *p != '@'; p += 2) {
+    hi = hex_nibble(p[0]);
+    lo = p[1] ? hex_nibble(p[1]) : -1;
+    if (hi < 0 || lo < 0 || req->req_len >= IPC_BENCH_MAX_REQ) {
+      return -1;
+    }
+    req->req[req->req_len++] = (uint8_t)((hi << 4) | lo);
+  }
+  if (req->req_len == 0) {
+    return -1;
+  }
+
+  if (*p == '@') {
+    req->weight = strtoul(p + 1, &end, 0);
+    if (*end != '\0' || req->weight == 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int
+echo_handler(client_t *cli)
+{
+  uint8_t buf[MAX_RESP_LEN];
+  size_t len = sizeof(buf);
+  int delay_us = (int)(intptr_t)cli->svc_cookie;
+
+  if (ipc_recv_req(cli, buf, &len, 1)) {
+    return -1;
+  }
+  if (delay_us > 0) {
+    usleep(delay_us);
+  }
+  return ipc_send_resp(cli, buf, len);
+}
+
+int
+ipc_bench_echo_start(const char *endpoint, int delay_us, bool pool)
+{
+  ipc_svc_attr_t attr = {
+    .num_workers = ECHO_WORKERS,
+    .max_pending = ECHO_WORKERS,
+    .max_req_len = MAX_RESP_LEN,
+  };
+
+  if (!pool) {
+    return ipc_start_svc(endpoint, echo_handler, ECHO_WORKERS,
+                         (void *)(intptr_t)delay_us, NULL);
+  }
+  return ipc_start_svc_pool(endpoint, echo_handler, &attr,
+                            (void *)(intptr_t)delay_us, NULL);
+}
+
+static void
+record_latency(bench_worker_t *w, uint64_t start)
+{
+  uint32_t *lat;
+
+  if (w->num_lat == w->cap_lat) {
+    lat = realloc(w->lat, sizeof(uint32_t) * w->cap_lat * 2);
+    if (!lat) {
+      return;
+    }
+    w->lat = lat;
+    w->cap_lat *= 2;
+  }
+  w->lat[w->num_lat++] = (uint32_t)(now_us() - start);
+}
+
+static void
+record_error(bench_worker_t *w, int err)
+{
+  if (err == EAGAIN || err == EWOULDBLOCK || err == ETIMEDOUT) {
+    w->timeouts++;
+  } else {
+    w->errors++;
+  }
+}
+
+static int
+pick_req(bench_worker_t *w)
+{
+  const ipc_bench_cfg_t *cfg = w->cfg;
+  unsigned int r = rand_r(&w->seed) % w->total_weight;
+  int i;
+
+  for (i = 0; i < cfg->num_reqs - 1; i++) {
+    if (r < cfg->reqs[i].weight)
+      break;
+    r -= cfg->reqs[i].weight;
+  }
+  return i;
+}
+
+/* Issue one request (or one pipelined batch) and return how many were sent */
+static int
+bench_once(bench_worker_t *w)
+{
+  const ipc_bench_cfg_t *cfg = w->cfg;
+  int idx = pick_req(w);
+  ipc_bench_req_t *r = &cfg->reqs[idx];
+  uint8_t resp[MAX_RESP_LEN];
+  size_t resp_len = sizeof(resp);
+  uint64_t start[MAX_DEPTH];
+  uint32_t tags[MAX_DEPTH], tag;
+  int depth = cfg->depth > 1 ? cfg->depth : 1;
+  int i, j, sent;
+
+  if (!cfg->persistent) {
+    start[0] = now_us();
+    if (ipc_send_req(r->endpoint, r->req, r->req_len, resp, &resp_len, cfg->timeout)) {
+      record_error(w, errno);
+    } else if (resp_len == 0) {
+      w->errors++;
+    } else {
+      record_latency(w, start[0]);
+    }
+    return 1;
+  }
+
+  if (!w->clis[idx]) {
+    w->clis[idx] = ipc_client_open(r->endpoint, cfg->timeout);
+    if (!w->clis[idx]) {
+      w->errors++;
+      /* Do not spin on an endpoint which is not there */
+      usleep(10 * 1000);
+      return 1;
+    }
+  }
+
+  for (sent = 0; sent < depth; sent++) {
+    start[sent] = now_us();
+    if (ipc_client_send(w->clis[idx], r->req, r->req_len, &tags[sent])) {
+      record_error(w, errno);
+      break;
+    }
+  }
+
+  for (i = 0; i < sent; i++) {
+    resp_len = sizeof(resp);
+    if (ipc_client_recv(w->clis[idx], &tag, resp, &resp_len)) {
+      /* Whatever is still outstanding is lost with this connection */
+      for (j = i; j < sent; j++) {
+        record_error(w, errno);
+      }
+      ipc_client_close(w->clis[idx]);
+      w->clis[idx] = NULL;
+      break;
+    }
+    for (j = 0; j < sent && tags[j] != tag; j++)
+      ;
+    if (j == sent || resp_len == 0) {
+      w->errors++;
+    } else {
+      record_latency(w, start[j]);
+    }
+  }
+  return depth;
+}
+
+static void *
+bench_thread(void *arg)
+{
+  bench_worker_t *w = (bench_worker_t *)arg;
+  const ipc_bench_cfg_t *cfg = w->cfg;
+  uint64_t deadline = now_us() + (uint64_t)cfg->duration * 1000000;
+  int done = 0;
+
+  while (cfg->duration > 0 ? now_us() < deadline : done < cfg->count) {
+    done += bench_once(w);
+  }
+  return NULL;
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t
+percentile(const uint32_t *lat, size_t n, int percent)
+{
+  size_t idx;
+
+  if (n == 0)
+    return 0;
+  idx = (n * percent + 99) / 100;
+  return lat[idx > 0 ? idx - 1 : 0];
+}
+
+int
+ipc_bench_run(const ipc_bench_cfg_t *cfg, ipc_bench_result_t *res)
+{
+  bench_worker_t *workers;
+  pthread_t *tids;
+  uint32_t *lat;
+  uint64_t start, total = 0;
+  unsigned int total_weight = 0;
+  size_t n = 0;
+  int i, j, ret = -1;
+
+  if (!cfg || !res || !cfg->reqs || cfg->num_reqs <= 0 || cfg->clients <= 0 ||
+      cfg->depth > MAX_DEPTH || (cfg->duration <= 0 && cfg->count <= 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < cfg->num_reqs; i++) {
+    total_weight += cfg->reqs[i].weight;
+  }
+  if (total_weight == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  workers = calloc(cfg->clients, sizeof(bench_worker_t));
+  tids = calloc(cfg->clients, sizeof(pthread_t));
+  if (!workers || !tids) {
+    goto free_bail;
+  }
+  for (i = 0; i < cfg->clients; i++) {
+    workers[i].cfg = cfg;
+    workers[i].seed = (unsigned int)(now_us() + i);
+    workers[i].total_weight = total_weight;
+    workers[i].cap_lat = LAT_INIT_CAP;
+    workers[i].lat = malloc(sizeof(uint32_t) * LAT_INIT_CAP);
+    workers[i].clis = calloc(cfg->num_reqs, sizeof(ipc_client_t *));
+    if (!workers[i].lat || !workers[i].clis) {
+      goto free_bail;
+    }
+  }
+
+  start = now_us();
+  for (i = 0; i < cfg->clients; i++) {
+    if (pthread_create(&tids[i], NULL, bench_thread, &workers[i])) {
+      break;
+    }
+  }
+  for (j = 0; j < i; j++) {
+    pthread_join(tids[j], NULL);
+  }
+  if (i != cfg->clients) {
+    goto free_bail;
+  }
+
+  memset(res, 0, sizeof(*res));
+  res->elapsed = (now_us() - start) / 1000000.0;
+  for (i = 0; i < cfg->clients; i++) {
+    n += workers[i].num_lat;
+    res->errors += workers[i].errors;
+    res->timeouts += workers[i].timeouts;
+  }
+  res->requests = n;
+  res->throughput = res->elapsed > 0 ? n / res->elapsed : 0;
+
+  lat = malloc(sizeof(uint32_t) * (n ? n : 1));
+  if (!lat) {
+    goto free_bail;
+  }
+  for (i = 0, n = 0; i < cfg->clients; i++) {
+    memcpy(&lat[n], workers[i].lat, sizeof(uint32_t) * workers[i].num_lat);
+    n += workers[i].num_lat;
+  }
+  qsort(lat, n, sizeof(uint32_t), cmp_u32);
+  for (j = 0; j < (int)n; j++) {
+    total += lat[j];
+  }
+  if (n > 0) {
+    res->avg_us = (double)total / n;
+    res->min_us = lat[0];
+    res->max_us = lat[n - 1];
+    res->p50_us = percentile(lat, n, 50);
+    res->p90_us = percentile(lat, n, 90);
+    res->p99_us = percentile(lat, n, 99);
+  }
+  free(lat);
+  ret = 0;
+
+free_bail:
+  if (workers) {
+    for (i = 0; i < cfg->clients; i++) {
+      if (workers[i].clis) {
+        for (j = 0; j < cfg->num_reqs; j++) {
+          ipc_client_close(workers[i].clis[j]);
+        }
+      }
+      free(workers[i].clis);
+      free(workers[i].lat);
+    }
+  }
+  free(workers);
+  free(tids);
+  return ret;
+}
@@ -0,0 +1,82 @@
+/*
+ * ipc-bench
+ *
+ * Copyright 2020-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __IPC_BENCH_H__
+#define __IPC_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <openbmc/ipc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IPC_BENCH_MAX_REQ 256
+
+/* One entry of the request mix */
+typedef struct {
+  char endpoint[MAX_ENDPOINT_LEN];
+  uint8_t req[IPC_BENCH_MAX_REQ];
+  size_t req_len;
+  unsigned int weight;
+} ipc_bench_req_t;
+
+typedef struct {
+  ipc_bench_req_t *reqs;
+  int num_reqs;
+  int clients;      /* concurrent client threads */
+  int count;        /* requests per client, used when duration is 0 */
+  int duration;     /* seconds to run */
+  int timeout;      /* response timeout in seconds */
+  bool persistent;  /* use ipc_client_* connections instead of ipc_send_req */
+  int depth;        /* pipelined requests in flight per persistent client */
+} ipc_bench_cfg_t;
+
+typedef struct {
+  uint64_t requests;  /* requests answered with a response */
+  uint64_t errors;    /* failed or answered empty */
+  uint64_t timeouts;
+  double elapsed;     /* seconds */
+  double throughput;  /* responses per second */
+  double avg_us;
+  uint32_t min_us;
+  uint32_t p50_us;
+  uint32_t p90_us;
+  uint32_t p99_us;
+  uint32_t max_us;
+} ipc_bench_result_t;
+
+/* Parse "<endpoint>:<hex bytes>[@weight]" into a request of the mix */
+int ipc_bench_parse_req(const char *spec, ipc_bench_req_t *req);
+
+/* Start an echo service on the endpoint in this process, answering every
+ * request with its own payload after delay_us microseconds. pool selects
+ * ipc_start_svc_pool() over the thread-per-connection ipc_start_svc(). */
+int ipc_bench_echo_start(const char *endpoint, int delay_us, bool pool);
+
+/* Drive the configured load and collect the results */
+int ipc_bench_run(const ipc_bench_cfg_t *cfg, ipc_bench_result_t *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __IPC_BENCH_H__ */
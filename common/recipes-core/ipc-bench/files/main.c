@@ -0,0 +1,166 @@
+/*
+ * ipc-bench
+ *
+ * Copyright 2020-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "ipc-bench.h"
+
+static void
+print_usage(const char *prog)
+{
+  printf("Usage: %s [options] <endpoint>:<hex request>[@weight] ...\n", prog);
+  printf("Options:\n");
+  printf("  -c <clients>   concurrent clients (default 1)\n");
+  printf("  -n <count>     requests per client (default 1000)\n");
+  printf("  -d <seconds>   run for a duration instead of a request count\n");
+  printf("  -t <seconds>   response timeout (default 2)\n");
+  printf("  -p             use persistent connections\n");
+  printf("  -q <depth>     pipelined requests per persistent client (implies -p)\n");
+  printf("  -e <endpoint>  serve a built-in echo service on <endpoint>\n");
+  printf("  -D <usec>      delay of the echo service per request\n");
+  printf("  -l             serve the echo service with one thread per connection\n");
+  printf("  -j             JSON output\n");
+  printf("Examples:\n");
+  printf("  %s -e bench_echo -c 8 -d 10 -p bench_echo:01020304\n", prog);
+  printf("  %s -c 4 -n 500 ipmi_socket:011801       (Get Device ID of slot1 through ipmid)\n", prog);
+  printf("  %s -c 2 ipmb_socket_1:<ipmb request>@3 ipmi_socket:011801@1\n", prog);
+}
+
+static void
+print_result(const ipc_bench_cfg_t *cfg, const ipc_bench_result_t *res, bool json)
+{
+  if (json) {
+    printf("{\"clients\": %d, \"persistent\": %s, \"depth\": %d, "
+           "\"elapsed_s\": %.3f, \"requests\": %llu, \"errors\": %llu, "
+           "\"timeouts\": %llu, \"throughput_rps\": %.1f, \"avg_us\": %.1f, "
+           "\"min_us\": %u, \"p50_us\": %u, \"p90_us\": %u, \"p99_us\": %u, "
+           "\"max_us\": %u}\n",
+           cfg->clients, cfg->persistent ? "true" : "false",
+           cfg->depth > 1 ? cfg->depth : 1, res->elapsed,
+           (unsigned long long)res->requests, (unsigned long long)res->errors,
+           (unsigned long long)res->timeouts, res->throughput, res->avg_us,
+           res->min_us, res->p50_us, res->p90_us, res->p99_us, res->max_us);
+    return;
+  }
+
+  printf("clients:    %d (%s, depth %d)\n", cfg->clients,
+         cfg->persistent ? "persistent" : "one-shot", cfg->depth > 1 ? cfg->depth : 1);
+  printf("elapsed:    %.3f s\n", res->elapsed);
+  printf("requests:   %llu\n", (unsigned long long)res->requests);
+  printf("errors:     %llu\n", (unsigned long long)res->errors);
+  printf("timeouts:   %llu\n", (unsigned long long)res->timeouts);
+  printf("throughput: %.1f req/s\n", res->throughput);
+  printf("latency:    avg %.1f us, min %u us, p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+         res->avg_us, res->min_us, res->p50_us, res->p90_us, res->p99_us, res->max_us);
+}
+
+int
+main(int argc, char **argv)
+{
+  ipc_bench_cfg_t cfg = {
+    .clients = 1,
+    .count = 1000,
+    .timeout = 2,
+  };
+  ipc_bench_result_t res;
+  const char *echo = NULL;
+  int echo_delay = 0;
+  bool echo_pool = true;
+  bool json = false;
+  int opt, i;
+
+  while ((opt = getopt(argc, argv, "c:n:d:t:pq:e:D:ljh")) != -1) {
+    switch (opt) {
+      case 'c':
+        cfg.clients = atoi(optarg);
+        break;
+      case 'n':
+        cfg.count = atoi(optarg);
+        break;
+      case 'd':
+        cfg.duration = atoi(optarg);
+        break;
+      case 't':
+        cfg.timeout = atoi(optarg);
+        break;
+      case 'p':
+        cfg.persistent = true;
+        break;
+      case 'q':
+        cfg.depth = atoi(optarg);
+        cfg.persistent = true;
+        break;
+      case 'e':
+        echo = optarg;
+        break;
+      case 'D':
+        echo_delay = atoi(optarg);
+        break;
+      case 'l':
+        echo_pool = false;
+        break;
+      case 'j':
+        json = true;
+        break;
+      default:
+        print_usage(argv[0]);
+        return -1;
+    }
+  }
+
+  cfg.num_reqs = argc - optind;
+  if (cfg.num_reqs <= 0) {
+    print_usage(argv[0]);
+    return -1;
+  }
+  cfg.reqs = calloc(cfg.num_reqs, sizeof(ipc_bench_req_t));
+  if (!cfg.reqs) {
+    return -1;
+  }
+  for (i = 0; i < cfg.num_reqs; i++) {
+    if (ipc_bench_parse_req(argv[optind + i], &cfg.reqs[i])) {
+      printf("Invalid request: %s\n", argv[optind + i]);
+      print_usage(argv[0]);
+      free(cfg.reqs);
+      return -1;
+    }
+  }
+
+  if (echo) {
+    if (ipc_bench_echo_start(echo, echo_delay, echo_pool)) {
+      printf("Failed to start echo service on %s\n", echo);
+      free(cfg.reqs);
+      return -1;
+    }
+  }
+
+  if (ipc_bench_run(&cfg, &res)) {
+    printf("Benchmark failed\n");
+    free(cfg.reqs);
+    return -1;
+  }
+  print_result(&cfg, &res, json);
+  free(cfg.reqs);
+  return (res.errors || res.timeouts) ? 1 : 0;
+}
@@ -41,8 +41,10 @@ static void
 print_usage_help(void) {
   printf("Usage: ipmb-util <bus_id> <slave address> COMMAND\n");
   printf("Usage: ipmb-util <bus_id> <slave_address> <--file> <path>\n");
+  printf("Usage: ipmb-util <bus_id> --stats\n");
   printf("COMMAND format: <netfn> <command ID> <cmd b1> <cmd b2> ...\n");
   printf("File is assumed to contain a set of commands one per line.\n");
+  printf("--stats prints the bus statistics of ipmbd in JSON.\n");
 }
 
 static int
@@ -142,11 +144,34 @@ process_file(uint8_t bus_id, uint8_t slave_addr, char *path) {
   return final_ret;
 }
 
+static int
+process_stats(uint8_t bus_id) {
+  char *buf;
+  size_t len = MAX_IPMB_STATS_LEN;
+
+  buf = malloc(len);
+  if (buf == NULL) {
+    return -1;
+  }
+  if (lib_ipmb_get_stats(bus_id, buf, &len)) {
+    printf("Failed to get statistics of bus %u\n", bus_id);
+    free(buf);
+    return -1;
+  }
+  printf("%s\n", buf);
+  free(buf);
+  return 0;
+}
+
 int
 main(int argc, char **argv) {
   uint8_t bus_id;
   uint8_t slave_addr;
 
+  if (argc == 3 && !strcmp(argv[2], "--stats")) {
+    return process_stats((uint8_t)strtoul(argv[1], NULL, 0));
+  }
+
   if (argc < 4) {
     goto err_exit;
   }
@@ -63,6 +63,7 @@
 #include <assert.h>
 #include <getopt.h>
 #include <stddef.h>
+#include <limits.h>
 #include <linux/limits.h>
 #include <linux/version.h>
 
@@ -91,7 +92,6 @@
  */
 #define MQ_DESC_INVALID         ((mqd_t)-1)
 #define MQ_IPMB_REQ             "/mq_ipmb_req"
-#define MQ_IPMB_RES             "/mq_ipmb_res"
 #define MQ_MAX_NUM_MSGS         256
 #define MQ_DFT_FLAGS            (O_RDONLY | O_CREAT)
 #define MQ_DFT_MODES            (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
@@ -103,6 +103,9 @@
 }
 
 #define SEQ_NUM_MAX 64
+#if SEQ_NUM_MAX > 64
+#error "seq# bitmap is a single 64-bit word"
+#endif
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(_a) (sizeof(_a) / sizeof((_a)[0]))
@@ -110,7 +113,6 @@
 
 #define IPMBD_RX_THREAD  "rx_handler"
 #define IPMBD_REQ_THREAD "req_handler"
-#define IPMBD_RES_THREAD "res_handler"
 #define IPMBD_SVC_THREAD "svc_handler"
 #define __VERBOSE(fmt, args...)       \
   do {                                \
@@ -120,30 +122,129 @@
 #define IPMBD_VERBOSE(fmt, args...) __VERBOSE(fmt, ##args)
 #define RX_VERBOSE(fmt, args...)  __VERBOSE(IPMBD_RX_THREAD ": " fmt, ##args)
 #define REQ_VERBOSE(fmt, args...) __VERBOSE(IPMBD_REQ_THREAD ": " fmt, ##args)
-#define RES_VERBOSE(fmt, args...) __VERBOSE(IPMBD_RES_THREAD ": " fmt, ##args)
 #define SVC_VERBOSE(fmt, args...) __VERBOSE(IPMBD_SVC_THREAD ": " fmt, ##args)
 
+// State of a seq# slot, see seq_put() and seq_release()
+enum {
+  SEQ_FREE = 0, // not waiting for a response
+  SEQ_WAIT,     // request sent, waiting for the response
+  SEQ_FILL,     // response is being copied to the requester's buffer
+  SEQ_DONE,     // response delivered
+};
+
 // Structure for sequence number and buffer
 typedef struct {
-  bool in_use; // seq# is being used
+  uint8_t state; // SEQ_*, accessed atomically
   uint8_t len; // buffer size
   uint8_t *p_buf; // pointer to buffer
   sem_t seq_sem; // semaphore for thread sync.
 } seq_buf_t;
 
 // Structure for holding currently used sequence number and
-// array of all possible sequence number
+// array of all possible sequence number. Allocation and completion are
+// lock free: a seq# is owned by whoever sets its bit in the map, and the
+// response is handed over through the slot state.
 static struct {
-  pthread_mutex_t seq_mutex;
-
-  uint8_t curr_seq; // currently used seq#
+  uint64_t map; // bit n set: seq# n is allocated
+  uint8_t curr_seq; // next seq# to try
   seq_buf_t seq[SEQ_NUM_MAX]; //array of all possible seq# struct.
-} ipmb_seq_buf = {
-  .seq_mutex = PTHREAD_MUTEX_INITIALIZER,
-};
+} ipmb_seq_buf;
 
+// Held for a single transfer, not across retries
 static pthread_mutex_t i2c_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Read-only commands for which identical requests in flight share one bus
+// transaction. With a ttl the response is also served from cache.
+typedef struct {
+  uint8_t netfn;
+  uint8_t cmd;
+  uint32_t ttl_ms;
+} shared_cmd_t;
+
+#define MAX_SHARED_CMDS 32
+static shared_cmd_t shared_cmds[MAX_SHARED_CMDS] = {
+  {NETFN_APP_REQ, CMD_APP_GET_DEVICE_ID, 0},
+  {NETFN_APP_REQ, CMD_APP_GET_SELFTEST_RESULTS, 0},
+  {NETFN_APP_REQ, CMD_APP_GET_DEVICE_GUID, 0},
+  {NETFN_SENSOR_REQ, CMD_SENSOR_GET_SENSOR_READING, 0},
+};
+static int num_shared_cmds = 4;
+
+// Requests with more data are never shared
+#define SHARE_KEY_MAX   32
+#define SHARE_ENTRY_MAX 32
+
+typedef struct {
+  bool used;
+  bool pending; // the bus transaction is in flight
+  uint8_t key[SHARE_KEY_MAX]; // rsSA, NetFn, Cmd, Data
+  uint8_t key_len;
+  uint8_t res[UCHAR_MAX];
+  uint8_t res_len;
+  uint32_t gen; // bumped every time a transaction completes
+  int waiters;
+  uint64_t expire_ms; // cached response valid until, 0: not cached
+  pthread_cond_t cond;
+} share_entry_t;
+
+static pthread_mutex_t share_mutex = PTHREAD_MUTEX_INITIALIZER;
+static share_entry_t share_entries[SHARE_ENTRY_MAX];
+
+// Latency histogram bucket n counts [2^n, 2^(n+1)) usec, bucket 0 [0, 2)
+#define STATS_HIST_BUCKETS 24
+#define STATS_CMD_MAX 64
+
+typedef struct {
+  uint32_t key; // STATS_CMD_KEY(), 0 if unused
+  uint64_t count;
+  uint64_t timeouts;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t hist[STATS_HIST_BUCKETS];
+} cmd_stats_t;
+
+#define STATS_CMD_KEY(netfn, cmd) (0x10000 | ((netfn) << 8) | (cmd))
+
+// Per bus statistics, all counters are updated atomically
+static struct {
+  uint64_t start_ms;
+  // requests from clients sent out on the bus
+  uint64_t tx_req;
+  uint64_t rx_res;
+  uint64_t timeouts;
+  uint64_t unmatched; // responses nobody was waiting for
+  uint64_t shared;    // answered by a request already in flight
+  uint64_t cached;    // answered from cache
+  uint64_t inflight_max;
+  // requests from the bus handled by the BMC
+  uint64_t rx_req;
+  uint64_t tx_res;
+  uint64_t mq_cur;
+  uint64_t mq_max;
+  uint64_t mq_drops;
+  // errors
+  uint64_t bad_len;
+  uint64_t hdr_cksum;
+  uint64_t data_cksum;
+  uint64_t i2c_retries;
+  uint64_t i2c_errors;
+  cmd_stats_t cmds[STATS_CMD_MAX];
+} ipmb_stats;
+
+#define STATS_INC(_f) __atomic_fetch_add(&ipmb_stats._f, 1, __ATOMIC_RELAXED)
+#define STATS_ADD(_f, _v) __atomic_fetch_add(&ipmb_stats._f, (_v), __ATOMIC_RELAXED)
+#define STATS_GET(_f) __atomic_load_n(&ipmb_stats._f, __ATOMIC_RELAXED)
+
+static void
+stats_set_max(uint64_t *max, uint64_t val) {
+  uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+  while (val > cur &&
+         !__atomic_compare_exchange_n(max, &cur, val, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
 static struct {
   int bus_id;
   int payload_id;
@@ -189,74 +290,116 @@ calc_cksum(uint8_t *buf, uint8_t len) {
 
 static void ipmb_seq_buf_init(void) {
   int i;
+  ipmb_seq_buf.map = 0;
+  ipmb_seq_buf.curr_seq = 0;
   for (i = 0; i < ARRAY_SIZE(ipmb_seq_buf.seq); i++) {
-    ipmb_seq_buf.seq[i].in_use = false;
+    ipmb_seq_buf.seq[i].state = SEQ_FREE;
     assert(sem_init(&ipmb_seq_buf.seq[i].seq_sem, 0, 0) == 0);
     ipmb_seq_buf.seq[i].len = 0;
     ipmb_seq_buf.seq[i].p_buf = NULL;
   }
 }
 
+// Deliver a response straight in to the buffer of the request waiting on seq
 static int seq_put(uint8_t seq, uint8_t *buf, uint8_t len)
 {
   seq_buf_t *s;
-  int rc = -1;
+  uint8_t state = SEQ_WAIT;
 
   if (seq >= ARRAY_SIZE(ipmb_seq_buf.seq)) {
     return -1;
   }
   // Check if the response is being waited for
-  pthread_mutex_lock(&ipmb_seq_buf.seq_mutex);
   s = &ipmb_seq_buf.seq[seq];
-  if (s->in_use && s->p_buf) {
-    // Copy the response to the requester's buffer
-    memcpy(s->p_buf, buf, len);
-    s->len = len;
-
-    // Wake up the worker thread to receive the response
-    sem_post(&s->seq_sem);
-    rc = 0;
+  if (!__atomic_compare_exchange_n(&s->state, &state, SEQ_FILL, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    return -1;
   }
-  pthread_mutex_unlock(&ipmb_seq_buf.seq_mutex);
-  return rc;
+
+  // Copy the response to the requester's buffer
+  memcpy(s->p_buf, buf, len);
+  s->len = len;
+  __atomic_store_n(&s->state, SEQ_DONE, __ATOMIC_RELEASE);
+
+  // Wake up the worker thread to receive the response
+  sem_post(&s->seq_sem);
+  return 0;
 }
 
 // Returns an unused seq# from all possible seq#
 static int8_t
 seq_get_new(unsigned char *resp) {
-  int8_t ret = -1;
-  uint8_t index;
-
-  pthread_mutex_lock(&ipmb_seq_buf.seq_mutex);
+  uint64_t map, avail;
+  uint8_t start, index;
+  seq_buf_t *s;
 
-  // Search for unused sequence number
-  index = ipmb_seq_buf.curr_seq;
+  start = __atomic_load_n(&ipmb_seq_buf.curr_seq, __ATOMIC_RELAXED);
+  map = __atomic_load_n(&ipmb_seq_buf.map, __ATOMIC_RELAXED);
   do {
-    if (!ipmb_seq_buf.seq[index].in_use) {
-      // Found it!
-      ret = index;
-      ipmb_seq_buf.seq[index].in_use = true;
-      ipmb_seq_buf.seq[index].len = 0;
-      ipmb_seq_buf.seq[index].p_buf = resp;
-      break;
+    avail = ~map & (~0ULL >> (64 - SEQ_NUM_MAX));
+    if (avail == 0) {
+      return -1;
     }
-
-    if (++index == ARRAY_SIZE(ipmb_seq_buf.seq)) {
-      index = 0;
+    // First unused seq# at or after the current one, wrapping around
+    if (avail >> start) {
+      index = start + __builtin_ctzll(avail >> start);
+    } else {
+      index = __builtin_ctzll(avail);
     }
-  } while (index != ipmb_seq_buf.curr_seq);
+  } while (!__atomic_compare_exchange_n(&ipmb_seq_buf.map, &map, map | (1ULL << index),
+                                        true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
 
   // Update the current seq num
-  if (ret >= 0) {
-    if (++index == ARRAY_SIZE(ipmb_seq_buf.seq)) {
-      index = 0;
-    }
-    ipmb_seq_buf.curr_seq = index;
-  }
+  __atomic_store_n(&ipmb_seq_buf.curr_seq, (index + 1) % SEQ_NUM_MAX, __ATOMIC_RELAXED);
+  stats_set_max(&ipmb_stats.inflight_max, __builtin_popcountll(map | (1ULL << index)));
 
-  pthread_mutex_unlock(&ipmb_seq_buf.seq_mutex);
+  s = &ipmb_seq_buf.seq[index];
+  s->len = 0;
+  s->p_buf = resp;
+  __atomic_store_n(&s->state, SEQ_WAIT, __ATOMIC_RELEASE);
+
+  return index;
+}
+
+// Wait up to timeout seconds (0: do not wait) for the response on seq#,
+// release the seq# and return the response length
+static uint8_t
+seq_release(uint8_t index, int timeout) {
+  seq_buf_t *s = &ipmb_seq_buf.seq[index];
+  struct timespec ts;
+  uint8_t state = SEQ_WAIT;
+  uint8_t len = 0;
+  int ret = -1;
+
+  if (timeout > 0) {
+    // Wait on semaphore for that sequence Number
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout;
+    while ((ret = sem_timedwait(&s->seq_sem, &ts)) == -1 && errno == EINTR)
+      ;
+  }
 
-  return ret;
+  if (ret == -1) {
+    if (__atomic_compare_exchange_n(&s->state, &state, SEQ_FREE, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      IPMBD_VERBOSE("No response for sequence number: %d\n", index);
+      if (timeout > 0) {
+        STATS_INC(timeouts);
+      }
+      goto release;
+    }
+    // The response raced with the timeout, it is posted right away
+    while (sem_wait(&s->seq_sem) == -1 && errno == EINTR)
+      ;
+  }
+  len = s->len;
+  STATS_INC(rx_res);
+
+release:
+  s->p_buf = NULL;
+  __atomic_store_n(&s->state, SEQ_FREE, __ATOMIC_RELEASE);
+  __atomic_fetch_and(&ipmb_seq_buf.map, ~(1ULL << index), __ATOMIC_RELEASE);
+  return len;
 }
 
 static int
@@ -276,16 +419,21 @@ ipmb_write_satellite(int fd, uint8_t *buf, uint16_t len) {
   data.msgs = &msg;
   data.nmsgs = 1;
 
-  pthread_mutex_lock(&i2c_mutex);
-  while ((rc = ioctl(fd, I2C_RDWR, &data)) < 0 &&
-         ++i < I2C_RETRIES_MAX) {
+  while (1) {
+    pthread_mutex_lock(&i2c_mutex);
+    rc = ioctl(fd, I2C_RDWR, &data);
+    pthread_mutex_unlock(&i2c_mutex);
+    if (rc >= 0 || ++i >= I2C_RETRIES_MAX) {
+      break;
+    }
+    STATS_INC(i2c_retries);
     msleep(I2C_RETRY_DELAY);
   }
   if (rc < 0) {
+    STATS_INC(i2c_errors);
     OBMC_ERROR(errno, "Failed to send %u bytes to device @%#x",
                len, msg.addr);
   }
-  pthread_mutex_unlock(&i2c_mutex);
 
   return (rc < 0 ? -1 : 0);
 }
@@ -346,6 +494,7 @@ ipmb_req_handler(void *args) {
       continue;
     }
     REQ_VERBOSE("received %d bytes from message queue", rlen);
+    STATS_INC(rx_req);
 
     if (ipmbd_config.bic_update_enabled) {
       continue;
@@ -427,58 +576,10 @@ ipmb_req_handler(void *args) {
     }
 #endif
     // Send response back
-    ipmb_write_satellite(fd, txbuf, txlen);
-    pal_ipmb_finished(bus_num, txbuf, txlen);
-  }
-}
-
-// Thread to handle the incoming responses
-static void*
-ipmb_res_handler(void *args) {
-  int bus_num = *((int*)args);
-  uint8_t buf[IPMB_PKT_MAX_SIZE] = { 0 };
-  uint8_t len = 0;
-  mqd_t mq;
-  ipmb_res_t *p_res;
-  uint8_t index;
-  char mq_name_res[NAME_MAX];
-
-  RES_VERBOSE("thread starts execution");
-
-  // Open the message queue
-  ipc_name_gen(mq_name_res, sizeof(mq_name_res), MQ_IPMB_RES, bus_num);
-  mq = mq_open(mq_name_res, O_RDONLY);
-  if (mq == MQ_DESC_INVALID) {
-    OBMC_ERROR(errno, "failed to open message queue %s", mq_name_res);
-    return NULL;
-  }
-
-  // Loop to wait for incomng response messages
-  while (1) {
-    if ((len = mq_receive(mq, (char *)buf, IPMB_PKT_MAX_SIZE, NULL)) <= 0) {
-      sleep(1);
-      continue;
+    if (ipmb_write_satellite(fd, txbuf, txlen) == 0) {
+      STATS_INC(tx_res);
     }
-    RES_VERBOSE("received %d bytes from message queue", len);
-
-    p_res = (ipmb_res_t *) buf;
-
-    // Check the seq# of response
-    index = p_res->seq_lun >> LUN_OFFSET;
-
-    if (seq_put(index, buf, len)) {
-      // Either the IPMB packet is corrupted or arrived late after client exits
-      OBMC_WARN("%s: WRONG packet received with seq #%d\n",
-                IPMBD_RES_THREAD, index);
-    }
-
-#ifdef DEBUG
-    syslog(LOG_WARNING, "Received Response of %d bytes\n", len);
-    int i;
-    for (i = 0; i < len; i++) {
-      syslog(LOG_WARNING, "0x%X:", buf[i]);
-    }
-#endif
+    pal_ipmb_finished(bus_num, txbuf, txlen);
   }
 }
 
@@ -515,12 +616,12 @@ static void*
 ipmb_rx_handler(void *args) {
   i2c_mslave_t *bmc_slave;
   mqd_t mq_req = MQ_DESC_INVALID;
-  mqd_t mq_res = MQ_DESC_INVALID;
+  struct mq_attr mq_attr;
   struct timespec req = {
     .tv_sec = 0,
     .tv_nsec = 10000000, //10mSec
   };
-  char mq_name_req[NAME_MAX], mq_name_res[NAME_MAX];
+  char mq_name_req[NAME_MAX];
   int bus_num = *((int*)args);
   uint16_t addr=0;
   int ret=0;
@@ -556,20 +657,11 @@ ipmb_rx_handler(void *args) {
   }
   RX_VERBOSE("message queue %s opened", mq_name_req);
 
-  ipc_name_gen(mq_name_res, sizeof(mq_name_res), MQ_IPMB_RES, bus_num);
-  mq_res = mq_open(mq_name_res, O_WRONLY);
-  if (mq_res == MQ_DESC_INVALID) {
-    OBMC_ERROR(errno, "%s: failed to open message queue %s",
-               IPMBD_RX_THREAD, mq_name_res);
-    goto cleanup;
-  }
-  RX_VERBOSE("message queue %s opened", mq_name_res);
-
   // Loop that retrieves messages
   while (1) {
     int ret;
     ipmb_req_t *p_req;
-    uint8_t len, tlun, fbyte;
+    uint8_t len, tlun, fbyte, index;
     uint8_t buf[IPMB_PKT_MAX_SIZE], tbuf[IPMB_PKT_MAX_SIZE];
 
     // Read messages from i2c driver
@@ -590,6 +682,7 @@ ipmb_rx_handler(void *args) {
 
     if (len < IPMB_PKT_MIN_SIZE) {
       OBMC_WARN("%s: IPMB Packet invalid size %d", IPMBD_RX_THREAD, len);
+      STATS_INC(bad_len);
       continue;
     }
 
@@ -617,11 +710,13 @@ ipmb_rx_handler(void *args) {
           if (buf[2] != calc_cksum(buf,2)) {
             OBMC_WARN("%s: IPMB Header cksum error after fixup",
                       IPMBD_RX_THREAD);
+            STATS_INC(hdr_cksum);
             continue;
           }
         }
       } else {
           OBMC_WARN("%s: IPMB Header cksum does not match", IPMBD_RX_THREAD);
+          STATS_INC(hdr_cksum);
           continue;
       }
     }
@@ -629,22 +724,36 @@ ipmb_rx_handler(void *args) {
     // Verify the IPMB data cksum: data starts from 4-th byte
     if (buf[len-1] != calc_cksum(&buf[3], len-4)) {
       OBMC_WARN("%s: IPMB Data cksum does not match\n", IPMBD_RX_THREAD);
+      STATS_INC(data_cksum);
       continue;
     }
 
     // Check if the messages is request or response
     // Even NetFn: Request, Odd NetFn: Response
-    // Post message to approriate Queue for further processing
+    // Responses go straight to the waiting requester, requests are posted
+    // to the request Queue for further processing
     p_req = (ipmb_req_t*)buf;
     tlun = p_req->netfn_lun >> LUN_OFFSET;
     if (tlun % 2) {
-      RX_VERBOSE("sending packet to %s", mq_name_res);
-      ret = mq_timedsend(mq_res, (char *)buf, len, 0, &req);
-    } else {
-      RX_VERBOSE("sending packet to %s", mq_name_req);
-      ret = mq_timedsend(mq_req, (char *)buf, len, 0, &req);
+      index = p_req->seq_lun >> LUN_OFFSET;
+      RX_VERBOSE("delivering response with seq #%d", index);
+      if (seq_put(index, buf, len)) {
+        // Either the IPMB packet is corrupted or arrived late after client exits
+        OBMC_WARN("%s: WRONG packet received with seq #%d\n",
+                  IPMBD_RX_THREAD, index);
+        STATS_INC(unmatched);
+      }
+      continue;
+    }
+
+    RX_VERBOSE("sending packet to %s", mq_name_req);
+    ret = mq_timedsend(mq_req, (char *)buf, len, 0, &req);
+    if (mq_getattr(mq_req, &mq_attr) == 0) {
+      __atomic_store_n(&ipmb_stats.mq_cur, mq_attr.mq_curmsgs, __ATOMIC_RELAXED);
+      stats_set_max(&ipmb_stats.mq_max, mq_attr.mq_curmsgs);
     }
     if (ret != 0) {
+      STATS_INC(mq_drops);
       //syslog(LOG_WARNING, "mq_send failed for queue %d\n", tmq);
       msleep(10);
       continue;
@@ -659,11 +768,53 @@ cleanup:
   if (mq_req != MQ_DESC_INVALID) {
     mq_close(mq_req);
   }
+  return NULL;
+}
 
-  if (mq_res != MQ_DESC_INVALID) {
-    mq_close(mq_req);
+static uint64_t
+stats_now_us(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+stats_record_cmd(uint8_t netfn, uint8_t cmd, uint64_t us, bool timed_out) {
+  uint32_t key = STATS_CMD_KEY(netfn, cmd), cur;
+  cmd_stats_t *cs = NULL;
+  int i, bucket;
+
+  for (i = 0; i < STATS_CMD_MAX; i++) {
+    cur = __atomic_load_n(&ipmb_stats.cmds[i].key, __ATOMIC_ACQUIRE);
+    if (cur == 0) {
+      if (__atomic_compare_exchange_n(&ipmb_stats.cmds[i].key, &cur, key, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        cur = key;
+      }
+    }
+    if (cur == key) {
+      cs = &ipmb_stats.cmds[i];
+      break;
+    }
   }
-  return NULL;
+  if (cs == NULL) {
+    // Out of slots, only the bus totals count this one
+    return;
+  }
+
+  __atomic_fetch_add(&cs->count, 1, __ATOMIC_RELAXED);
+  if (timed_out) {
+    __atomic_fetch_add(&cs->timeouts, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  bucket = 63 - __builtin_clzll(us | 1);
+  if (bucket >= STATS_HIST_BUCKETS) {
+    bucket = STATS_HIST_BUCKETS - 1;
+  }
+  __atomic_fetch_add(&cs->hist[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&cs->total_us, us, __ATOMIC_RELAXED);
+  stats_set_max(&cs->max_us, us);
 }
 
 /*
@@ -676,18 +827,20 @@ ipmb_handle (int fd, unsigned char *request, unsigned short req_len,
   ipmb_req_t *req = (ipmb_req_t *) request;
   int i, ret;
   int8_t index;
-  struct timespec ts;
+  int timeout = 0;
+  uint64_t start_us = 0;
   uint16_t addr=0;
 
-  // Allocate right sequence Number
-  index = seq_get_new(response);
-  if (index < 0) {
+  ret = pal_get_bmc_ipmb_slave_addr(&addr, ipmbd_config.bus_id);
+  if (ret < 0) {
     *res_len = 0;
     return ;
   }
 
-  ret = pal_get_bmc_ipmb_slave_addr(&addr, ipmbd_config.bus_id);
-  if (ret < 0) {
+  // Allocate right sequence Number
+  index = seq_get_new(response);
+  if (index < 0) {
+    *res_len = 0;
     return ;
   }
 #ifdef DEBUG
@@ -715,40 +868,293 @@ ipmb_handle (int fd, unsigned char *request, unsigned short req_len,
   }
 
   // Send request over i2c bus
+  start_us = stats_now_us();
   if (ipmb_write_satellite(fd, request, req_len)) {
     goto ipmb_handle_out;
   }
+  STATS_INC(tx_req);
+  timeout = TIMEOUT_IPMB;
+
+ipmb_handle_out:
+  // Reply to user with data, the response is already in its buffer
+  *res_len = seq_release(index, timeout);
+  if (timeout) {
+    stats_record_cmd(req->netfn_lun >> LUN_OFFSET, req->cmd,
+                     stats_now_us() - start_us, *res_len == 0);
+  }
 
-  // Wait on semaphore for that sequence Number
-  clock_gettime(CLOCK_REALTIME, &ts);
+  pal_ipmb_finished(ipmbd_config.bus_id, request, *res_len);
 
-  ts.tv_sec += TIMEOUT_IPMB;
+  return;
+}
 
-  ret = sem_timedwait(&ipmb_seq_buf.seq[index].seq_sem, &ts);
-  if (ret == -1) {
-    IPMBD_VERBOSE("No response for sequence number: %d\n", index);
-    *res_len = 0;
+
+static uint64_t
+share_now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static shared_cmd_t *
+shared_cmd_find(uint8_t netfn, uint8_t cmd) {
+  int i;
+
+  for (i = 0; i < num_shared_cmds; i++) {
+    if (shared_cmds[i].netfn == netfn && shared_cmds[i].cmd == cmd) {
+      return &shared_cmds[i];
+    }
   }
+  return NULL;
+}
 
-ipmb_handle_out:
-  // Reply to user with data
-  pthread_mutex_lock(&ipmb_seq_buf.seq_mutex);
-  *res_len = ipmb_seq_buf.seq[index].len;
+// Add or update a shared command, "<netfn>:<cmd>[:<ttl-ms>]"
+static int
+shared_cmd_add(const char *spec) {
+  unsigned long netfn, cmd, ttl = 0;
+  shared_cmd_t *sc;
+  char *end;
 
-  ipmb_seq_buf.seq[index].in_use = false;
-  ipmb_seq_buf.seq[index].p_buf = NULL;
-  pthread_mutex_unlock(&ipmb_seq_buf.seq_mutex);
+  netfn = strtoul(spec, &end, 0);
+  if (*end != ':' || netfn > 0x3f) {
+    return -1;
+  }
+  cmd = strtoul(end + 1, &end, 0);
+  if ((*end != ':' && *end != '\0') || cmd > 0xff) {
+    return -1;
+  }
+  if (*end == ':') {
+    ttl = strtoul(end + 1, &end, 0);
+    if (*end != '\0') {
+      return -1;
+    }
+  }
 
-  pal_ipmb_finished(ipmbd_config.bus_id, request, *res_len);
+  sc = shared_cmd_find(netfn, cmd);
+  if (sc == NULL) {
+    if (num_shared_cmds == MAX_SHARED_CMDS) {
+      return -1;
+    }
+    sc = &shared_cmds[num_shared_cmds++];
+    sc->netfn = netfn;
+    sc->cmd = cmd;
+  }
+  sc->ttl_ms = ttl;
+  return 0;
+}
 
-  return;
+static void
+share_init(void) {
+  int i;
+
+  for (i = 0; i < SHARE_ENTRY_MAX; i++) {
+    pthread_cond_init(&share_entries[i].cond, NULL);
+  }
+}
+
+// Called with share_mutex held
+static share_entry_t *
+share_get(uint8_t *key, uint8_t key_len, uint64_t now) {
+  share_entry_t *e, *free_e = NULL;
+  int i;
+
+  for (i = 0; i < SHARE_ENTRY_MAX; i++) {
+    e = &share_entries[i];
+    if (e->used && e->key_len == key_len && !memcmp(e->key, key, key_len)) {
+      return e;
+    }
+    // Drop expired cache entries nobody is using
+    if (e->used && !e->pending && !e->waiters && e->expire_ms <= now) {
+      e->used = false;
+    }
+    if (!e->used && free_e == NULL) {
+      free_e = e;
+    }
+  }
+
+  if (free_e != NULL) {
+    free_e->used = true;
+    free_e->pending = false;
+    free_e->waiters = 0;
+    free_e->expire_ms = 0;
+    free_e->res_len = 0;
+    memcpy(free_e->key, key, key_len);
+    free_e->key_len = key_len;
+  }
+  return free_e;
 }
 
+/*
+ * ipmb_handle() for shared commands: the first of identical requests goes
+ * out on the bus, the ones arriving while it is in flight wait for and
+ * get a copy of its response. Responses of commands with a ttl are kept
+ * and returned without any bus transaction until they expire.
+ */
+static void
+ipmb_handle_shared(int fd, unsigned char *request, unsigned short req_len,
+                   unsigned char *response, unsigned char *res_len)
+{
+  ipmb_req_t *req = (ipmb_req_t *) request;
+  uint8_t key[SHARE_KEY_MAX];
+  int data_len = req_len - (int)offsetof(ipmb_req_t, data) - 1;
+  shared_cmd_t *sc;
+  share_entry_t *e;
+  uint32_t gen;
+  uint64_t now;
+
+  sc = shared_cmd_find(req->netfn_lun >> LUN_OFFSET, req->cmd);
+  if (sc == NULL || data_len < 0 || data_len + 3 > SHARE_KEY_MAX) {
+    ipmb_handle(fd, request, req_len, response, res_len);
+    return;
+  }
+
+  key[0] = req->res_slave_addr;
+  key[1] = req->netfn_lun;
+  key[2] = req->cmd;
+  memcpy(&key[3], req->data, data_len);
+
+  pthread_mutex_lock(&share_mutex);
+  now = share_now_ms();
+  e = share_get(key, data_len + 3, now);
+  if (e == NULL) {
+    // Too many distinct requests in flight, just send it
+    pthread_mutex_unlock(&share_mutex);
+    ipmb_handle(fd, request, req_len, response, res_len);
+    return;
+  }
+
+  if (e->pending || e->expire_ms > now) {
+    if (!e->pending) {
+      STATS_INC(cached);
+    } else {
+      STATS_INC(shared);
+      gen = e->gen;
+      e->waiters++;
+      while (e->gen == gen) {
+        pthread_cond_wait(&e->cond, &share_mutex);
+      }
+      e->waiters--;
+    }
+    memcpy(response, e->res, e->res_len);
+    *res_len = e->res_len;
+    if (!e->pending && !e->waiters && e->expire_ms <= share_now_ms()) {
+      e->used = false;
+    }
+    pthread_mutex_unlock(&share_mutex);
+    return;
+  }
+
+  e->pending = true;
+  pthread_mutex_unlock(&share_mutex);
+
+  ipmb_handle(fd, request, req_len, response, res_len);
+
+  pthread_mutex_lock(&share_mutex);
+  memcpy(e->res, response, *res_len);
+  e->res_len = *res_len;
+  e->pending = false;
+  e->gen++;
+  // Only cache complete responses with a successful completion code
+  e->expire_ms = 0;
+  if (sc->ttl_ms && *res_len >= MIN_IPMB_RES_LEN &&
+      ((ipmb_res_t *)response)->cc == CC_SUCCESS) {
+    e->expire_ms = share_now_ms() + sc->ttl_ms;
+  }
+  if (e->waiters) {
+    pthread_cond_broadcast(&e->cond);
+  } else if (!e->expire_ms) {
+    e->used = false;
+  }
+  pthread_mutex_unlock(&share_mutex);
+}
 
 struct ipmb_svc_cookie {
   int i2c_fd;
 };
 
+#define JSON_APPEND(_buf, _size, _len, ...)                           \
+  do {                                                                \
+    if ((_len) < (_size))                                             \
+      (_len) += snprintf((_buf) + (_len), (_size) - (_len), __VA_ARGS__); \
+  } while (0)
+
+// Largest output of stats_json(): the bus totals and one entry per
+// tracked command, with every counter at 20 digits
+#define STATS_JSON_U64_LEN 20
+#define STATS_JSON_BUS_LEN 1024
+#define STATS_JSON_CMD_LEN (192 + STATS_HIST_BUCKETS * (STATS_JSON_U64_LEN + 2))
+#define STATS_JSON_MAX_LEN (STATS_JSON_BUS_LEN + STATS_CMD_MAX * STATS_JSON_CMD_LEN)
+
+_Static_assert(STATS_JSON_MAX_LEN <= MAX_IPMB_STATS_LEN,
+               "MAX_IPMB_STATS_LEN does not fit the bus statistics");
+
+// Statistics of this bus as JSON. Counters are totals since start,
+// clients get rates from the difference of two queries over uptime_ms.
+// Returns the length including the terminating NUL, -1 if buf is too
+// small.
+static int
+stats_json(char *buf, size_t size) {
+  uint64_t now = share_now_ms(), count;
+  cmd_stats_t *cs;
+  size_t len = 0;
+  int i, j, n;
+
+  JSON_APPEND(buf, size, len,
+    "{\"bus\": %d, \"uptime_ms\": %llu, ",
+    ipmbd_config.bus_id, (unsigned long long)(now - ipmb_stats.start_ms));
+  JSON_APPEND(buf, size, len,
+    "\"requests\": {\"sent\": %llu, \"responses\": %llu, \"timeouts\": %llu, "
+    "\"unmatched_responses\": %llu, \"shared\": %llu, \"cached\": %llu, "
+    "\"in_flight\": %d, \"max_in_flight\": %llu}, ",
+    (unsigned long long)STATS_GET(tx_req), (unsigned long long)STATS_GET(rx_res),
+    (unsigned long long)STATS_GET(timeouts), (unsigned long long)STATS_GET(unmatched),
+    (unsigned long long)STATS_GET(shared), (unsigned long long)STATS_GET(cached),
+    __builtin_popcountll(__atomic_load_n(&ipmb_seq_buf.map, __ATOMIC_RELAXED)),
+    (unsigned long long)STATS_GET(inflight_max));
+  JSON_APPEND(buf, size, len,
+    "\"bus_requests\": {\"received\": %llu, \"responses\": %llu, "
+    "\"queue\": %llu, \"max_queue\": %llu, \"queue_size\": %d, \"queue_drops\": %llu}, ",
+    (unsigned long long)STATS_GET(rx_req), (unsigned long long)STATS_GET(tx_res),
+    (unsigned long long)STATS_GET(mq_cur), (unsigned long long)STATS_GET(mq_max),
+    MQ_MAX_NUM_MSGS, (unsigned long long)STATS_GET(mq_drops));
+
+  JSON_APPEND(buf, size, len,
+    "\"errors\": {\"bad_length\": %llu, \"hdr_cksum\": %llu, \"data_cksum\": %llu, "
+    "\"i2c_retries\": %llu, \"i2c_failures\": %llu}, \"commands\": [",
+    (unsigned long long)STATS_GET(bad_len), (unsigned long long)STATS_GET(hdr_cksum),
+    (unsigned long long)STATS_GET(data_cksum), (unsigned long long)STATS_GET(i2c_retries),
+    (unsigned long long)STATS_GET(i2c_errors));
+
+  for (i = 0, n = 0; i < STATS_CMD_MAX; i++) {
+    cs = &ipmb_stats.cmds[i];
+    if (__atomic_load_n(&cs->key, __ATOMIC_ACQUIRE) == 0) {
+      break;
+    }
+    count = __atomic_load_n(&cs->count, __ATOMIC_RELAXED);
+    JSON_APPEND(buf, size, len,
+      "%s{\"netfn\": %u, \"cmd\": %u, \"count\": %llu, \"timeouts\": %llu, "
+      "\"avg_us\": %llu, \"max_us\": %llu, \"hist\": [",
+      n++ ? ", " : "", (cs->key >> 8) & 0xff, cs->key & 0xff,
+      (unsigned long long)count, (unsigned long long)cs->timeouts,
+      (unsigned long long)(count > cs->timeouts ?
+                           cs->total_us / (count - cs->timeouts) : 0),
+      (unsigned long long)cs->max_us);
+    for (j = 0; j < STATS_HIST_BUCKETS; j++) {
+      JSON_APPEND(buf, size, len, "%s%llu", j ? ", " : "",
+                  (unsigned long long)cs->hist[j]);
+    }
+    JSON_APPEND(buf, size, len, "]}");
+  }
+  JSON_APPEND(buf, size, len, "]}");
+
+  if (len >= size) {
+    syslog(LOG_WARNING, "%s: statistics truncated at %zu bytes", __func__, size);
+    return -1;
+  }
+  return len + 1;
+}
+
 static int
 conn_handler(client_t *cli) {
   struct ipmb_svc_cookie *svc = (struct ipmb_svc_cookie *)cli->svc_cookie;
@@ -776,6 +1182,20 @@ conn_handler(client_t *cli) {
     return 0;
   }
 
+  if (req_len == IPMB_STATS_LEN) {
+    char *stats = malloc(MAX_IPMB_STATS_LEN);
+    int rc = -1, len;
+
+    if (stats != NULL) {
+      len = stats_json(stats, MAX_IPMB_STATS_LEN);
+      if (len > 0) {
+        rc = ipc_send_resp(cli, (uint8_t *)stats, len);
+      }
+      free(stats);
+    }
+    return rc;
+  }
+
   if(ipmbd_config.bic_update_enabled) {
     if(!((req_buf[1] == 0xe0) &&
         (req_buf[5] == CMD_OEM_1S_ENABLE_BIC_UPDATE))) {
@@ -783,8 +1203,8 @@ conn_handler(client_t *cli) {
     }
   }
 
-  ipmb_handle(svc->i2c_fd, req_buf,
-              (unsigned int)req_len, res_buf, &res_len);
+  ipmb_handle_shared(svc->i2c_fd, req_buf,
+                     (unsigned int)req_len, res_buf, &res_len);
 
   if(ipc_send_resp(cli, res_buf, res_len) != 0) {
     OBMC_ERROR(errno, "%s: ipc_send_resp() failed", IPMBD_SVC_THREAD);
@@ -798,6 +1218,12 @@ conn_handler(client_t *cli) {
 static int
 start_ipmb_lib_handler(int bus_num) {
   char sock_path[64];
+  // Every worker can wait on an outstanding sequence number
+  ipc_svc_attr_t svc_attr = {
+    .num_workers = SEQ_NUM_MAX,
+    .max_pending = SEQ_NUM_MAX,
+    .max_req_len = MAX_IPMB_REQ_LEN,
+  };
   struct ipmb_svc_cookie *svc = calloc(1, sizeof(*svc));
   if (!svc) {
     OBMC_ERROR(errno, "failed to allocate svc cookie");
@@ -813,7 +1239,7 @@ start_ipmb_lib_handler(int bus_num) {
   IPMBD_VERBOSE("bic opened successfully, fd=%d", svc->i2c_fd);
 
   ipc_name_gen(sock_path, sizeof(sock_path), SOCK_PATH_IPMB, bus_num);
-  if (ipc_start_svc(sock_path, conn_handler, SEQ_NUM_MAX, svc, NULL)) {
+  if (ipc_start_svc_pool(sock_path, conn_handler, &svc_attr, svc, NULL)) {
     OBMC_ERROR(errno, "failed to start svc thread");
     free(svc);
     return -1;
@@ -833,6 +1259,8 @@ dump_usage(const char *prog_name)
     {"-h|--help", "print this help message"},
     {"-v|--verbose", "enable verbose logging"},
     {"-u|--enable-bic-update", "enable/allow bic update"},
+    {"-c|--cache <netfn>:<cmd>[:<ttl-ms>]",
+     "share identical requests in flight, cache responses for ttl-ms"},
     {NULL, NULL},
   };
 
@@ -840,6 +1268,11 @@ dump_usage(const char *prog_name)
   for (i = 0; options[i].opt != NULL; i++) {
     printf("    %-24s - %s\n", options[i].opt, options[i].desc);
   }
+  printf("Requests shared by default:");
+  for (i = 0; i < num_shared_cmds; i++) {
+    printf(" %#x:%#x", shared_cmds[i].netfn, shared_cmds[i].cmd);
+  }
+  printf("\n");
 }
 
 static int
@@ -849,12 +1282,13 @@ parse_cmdline_args(int argc, char* const argv[])
     {"help",              no_argument, NULL, 'h'},
     {"verbose",           no_argument, NULL, 'v'},
     {"enable-bic-update", no_argument, NULL, 'u'},
+    {"cache",             required_argument, NULL, 'c'},
     {NULL,               0,           NULL, 0},
   };
 
   while (1) {
     int opt_index = 0;
-    int ret = getopt_long(argc, argv, "hvu", long_opts, &opt_index);
+    int ret = getopt_long(argc, argv, "hvuc:", long_opts, &opt_index);
     if (ret == -1)
       break; /* end of arguments */
 
@@ -871,6 +1305,14 @@ parse_cmdline_args(int argc, char* const argv[])
       ipmbd_config.bic_update_enabled = true;
       break;
 
+    case 'c':
+      if (shared_cmd_add(optarg) != 0) {
+        fprintf(stderr, "Error: invalid cache entry %s\n\n", optarg);
+        dump_usage(argv[0]);
+        return -1;
+      }
+      break;
+
     default:
       return -1;
     }
@@ -892,15 +1334,14 @@ int
 main(int argc, char * const argv[]) {
   int i, rc = 0;
   mqd_t mqd_req = MQ_DESC_INVALID;
-  mqd_t mqd_res = MQ_DESC_INVALID;
   struct mq_attr attr = MQ_DFT_ATTR_INITIALIZER;
-  char mq_name_req[NAME_MAX], mq_name_res[NAME_MAX];
+  char mq_name_req[NAME_MAX];
   struct {
     const char *name;
     void* (*handler)(void *args);
     bool initialized;
     pthread_t tid;
-  } ipmb_threads[3] = {
+  } ipmb_threads[2] = {
     {
       .name = IPMBD_RX_THREAD,
       .handler = ipmb_rx_handler,
@@ -911,11 +1352,6 @@ main(int argc, char * const argv[]) {
       .handler = ipmb_req_handler,
       .initialized = false,
     },
-    {
-      .name = IPMBD_RES_THREAD,
-      .handler = ipmb_res_handler,
-      .initialized = false,
-    },
   };
 
   /*
@@ -962,18 +1398,9 @@ main(int argc, char * const argv[]) {
   }
   IPMBD_VERBOSE("message queue %s created", mq_name_req);
 
-  ipc_name_gen(mq_name_res, sizeof(mq_name_res),
-               MQ_IPMB_RES, ipmbd_config.bus_id);
-  mq_unlink(mq_name_res);
-  mqd_res = mq_open(mq_name_res, MQ_DFT_FLAGS, MQ_DFT_MODES, &attr);
-  if (mqd_res == MQ_DESC_INVALID) {
-    rc = errno;
-    OBMC_ERROR(rc, "failed to open message queue %s", mq_name_res);
-    goto cleanup;
-  }
-  IPMBD_VERBOSE("message queue %s created", mq_name_res);
-
+  ipmb_stats.start_ms = share_now_ms();
   ipmb_seq_buf_init();
+  share_init();
   IPMBD_VERBOSE("sequence buffer initialized");
 
   for (i = 0; i < ARRAY_SIZE(ipmb_threads); i++) {
@@ -1003,11 +1430,6 @@ cleanup:
     }
   }
 
-  if (mqd_res != MQ_DESC_INVALID) {
-    mq_close(mqd_res);
-    mq_unlink(mq_name_res);
-  }
-
   if (mqd_req != MQ_DESC_INVALID) {
     mq_close(mqd_req);
     mq_unlink(mq_name_req);
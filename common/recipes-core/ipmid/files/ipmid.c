@@ -158,19 +158,61 @@ enum {
   DUMP_ONGOING = 0x3,
 };
 
-// TODO: Based on performance testing results, might need fine grained locks
-// Since the global data is specific to a NetFunction, adding locs at NetFn level
-static pthread_mutex_t m_chassis;
-static pthread_mutex_t m_sensor;
-static pthread_mutex_t m_app;
-static pthread_mutex_t m_storage;
-static pthread_mutex_t m_transport;
-static pthread_mutex_t m_oem;
-static pthread_mutex_t m_oem_storage;
-static pthread_mutex_t m_oem_1s;
-static pthread_mutex_t m_oem_usb_dbg;
-static pthread_mutex_t m_oem_q;
-static pthread_mutex_t m_oem_zion;
+// Locking done by ipmi_handle() before a command is dispatched
+enum {
+  CMD_LOCK_NETFN = 0, // serialized with the whole NetFn (default)
+  CMD_LOCK_NONE,      // reentrant: no shared ipmid state, or locks on its own
+  CMD_LOCK_FRU,       // serialized per payload FRU
+  CMD_LOCK_SEL,       // serialized per SEL node, across NetFns
+};
+
+typedef struct {
+  unsigned char netfn;
+  unsigned char cmd;
+  unsigned char lock;
+} cmd_lock_t;
+
+typedef struct {
+  pthread_rwlock_t *netfn;
+  pthread_mutex_t *res;
+} ipmi_lock_t;
+
+// Commands which do not need the whole NetFn. Anything not listed here
+// takes the NetFn lock exclusively, as before.
+static const cmd_lock_t g_cmd_locks[] = {
+  {NETFN_CHASSIS_REQ, CMD_CHASSIS_GET_STATUS, CMD_LOCK_NONE},
+  {NETFN_CHASSIS_REQ, CMD_CHASSIS_GET_SYSTEM_RESTART_CAUSE, CMD_LOCK_NONE},
+  {NETFN_SENSOR_REQ, CMD_SENSOR_PLAT_EVENT_MSG, CMD_LOCK_SEL},
+  {NETFN_SENSOR_REQ, CMD_SENSOR_ALERT_IMMEDIATE_MSG, CMD_LOCK_SEL},
+  {NETFN_SENSOR_REQ, CMD_SENSOR_SET_SENSOR_READING, CMD_LOCK_NONE},
+  {NETFN_APP_REQ, CMD_APP_GET_DEVICE_ID, CMD_LOCK_NONE},
+  {NETFN_APP_REQ, CMD_APP_GET_SELFTEST_RESULTS, CMD_LOCK_NONE},
+  {NETFN_APP_REQ, CMD_APP_GET_DEVICE_GUID, CMD_LOCK_NONE},
+  {NETFN_APP_REQ, CMD_APP_GET_SYSTEM_GUID, CMD_LOCK_NONE},
+  {NETFN_APP_REQ, CMD_APP_RESET_WDT, CMD_LOCK_NONE},  // wdt->mutex
+  {NETFN_APP_REQ, CMD_APP_SET_WDT, CMD_LOCK_NONE},    // wdt->mutex
+  {NETFN_APP_REQ, CMD_APP_GET_WDT, CMD_LOCK_NONE},    // wdt->mutex
+  {NETFN_STORAGE_REQ, CMD_STORAGE_GET_FRUID_INFO, CMD_LOCK_FRU},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_READ_FRUID_DATA, CMD_LOCK_FRU},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_GET_SEL_INFO, CMD_LOCK_SEL},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_RSV_SEL, CMD_LOCK_SEL},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_ADD_SEL, CMD_LOCK_SEL},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_GET_SEL, CMD_LOCK_SEL},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_CLR_SEL, CMD_LOCK_SEL},
+  {NETFN_STORAGE_REQ, CMD_STORAGE_GET_SEL_UTC, CMD_LOCK_NONE},
+  {NETFN_OEM_REQ, CMD_OEM_ADD_RAS_SEL, CMD_LOCK_SEL},
+  {NETFN_OEM_REQ, CMD_OEM_GET_BOARD_ID, CMD_LOCK_NONE},
+  {NETFN_OEM_REQ, CMD_OEM_GET_FW_INFO, CMD_LOCK_NONE},
+  {NETFN_OEM_REQ, CMD_OEM_GET_DEV_CARD_SENSOR, CMD_LOCK_NONE},
+  {NETFN_OEM_REQ, CMD_OEM_GET_SENSOR_REAL_READING, CMD_LOCK_NONE},
+  // Bridged requests are dispatched again through ipmi_handle()
+  {NETFN_OEM_1S_REQ, CMD_OEM_1S_MSG_IN, CMD_LOCK_NONE},
+};
+
+#define NUM_NETFN_LOCKS 32
+static pthread_rwlock_t m_netfn[NUM_NETFN_LOCKS];
+static pthread_mutex_t m_fru[MAX_NODES+1];
+static pthread_mutex_t m_sel[MAX_NODES+1];
 
 extern int plat_udbg_get_frame_info(uint8_t *num);
 extern int plat_udbg_get_updated_frames(uint8_t *count, uint8_t *buffer);
@@ -391,7 +433,6 @@ ipmi_handle_chassis (unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_chassis);
   switch (cmd)
   {
     case CMD_CHASSIS_GET_STATUS:
@@ -423,7 +464,6 @@ ipmi_handle_chassis (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_chassis);
 }
 
 /*
@@ -532,7 +572,6 @@ ipmi_handle_sensor(unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_sensor);
   switch (cmd)
   {
     case CMD_SENSOR_PLAT_EVENT_MSG:
@@ -548,7 +587,6 @@ ipmi_handle_sensor(unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_sensor);
 }
 
 /*
@@ -641,6 +679,10 @@ app_cold_reset(unsigned char *request, unsigned char req_len,
   }
 
   syslog(LOG_CRIT, "BMC Cold Reset.");
+  // reboot() does not write back the SEL
+  for (i = 1; i <= MAX_NODES; i++) {
+    sel_flush(i);
+  }
   pal_bmc_reboot(RB_AUTOBOOT);
 }
 
@@ -1198,7 +1240,6 @@ ipmi_handle_app (unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_app);
   switch (cmd)
   {
     case CMD_APP_GET_DEVICE_ID:
@@ -1259,7 +1300,6 @@ ipmi_handle_app (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_app);
 }
 
 /*
@@ -1680,7 +1720,6 @@ ipmi_handle_storage (unsigned char *request, unsigned char req_len,
   res->cc = CC_SUCCESS;
   *res_len = 0;
 
-  pthread_mutex_lock(&m_storage);
   switch (cmd)
   {
     case CMD_STORAGE_GET_FRUID_INFO:
@@ -1733,7 +1772,6 @@ ipmi_handle_storage (unsigned char *request, unsigned char req_len,
       break;
   }
 
-  pthread_mutex_unlock(&m_storage);
   return;
 }
 
@@ -2004,7 +2042,6 @@ ipmi_handle_transport (unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_transport);
   switch (cmd)
   {
     case CMD_TRANSPORT_SET_LAN_CONFIG:
@@ -2020,7 +2057,6 @@ ipmi_handle_transport (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_transport);
 }
 
 /*
@@ -3569,7 +3605,6 @@ ipmi_handle_oem (unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
 
   unsigned char cmd = req->cmd;
-  pthread_mutex_lock(&m_oem);
   switch (cmd)
   {
     case CMD_OEM_ADD_RAS_SEL:
@@ -3717,7 +3752,6 @@ ipmi_handle_oem (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_oem);
 }
 
 static void
@@ -3729,7 +3763,6 @@ ipmi_handle_oem_storage (unsigned char *request, unsigned char req_len,
 
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_oem_storage);
   switch (cmd)
   {
     case CMD_OEM_STOR_ADD_STRING_SEL:
@@ -3739,7 +3772,6 @@ ipmi_handle_oem_storage (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_oem_storage);
 }
 
 static void
@@ -3750,7 +3782,6 @@ ipmi_handle_oem_q (unsigned char *request, unsigned char req_len,
   ipmi_res_t *res = (ipmi_res_t *) response;
 
   unsigned char cmd = req->cmd;
-  pthread_mutex_lock(&m_oem_q);
   switch (cmd)
   {
     case CMD_OEM_Q_SET_PROC_INFO:
@@ -3781,7 +3812,6 @@ ipmi_handle_oem_q (unsigned char *request, unsigned char req_len,
       res->cc = CC_INVALID_CMD;
       break;
   }
-  pthread_mutex_unlock(&m_oem_q);
 }
 
 static void
@@ -3870,17 +3900,14 @@ ipmi_handle_oem_1s(unsigned char *request, unsigned char req_len,
 
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_oem_1s);
   switch (cmd)
   {
     case CMD_OEM_1S_MSG_IN:
       // As all bridge in messages are IPMI request
       // all IPMI request will be process by ipmi_handle
       // which will "properly" serialize the processing according to netfn
-      // Thus it is not necessary to serialize processing of MSG-IN.
-      pthread_mutex_unlock(&m_oem_1s);
+      // Thus MSG-IN is dispatched without a lock (see g_cmd_locks).
       oem_1s_handle_ipmb_req(request, req_len, response, res_len);
-      pthread_mutex_lock(&m_oem_1s);
       break;
     case CMD_OEM_1S_INTR:
 #ifdef DEBUG
@@ -3997,7 +4024,6 @@ ipmi_handle_oem_1s(unsigned char *request, unsigned char req_len,
       *res_len = 3;
       break;
   }
-  pthread_mutex_unlock(&m_oem_1s);
 }
 
 static void
@@ -4189,7 +4215,6 @@ ipmi_handle_oem_usb_dbg(unsigned char *request, unsigned char req_len,
 
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_oem_usb_dbg);
   switch (cmd)
   {
     case CMD_OEM_USB_DBG_GET_FRAME_INFO:
@@ -4216,7 +4241,6 @@ ipmi_handle_oem_usb_dbg(unsigned char *request, unsigned char req_len,
       *res_len = 3;
       break;
   }
-  pthread_mutex_unlock(&m_oem_usb_dbg);
 }
 
 static void
@@ -4293,7 +4317,6 @@ ipmi_handle_oem_zion(unsigned char *request, unsigned char req_len,
 
   unsigned char cmd = req->cmd;
 
-  pthread_mutex_lock(&m_oem_zion);
   switch (cmd)
   {
     case CMD_OEM_ZION_GET_SYSTEM_MODE:
@@ -4314,7 +4337,63 @@ ipmi_handle_oem_zion(unsigned char *request, unsigned char req_len,
       *res_len = 3;
       break;
   }
-  pthread_mutex_unlock(&m_oem_zion);
+}
+
+static unsigned char
+cmd_lock_type(unsigned char netfn, unsigned char cmd)
+{
+  size_t i;
+
+  // DCMI is handed to the PAL as a whole and was never serialized here
+  if (netfn == NETFN_DCMI_REQ)
+    return CMD_LOCK_NONE;
+
+  for (i = 0; i < sizeof(g_cmd_locks)/sizeof(g_cmd_locks[0]); i++) {
+    if (g_cmd_locks[i].netfn == netfn && g_cmd_locks[i].cmd == cmd)
+      return g_cmd_locks[i].lock;
+  }
+  return CMD_LOCK_NETFN;
+}
+
+/*
+ * NetFn-wide commands take the NetFn lock for writing. FRU and SEL commands
+ * take it for reading plus the lock of the FRU/SEL node they work on, so e.g.
+ * a slow FRU read on one slot no longer holds up SEL or FRU access of the
+ * other slots.
+ */
+static void
+ipmi_lock(unsigned char netfn, unsigned char cmd, unsigned char payload_id,
+          ipmi_lock_t *lock)
+{
+  unsigned char type = cmd_lock_type(netfn, cmd);
+
+  lock->netfn = NULL;
+  lock->res = NULL;
+
+  if (type == CMD_LOCK_NONE)
+    return;
+
+  if (payload_id > MAX_NODES)
+    type = CMD_LOCK_NETFN;
+
+  lock->netfn = &m_netfn[(netfn & 0x3F) >> 1];
+  if (type == CMD_LOCK_NETFN) {
+    pthread_rwlock_wrlock(lock->netfn);
+    return;
+  }
+
+  pthread_rwlock_rdlock(lock->netfn);
+  lock->res = (type == CMD_LOCK_FRU) ? &m_fru[payload_id] : &m_sel[payload_id];
+  pthread_mutex_lock(lock->res);
+}
+
+static void
+ipmi_unlock(ipmi_lock_t *lock)
+{
+  if (lock->res)
+    pthread_mutex_unlock(lock->res);
+  if (lock->netfn)
+    pthread_rwlock_unlock(lock->netfn);
 }
 
 /*
@@ -4328,6 +4407,7 @@ ipmi_handle (unsigned char *request, unsigned char req_len,
   ipmi_mn_req_t *req = (ipmi_mn_req_t *) request;
   ipmi_res_t *res = (ipmi_res_t *) response;
   unsigned char netfn;
+  ipmi_lock_t lock;
   netfn = req->netfn_lun >> 2;
 
   // Provide default values in the response message
@@ -4336,6 +4416,7 @@ ipmi_handle (unsigned char *request, unsigned char req_len,
   printf("ipmi_handle netfn %x cmd %x len %d\n", netfn, req->cmd, req_len);
   *(unsigned short*)res_len = 0;
 
+  ipmi_lock(netfn, req->cmd, req->payload_id, &lock);
   switch (netfn)
   {
     case NETFN_CHASSIS_REQ:
@@ -4390,6 +4471,7 @@ ipmi_handle (unsigned char *request, unsigned char req_len,
       res->netfn_lun = (netfn + 1) << 2;
       break;
   }
+  ipmi_unlock(&lock);
 
   // This header includes NetFunction, Command, and Completion Code
   *(unsigned short*)res_len += IPMI_RESP_HDR_SIZE;
@@ -4514,9 +4596,14 @@ wdt_timer (void *arg) {
 int
 main (void)
 {
-  int fru;
+  int fru, i;
   pthread_t tid;
   uint8_t max_slot_num = 0;
+  ipc_svc_attr_t svc_attr = {
+    .num_workers = MAX_REQUESTS,
+    .max_pending = MAX_REQUESTS,
+    .max_req_len = MAX_IPMI_MSG_SIZE,
+  };
 
   //daemon(1, 1);
   //openlog("ipmid", LOG_CONS, LOG_DAEMON);
@@ -4528,16 +4615,13 @@ main (void)
   sdr_init();
   sel_init();
 
-  pthread_mutex_init(&m_chassis, NULL);
-  pthread_mutex_init(&m_sensor, NULL);
-  pthread_mutex_init(&m_app, NULL);
-  pthread_mutex_init(&m_storage, NULL);
-  pthread_mutex_init(&m_transport, NULL);
-  pthread_mutex_init(&m_oem, NULL);
-  pthread_mutex_init(&m_oem_1s, NULL);
-  pthread_mutex_init(&m_oem_usb_dbg, NULL);
-  pthread_mutex_init(&m_oem_q, NULL);
-  pthread_mutex_init(&m_oem_zion, NULL);
+  for (i = 0; i < NUM_NETFN_LOCKS; i++) {
+    pthread_rwlock_init(&m_netfn[i], NULL);
+  }
+  for (i = 0; i <= MAX_NODES; i++) {
+    pthread_mutex_init(&m_fru[i], NULL);
+    pthread_mutex_init(&m_sel[i], NULL);
+  }
 
   pal_get_num_slots(&max_slot_num);
   fru = 1;
@@ -4562,20 +4646,18 @@ main (void)
     fru++;
   }
 
-  if (ipc_start_svc(SOCK_PATH_IPMI, conn_handler, MAX_REQUESTS, NULL, &tid) == 0) {
+  if (ipc_start_svc_pool(SOCK_PATH_IPMI, conn_handler, &svc_attr, NULL, &tid) == 0) {
     pthread_join(tid, NULL);
   }
 
 
-  pthread_mutex_destroy(&m_chassis);
-  pthread_mutex_destroy(&m_sensor);
-  pthread_mutex_destroy(&m_app);
-  pthread_mutex_destroy(&m_storage);
-  pthread_mutex_destroy(&m_transport);
-  pthread_mutex_destroy(&m_oem);
-  pthread_mutex_destroy(&m_oem_1s);
-  pthread_mutex_destroy(&m_oem_usb_dbg);
-  pthread_mutex_destroy(&m_oem_q);
+  for (i = 0; i < NUM_NETFN_LOCKS; i++) {
+    pthread_rwlock_destroy(&m_netfn[i]);
+  }
+  for (i = 0; i <= MAX_NODES; i++) {
+    pthread_mutex_destroy(&m_fru[i]);
+    pthread_mutex_destroy(&m_sel[i]);
+  }
 
   return 0;
 }
@@ -23,7 +23,7 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
-#define _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
 #include "sel.h"
 #include "timestamp.h"
 #include <stdio.h>
@@ -33,7 +33,12 @@
 #include <syslog.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <time.h>
 #include <openbmc/pal.h>
@@ -86,127 +91,170 @@ typedef struct {
 // Keep track of last Reservation ID
 static int g_rsv_id[MAX_NODES+1];
 
-// Cached version of SEL Header and data
-static sel_hdr_t g_sel_hdr[MAX_NODES+1];
-static sel_msg_t g_sel_data[MAX_NODES+1][SEL_ELEMS_MAX];
+// SEL Header and data, pointing in to the node's SEL store image
+static sel_hdr_t *g_sel_hdr[MAX_NODES+1];
+static sel_msg_t *g_sel_data[MAX_NODES+1];
 
-// Local helper functions to interact with file system
-static int
-file_get_sel_hdr(int node) {
-  FILE *fp;
-  char fpath[SIZE_PATH_MAX] = {0};
+// Size of the SEL file image
+#define SEL_FILE_SIZE (SEL_DATA_OFFSET + SEL_ELEMS_MAX * sizeof(sel_msg_t))
 
-  sprintf(fpath, SEL_LOG_FILE, node);
+// Interval to write back modified SEL data to the file
+#define SEL_FLUSH_INTERVAL 1
 
-  fp = fopen(fpath, "r");
-  if (fp == NULL) {
-    return -1;
-  }
+// In-memory image of a SEL file. The image is a shared mapping of the file
+// if the filesystem allows it, otherwise a private copy written back with
+// pwrite(). Either way adding an entry only touches memory and the modified
+// byte range is written back by sel_flush(), from the flush thread or on
+// demand.
+typedef struct {
+  int fd;
+  uint8_t *base;
+  bool mapped;
+  size_t dirty_lo;  // dirty byte range [dirty_lo, dirty_hi)
+  size_t dirty_hi;
+  pthread_mutex_t lock;
+} sel_store_t;
 
-  if (fread(&g_sel_hdr[node], sizeof(sel_hdr_t), 1, fp) <= 0) {
-    syslog(LOG_WARNING, "file_get_sel_hdr: fread\n");
-    fclose (fp);
-    return -1;
-  }
+static sel_store_t g_sel_store[MAX_NODES+1];
 
-  fclose(fp);
-  return 0;
+// Image of a node whose SEL file could not be opened, the log is then
+// kept in memory only
+static uint8_t g_sel_mem[MAX_NODES+1][SEL_FILE_SIZE] __attribute__((aligned(8)));
+
+// Record a modification of the image; called with store lock held
+static void
+sel_mark_dirty(int node, size_t offset, size_t len) {
+  sel_store_t *st = &g_sel_store[node];
+
+  if (st->dirty_lo == st->dirty_hi) {
+    st->dirty_lo = offset;
+    st->dirty_hi = offset + len;
+    return;
+  }
+  if (offset < st->dirty_lo)
+    st->dirty_lo = offset;
+  if (offset + len > st->dirty_hi)
+    st->dirty_hi = offset + len;
+}
+
+static void
+sel_mark_hdr_dirty(int node) {
+  sel_mark_dirty(node, 0, sizeof(sel_hdr_t));
+}
+
+static void
+sel_mark_data_dirty(int node, int index) {
+  sel_mark_dirty(node, SEL_DATA_OFFSET + index * sizeof(sel_msg_t), sizeof(sel_msg_t));
 }
 
 static int
-file_get_sel_data(int node) {
-  FILE *fp;
-  int i, j;
+file_open_sel(int node) {
+  sel_store_t *st = &g_sel_store[node];
   char fpath[SIZE_PATH_MAX] = {0};
+  struct stat sb;
+  ssize_t len;
 
   sprintf(fpath, SEL_LOG_FILE, node);
 
-  fp = fopen(fpath, "r");
-  if (fp == NULL) {
-    syslog(LOG_WARNING, "file_get_sel_data: fopen\n");
+  st->fd = open(fpath, O_RDWR | O_CREAT, 0644);
+  if (st->fd < 0) {
+    syslog(LOG_WARNING, "file_open_sel: open %s: %s\n", fpath, strerror(errno));
     return -1;
   }
 
-  if (fseek(fp, SEL_DATA_OFFSET, SEEK_SET)) {
-    syslog(LOG_WARNING, "file_get_sel_data: fseek\n");
-    fclose(fp);
-    return -1;
-  }
-
-  unsigned char buf[SEL_ELEMS_MAX * 16];
-  if (fread(buf, 1, SEL_ELEMS_MAX * sizeof(sel_msg_t), fp) <= 0) {
-    syslog(LOG_WARNING, "file_get_sel_data: fread\n");
-    fclose(fp);
-    return -1;
+  // Files created by older versions do not cover the last record
+  if (fstat(st->fd, &sb) || (sb.st_size < SEL_FILE_SIZE && ftruncate(st->fd, SEL_FILE_SIZE))) {
+    syslog(LOG_WARNING, "file_open_sel: resize %s: %s\n", fpath, strerror(errno));
+    goto close_bail;
   }
 
-  fclose(fp);
-
-  for (i = 0; i < SEL_ELEMS_MAX; i++) {
-    for (j = 0; j < sizeof(sel_msg_t);j++) {
-      g_sel_data[node][i].msg[j] = buf[i*16 + j];
+  st->base = mmap(NULL, SEL_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, st->fd, 0);
+  if (st->base != MAP_FAILED) {
+    st->mapped = true;
+  } else {
+    // e.g. JFFS2 does not support shared writable mappings
+    st->mapped = false;
+    st->base = calloc(1, SEL_FILE_SIZE);
+    if (st->base == NULL) {
+      goto close_bail;
+    }
+    len = pread(st->fd, st->base, SEL_FILE_SIZE, 0);
+    if (len < 0) {
+      syslog(LOG_WARNING, "file_open_sel: read %s: %s\n", fpath, strerror(errno));
+      free(st->base);
+      goto close_bail;
     }
   }
 
+  g_sel_hdr[node] = (sel_hdr_t *)st->base;
+  g_sel_data[node] = (sel_msg_t *)(st->base + SEL_DATA_OFFSET);
   return 0;
-}
 
-static int
-file_store_sel_hdr(int node) {
-  FILE *fp;
-  char fpath[SIZE_PATH_MAX] = {0};
+close_bail:
+  st->base = NULL;
+  close(st->fd);
+  st->fd = -1;
+  return -1;
+}
 
-  sprintf(fpath, SEL_LOG_FILE, node);
+// Write back the modified part of a node's SEL image
+int
+sel_flush(int node) {
+  sel_store_t *st;
+  size_t lo, hi, page;
+  int ret = 0;
 
-  fp = fopen(fpath, "r+");
-  if (fp == NULL) {
-    syslog(LOG_WARNING, "file_store_sel_hdr: fopen\n");
+  if (node < 1 || node > MAX_NODES) {
     return -1;
   }
-
-  if (fwrite(&g_sel_hdr[node], sizeof(sel_hdr_t), 1, fp) <= 0) {
-    syslog(LOG_WARNING, "file_store_sel_hdr: fwrite\n");
-    fclose(fp);
+  st = &g_sel_store[node];
+  if (st->base == NULL || st->fd < 0) {
     return -1;
   }
 
-  fclose(fp);
-
-  return 0;
-}
-
-static int
-file_store_sel_data(int node, int recId, sel_msg_t *data) {
-  FILE *fp;
-  int index;
-  char fpath[SIZE_PATH_MAX] = {0};
+  // Take the dirty range and write it back without holding the lock, so
+  // adding entries never waits for the flash. Anything modified meanwhile
+  // is marked dirty again and goes out with the next flush.
+  pthread_mutex_lock(&st->lock);
+  lo = st->dirty_lo;
+  hi = st->dirty_hi;
+  st->dirty_lo = st->dirty_hi = 0;
+  pthread_mutex_unlock(&st->lock);
+  if (lo == hi) {
+    return 0;
+  }
 
-  sprintf(fpath, SEL_LOG_FILE, node);
+  if (st->mapped) {
+    page = sysconf(_SC_PAGESIZE);
+    ret = msync(st->base + (lo & ~(page - 1)), hi - (lo & ~(page - 1)), MS_SYNC);
+  } else {
+    ret = (pwrite(st->fd, st->base + lo, hi - lo, lo) == (ssize_t)(hi - lo)) ? 0 : -1;
+  }
 
-  fp = fopen(fpath, "r+");
-  if (fp == NULL) {
-    syslog(LOG_WARNING, "file_store_sel_data: fopen\n");
-    return -1;
+  if (ret) {
+    syslog(LOG_WARNING, "sel_flush: node %d: %s\n", node, strerror(errno));
+    pthread_mutex_lock(&st->lock);
+    sel_mark_dirty(node, lo, hi - lo);
+    pthread_mutex_unlock(&st->lock);
   }
 
-  // Records are stored using zero-based index
-  index = (recId-1) * sizeof(sel_msg_t);
+  return ret;
+}
 
-  if (fseek(fp, SEL_DATA_OFFSET+index, SEEK_SET)) {
-    syslog(LOG_WARNING, "file_store_sel_data: fseek\n");
-    fclose(fp);
-    return -1;
-  }
+static void *
+sel_flush_thread(void *arg) {
+  int node;
 
-  if (fwrite(data->msg, sizeof(sel_msg_t), 1, fp) <= 0) {
-    syslog(LOG_WARNING, "file_store_sel_data: fwrite\n");
-    fclose(fp);
-    return -1;
+  while (1) {
+    sleep(SEL_FLUSH_INTERVAL);
+    for (node = 1; node < MAX_NODES+1; node++) {
+      if (g_sel_store[node].fd >= 0) {
+        sel_flush(node);
+      }
+    }
   }
 
-  fclose(fp);
-
-  return 0;
+  return NULL;
 }
 
 static void
@@ -403,22 +451,22 @@ parse_sel(uint8_t fru, sel_msg_t *data) {
 // Retrieve time stamp for recent add operation
 void
 sel_ts_recent_add(int node, time_stamp_t *ts) {
-  memcpy(ts->ts, g_sel_hdr[node].ts_add.ts, 0x04);
+  memcpy(ts->ts, g_sel_hdr[node]->ts_add.ts, 0x04);
 }
 
 // Retrieve time stamp for recent erase operation
 void
 sel_ts_recent_erase(int node, time_stamp_t *ts) {
-  memcpy(ts->ts, g_sel_hdr[node].ts_erase.ts, 0x04);
+  memcpy(ts->ts, g_sel_hdr[node]->ts_erase.ts, 0x04);
 }
 
 // Retrieve total number of entries in SEL log
 int
 sel_num_entries(int node) {
-  if (g_sel_hdr[node].begin <= g_sel_hdr[node].end) {
-      return (g_sel_hdr[node].end - g_sel_hdr[node].begin);
+  if (g_sel_hdr[node]->begin <= g_sel_hdr[node]->end) {
+      return (g_sel_hdr[node]->end - g_sel_hdr[node]->begin);
   } else {
-    return (g_sel_hdr[node].end + (SEL_INDEX_MAX - g_sel_hdr[node].begin + 1));
+    return (g_sel_hdr[node]->end + (SEL_INDEX_MAX - g_sel_hdr[node]->begin + 1));
   }
 }
 
@@ -455,10 +503,10 @@ sel_get_entry(int node, int read_rec_id, sel_msg_t *msg, int *next_rec_id) {
 
   // Find the index in to array based on given index
   if (read_rec_id == SEL_RECID_FIRST) {
-    index = g_sel_hdr[node].begin;
+    index = g_sel_hdr[node]->begin;
   } else if (read_rec_id == SEL_RECID_LAST) {
-    if (g_sel_hdr[node].end) {
-      index = g_sel_hdr[node].end - 1;
+    if (g_sel_hdr[node]->end) {
+      index = g_sel_hdr[node]->end - 1;
     } else {
       index = SEL_INDEX_MAX;
     }
@@ -479,16 +527,16 @@ sel_get_entry(int node, int read_rec_id, sel_msg_t *msg, int *next_rec_id) {
   }
 
   // If begin < end, check to make sure the given id falls between
-  if (g_sel_hdr[node].begin < g_sel_hdr[node].end) {
-    if (index < g_sel_hdr[node].begin || index >= g_sel_hdr[node].end) {
+  if (g_sel_hdr[node]->begin < g_sel_hdr[node]->end) {
+    if (index < g_sel_hdr[node]->begin || index >= g_sel_hdr[node]->end) {
       syslog(LOG_WARNING, "sel_get_entry: Wrong Record ID %d\n", read_rec_id);
       return -1;
     }
   }
 
   // If end < begin, check to make sure the given id is valid
-  if (g_sel_hdr[node].begin > g_sel_hdr[node].end) {
-    if (index >= g_sel_hdr[node].end && index < g_sel_hdr[node].begin) {
+  if (g_sel_hdr[node]->begin > g_sel_hdr[node]->end) {
+    if (index >= g_sel_hdr[node]->end && index < g_sel_hdr[node]->begin) {
       syslog(LOG_WARNING, "sel_get_entry: Wrong Record ID2 %d\n", read_rec_id);
       return -1;
     }
@@ -503,7 +551,7 @@ sel_get_entry(int node, int read_rec_id, sel_msg_t *msg, int *next_rec_id) {
   }
 
   // If this is the last entry in the log, return 0xFFFF
-  if (*next_rec_id == g_sel_hdr[node].end) {
+  if (*next_rec_id == g_sel_hdr[node]->end) {
     *next_rec_id = SEL_RECID_LAST;
   }
 
@@ -531,23 +579,23 @@ sel_add_entry(int node, sel_msg_t *msg, int *rec_id) {
   // one empty location less than the max records.
   if (sel_num_entries(node) == SEL_RECORDS_MAX) {
       syslog(LOG_WARNING, "sel_add_entry: SEL rollover\n");
-    if (++g_sel_hdr[node].begin > SEL_INDEX_MAX) {
-      g_sel_hdr[node].begin = SEL_INDEX_MIN;
+    pthread_mutex_lock(&g_sel_store[node].lock);
+    if (++g_sel_hdr[node]->begin > SEL_INDEX_MAX) {
+      g_sel_hdr[node]->begin = SEL_INDEX_MIN;
     }
+    sel_mark_hdr_dirty(node);
+    pthread_mutex_unlock(&g_sel_store[node].lock);
   }
 
-  msg->msg[0] = g_sel_hdr[node].end & 0xFF;
-  msg->msg[1] = (g_sel_hdr[node].end >> 8) & 0xFF;
+  msg->msg[0] = g_sel_hdr[node]->end & 0xFF;
+  msg->msg[1] = (g_sel_hdr[node]->end >> 8) & 0xFF;
 
   // Update message's time stamp starting at byte 4
   if (msg->msg[2] < 0xE0)
     time_stamp_fill(&msg->msg[3]);
 
-  // Add the enry at end
-  memcpy(g_sel_data[node][g_sel_hdr[node].end].msg, msg->msg, sizeof(sel_msg_t));
-
   // Return the newly added record ID
-  *rec_id = g_sel_hdr[node].end+1;
+  *rec_id = g_sel_hdr[node]->end+1;
 
   // Print the data in syslog
   dump_sel_syslog(node, msg);
@@ -555,24 +603,20 @@ sel_add_entry(int node, sel_msg_t *msg, int *rec_id) {
   // Parse the SEL message
   parse_sel((uint8_t) node, msg);
 
-  if (file_store_sel_data(node, *rec_id, msg)) {
-    syslog(LOG_WARNING, "sel_add_entry: file_store_sel_data\n");
-    return -1;
-  }
+  // Add the enry at end, it is written back by sel_flush()
+  pthread_mutex_lock(&g_sel_store[node].lock);
+  memcpy(g_sel_data[node][g_sel_hdr[node]->end].msg, msg->msg, sizeof(sel_msg_t));
+  sel_mark_data_dirty(node, g_sel_hdr[node]->end);
 
   // Increment the end pointer
-  if (++g_sel_hdr[node].end > SEL_INDEX_MAX) {
-    g_sel_hdr[node].end = SEL_INDEX_MIN;
+  if (++g_sel_hdr[node]->end > SEL_INDEX_MAX) {
+    g_sel_hdr[node]->end = SEL_INDEX_MIN;
   }
 
   // Update timestamp for add in header
-  time_stamp_fill(g_sel_hdr[node].ts_add.ts);
-
-  // Store the structure persistently
-  if (file_store_sel_hdr(node)) {
-    syslog(LOG_WARNING, "sel_add_entry: file_store_sel_hdr\n");
-    return -1;
-  }
+  time_stamp_fill(g_sel_hdr[node]->ts_add.ts);
+  sel_mark_hdr_dirty(node);
+  pthread_mutex_unlock(&g_sel_store[node].lock);
 
   return 0;
 }
@@ -587,15 +631,18 @@ sel_erase(int node, int rsv_id) {
   }
 
   // Erase SEL Logs
-  g_sel_hdr[node].begin = SEL_INDEX_MIN;
-  g_sel_hdr[node].end = SEL_INDEX_MIN;
+  pthread_mutex_lock(&g_sel_store[node].lock);
+  g_sel_hdr[node]->begin = SEL_INDEX_MIN;
+  g_sel_hdr[node]->end = SEL_INDEX_MIN;
 
   // Update timestamp for erase in header
-  time_stamp_fill(g_sel_hdr[node].ts_erase.ts);
+  time_stamp_fill(g_sel_hdr[node]->ts_erase.ts);
+  sel_mark_hdr_dirty(node);
+  pthread_mutex_unlock(&g_sel_store[node].lock);
 
-  // Store the structure persistently
-  if (file_store_sel_hdr(node)) {
-    syslog(LOG_WARNING, "sel_erase: file_store_sel_hdr\n");
+  // Store the structure persistently right away
+  if (g_sel_store[node].fd >= 0 && sel_flush(node)) {
+    syslog(LOG_WARNING, "sel_erase: sel_flush\n");
     return -1;
   }
 
@@ -620,76 +667,70 @@ sel_erase_status(int node, int rsv_id, sel_erase_stat_t *status) {
 // Initialize SEL log file
 static int
 sel_node_init(int node) {
-  FILE *fp;
-  int i;
+  sel_store_t *st = &g_sel_store[node];
+  bool created;
+  int ret = 0;
   char fpath[SIZE_PATH_MAX] = {0};
 
   sprintf(fpath, SEL_LOG_FILE, node);
 
-  // Check if the file exists or not
-  if (access(fpath, F_OK) == 0) {
-    // Since file is present, fetch all the contents to cache
-    if (file_get_sel_hdr(node)) {
-      syslog(LOG_WARNING, "init_sel: file_get_sel_hdr\n");
-      return -1;
-    }
+  pthread_mutex_init(&st->lock, NULL);
 
-    if (file_get_sel_data(node)) {
-      syslog(LOG_WARNING, "init_sel: file_get_sel_data\n");
-      return -1;
-    }
+  // Check if the file exists or not; if present, its contents are the cache
+  created = (access(fpath, F_OK) != 0);
 
-    return 0;
+  if (file_open_sel(node)) {
+    syslog(LOG_WARNING, "init_sel: file_open_sel, node %d SEL not persistent\n", node);
+    st->fd = -1;
+    st->mapped = false;
+    st->base = g_sel_mem[node];
+    g_sel_hdr[node] = (sel_hdr_t *)st->base;
+    g_sel_data[node] = (sel_msg_t *)(st->base + SEL_DATA_OFFSET);
+    created = true;
+    ret = -1;
   }
 
-  // File not present, so create the file
-  fp = fopen(fpath, "w+");
-  if (fp == NULL) {
-    syslog(LOG_WARNING, "init_sel: fopen\n");
-    return -1;
+  if (!created) {
+    return 0;
   }
 
-  fclose (fp);
-
-  // Populate SEL Header in to the file
-  g_sel_hdr[node].magic = SEL_HDR_MAGIC;
-  g_sel_hdr[node].version = SEL_HDR_VERSION;
-  g_sel_hdr[node].begin = SEL_INDEX_MIN;
-  g_sel_hdr[node].end = SEL_INDEX_MIN;
-  memset(g_sel_hdr[node].ts_add.ts, 0x0, 4);
-  memset(g_sel_hdr[node].ts_erase.ts, 0x0, 4);
-
-  if (file_store_sel_hdr(node)) {
-    syslog(LOG_WARNING, "init_sel: file_store_sel_hdr\n");
-    return -1;
-  }
+  // Populate SEL Header in to the file, SEL Data is zero filled already
+  g_sel_hdr[node]->magic = SEL_HDR_MAGIC;
+  g_sel_hdr[node]->version = SEL_HDR_VERSION;
+  g_sel_hdr[node]->begin = SEL_INDEX_MIN;
+  g_sel_hdr[node]->end = SEL_INDEX_MIN;
+  memset(g_sel_hdr[node]->ts_add.ts, 0x0, 4);
+  memset(g_sel_hdr[node]->ts_erase.ts, 0x0, 4);
+  sel_mark_dirty(node, 0, SEL_FILE_SIZE);
+  g_rsv_id[node] = 0x01;
 
-  // Populate SEL Data in to the file
-  for (i = 1;  i <= SEL_RECORDS_MAX; i++) {
-    sel_msg_t msg = {0};
-    if (file_store_sel_data(node, i, &msg)) {
-      syslog(LOG_WARNING, "init_sel: file_store_sel_data\n");
-      return -1;
-    }
+  if (ret == 0 && sel_flush(node)) {
+    syslog(LOG_WARNING, "init_sel: sel_flush\n");
+    ret = -1;
   }
 
-  g_rsv_id[node] = 0x01;
-
-  return 0;
+  return ret;
 }
 
 int
 sel_init(void) {
-  int ret;
+  int ret = 0;
   int i;
+  pthread_t tid;
 
+  // A node failing to initialize keeps a usable in-memory image, go on
+  // with the others
   for (i = 1; i < MAX_NODES+1; i++) {
-    ret = sel_node_init(i);
-    if (ret) {
-      return ret;
+    if (sel_node_init(i)) {
+      ret = -1;
     }
   }
 
+  if (pthread_create(&tid, NULL, sel_flush_thread, NULL)) {
+    syslog(LOG_WARNING, "sel_init: failed to create flush thread\n");
+    return -1;
+  }
+  pthread_detach(tid);
+
   return ret;
 }
-
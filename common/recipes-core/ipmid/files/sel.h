@@ -51,6 +51,7 @@ int sel_add_entry(int node, sel_msg_t *msg, int *rec_id);
 int sel_erase(int node, int rsv_id);
 int sel_erase_status(int node, int rsv_id, sel_erase_stat_t *status);
 int sel_init(void);
+int sel_flush(int node);
 int ras_sel_add_entry(int node, ras_sel_msg_t *msg);
 
 #endif /* __SEL_H__ */
@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <errno.h>
 #include <syslog.h>
@@ -155,9 +156,33 @@ bufStore* createBuffer(const char *dev, int fsize) {
     return NULL;
   }
 
+  buf->wbuf = malloc(LOG_BUF_SIZE);
+  buf->lineIdx = malloc(LOG_INDEX_LINES * sizeof(uint32_t));
+  if (buf->wbuf == NULL || buf->lineIdx == NULL) {
+    perror("Malloc error");
+    free(buf->wbuf);
+    free(buf->lineIdx);
+    free(buf);
+    return NULL;
+  }
+
+  struct stat file_stat;
   buf->buf_fd = open(buf->file, O_RDWR | O_APPEND | O_CREAT, 0666) ;
+  if (buf->buf_fd >= 0 && fstat(buf->buf_fd, &file_stat) == 0) {
+    buf->fileSize = file_stat.st_size;
+  } else {
+    buf->fileSize = 0;
+  }
   buf->maxSizeBytes = fsize;
   buf->needTimestamp = 1;
+  buf->lineNumber = 0;
+  buf->wlen = 0;
+  buf->flushMs = LOG_FLUSH_MS;
+  buf->stampTime = (time_t)-1;
+  buf->stampLen = 0;
+  buf->lineHead = 0;
+  buf->lineCount = 0;
+  buf->linePending = 0;
   return buf;
 }
 
@@ -165,183 +190,293 @@ void closeBuffer(bufStore* buf) {
   if (!buf) {
     return;
   }
+  flushBuffer(buf);
   close(buf->buf_fd);
+  free(buf->wbuf);
+  free(buf->lineIdx);
   free(buf);
 }
 
-/* Write human-readable timestamp with line number in the provided buffer */
-void writeTimestampToBuffer(bufStore *buf) {
+/* Rollover to the backup file by renaming the log file */
+static void rotateBuffer(bufStore *buf) {
+  if (rename(buf->file, buf->backupfile) != 0) {
+    syslog(LOG_WARNING, "Rename of %s failed, errno=%d\n", buf->file, errno);
+  }
+  close(buf->buf_fd);
+  buf->buf_fd = open(buf->file, O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0666);
+  if (buf->buf_fd < 0) {
+    perror("Cannot open the mTerm buffer log file");
+    exit(-1);
+  }
+  buf->fileSize = 0;
+  // Only the lines still in the userspace buffer will be in the new file
+  buf->lineCount = buf->linePending;
+}
 
-  time_t cur_time;
-  size_t dateLen;
-  char dateBuff[64];
+/* Index entries are added with their offset in the userspace buffer and
+ * turned into file offsets when the buffer is written */
+static void indexLine(bufStore *buf) {
+  buf->lineIdx[buf->lineHead] = buf->wlen;
+  buf->lineHead = (buf->lineHead + 1) % LOG_INDEX_LINES;
+  if (buf->lineCount < LOG_INDEX_LINES) {
+    buf->lineCount++;
+  }
+  if (buf->linePending < LOG_INDEX_LINES) {
+    buf->linePending++;
+  }
+}
 
-  time(&cur_time);
+/* Offset of the i-th indexed line, oldest first */
+static uint32_t indexedLine(bufStore *buf, unsigned int i) {
+  return buf->lineIdx[(buf->lineHead + LOG_INDEX_LINES - buf->lineCount + i) %
+                      LOG_INDEX_LINES];
+}
 
-  if (!ctime_r(&cur_time, dateBuff))
-    strcpy(dateBuff, "unknown time ");
+void flushBuffer(bufStore *buf) {
+  struct stat file_stat;
+  unsigned int i;
 
-  dateLen = strlen(dateBuff);
-  dateBuff[dateLen - 1] = ' ';
-  snprintf(dateBuff + dateLen, sizeof(dateBuff) - dateLen, "%07lu ", buf->lineNumber++);
-  writeData(buf->buf_fd, dateBuff, strlen(dateBuff), "buffer");
-}
+  if (buf->wlen == 0) {
+    return;
+  }
+
+  if (fstat(buf->buf_fd, &file_stat) == 0 && file_stat.st_nlink == 0) {
+    // Maybe someone externally removed our buffer file. Force file rotation.
+    close(buf->buf_fd);
+    buf->buf_fd = open(buf->file, O_RDWR | O_APPEND | O_CREAT | O_TRUNC, 0666);
+    if (buf->buf_fd < 0) {
+      perror("Cannot open the mTerm buffer log file");
+      exit(-1);
+    }
+    buf->fileSize = 0;
+    buf->lineCount = buf->linePending;
+  }
 
-int backupBuffer(bufStore *buf) {
-  int ret = 0;
-  int in_fd, out_fd;
-  ssize_t r_cnt, w_cnt;
-  uint8_t rd_buf[1024];
+  if (buf->fileSize >= buf->maxSizeBytes) {
+    rotateBuffer(buf);
+  }
 
-  in_fd = open(buf->file, O_RDONLY);
-  if (in_fd < 0) {
-    perror("Cannot open the mTerm buffer log file");
-    return -1;
+  for (i = buf->lineCount - buf->linePending; i < buf->lineCount; i++) {
+    buf->lineIdx[(buf->lineHead + LOG_INDEX_LINES - buf->lineCount + i) %
+                 LOG_INDEX_LINES] += buf->fileSize;
   }
+  buf->linePending = 0;
+
+  writeData(buf->buf_fd, buf->wbuf, buf->wlen, "buffer");
+  buf->fileSize += buf->wlen;
+  buf->wlen = 0;
+}
+
+/* Milliseconds until the buffered data is due to be written, -1 if none */
+int bufferFlushTimeout(bufStore *buf) {
+  struct timespec now;
+  long elapsed;
 
-  out_fd = open(buf->backupfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-  if (out_fd < 0) {
-    perror("Cannot create the mTerm backup buffer log file");
-    close(in_fd);
+  if (buf->wlen == 0) {
     return -1;
   }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (now.tv_sec - buf->firstPending.tv_sec) * 1000 +
+            (now.tv_nsec - buf->firstPending.tv_nsec) / 1000000;
+  return elapsed >= buf->flushMs ? 0 : buf->flushMs - elapsed;
+}
 
-  while (1) {
-    r_cnt = read(in_fd, rd_buf, sizeof(rd_buf));
-    if (r_cnt <= 0) {
-      if (r_cnt < 0) {
-        ret = -1;
-      }
-      break;
-    }
+static void appendToBuffer(bufStore *buf, const char *data, size_t len) {
+  size_t n;
 
-    w_cnt = write(out_fd, rd_buf, r_cnt);
-    if (w_cnt != r_cnt) {
-      ret = -1;
-      break;
+  while (len > 0) {
+    if (buf->wlen == LOG_BUF_SIZE) {
+      flushBuffer(buf);
+    }
+    if (buf->wlen == 0) {
+      clock_gettime(CLOCK_MONOTONIC, &buf->firstPending);
     }
+    n = LOG_BUF_SIZE - buf->wlen;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(buf->wbuf + buf->wlen, data, n);
+    buf->wlen += n;
+    data += n;
+    len -= n;
+  }
+}
+
+/* Write human-readable timestamp with line number in the provided buffer */
+void writeTimestampToBuffer(bufStore *buf) {
+
+  time_t cur_time;
+  char lineBuff[32];
+  int lineLen;
+
+  time(&cur_time);
+
+  // The date only changes once per second, lines in between reuse it
+  if (cur_time != buf->stampTime) {
+    if (!ctime_r(&cur_time, buf->stamp))
+      strcpy(buf->stamp, "unknown time ");
+    buf->stampLen = strlen(buf->stamp);
+    buf->stamp[buf->stampLen - 1] = ' ';
+    buf->stampTime = cur_time;
   }
 
-  close(in_fd);
-  close(out_fd);
-  return ret;
+  lineLen = snprintf(lineBuff, sizeof(lineBuff), "%07lu ", buf->lineNumber++);
+  if (buf->wlen == LOG_BUF_SIZE) {
+    flushBuffer(buf);
+  }
+  indexLine(buf);
+  appendToBuffer(buf, buf->stamp, buf->stampLen);
+  appendToBuffer(buf, lineBuff, lineLen);
 }
 
 void writeToBuffer(bufStore *buf, char* data, int len) {
-   bool rotate = false;
-   struct stat file_stat;
-   int rc = stat(buf->file, &file_stat), nbytes = len, cur_len;
-   char *cur = data, *prev = data;
-
-   if (rc != 0) {
-     if (errno == ENOENT) {
-       // Maybe someone externally removed our buffer file. Force file rotation.
-       close(buf->buf_fd);
-       buf->buf_fd = open(buf->file, O_RDWR | O_CREAT | O_TRUNC, 0666);
-       if (buf->buf_fd < 0) {
-         perror("Cannot open the mTerm buffer log file");
-         exit(-1);
-       }
-       syncfs(buf->buf_fd);
-     } else {
-       // We couldn't figure out if the file needs to be rotated.
-       // Don't rotate the file.  Continue and log the data anyway, though.
-       syslog(LOG_WARNING, "Error determining existing buffer file size: "
-              "errno=%d", errno);
-     }
-   } else {
-     if (file_stat.st_size >= buf->maxSizeBytes) {
-       rotate = true;
-     }
-   }
-
-   // Rollover to a backup file when buffer hits filesize
-   if (rotate) {
-     backupBuffer(buf);
-     if (ftruncate(buf->buf_fd, 0) != 0) {
-       syslog(LOG_WARNING, "Truncation post-rotation failed, errno=%d\n", errno);
-     }
-     syncfs(buf->buf_fd);
-     lseek(buf->buf_fd, 0, SEEK_SET);
-   }
+  char *cur;
+  int cur_len;
 
   /*
    * Treat data as byte array but try to seek out newline characters. When they are
    * found, add current timestamp and sequential line number.
    */
-   while ((cur = memchr(cur, '\n', nbytes)) || nbytes) {
-     if (buf->needTimestamp) {
-       writeTimestampToBuffer(buf);
-       buf->needTimestamp = 0;
-     }
-     /* there is no new line in this buffer, move on */
-     if (!cur) {
-       writeData(buf->buf_fd, prev, nbytes, "buffer");
-       break;
-     }
+  while (len > 0) {
+    if (buf->needTimestamp) {
+      writeTimestampToBuffer(buf);
+      buf->needTimestamp = 0;
+    }
+    cur = memchr(data, '\n', len);
+    /* there is no new line in this buffer, move on */
+    cur_len = cur ? cur - data + 1 : len;
+    appendToBuffer(buf, data, cur_len);
+    if (cur) {
+      buf->needTimestamp = 1;
+    }
+    data += cur_len;
+    len -= cur_len;
+  }
 
-     cur_len = cur - prev + 1;
-     nbytes -= cur_len;
+  if (buf->flushMs == 0) {
+    flushBuffer(buf);
+  }
+}
+
+/* Send the [start, end) range of the log file to the client */
+static int sendRange(int fd, int clientfd, off_t start, off_t end) {
+  ssize_t sent;
 
-     writeData(buf->buf_fd, prev, cur_len, "buffer");
-     prev = ++cur;
-     buf->needTimestamp = 1;
+  while (start < end) {
+    sent = sendfile(clientfd, fd, &start, end - start);
+    if (sent <= 0) {
+      if (sent < 0 && errno == EINTR) {
+        continue;
+      }
+      syslog(LOG_ERR, "mTerm: sendfile to fd=%d failed, errno=%d\n", clientfd, errno);
+      return -1;
+    }
   }
+  return 0;
+}
+
+/*
+ * Find the last nlines complete lines of the log file ending at curr (at
+ * the end of the file if 0), they are in [start, end). The file is
+ * scanned backwards a block at a time.
+ */
+static void linesRange(int fd, int nlines, off_t curr, off_t *start,
+                       off_t *end) {
+  char blk[4096];
+  off_t pos;
+  ssize_t len;
+  int count = 0;
 
+  *start = 0;
+  *end = curr ? curr : lseek(fd, 0, SEEK_END);
+  pos = *end;
+  while (pos > 0) {
+    len = pos > sizeof(blk) ? sizeof(blk) : pos;
+    pos -= len;
+    if (pread(fd, blk, len, pos) != len) {
+      break;
+    }
+    while (len-- > 0) {
+      if (blk[len] != '\n') {
+        continue;
+      }
+      // The first newline found ends the last complete line
+      if (count == 0) {
+        *end = pos + len + 1;
+      }
+      if (count++ == nlines) {
+        *start = pos + len + 1;
+        pos = 0;
+        break;
+      }
+    }
+  }
+  if (count == 0) {
+    *end = 0;
+  }
 }
 
+/*
+ * Send the last nlines complete lines of the log file ending at curr (at
+ * the end of the file if 0) to the client, returns the offset of the
+ * first line sent.
+ */
 long int bufferGetLines(char* fname, int clientfd, int nlines, long int curr) {
-  FILE* fd;
-  int count = 0;
-  int cursize = 0;
-  char ch;
-  char buf[SEND_SIZE];
+  off_t start, end;
+  int fd;
 
-  if (nlines == 0) {
+  if (nlines <= 0) {
     return curr;
   }
 
-  fd = fopen(fname, "r");
-  if (fd == NULL) {
-    perror("fopen");
+  fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    perror("open");
     return -1;
   }
 
-  if (curr) {
-    fseek(fd, curr, SEEK_END);
-  } else {
-    fseek(fd, 0, SEEK_END);
-    curr = ftell(fd);
-  }
+  linesRange(fd, nlines, curr, &start, &end);
+  sendRange(fd, clientfd, start, end);
+  close(fd);
+  return start;
+}
 
-  while (curr) {
-    fseek(fd, --curr, SEEK_SET);
-    if (fgetc(fd) == '\n') {
-      if (count++ == nlines) {
-         break;
-      }
-    }
+/*
+ * Open the log to send its last nlines complete lines, they are in
+ * [start, end) of the returned file descriptor. The line index is used
+ * when it covers them.
+ */
+int bufferOpenLines(bufStore *buf, int nlines, off_t *start, off_t *end) {
+  unsigned int complete;
+  int fd;
+
+  flushBuffer(buf);
+
+  fd = open(buf->file, O_RDONLY);
+  if (fd < 0) {
+    perror("open");
+    return -1;
   }
-  count = 0;
-  if (!curr) {
-    fseek(fd, -1, SEEK_CUR);
+  *start = *end = 0;
+  if (nlines <= 0) {
+    return fd;
   }
-  while (count < nlines) {
-    ch = fgetc(fd);
-    if(ch == '\n') {
-      count++;
-    }
-    buf[cursize++] = ch;
 
-    if(cursize == SEND_SIZE) {
-      send(clientfd, buf , SEND_SIZE, 0);
-      memset(buf, 0, sizeof(buf));
-      cursize = 0;
-    }
+  // The last indexed line is incomplete unless the log ends with a newline
+  complete = buf->lineCount;
+  if (complete && !buf->needTimestamp) {
+    complete--;
   }
-  if (cursize) {
-    send(clientfd, buf, cursize, 0);
+
+  if (nlines <= complete) {
+    *start = indexedLine(buf, complete - nlines);
+  } else if (buf->lineCount && indexedLine(buf, 0) == 0) {
+    // all the log is indexed, and there are fewer lines than asked for
+    *start = 0;
+  } else {
+    linesRange(fd, nlines, 0, start, end);
+    return fd;
   }
-  fclose(fd);
-  return curr;
+  *end = complete < buf->lineCount ? indexedLine(buf, complete) : buf->fileSize;
+  return fd;
 }
@@ -18,6 +18,7 @@
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <time.h>
 
 #define ASCII_DELETE  0177
 #define ESC_CHAR_HELP '?'
@@ -43,6 +44,14 @@
 #define FILE_SIZE_BYTES 300000
 #define FILE_SIZE_MAX_BYTES 10000000
 #define MAX_BYTE 5120
+/* Console data is timestamped into a userspace buffer of LOG_BUF_SIZE
+ * bytes, written to the log file when it is full or when its oldest
+ * data is LOG_FLUSH_MS old (0 to write every chunk at once) */
+#define LOG_BUF_SIZE 16384
+#define LOG_FLUSH_MS 500
+#define LOG_FLUSH_MAX_MS 60000
+/* Offsets of the last LOG_INDEX_LINES line starts in the log file */
+#define LOG_INDEX_LINES 16384
 
 typedef enum escMode {
   EOL,
@@ -58,6 +67,18 @@ typedef struct bufStore {
   char backupfile[PATH_SIZE];
   char needTimestamp;
   unsigned long lineNumber;
+  size_t fileSize;
+  char *wbuf;
+  size_t wlen;
+  int flushMs;
+  struct timespec firstPending;
+  time_t stampTime;
+  char stamp[32];
+  size_t stampLen;
+  uint32_t *lineIdx;
+  unsigned int lineHead;
+  unsigned int lineCount;
+  unsigned int linePending;
 } bufStore;
 
 typedef struct TlvHeader {
@@ -76,7 +97,10 @@ void charSend(int clientfd, char* c, int length);
 bufStore* createBuffer(const char *dev, int fsize);
 void closeBuffer(bufStore* buf);
 long int bufferGetLines(char* fname, int clientfd, int n, long int curr);
+int bufferOpenLines(bufStore *buf, int nlines, off_t *start, off_t *end);
 void writeToBuffer(bufStore *buf, char* data, int len);
+void flushBuffer(bufStore *buf);
+int bufferFlushTimeout(bufStore *buf);
 // tx
 int sendTlv(int fd, uint16_t type, void* value, uint16_t valLen);
 int escSendBreak(int clientfd, char *c);
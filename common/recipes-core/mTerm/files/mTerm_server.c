@@ -23,12 +23,39 @@
 #include <errno.h>
 #include <syslog.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <signal.h>
 #include "tty_helper.h"
 #include "mTerm_helper.h"
 
 #define NUM_CLIENTS 10
+/* Console data a client is behind on, beyond this the overflow policy applies */
+#define CLIENT_RING_SIZE (8 * SEND_SIZE)
+
+typedef enum overflowPolicy {
+  OVERFLOW_DROP,
+  OVERFLOW_DISCONNECT
+} overflowPolicy;
+
+/* Console data queued for a client which could not take it at once, and
+the [histPos, histEnd) range of the log it asked for, sent once the first
+histAfter bytes of the ring are out */
+typedef struct clientRing {
+  char *data;
+  size_t head;
+  size_t len;
+  unsigned long long dropped;
+  int histFd;
+  off_t histPos;
+  off_t histEnd;
+  size_t histAfter;
+} clientRing;
 
 static size_t file_size = FILE_SIZE_BYTES;
+static int flush_ms = LOG_FLUSH_MS;
+static overflowPolicy overflow_policy = OVERFLOW_DROP;
+static clientRing clients[FD_SETSIZE];
+static fd_set writers;
 
 static int createServerSocket(const char* dev) {
   int serverFd;
@@ -88,9 +115,189 @@ static int acceptClient(int serverFd) {
   return fd;
 }
 
+static int historyPending(clientRing *c) {
+  return c->histPos < c->histEnd;
+}
+
 void closeClient(fd_set* master, int clientfd) {
+  if (clients[clientfd].dropped) {
+    syslog(LOG_WARNING, "mTerm_server: Client socket %d dropped %llu bytes\n",
+           clientfd, clients[clientfd].dropped);
+  }
+  free(clients[clientfd].data);
+  if (historyPending(&clients[clientfd])) {
+    close(clients[clientfd].histFd);
+  }
+  memset(&clients[clientfd], 0, sizeof(clientRing));
   close(clientfd);
   FD_CLR(clientfd, master);
+  FD_CLR(clientfd, &writers);
+}
+
+/* Send a part of the history without blocking, the client socket is only
+ * non-blocking meanwhile as its reads expect a whole tlv */
+static ssize_t sendHistory(int clientFd, clientRing *c) {
+  int flags = fcntl(clientFd, F_GETFL);
+  ssize_t rc;
+
+  fcntl(clientFd, F_SETFL, flags | O_NONBLOCK);
+  rc = sendfile(clientFd, c->histFd, &c->histPos, c->histEnd - c->histPos);
+  fcntl(clientFd, F_SETFL, flags);
+  // Done, or the file ended before the range did
+  if (rc == 0 || !historyPending(c)) {
+    close(c->histFd);
+    c->histPos = c->histEnd = 0;
+  }
+  return rc;
+}
+
+/* Send what is queued for the client without blocking, returns -1 if
+ * the client is gone */
+static int flushClient(int clientFd) {
+  clientRing *c = &clients[clientFd];
+  struct iovec vec[2];
+  struct msghdr msg = {0};
+  size_t first, len;
+  ssize_t rc;
+
+  while (c->len || historyPending(c)) {
+    len = historyPending(c) ? c->histAfter : c->len;
+    if (len == 0) {
+      rc = sendHistory(clientFd, c);
+    } else {
+      first = CLIENT_RING_SIZE - c->head;
+      if (first > len) {
+        first = len;
+      }
+      vec[0].iov_base = c->data + c->head;
+      vec[0].iov_len = first;
+      vec[1].iov_base = c->data;
+      vec[1].iov_len = len - first;
+      msg.msg_iov = vec;
+      msg.msg_iovlen = vec[1].iov_len ? 2 : 1;
+      rc = sendmsg(clientFd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    if (rc < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (len) {
+      c->head = (c->head + rc) % CLIENT_RING_SIZE;
+      c->len -= rc;
+      c->histAfter -= historyPending(c) ? rc : 0;
+    }
+  }
+  if (c->len || historyPending(c)) {
+    FD_SET(clientFd, &writers);
+  } else {
+    FD_CLR(clientFd, &writers);
+  }
+  return 0;
+}
+
+/* Queue console data for the client, returns -1 if the client has to be
+ * disconnected */
+static int queueClient(int clientFd, const char *data, size_t len) {
+  clientRing *c = &clients[clientFd];
+  size_t tail, n;
+
+  if (c->data == NULL) {
+    c->data = malloc(CLIENT_RING_SIZE);
+    if (c->data == NULL) {
+      syslog(LOG_ERR, "mTerm_server: Cannot queue data for fd=%d\n", clientFd);
+      return -1;
+    }
+  }
+  if (c->len + len > CLIENT_RING_SIZE) {
+    if (overflow_policy == OVERFLOW_DISCONNECT) {
+      syslog(LOG_ERR, "mTerm_server: Client socket %d too slow\n", clientFd);
+      return -1;
+    }
+    if (c->dropped == 0) {
+      syslog(LOG_WARNING, "mTerm_server: Client socket %d too slow, "
+             "dropping console data\n", clientFd);
+    }
+    // Keep the newest data
+    if (len > CLIENT_RING_SIZE) {
+      c->dropped += len - CLIENT_RING_SIZE;
+      data += len - CLIENT_RING_SIZE;
+      len = CLIENT_RING_SIZE;
+    }
+    n = c->len + len - CLIENT_RING_SIZE;
+    if (n > c->len) {
+      n = c->len;
+    }
+    c->head = (c->head + n) % CLIENT_RING_SIZE;
+    c->len -= n;
+    c->dropped += n;
+    c->histAfter -= n < c->histAfter ? n : c->histAfter;
+  }
+  while (len) {
+    tail = (c->head + c->len) % CLIENT_RING_SIZE;
+    n = CLIENT_RING_SIZE - tail;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(c->data + tail, data, n);
+    c->len += n;
+    data += n;
+    len -= n;
+  }
+  FD_SET(clientFd, &writers);
+  return 0;
+}
+
+/* Send console data to a client, whatever it cannot take now is queued */
+static int sendClient(int clientFd, const char *data, size_t len) {
+  ssize_t rc = 0;
+
+  // Keep the order of the data when some is already queued
+  if (clients[clientFd].len == 0 && !historyPending(&clients[clientFd])) {
+    rc = send(clientFd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (rc < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        return -1;
+      }
+      rc = 0;
+    }
+  }
+  if (rc < len) {
+    return queueClient(clientFd, data + rc, len - rc);
+  }
+  return 0;
+}
+
+/* Queue the last nlines lines of the log for the client, they are sent
+ * after the console data already queued for it. Returns -1 if the client
+ * is gone */
+static int queueHistory(int clientFd, bufStore *buf, int nlines) {
+  clientRing *c = &clients[clientFd];
+  off_t start, end;
+  int fd;
+
+  if (historyPending(c)) {
+    syslog(LOG_WARNING, "mTerm_server: Client socket %d history request "
+           "while sending one, ignored\n", clientFd);
+    return 0;
+  }
+  fd = bufferOpenLines(buf, nlines, &start, &end);
+  if (fd < 0) {
+    return 0;
+  }
+  if (start >= end) {
+    close(fd);
+    return 0;
+  }
+  c->histFd = fd;
+  c->histPos = start;
+  c->histEnd = end;
+  c->histAfter = c->len;
+  return flushClient(clientFd);
 }
 
 void sendBreak(int clientFd, int solFd, char *c) {
@@ -113,8 +320,10 @@ static void processClient(fd_set* master, int clientFd , int solFd,
   nbytesHeader = readv(clientFd, &vecHeader, 1);
   /* Reading client data to which header length info correspond */
   vecData.iov_base = &data;
-  vecData.iov_len = header.length;
+  vecData.iov_len = header.length < sizeof(data) ? header.length : sizeof(data) - 1;
   nbytesData = readv(clientFd, &vecData, 1);
+  // The line count is parsed as a string
+  data[nbytesData > 0 ? nbytesData : 0] = '\0';
 
   if (nbytesHeader <= 0) {
     if (nbytesHeader == 0) {
@@ -146,7 +355,10 @@ static void processClient(fd_set* master, int clientFd , int solFd,
             syslog(LOG_ERR, "mTerm_server: Received incorrect break char");
           }
         } else {
-          bufferGetLines(buf->file, clientFd, atoi(vecData.iov_base), 0);
+          if (queueHistory(clientFd, buf, atoi(vecData.iov_base)) < 0) {
+            syslog(LOG_ERR, "mTerm_server: Error on send fd=%d\n", clientFd);
+            closeClient(master, clientFd);
+          }
         }
         break;
       case 'x':
@@ -163,9 +375,8 @@ static void processClient(fd_set* master, int clientFd , int solFd,
   }
 }
 
-/* TODO: We should support non-blocking writes to clients, and buffer data if
-they don't read it fast enough. If we end up buffering too much data for any
-particular client then we should disconnect that client.
+/* Console data is sent to every client without blocking, a slow client gets
+it queued in its ring and the overflow policy applies once that is full.
 */
 static int processSol(fd_set* master, int serverfd, int fdmax,
                       int solFd, bufStore *buf) {
@@ -178,7 +389,7 @@ static int processSol(fd_set* master, int serverfd, int fdmax,
     for (currFd = 0; currFd <= fdmax; currFd++) {
       if (FD_ISSET(currFd, master)) {
         if ((currFd != serverfd) && (currFd != solFd)) {
-          if (send(currFd, data, nbytes, 0) == -1) {
+          if (sendClient(currFd, data, nbytes) < 0) {
             syslog(LOG_ERR, "mTerm_server: Error on send fd=%d\n", currFd);
             closeClient(master, currFd);
             syslog(LOG_ERR, "mTerm_server: Terminated client fd=%d\n", currFd);
@@ -197,9 +408,10 @@ static int processSol(fd_set* master, int serverfd, int fdmax,
 static void connectServer(const char *stty, const char *dev) {
   int fdmax, newfd;
 
-  fd_set master, read_fds;
+  fd_set master, read_fds, write_fds;
   FD_ZERO(&master);
   FD_ZERO(&read_fds);
+  FD_ZERO(&writers);
 
   int serverfd;
   serverfd = createServerSocket(dev);
@@ -224,21 +436,43 @@ static void connectServer(const char *stty, const char *dev) {
     close(serverfd);
     return;
   }
+  buf->flushMs = flush_ms;
 
   FD_SET(serverfd, &master);
   FD_SET(tty_sol->fd,&master);
   fdmax = (serverfd > tty_sol->fd) ? serverfd : tty_sol->fd;
 
   for(;;) {
+    struct timeval tv, *timeout = NULL;
+    int flush_in = bufferFlushTimeout(buf);
+    int nready;
+
+    // Wake up to write the buffered console data to the log in time
+    if (flush_in >= 0) {
+      tv.tv_sec = flush_in / 1000;
+      tv.tv_usec = (flush_in % 1000) * 1000;
+      timeout = &tv;
+    }
     read_fds = master;
-    if (select(fdmax + 1, &read_fds, NULL, NULL, NULL) == -1) {
+    write_fds = writers;
+    nready = select(fdmax + 1, &read_fds, &write_fds, NULL, timeout);
+    if (nready == -1) {
       syslog(LOG_ERR, "mTerm_server: Server socket: select error\n");
       break;
     }
+    if (bufferFlushTimeout(buf) == 0) {
+      flushBuffer(buf);
+    }
+    if (nready == 0) {
+      continue;
+    }
     if (FD_ISSET(serverfd, &read_fds)) {
       newfd = acceptClient(serverfd);
       if (newfd < 0) {
         syslog(LOG_ERR, "mTerm_server: Error on accepting client\n");
+      } else if (newfd >= FD_SETSIZE) {
+        syslog(LOG_ERR, "mTerm_server: Too many clients\n");
+        close(newfd);
       } else {
         FD_SET(newfd, &master);
         if (newfd > fdmax) {
@@ -253,7 +487,13 @@ static void connectServer(const char *stty, const char *dev) {
     }
     int i;
     for(i = 0; i <= fdmax; i++) {
-      if (FD_ISSET(i, &read_fds)) {
+      if (FD_ISSET(i, &write_fds) && FD_ISSET(i, &master)) {
+        if (flushClient(i) < 0) {
+          syslog(LOG_ERR, "mTerm_server: Error on send fd=%d\n", i);
+          closeClient(&master, i);
+        }
+      }
+      if (FD_ISSET(i, &read_fds) && FD_ISSET(i, &master)) {
         if ((i == serverfd) || (i == tty_sol->fd)) {
           continue;
         } else {
@@ -271,13 +511,18 @@ static void
 print_usage() {
   printf("Usage:\t/usr/local/bin/mTerm_server <fru> /dev/ttyS*\n"
       "\t/usr/local/bin/mTerm_server <fru> /dev/ttyS* baudrate\n"
-      "\t/usr/local/bin/mTerm_server <fru> /dev/ttyS* baudrate max-log-size\n\n"
+      "\t/usr/local/bin/mTerm_server <fru> /dev/ttyS* baudrate max-log-size\n"
+      "\t/usr/local/bin/mTerm_server <fru> /dev/ttyS* baudrate max-log-size log-flush-ms\n"
+      "\t/usr/local/bin/mTerm_server <fru> /dev/ttyS* baudrate max-log-size log-flush-ms drop|disconnect\n\n"
       "\tDefault baudrate: 57600\n"
-      "\tDefault max log size: 300 KB\n");
+      "\tDefault max log size: 300 KB\n"
+      "\tDefault log flush time: %d ms (0 to write the log on every read)\n"
+      "\tDefault slow client policy: drop (its oldest console data)\n",
+      LOG_FLUSH_MS);
 }
 
 int main(int argc, char **argv) {
-  if (argc < 3 || argc > 5) {
+  if (argc < 3 || argc > 7) {
     print_usage();
     exit(1);
   }
@@ -294,7 +539,7 @@ int main(int argc, char **argv) {
       baudrate = BAUDRATE;
   }
 
-  if (argc == 5) {
+  if (argc >= 5) {
     file_size = strtol(argv[4], NULL, 10);
     if (errno || file_size < FILE_SIZE_BYTES || file_size > FILE_SIZE_MAX_BYTES) {
       printf("File size must be between %d and %d bytes\n", FILE_SIZE_BYTES, FILE_SIZE_MAX_BYTES);
@@ -302,6 +547,25 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (argc >= 6) {
+    flush_ms = strtol(argv[5], NULL, 10);
+    if (errno || flush_ms < 0 || flush_ms > LOG_FLUSH_MAX_MS) {
+      printf("Log flush time must be between 0 and %d ms\n", LOG_FLUSH_MAX_MS);
+      exit(-1);
+    }
+  }
+
+  if (argc == 7) {
+    if (!strcmp(argv[6], "drop")) {
+      overflow_policy = OVERFLOW_DROP;
+    } else if (!strcmp(argv[6], "disconnect")) {
+      overflow_policy = OVERFLOW_DISCONNECT;
+    } else {
+      print_usage();
+      exit(1);
+    }
+  }
+
   int ret;
   char file[PATH_SIZE];
   ret = snprintf(file, sizeof(file), "/var/lock/mTerm_%s", dev);
@@ -326,6 +590,8 @@ int main(int argc, char **argv) {
     }
   } else {
     openlog("mTerm_log", LOG_CONS, LOG_DAEMON);
+    // A client hanging up is handled where the write to it fails
+    signal(SIGPIPE, SIG_IGN);
     syslog(LOG_INFO, "mTerm: daemon started");
 
     connectServer(stty, dev);
@@ -34,9 +34,10 @@
 
 void usage() {
   fprintf(stderr,
-      "modbuscmd [-v] [-t <timeout in ms>] [-x <expected response length>] modbus_command\n"
+      "modbuscmd [-v] [-t <timeout in ms>] [-x <expected response length>] [-p <port>] modbus_command\n"
       "\tmodbus command should be specified in hex\n"
       "\teg:\ta40300000008\n"
+      "\twithout a port the command goes to the port the PSU was detected on\n"
       "\tif an expected response length is provided, modbuscmd will stop receving and check crc immediately "
       "after receiving that many bytes\n");
   exit(1);
@@ -49,15 +50,17 @@ int main(int argc, char **argv) {
     size_t cmd_len = 0;
     int expected = 0;
     uint32_t timeout = 0;
+    int port = -1;
     verbose = 0;
     rackmond_command *cmd = NULL;
+    raw_modbus_command *raw;
     char *response = NULL;
     int clisock;
     uint16_t response_len_actual;
     struct sockaddr_un rackmond_addr;
 
     int opt;
-    while((opt = getopt(argc, argv, "w:x:t:g:v")) != -1) {
+    while((opt = getopt(argc, argv, "w:x:t:g:p:v")) != -1) {
       switch (opt) {
       case 'x':
         expected = atoi(optarg);
@@ -65,6 +68,9 @@ int main(int argc, char **argv) {
       case 't':
         timeout = atol(optarg);
         break;
+      case 'p':
+        port = atoi(optarg);
+        break;
       case 'v':
         verbose = 1;
         break;
@@ -88,12 +94,19 @@ int main(int argc, char **argv) {
     }
     
     cmd = malloc(sizeof(rackmond_command) + cmd_len);
-    cmd->type = COMMAND_TYPE_RAW_MODBUS;
-    cmd->raw_modbus.custom_timeout = timeout;
-    memcpy(cmd->raw_modbus.data, modbus_cmd, cmd_len);
-    decode_hex_in_place(cmd->raw_modbus.data, &cmd_len);
-    cmd->raw_modbus.length = cmd_len;
-    cmd->raw_modbus.expected_response_length = expected;
+    if (port >= 0) {
+      cmd->type = COMMAND_TYPE_RAW_MODBUS_PORT;
+      cmd->raw_modbus_port.port = port;
+      raw = &cmd->raw_modbus_port.raw;
+    } else {
+      cmd->type = COMMAND_TYPE_RAW_MODBUS;
+      raw = &cmd->raw_modbus;
+    }
+    raw->custom_timeout = timeout;
+    memcpy(raw->data, modbus_cmd, cmd_len);
+    decode_hex_in_place(raw->data, &cmd_len);
+    raw->length = cmd_len;
+    raw->expected_response_length = expected;
     response = malloc(expected ? expected : 1024);
     uint16_t wire_cmd_len = sizeof(rackmond_command) + cmd_len;
 
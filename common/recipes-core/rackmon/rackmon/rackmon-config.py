@@ -5,13 +5,13 @@ from rackmond import configure_rackmond
 
 
 reglist = [
-    {"begin": 0x0, "length": 8},  # MFR_MODEL
-    {"begin": 0x10, "length": 8},  # MFR_DATE
-    {"begin": 0x20, "length": 8},  # FB Part #
-    {"begin": 0x30, "length": 4},  # HW Revision
-    {"begin": 0x38, "length": 4},  # FW Revision
-    {"begin": 0x40, "length": 16},  # MFR Serial #
-    {"begin": 0x60, "length": 4},  # Workorder #
+    {"begin": 0x0, "length": 8, "flags": 2},  # MFR_MODEL
+    {"begin": 0x10, "length": 8, "flags": 2},  # MFR_DATE
+    {"begin": 0x20, "length": 8, "flags": 2},  # FB Part #
+    {"begin": 0x30, "length": 4, "flags": 2},  # HW Revision
+    {"begin": 0x38, "length": 4, "flags": 2},  # FW Revision
+    {"begin": 0x40, "length": 16, "flags": 2},  # MFR Serial #
+    {"begin": 0x60, "length": 4, "flags": 2},  # Workorder #
     {
         "begin": 0x68,  # PSU Status
         "length": 1,
@@ -101,13 +101,13 @@ reglist = [
     {"begin": 0xD7, "length": 1},  # Temperature Alarm Status Register
     {"begin": 0xD8, "length": 1},  # Fan Alarm Status Register
     {"begin": 0xD9, "length": 1},  # Communication Alarm Status Register
-    {"begin": 0x106, "length": 1},  # BBU Specification Info
-    {"begin": 0x107, "length": 1},  # BBU Manufacturer Date
-    {"begin": 0x108, "length": 1},  # BBU Serial Number
-    {"begin": 0x109, "length": 2},  # BBU Device Chemistry
-    {"begin": 0x10B, "length": 2},  # BBU Manufacturer Data
-    {"begin": 0x10D, "length": 8},  # BBU Manufacturer Name
-    {"begin": 0x115, "length": 8},  # BBU Device Name
+    {"begin": 0x106, "length": 1, "flags": 2},  # BBU Specification Info
+    {"begin": 0x107, "length": 1, "flags": 2},  # BBU Manufacturer Date
+    {"begin": 0x108, "length": 1, "flags": 2},  # BBU Serial Number
+    {"begin": 0x109, "length": 2, "flags": 2},  # BBU Device Chemistry
+    {"begin": 0x10B, "length": 2, "flags": 2},  # BBU Manufacturer Data
+    {"begin": 0x10D, "length": 8, "flags": 2},  # BBU Manufacturer Name
+    {"begin": 0x115, "length": 8, "flags": 2},  # BBU Device Name
     {"begin": 0x11D, "length": 4},  # FB Battery Status
     {"begin": 0x121, "length": 1},  # SoH results
     {"begin": 0x122, "length": 1},  # Fan RPM Override
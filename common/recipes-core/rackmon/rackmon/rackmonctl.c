@@ -52,6 +52,10 @@ static struct {
         .name = "resume",
         .type = COMMAND_TYPE_START_MONITORING,
     },
+    {
+        .name = "export",
+        .type = COMMAND_TYPE_DUMP_DATA_BINARY,
+    },
 
     /*
      * Make sure this is the last entry.
@@ -70,6 +74,8 @@ static void usage(const char *prog_name)
     for (i = 0; cmd_map[i].name != NULL; i++) {
         fprintf(stderr, " - %s\n", cmd_map[i].name);
     }
+    fprintf(stderr, "\"export [since]\" writes the binary data (see "
+            "rackmond.h), only readings newer than <since> if given\n");
 }
 
 int main(int argc, char **argv) {
@@ -110,6 +116,9 @@ int main(int argc, char **argv) {
         usage(argv[0]);
         return -1;
     }
+    if (cmd.type == COMMAND_TYPE_DUMP_DATA_BINARY) {
+        cmd.dump_data.since = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+    }
 
     clisock = socket(AF_UNIX, SOCK_STREAM, 0);
     ERR_LOG_EXIT(clisock, "failed to create socket");
@@ -30,6 +30,7 @@
 #define DAEMON_NAME  "rackmond"
 
 #define MAX_ACTIVE_ADDRS 24
+#define MAX_PORTS        4
 #define MAX_RACKS        3
 #define MAX_SHELVES      2
 #define MAX_PSUS         3
@@ -74,10 +75,30 @@ const static speed_t BAUDRATE_VALUES[] = {
 #define PSU_SCAN_INTERVAL 120
 
 /*
- * A small amount of delay (in seconds) during PSU access, mainly for
- * reducing the average CPU usage.
+ * Default poll periods (in milliseconds) of the register ranges: status
+ * flag registers are polled fast, inventory registers slow and everything
+ * else in between. They can be overridden with RACKMOND_FAST_PERIOD,
+ * RACKMOND_NORMAL_PERIOD and RACKMOND_SLOW_PERIOD.
  */
-#define PSU_ACCESS_NICE_DELAY 3
+#define POLL_PERIOD_FAST    500
+#define POLL_PERIOD_NORMAL  10000
+#define POLL_PERIOD_SLOW    300000
+
+/*
+ * Register ranges of a PSU that are close in the register map and due
+ * about the same time are read in one transaction. MERGE_MAX_GAP is the
+ * number of unused registers read along in between, the whole span is
+ * limited by what a single Function 3 request can return.
+ */
+#define MODBUS_MAX_READ_REGS 125
+#define MERGE_MAX_GAP 8
+
+enum {
+  POLL_CLASS_FAST = 0,
+  POLL_CLASS_NORMAL,
+  POLL_CLASS_SLOW,
+  POLL_CLASS_MAX,
+};
 
 /*
  * REG_INT_DATA_SIZE defines the memory size required to store a specific
@@ -98,16 +119,24 @@ const static speed_t BAUDRATE_VALUES[] = {
   }                                                  \
 } while (0)
 
-static int scanning = 0;
-
 typedef struct {
-  // hold this for the duration of a command
+  // protects "busy" and "urgent_waiting", the bus itself is owned by
+  // whoever set "busy" for the duration of a command
   pthread_mutex_t lock;
 #define dev_lock(_d)   mutex_lock_helper(&((_d)->lock), "dev_lock")
 #define dev_unlock(_d) mutex_unlock_helper(&((_d)->lock), "dev_lock")
+  pthread_cond_t idle;
+  bool busy;
+  // raw commands waiting for the bus, polling yields to them
+  int urgent_waiting;
   int tty_fd;
 } rs485_dev_t;
 
+// set in the monitoring thread, whose transactions have the lowest priority
+static __thread bool polling_thread = false;
+// bus held by this thread across several transfers, see psu_bus_begin()
+static __thread rs485_dev_t *held_dev = NULL;
+
 typedef struct {
   uint16_t begin; /* starting register address */
   int num;        /* number of registers */
@@ -117,6 +146,8 @@ typedef struct {
   monitor_interval* i;
   void* mem_begin;
   size_t mem_pos;
+  uint64_t next_poll; // CLOCK_MONOTONIC, in ms
+  bool no_merge_next; // the PSU rejected a read spanning the next range
 } reg_range_data_t;
 
 typedef struct {
@@ -128,9 +159,34 @@ typedef struct {
   int consecutive_failures;
   bool timeout_mode;
   time_t last_comms;
+  size_t size; // of the whole allocation, including the register data
   reg_range_data_t range_data[1];
 } psu_datastore_t;
 
+/*
+ * One RS-485 bus and the PSUs found on it, polled by its own monitoring
+ * thread. The fields after "lock" are protected by it.
+ */
+typedef struct {
+  int index;
+  const char *tty;
+  rs485_dev_t rs485;
+  pthread_t monitoring_tid;
+
+  pthread_mutex_t lock;
+#define port_lock(_p)   mutex_lock_helper(&(_p)->lock, "port_lock")
+#define port_unlock(_p) mutex_unlock_helper(&(_p)->lock, "port_lock")
+  // wakes up the monitoring thread, waited on with the port lock
+  pthread_cond_t wakeup;
+  bool kicked;
+  int scanning;
+  time_t search_at;
+  uint32_t last_scan_ms;
+  uint8_t num_active_addrs;
+  uint8_t active_addrs[MAX_ACTIVE_ADDRS];
+  psu_datastore_t* stored_data[MAX_ACTIVE_ADDRS];
+} rackmon_port_t;
+
 typedef struct {
   char* buffer;
   size_t len;
@@ -139,7 +195,8 @@ typedef struct {
 } write_buf_t;
 
 /*
- * Global rackmond config structure, protected by its mutex lock.
+ * Global rackmond config structure, protected by its mutex lock. When
+ * both are needed, the global lock is taken before a port lock.
  */
 static struct {
   // global rackmond lock
@@ -153,9 +210,6 @@ static struct {
   reg_req_t *reqs;
   monitoring_config *config;
 
-  uint8_t num_active_addrs;
-  uint8_t active_addrs[MAX_ACTIVE_ADDRS];
-  psu_datastore_t* stored_data[MAX_ACTIVE_ADDRS];
   FILE *status_log;
 
   // timeout in nanosecs
@@ -169,13 +223,27 @@ static struct {
   // the value we will auto-adjust to if possible
   speed_t desired_baudrate;
 
-  rs485_dev_t rs485;
+  // poll period of each POLL_CLASS_*, in ms
+  int poll_period[POLL_CLASS_MAX];
+
+  int num_ports;
+  rackmon_port_t ports[MAX_PORTS];
 } rackmond_config = {
   .lock = PTHREAD_MUTEX_INITIALIZER,
   .modbus_timeout = 300000,
   .desired_baudrate = DEFAULT_BAUDRATE,
+  .poll_period = {
+    [POLL_CLASS_FAST] = POLL_PERIOD_FAST,
+    [POLL_CLASS_NORMAL] = POLL_PERIOD_NORMAL,
+    [POLL_CLASS_SLOW] = POLL_PERIOD_SLOW,
+  },
 };
 
+// This flag is triggered by SIGTERM and SIGINT signal handlers
+// indicating that the program should finish up what it's doing and exit
+// gracefully
+volatile sig_atomic_t should_exit;
+
 static int mutex_lock_helper(pthread_mutex_t *lock, const char *name)
 {
   int error = pthread_mutex_lock(lock);
@@ -198,6 +266,84 @@ static int mutex_unlock_helper(pthread_mutex_t *lock, const char *name)
   return 0;
 }
 
+static uint64_t monotonic_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Wake up the monitoring threads, optionally to rescan for PSUs. Called
+ * with the global lock held.
+ */
+static void wakeup_monitoring(bool rescan)
+{
+  int i;
+  rackmon_port_t *port;
+
+  for (i = 0; i < rackmond_config.num_ports; i++) {
+    port = &rackmond_config.ports[i];
+    if (port_lock(port) != 0) {
+      continue;
+    }
+    if (rescan) {
+      TIME_UPDATE(port->search_at);
+    }
+    port->kicked = true;
+    pthread_cond_signal(&port->wakeup);
+    port_unlock(port);
+  }
+}
+
+static bool monitoring_active(void)
+{
+  bool active;
+
+  if (global_lock() != 0) {
+    return false;
+  }
+  active = (rackmond_config.paused == 0 && rackmond_config.config != NULL);
+  global_unlock();
+  return active;
+}
+
+/*
+ * Take the bus for one command. Raw commands are "urgent": they are
+ * granted the bus as soon as the current transaction finishes, while
+ * polling waits until no urgent command is queued.
+ */
+static int dev_acquire(rs485_dev_t *dev, bool urgent)
+{
+  if (dev_lock(dev) != 0) {
+    return -1;
+  }
+  if (urgent) {
+    dev->urgent_waiting++;
+    while (dev->busy) {
+      pthread_cond_wait(&dev->idle, &dev->lock);
+    }
+    dev->urgent_waiting--;
+  } else {
+    while (dev->busy || dev->urgent_waiting > 0) {
+      pthread_cond_wait(&dev->idle, &dev->lock);
+    }
+  }
+  dev->busy = true;
+  return dev_unlock(dev);
+}
+
+static void dev_release(rs485_dev_t *dev)
+{
+  if (dev_lock(dev) != 0) {
+    return;
+  }
+  dev->busy = false;
+  pthread_cond_broadcast(&dev->idle);
+  dev_unlock(dev);
+}
+
 static int buf_open(write_buf_t* buf, int fd, size_t len) {
   int error = 0;
   char* bufmem;
@@ -334,13 +480,13 @@ static uint16_t baudrate_to_value(speed_t baudrate) {
   return value;
 }
 
-static int lookup_data_slot(uint8_t addr)
+static int lookup_data_slot(rackmon_port_t *port, uint8_t addr)
 {
   int i;
 
-  for (i = 0; i < ARRAY_SIZE(rackmond_config.stored_data); i++) {
-    if (rackmond_config.stored_data[i] == NULL ||
-        rackmond_config.stored_data[i]->addr == addr) {
+  for (i = 0; i < ARRAY_SIZE(port->stored_data); i++) {
+    if (port->stored_data[i] == NULL ||
+        port->stored_data[i]->addr == addr) {
       return i; /* Found the slot */
     }
   }
@@ -401,17 +547,19 @@ static void update_psu_comms(psu_datastore_t *psu, bool success) {
   }
 }
 
-static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
+static int modbus_command(rackmon_port_t *port, int timeout, char* cmd_buf,
                           size_t cmd_size, char* resp_buf, size_t resp_size,
                           size_t exp_resp_len, speed_t baudrate) {
   modbus_req req;
   int error;
   useconds_t delay = rackmond_config.min_delay;
   psu_datastore_t* psu = NULL;
+  rs485_dev_t *dev = &port->rs485;
+  bool held = (held_dev == dev);
 
-  int slot = lookup_data_slot(cmd_buf[0]);
+  int slot = lookup_data_slot(port, cmd_buf[0]);
   if (slot >= 0) {
-    psu = rackmond_config.stored_data[slot];
+    psu = port->stored_data[slot];
   }
 
   if (check_psu_comms(psu) < 0) {
@@ -425,9 +573,9 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
   req.dest_limit = resp_size;
   req.timeout = timeout;
   req.expected_len = (exp_resp_len != 0 ? exp_resp_len : resp_size);
-  req.scan = scanning;
+  req.scan = port->scanning;
 
-  if (dev_lock(dev) != 0) {
+  if (!held && dev_acquire(dev, !polling_thread) != 0) {
     return -1;
   }
 
@@ -448,9 +596,15 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
     if (error >= 0) {
       break;
     }
+    // do not hold a raw command back for the retries of a poll
+    if (polling_thread && __atomic_load_n(&dev->urgent_waiting, __ATOMIC_RELAXED)) {
+      break;
+    }
   }
 
-  dev_unlock(dev);
+  if (!held) {
+    dev_release(dev);
+  }
   update_psu_comms(psu, (error >= 0));
 
   if (error < 0) {
@@ -474,7 +628,7 @@ static int modbus_command(rs485_dev_t* dev, int timeout, char* cmd_buf,
  */
 #define MODBUS_FUN3_RESP_PKT_SIZE(nreg) (2 * (nreg) + 5)
 
-static int read_holding_reg(rs485_dev_t *dev, int timeout, uint8_t slave_addr,
+static int read_holding_reg(rackmon_port_t *port, int timeout, uint8_t slave_addr,
                             uint16_t reg_start_addr, uint16_t reg_count,
                             uint16_t *out, speed_t baudrate) {
   int error = 0;
@@ -496,7 +650,7 @@ static int read_holding_reg(rs485_dev_t *dev, int timeout, uint8_t slave_addr,
   command[4] = reg_count >> 8;
   command[5] = reg_count & 0xFF;
 
-  dest_len = modbus_command(dev, timeout, command, MODBUS_FUN3_REQ_HDR_SIZE,
+  dest_len = modbus_command(port, timeout, command, MODBUS_FUN3_REQ_HDR_SIZE,
                             resp_buf, resp_len, 0, baudrate);
   ERR_EXIT(dest_len);
 
@@ -545,7 +699,7 @@ cleanup:
  */
 #define MODBUS_FUN6_RESP_PKT_SIZE(nreg) (2 * (nreg) + 6)
 
-static int write_holding_reg(rs485_dev_t *dev, int timeout, uint8_t slave_addr,
+static int write_holding_reg(rackmon_port_t *port, int timeout, uint8_t slave_addr,
                              uint16_t reg_start_addr, uint16_t reg_count,
                              uint16_t *reg_values, uint16_t *out, speed_t baudrate) {
   int error = 0;
@@ -571,7 +725,7 @@ static int write_holding_reg(rs485_dev_t *dev, int timeout, uint8_t slave_addr,
     command[i * 2 + 5] = reg_values[i] & 0xFF;
   }
 
-  dest_len = modbus_command(dev, timeout, command, cmd_len, resp_buf, resp_len,
+  dest_len = modbus_command(port, timeout, command, cmd_len, resp_buf, resp_len,
                             0, baudrate);
   ERR_EXIT(dest_len);
 
@@ -605,15 +759,18 @@ static int sub_uint8s(const void* a, const void* b) {
 
 /*
  * Check the baudrate used by this PSU.
- * If a higher baudrate is desired, and all PSUs in the rack support it,
+ * If a higher baudrate is desired, and all PSUs on the port support it,
  * then raise the baudrate to the desired value for just this PSU.
+ * Called with the bus held, see psu_bus_begin().
  */
-static int check_psu_baudrate(psu_datastore_t *psu, speed_t *baudrate_out) {
+static int check_psu_baudrate(rackmon_port_t *port, psu_datastore_t *psu,
+                              speed_t *baudrate_out) {
   int pos, err;
   bool supported = true;
   uint16_t output[2];
   uint16_t values[1];
   psu_datastore_t *mdata;
+  speed_t baudrate;
 
   if (psu == NULL) {
     OBMC_WARN("check_psu_baudrate received a null PSU argument, assuming default baudrate");
@@ -621,15 +778,21 @@ static int check_psu_baudrate(psu_datastore_t *psu, speed_t *baudrate_out) {
     return 0;
   }
 
+  if (port_lock(port) != 0) {
+    return -1;
+  }
+  baudrate = psu->baudrate;
+
   // only attempt to raise the baudrate if it doesn't already match the desired baudrate
-  if (psu->baudrate == rackmond_config.desired_baudrate) {
-    *baudrate_out = psu->baudrate;
+  if (baudrate == rackmond_config.desired_baudrate) {
+    port_unlock(port);
+    *baudrate_out = baudrate;
     return 0;
   }
 
   // only attempt to raise the baudrate if all connected PSUs support it
-  for (pos = 0; pos < ARRAY_SIZE(rackmond_config.stored_data); pos++) {
-    mdata = rackmond_config.stored_data[pos];
+  for (pos = 0; pos < ARRAY_SIZE(port->stored_data); pos++) {
+    mdata = port->stored_data[pos];
     if (mdata == NULL) {
       continue;
     }
@@ -638,17 +801,22 @@ static int check_psu_baudrate(psu_datastore_t *psu, speed_t *baudrate_out) {
     }
   }
 
+  port_unlock(port);
+
   if (!supported) {
-    *baudrate_out = psu->baudrate;
+    *baudrate_out = baudrate;
     return 0;
   }
 
   // now attempt to raise the baudrate for this PSU
   values[0] = baudrate_to_value(rackmond_config.desired_baudrate);
-  err = write_holding_reg(&rackmond_config.rs485, BAUDRATE_CMD_TIMEOUT,
+  err = write_holding_reg(port, BAUDRATE_CMD_TIMEOUT,
                           psu->addr, REGISTER_PSU_BAUDRATE, 1, values, output,
-                          psu->baudrate);
+                          baudrate);
 
+  if (port_lock(port) != 0) {
+    return -1;
+  }
   // if unsuccessful, assume that the unit's baudrate didn't change
   if (err != 0) {
     OBMC_WARN("Could not set PSU at addr %02x to desired baudrate", psu->addr);
@@ -658,70 +826,113 @@ static int check_psu_baudrate(psu_datastore_t *psu, speed_t *baudrate_out) {
   }
 
   *baudrate_out = psu->baudrate;
+  port_unlock(port);
   return err;
 }
 
 /*
- * Scan connected PSUs. Executed in monitoring thread.
+ * Take the bus of the port for transfers to "psu", raising the baudrate
+ * of the PSU first if needed. The baudrate write goes out in the same
+ * bus window as the transfers, so it keeps their priority: a poll never
+ * holds up a raw command with it. Returns the baudrate to use in
+ * "baudrate_out", the bus is only held on success.
  */
-static int check_active_psus(void) {
-  int num_psus;
-  int rack, shelf, psu, offset;
+static int psu_bus_begin(rackmon_port_t *port, psu_datastore_t *psu,
+                         speed_t *baudrate_out) {
+  int err;
 
-  if (global_lock() != 0) {
+  if (dev_acquire(&port->rs485, !polling_thread) != 0) {
     return -1;
   }
-  if (rackmond_config.paused == 1 || rackmond_config.config == NULL) {
-    global_unlock();
+  held_dev = &port->rs485;
+  err = check_psu_baudrate(port, psu, baudrate_out);
+  if (err != 0) {
+    held_dev = NULL;
+    dev_release(&port->rs485);
+  }
+  return err;
+}
+
+static void psu_bus_end(rackmon_port_t *port) {
+  held_dev = NULL;
+  dev_release(&port->rs485);
+}
+
+/*
+ * Scan connected PSUs. Executed in monitoring thread of the port. The
+ * bus is probed without the port lock, the result is published at the
+ * end, so that requests on the port are not held up by the scan.
+ */
+static int check_active_psus(rackmon_port_t *port) {
+  int num_psus;
+  uint64_t scan_begin;
+  int rack, shelf, psu, offset;
+  uint8_t active_addrs[MAX_ACTIVE_ADDRS];
+
+  if (!monitoring_active()) {
     return 0;
   }
+  if (port_lock(port) != 0) {
+    return -1;
+  }
+  port->scanning = 1;
+  port_unlock(port);
 
   offset = 0;
-  scanning = 1;
-  for (rack = 0; rack < MAX_RACKS; rack++) {
-    for (shelf = 0; shelf < MAX_SHELVES; shelf++) {
-      for (psu = 0; psu < MAX_PSUS; psu++) {
+  scan_begin = monotonic_ms();
+  for (rack = 0; rack < MAX_RACKS && !should_exit; rack++) {
+    for (shelf = 0; shelf < MAX_SHELVES && !should_exit; shelf++) {
+      for (psu = 0; psu < MAX_PSUS && !should_exit; psu++) {
         int err, slot;
         uint16_t output = 0;
         speed_t baudrate;
         char addr = psu_address(rack, shelf, psu);
 
-        slot = lookup_data_slot((uint8_t) addr);
-        if (slot < 0 || rackmond_config.stored_data[slot] == NULL) {
+        // only this thread changes the datastore slots of the port
+        slot = lookup_data_slot(port, (uint8_t) addr);
+        if (slot < 0 || port->stored_data[slot] == NULL) {
           // No allocated slot exists for psu at this addr yet, not a real error
-          baudrate = DEFAULT_BAUDRATE;
+          err = read_holding_reg(port, rackmond_config.modbus_timeout, addr,
+                                 REGISTER_PSU_STATUS, 1, &output,
+                                 DEFAULT_BAUDRATE);
         } else {
-          err = check_psu_baudrate(rackmond_config.stored_data[slot], &baudrate);
+          err = psu_bus_begin(port, port->stored_data[slot], &baudrate);
           if (err != 0) {
             OBMC_WARN("Unable to check baudrate for PSU at addr %02x", addr);
             continue;
           }
+          err = read_holding_reg(port, rackmond_config.modbus_timeout, addr,
+                                 REGISTER_PSU_STATUS, 1, &output, baudrate);
+          psu_bus_end(port);
         }
-
-        err = read_holding_reg(&rackmond_config.rs485,
-                               rackmond_config.modbus_timeout, addr,
-                               REGISTER_PSU_STATUS, 1, &output, baudrate);
         if (err != 0) {
           continue;
         }
-        if (offset >= ARRAY_SIZE(rackmond_config.active_addrs)) {
+        if (offset >= ARRAY_SIZE(active_addrs)) {
           OBMC_WARN("Too many PSUs detected: addr %#02x ignored.", addr);
           continue;
         }
 
-        dbg("detected PSU at addr %#02x", addr);
-        rackmond_config.active_addrs[offset++] = addr;
+        dbg("detected PSU at addr %#02x on port %d", addr, port->index);
+        active_addrs[offset++] = addr;
       }
     }
   }
-  num_psus = rackmond_config.num_active_addrs = offset;
 
   //its the only stdlib sort
-  qsort(rackmond_config.active_addrs, rackmond_config.num_active_addrs,
-        sizeof(uint8_t), sub_uint8s);
+  qsort(active_addrs, offset, sizeof(uint8_t), sub_uint8s);
 
-  scanning = 0;
-  global_unlock();
+  if (port_lock(port) != 0) {
+    return -1;
+  }
+  port->scanning = 0;
+  if (!should_exit) {
+    memcpy(port->active_addrs, active_addrs, offset);
+    port->num_active_addrs = offset;
+    port->last_scan_ms = monotonic_ms() - scan_begin;
+  }
+  num_psus = port->num_active_addrs;
+  port_unlock(port);
 
   return num_psus;
 }
@@ -786,6 +997,7 @@ static psu_datastore_t* alloc_monitoring_data(uint8_t addr) {
   }
 
   d->addr = addr;
+  d->size = size;
   d->crc_errors = 0;
   d->timeout_errors = 0;
   d->baudrate = DEFAULT_BAUDRATE;
@@ -828,39 +1040,37 @@ static int sub_storeptrs(const void* va, const void *vb) {
   return (int)(a->addr - b->addr);
 }
 
-static int alloc_monitoring_datas(void) {
+static int alloc_monitoring_datas(rackmon_port_t *port) {
   int i;
   int error = 0;
 
-  if (global_lock() != 0) {
-    return -1;
-  }
-
-  if (rackmond_config.config == NULL) {
-    global_unlock();
+  if (!monitoring_active()) {
     return 0;
   }
+  if (port_lock(port) != 0) {
+    return -1;
+  }
 
-  qsort(rackmond_config.stored_data, MAX_ACTIVE_ADDRS,
+  qsort(port->stored_data, MAX_ACTIVE_ADDRS,
         sizeof(psu_datastore_t*), sub_storeptrs);
 
-  for (i = 0; i < rackmond_config.num_active_addrs; i++) {
+  for (i = 0; i < port->num_active_addrs; i++) {
     int slot;
-    uint8_t addr = rackmond_config.active_addrs[i];
+    uint8_t addr = port->active_addrs[i];
 
-    slot = lookup_data_slot(addr);
+    slot = lookup_data_slot(port, addr);
     if (slot < 0) {
       OBMC_WARN("no data space left for psu addr %#02x", addr);
       error = -1;
       break;
     }
 
-    if (rackmond_config.stored_data[slot] == NULL) {
+    if (port->stored_data[slot] == NULL) {
       // this will only be logged once per address
-      OBMC_INFO("Detected PSU at address 0x%02x", addr);
+      OBMC_INFO("Detected PSU at address 0x%02x on port %d", addr, port->index);
 
-      rackmond_config.stored_data[slot] = alloc_monitoring_data(addr);
-      if (rackmond_config.stored_data[slot] == NULL) {
+      port->stored_data[slot] = alloc_monitoring_data(addr);
+      if (port->stored_data[slot] == NULL) {
         OBMC_WARN("failed to allocate datastore for psu addr %#02x", addr);
         error = -1;
         break;
@@ -868,7 +1078,7 @@ static int alloc_monitoring_datas(void) {
     }
   } /* for */
 
-  global_unlock();
+  port_unlock(port);
   return error;
 }
 
@@ -924,6 +1134,7 @@ struct rackmon_io_handler *rackmon_io = &uart_rs485_io;
 static void rs485_device_cleanup(rs485_dev_t *dev)
 {
   if (dev->tty_fd >= 0) {
+    pthread_cond_destroy(&dev->idle);
     pthread_mutex_destroy(&dev->lock);
     close(dev->tty_fd);
   }
@@ -931,9 +1142,19 @@ static void rs485_device_cleanup(rs485_dev_t *dev)
 
 static int rs485_device_init(const char* tty_dev, rs485_dev_t *dev) {
   int ret = 0;
+  struct rackmon_io_handler io = *rackmon_io;
 
+  // the platform decides how to open a port, we only pick which one
+  io.dev_path = tty_dev;
   dbg("Opening %s\n", tty_dev);
-  dev->tty_fd = rackmon_io->open(rackmon_io);
+  if (getenv("RACKMOND_PLAIN_TTY") != NULL) {
+    // e.g. the pty of rackmonsim, which has no RS485 mode
+    dev->tty_fd = open(tty_dev, O_RDWR | O_NOCTTY);
+    if (dev->tty_fd < 0)
+      OBMC_ERROR(errno, "failed to open %s", tty_dev);
+  } else {
+    dev->tty_fd = io.open(&io);
+  }
   if (dev->tty_fd < 0)
     return -1;
 
@@ -946,23 +1167,31 @@ static int rs485_device_init(const char* tty_dev, rs485_dev_t *dev) {
     return -1;
   }
 
+  ret = pthread_cond_init(&dev->idle, NULL);
+  if (ret != 0) {
+    OBMC_ERROR(ret, "failed to initialize rs485 dev condition");
+    pthread_mutex_destroy(&dev->lock);
+    close(dev->tty_fd);  /* ignore errors */
+    dev->tty_fd = -1;
+    errno = ret;
+    return -1;
+  }
+  dev->busy = false;
+  dev->urgent_waiting = 0;
+
   return 0;
 }
 
-// This flag is triggered by SIGTERM and SIGINT signal handlers
-// indicating that the program should finish up what it's doing and exit
-// gracefully
-volatile sig_atomic_t should_exit;
-
 static void trigger_graceful_exit(int sig) {
   should_exit = 1;
 }
 
 static int reset_psu_baudrate(void) {
-  int pos, ret = 0, err;
+  int i, pos, ret = 0, err;
   uint16_t output[2];
   uint16_t values[1];
   psu_datastore_t *mdata;
+  rackmon_port_t *port;
 
   global_lock();
   rackmond_config.paused = 1;
@@ -971,25 +1200,27 @@ static int reset_psu_baudrate(void) {
 
   // set all connected PSUs back to the default baud rate
   OBMC_INFO("restoring PSUs to the default baud rate");
-  for (pos = 0; pos < ARRAY_SIZE(rackmond_config.stored_data); pos++) {
-    mdata = rackmond_config.stored_data[pos];
-    if (mdata == NULL) {
-      continue;
-    }
-    if (mdata->baudrate <= 0) {
-      continue;
-    }
-    if (mdata->baudrate != DEFAULT_BAUDRATE) {
-      values[0] = baudrate_to_value(DEFAULT_BAUDRATE);
-      err = write_holding_reg(&rackmond_config.rs485,
-                              BAUDRATE_CMD_TIMEOUT, mdata->addr,
-                              REGISTER_PSU_BAUDRATE, 1, values, output,
-                              mdata->baudrate);
-
-      if (err != 0) {
-        OBMC_WARN("Unable to reset PSU %02x to the original baudrate",
-                  mdata->addr);
-        ret = 1;
+  for (i = 0; i < rackmond_config.num_ports; i++) {
+    port = &rackmond_config.ports[i];
+    for (pos = 0; pos < ARRAY_SIZE(port->stored_data); pos++) {
+      mdata = port->stored_data[pos];
+      if (mdata == NULL) {
+        continue;
+      }
+      if (mdata->baudrate <= 0) {
+        continue;
+      }
+      if (mdata->baudrate != DEFAULT_BAUDRATE) {
+        values[0] = baudrate_to_value(DEFAULT_BAUDRATE);
+        err = write_holding_reg(port, BAUDRATE_CMD_TIMEOUT, mdata->addr,
+                                REGISTER_PSU_BAUDRATE, 1, values, output,
+                                mdata->baudrate);
+
+        if (err != 0) {
+          OBMC_WARN("Unable to reset PSU %02x to the original baudrate",
+                    mdata->addr);
+          ret = 1;
+        }
       }
     }
   }
@@ -1010,125 +1241,215 @@ static void record_data(reg_range_data_t* rd, uint32_t time,
   rd->mem_pos = rd->mem_pos % mem_size;
 }
 
-static int reload_psu_registers(psu_datastore_t *mdata)
+static int poll_class(monitor_interval *iv)
+{
+  if (iv->flags & MONITOR_FLAG_ONLY_CHANGES) {
+    return POLL_CLASS_FAST;
+  }
+  if (iv->flags & MONITOR_FLAG_INVENTORY) {
+    return POLL_CLASS_SLOW;
+  }
+  return POLL_CLASS_NORMAL;
+}
+
+/*
+ * Store the values read for one register range of a PSU.
+ */
+static void store_psu_range(rackmon_port_t *port, psu_datastore_t *mdata,
+                            reg_range_data_t *rd, uint16_t *regs,
+                            uint32_t timestamp)
 {
-  int r, error;
+  monitor_interval* iv = rd->i;
+
+  if (iv->flags & MONITOR_FLAG_ONLY_CHANGES) {
+    int pitch = REG_INT_DATA_SIZE(iv);
+    int lastpos = rd->mem_pos - pitch;
+    if (lastpos < 0) {
+      lastpos = (pitch * iv->keep) - pitch;
+    }
+    if (!memcmp(rd->mem_begin + lastpos + sizeof(timestamp),
+                regs, sizeof(uint16_t) * iv->len) &&
+         memcmp(rd->mem_begin, "\x00\x00\x00\x00", 4)) {
+      return;
+    }
+
+    if (rackmond_config.status_log) {
+      time_t rawt;
+      struct tm* ti;
+      char timestr[80];
+
+      time(&rawt);
+      ti = localtime(&rawt);
+      strftime(timestr, sizeof(timestr), "%b %e %T", ti);
+      fprintf(rackmond_config.status_log,
+              "%s: Change to status register %02x on address %02x. "
+              "New value: %02x\n",
+              timestr, iv->begin, mdata->addr, regs[0]);
+      fflush(rackmond_config.status_log);
+    }
+  }
+
+  port_lock(port);
+  if (iv->begin == REGISTER_PSU_BAUDRATE) {
+    uint16_t baudrate_value = regs[0] >> 8;
+    mdata->supports_baudrate = (baudrate_value != 0);
+    mdata->baudrate = BAUDRATE_VALUES[baudrate_value];
+  }
+  record_data(rd, timestamp, regs);
+  port_unlock(port);
+}
+
+/*
+ * Read "num" consecutive register ranges of a PSU (as planned by
+ * plan_psu_read) in a single transaction and store the values.
+ */
+static int poll_psu_ranges(rackmon_port_t *port, psu_datastore_t *mdata,
+                           reg_range_data_t *first, int num)
+{
+  int i, err;
   speed_t baudrate;
+  uint32_t timestamp;
   uint8_t addr = mdata->addr;
+  reg_range_data_t *last = &first[num - 1];
+  uint16_t begin = first->i->begin;
+  uint16_t len = last->i->begin + last->i->len - begin;
+  uint16_t regs[len];
 
-  if (global_lock() != 0) {
-    return -1;
-  }
-  error = check_psu_baudrate(mdata, &baudrate);
-  global_unlock();
-  if (error != 0) {
+  err = psu_bus_begin(port, mdata, &baudrate);
+  if (err != 0) {
     OBMC_WARN("Unable to check baudrate for PSU at addr %02x", addr);
     return -1;
   }
-
-  for (r = 0; r < rackmond_config.config->num_intervals; r++) {
-    int err;
-    uint32_t timestamp;
-    reg_range_data_t* rd = &mdata->range_data[r];
-    monitor_interval* iv = rd->i;
-    uint16_t regs[iv->len];
-
-    err = read_holding_reg(&rackmond_config.rs485,
-                           rackmond_config.modbus_timeout, addr,
-                           iv->begin, iv->len, regs, baudrate);
-    sched_yield();
-    if (err != 0) {
-      if (err != READ_ERROR_RESPONSE && err != PSU_TIMEOUT_RESPONSE) {
-        log("Error %d reading %02x registers at %02x from %02x\n",
-            err, iv->len, iv->begin, addr);
-        if(err == MODBUS_BAD_CRC) {
-          mdata->crc_errors++;
+  err = read_holding_reg(port, rackmond_config.modbus_timeout, addr,
+                         begin, len, regs, baudrate);
+  psu_bus_end(port);
+
+  if (err == READ_ERROR_RESPONSE && num > 1) {
+    // some registers of the span are not available on this model: read
+    // the ranges on their own, and from now on keep apart only those
+    // next to a range rejected alone, or else those apart by a gap
+    bool split = false;
+    for (i = 0; i < num; i++) {
+      if (poll_psu_ranges(port, mdata, &first[i], 1) == READ_ERROR_RESPONSE) {
+        if (i > 0) {
+          first[i - 1].no_merge_next = true;
         }
-        if(err == MODBUS_RESPONSE_TIMEOUT) {
-          mdata->timeout_errors++;
+        if (i < num - 1) {
+          first[i].no_merge_next = true;
         }
+        split = true;
       }
-
-      continue;
     }
-
-    TIME_UPDATE(timestamp);
-    if (iv->flags & MONITOR_FLAG_ONLY_CHANGES) {
-      int pitch = REG_INT_DATA_SIZE(iv);
-      int lastpos = rd->mem_pos - pitch;
-      if (lastpos < 0) {
-        lastpos = (pitch * iv->keep) - pitch;
+    for (i = 0; !split && i < num - 1; i++) {
+      if (first[i + 1].i->begin > first[i].i->begin + first[i].i->len) {
+        first[i].no_merge_next = true;
       }
-      if (!memcmp(rd->mem_begin + lastpos + sizeof(timestamp),
-                  regs, sizeof(uint16_t) * iv->len) &&
-           memcmp(rd->mem_begin, "\x00\x00\x00\x00", 4)) {
-        continue;
+    }
+    return 0;
+  }
+  if (err != 0) {
+    if (err != READ_ERROR_RESPONSE && err != PSU_TIMEOUT_RESPONSE) {
+      log("Error %d reading %02x registers at %02x from %02x\n",
+          err, len, begin, addr);
+      if(err == MODBUS_BAD_CRC) {
+        mdata->crc_errors++;
       }
-
-      if (rackmond_config.status_log) {
-        time_t rawt;
-        struct tm* ti;
-        char timestr[80];
-
-        time(&rawt);
-        ti = localtime(&rawt);
-        strftime(timestr, sizeof(timestr), "%b %e %T", ti);
-        fprintf(rackmond_config.status_log,
-                "%s: Change to status register %02x on address %02x. "
-                "New value: %02x\n",
-                timestr, iv->begin, addr, regs[0]);
-        fflush(rackmond_config.status_log);
+      if(err == MODBUS_RESPONSE_TIMEOUT) {
+        mdata->timeout_errors++;
       }
     }
 
-    global_lock();
-    if (iv->begin == REGISTER_PSU_BAUDRATE) {
-      uint16_t baudrate_value = regs[0] >> 8;
-      mdata->supports_baudrate = (baudrate_value != 0);
-      mdata->baudrate = BAUDRATE_VALUES[baudrate_value];
-    }
-    record_data(rd, timestamp, regs);
-    global_unlock();
-  } /* for each monitor_interval */
+    return err;
+  }
+
+  TIME_UPDATE(timestamp);
+  for (i = 0; i < num; i++) {
+    store_psu_range(port, mdata, &first[i],
+                    regs + (first[i].i->begin - begin), timestamp);
+  }
 
   return 0;
 }
 
-static int fetch_monitored_data(void) {
-  int pos;
-  psu_datastore_t *mdata;
+static bool range_due_soon(reg_range_data_t *rd, uint64_t now_ms)
+{
+  return rd->next_poll <=
+         now_ms + rackmond_config.poll_period[poll_class(rd->i)] / 4;
+}
 
-  if (global_lock() != 0) {
-    return -1;
+static bool range_follows(reg_range_data_t *prev, reg_range_data_t *next)
+{
+  unsigned int end = prev->i->begin + prev->i->len;
+
+  return !prev->no_merge_next && next->i->begin >= end &&
+         next->i->begin - end <= MERGE_MAX_GAP;
+}
+
+/*
+ * Plan the read of the due register range "r" of a PSU: the ranges next
+ * to it in the register map that are due soon anyway are read along, so
+ * that the bus turnaround of their own requests is saved. Returns the
+ * number of ranges to read, starting with range "*first". Called with
+ * the port lock held.
+ */
+static int plan_psu_read(psu_datastore_t *mdata, int r, uint64_t now_ms,
+                         int *first)
+{
+  int lo = r, hi = r;
+  reg_range_data_t *rd = mdata->range_data;
+
+  while (lo > 0 && range_follows(&rd[lo - 1], &rd[lo]) &&
+         range_due_soon(&rd[lo - 1], now_ms) &&
+         rd[hi].i->begin + rd[hi].i->len - rd[lo - 1].i->begin <=
+           MODBUS_MAX_READ_REGS) {
+    lo--;
   }
-  if (rackmond_config.paused == 1 || rackmond_config.config == NULL) {
-    global_unlock();
-    return -1;
+  while (hi < rackmond_config.config->num_intervals - 1 &&
+         range_follows(&rd[hi], &rd[hi + 1]) &&
+         range_due_soon(&rd[hi + 1], now_ms) &&
+         rd[hi + 1].i->begin + rd[hi + 1].i->len - rd[lo].i->begin <=
+           MODBUS_MAX_READ_REGS) {
+    hi++;
   }
-  global_unlock();
 
-  for (pos = 0; pos < ARRAY_SIZE(rackmond_config.stored_data); pos++) {
-    if (should_exit)
-      break;
+  *first = lo;
+  return hi - lo + 1;
+}
 
-    mdata = rackmond_config.stored_data[pos];
-    if (mdata != NULL) {
-      reload_psu_registers(mdata);
+/*
+ * Find the register range of the port whose poll is due first (earliest
+ * deadline first, so an overloaded bus delays every class instead of
+ * starving the slower ones). Called with the port lock held.
+ */
+static reg_range_data_t* next_poll_range(rackmon_port_t *port,
+                                         psu_datastore_t **psu)
+{
+  int pos, r;
+  psu_datastore_t *mdata;
+  reg_range_data_t *rd, *next = NULL;
 
-      if (!should_exit)
-        sleep(PSU_ACCESS_NICE_DELAY);
+  for (pos = 0; pos < ARRAY_SIZE(port->stored_data); pos++) {
+    mdata = port->stored_data[pos];
+    if (mdata == NULL) {
+      continue;
+    }
+    for (r = 0; r < rackmond_config.config->num_intervals; r++) {
+      rd = &mdata->range_data[r];
+      if (next == NULL || rd->next_poll < next->next_poll) {
+        next = rd;
+        *psu = mdata;
+      }
     }
-  } /* for each psu */
+  }
 
-  return 0;
+  return next;
 }
 
-static time_t search_at = 0;
-
 void* monitoring_loop(void* arg)
 {
   int ret;
   sigset_t sig_mask;
+  rackmon_port_t *port = arg;
 
   /*
    * Block SIGINT and SIGTERM so these signals can be delivered to the
@@ -1142,49 +1463,97 @@ void* monitoring_loop(void* arg)
     OBMC_ERROR(ret, "failed to set signal mask in monitoring thread");
     return NULL;
   }
-
-  rackmond_config.status_log = fopen(RACKMON_STAT_STORE, "a+");
-  if (rackmond_config.status_log == NULL) {
-    OBMC_ERROR(errno, "failed to open %s", RACKMON_STAT_STORE);
-    /* XXX shall we exit the thread??? */
-  }
+  polling_thread = true;
 
   while (!should_exit) {
-    long delay;
-    int num_psus;
-    struct timespec now;
+    bool active;
+    uint64_t now_ms, wake_ms;
+    struct timespec now, deadline;
+    reg_range_data_t *rd = NULL;
+    psu_datastore_t *mdata = NULL;
 
     clock_gettime(CLOCK_REALTIME, &now);
-    if (search_at <= now.tv_sec) {
-      num_psus = check_active_psus();
+    if (port->search_at <= now.tv_sec) {
+      if (check_active_psus(port) > 0) {
+        alloc_monitoring_datas(port);
+      }
 
       clock_gettime(CLOCK_REALTIME, &now);
-      search_at = now.tv_sec + PSU_SCAN_INTERVAL;
+      port->search_at = now.tv_sec + PSU_SCAN_INTERVAL;
+    }
 
-      if (num_psus > 0) {
-        alloc_monitoring_datas();
+    // taken before the port lock, a change in between sets "kicked"
+    active = monitoring_active();
+    if (port_lock(port) != 0) {
+      break;
+    }
+    now_ms = monotonic_ms();
+    wake_ms = now_ms + (port->search_at - now.tv_sec) * 1000;
+    if (active) {
+      rd = next_poll_range(port, &mdata);
+    }
+
+    if (rd != NULL && rd->next_poll <= now_ms) {
+      int i, first, num;
 
-        sleep(PSU_ACCESS_NICE_DELAY);
-        fetch_monitored_data();
+      num = plan_psu_read(mdata, rd - mdata->range_data, now_ms, &first);
+      for (i = first; i < first + num; i++) {
+        reg_range_data_t *p = &mdata->range_data[i];
+        uint64_t next = p->next_poll + rackmond_config.poll_period[poll_class(p->i)];
+
+        // a late poll is not repeated to catch up, an early one keeps
+        // its period from now on
+        p->next_poll = (next > now_ms && p->next_poll <= now_ms) ? next :
+                       now_ms + rackmond_config.poll_period[poll_class(p->i)];
       }
+      port_unlock(port);
+
+      poll_psu_ranges(port, mdata, &mdata->range_data[first], num);
+      continue;
     }
 
-    /*
-     * TODO: ideally we should allow the main thread to wake up this
-     * monitoring loop (for example, in case "force_rescan" command is
-     * received).
-     */
-    delay = search_at - now.tv_sec;
-    if (delay > PSU_ACCESS_NICE_DELAY)
-      delay = PSU_ACCESS_NICE_DELAY;
-    sleep(delay);
+    if (rd != NULL && rd->next_poll < wake_ms) {
+      wake_ms = rd->next_poll;
+    }
+    deadline.tv_sec = wake_ms / 1000;
+    deadline.tv_nsec = (wake_ms % 1000) * 1000000;
+    if (!port->kicked) {
+      pthread_cond_timedwait(&port->wakeup, &port->lock, &deadline);
+    }
+    port->kicked = false;
+    port_unlock(port);
   } /* while (!should_exit) */
 
-  OBMC_INFO("exiting rackmon monitoring thread");
+  OBMC_INFO("exiting rackmon monitoring thread of port %d", port->index);
   return NULL;
 }
 
-static int run_cmd_raw_modbus(rackmond_command* cmd, write_buf_t *wb)
+/*
+ * Find the port a PSU was detected on, the first port if none.
+ */
+static rackmon_port_t* lookup_port(uint8_t addr)
+{
+  int i, slot;
+  rackmon_port_t *port;
+
+  for (i = 0; i < rackmond_config.num_ports; i++) {
+    port = &rackmond_config.ports[i];
+    if (port_lock(port) != 0) {
+      continue;
+    }
+    slot = lookup_data_slot(port, addr);
+    if (slot >= 0 && port->stored_data[slot] != NULL) {
+      port_unlock(port);
+      return port;
+    }
+    port_unlock(port);
+  }
+
+  return &rackmond_config.ports[0];
+}
+
+static int do_raw_modbus(rackmon_port_t *port, raw_modbus_command *raw,
+                         write_buf_t *wb)
 {
   char *resp_buf;
   int timeout, resp_len, err, slot;
@@ -1192,39 +1561,29 @@ static int run_cmd_raw_modbus(rackmond_command* cmd, write_buf_t *wb)
   speed_t baudrate;
   psu_datastore_t *psu = NULL;
 
-  if (cmd->raw_modbus.custom_timeout) {
-    timeout = cmd->raw_modbus.custom_timeout * 1000; // ms to us
+  if (raw->custom_timeout) {
+    timeout = raw->custom_timeout * 1000; // ms to us
   } else {
     timeout = rackmond_config.modbus_timeout;
   }
 
-  if (cmd->raw_modbus.length < 1) {
+  if (raw->length < 1) {
     OBMC_WARN("Raw modbus command too short!");
     return -1;
   }
 
-  if (global_lock() != 0) {
+  if (port_lock(port) != 0) {
     return -1;
   }
 
-  slot = lookup_data_slot((uint8_t) cmd->raw_modbus.data[0]);
+  slot = lookup_data_slot(port, (uint8_t) raw->data[0]);
   if (slot >= 0) {
-    psu = rackmond_config.stored_data[slot];
+    psu = port->stored_data[slot];
   }
 
-  err = check_psu_baudrate(psu, &baudrate);
-
-  global_unlock();
+  port_unlock(port);
 
-  if (err != 0) {
-    error_code = -err;
-    resp_len_wire = 0;
-    buf_write(wb, &resp_len_wire, sizeof(uint16_t));
-    buf_write(wb, &error_code, sizeof(uint16_t));
-    return 0;
-  }
-
-  exp_resp_len = cmd->raw_modbus.expected_response_length;
+  exp_resp_len = raw->expected_response_length;
   if (exp_resp_len == 0) {
     exp_resp_len = 1024;
   }
@@ -1235,9 +1594,20 @@ static int run_cmd_raw_modbus(rackmond_command* cmd, write_buf_t *wb)
     return -1;
   }
 
-  resp_len = modbus_command(&rackmond_config.rs485, timeout,
-                            cmd->raw_modbus.data, cmd->raw_modbus.length,
+  err = psu_bus_begin(port, psu, &baudrate);
+  if (err != 0) {
+    free(resp_buf);
+    error_code = -err;
+    resp_len_wire = 0;
+    buf_write(wb, &resp_len_wire, sizeof(uint16_t));
+    buf_write(wb, &error_code, sizeof(uint16_t));
+    return 0;
+  }
+
+  resp_len = modbus_command(port, timeout,
+                            raw->data, raw->length,
                             resp_buf, exp_resp_len, exp_resp_len, baudrate);
+  psu_bus_end(port);
   if(resp_len < 0) {
     error_code = -resp_len;
     resp_len_wire = 0;
@@ -1253,6 +1623,26 @@ static int run_cmd_raw_modbus(rackmond_command* cmd, write_buf_t *wb)
   return 0;
 }
 
+// routed to the port the addressed PSU was detected on
+static int run_cmd_raw_modbus(rackmond_command* cmd, write_buf_t *wb)
+{
+  rackmon_port_t *port = lookup_port((uint8_t) cmd->raw_modbus.data[0]);
+
+  return do_raw_modbus(port, &cmd->raw_modbus, wb);
+}
+
+static int run_cmd_raw_modbus_port(rackmond_command* cmd, write_buf_t *wb)
+{
+  if (cmd->raw_modbus_port.port >= rackmond_config.num_ports) {
+    OBMC_WARN("Raw modbus command for unknown port %u",
+              cmd->raw_modbus_port.port);
+    return -1;
+  }
+
+  return do_raw_modbus(&rackmond_config.ports[cmd->raw_modbus_port.port],
+                       &cmd->raw_modbus_port.raw, wb);
+}
+
 static int run_cmd_set_config(rackmond_command* cmd, write_buf_t *wb)
 {
   int error = 0;
@@ -1275,7 +1665,7 @@ static int run_cmd_set_config(rackmond_command* cmd, write_buf_t *wb)
 
   memcpy(rackmond_config.config, &cmd->set_config.config, config_size);
   OBMC_INFO("got configuration");
-  TIME_UPDATE(search_at);
+  wakeup_monitoring(true);
 
 cleanup:
   global_unlock();
@@ -1291,35 +1681,54 @@ static int run_cmd_dump_status(rackmond_command* cmd, write_buf_t *wb)
   if (rackmond_config.config == NULL) {
     buf_printf(wb, "Unconfigured\n");
   } else {
-    int i;
+    int i, p;
     time_t now;
+    rackmon_port_t *port;
 
     TIME_UPDATE(now);
-    buf_printf(wb, "Monitored PSUs:\n");
-    for (i = 0; i < ARRAY_SIZE(rackmond_config.stored_data); i++) {
-      if (rackmond_config.stored_data[i] == NULL) {
+    for (p = 0; p < rackmond_config.num_ports; p++) {
+      port = &rackmond_config.ports[p];
+      if (port_lock(port) != 0) {
         continue;
       }
+      if (rackmond_config.num_ports > 1) {
+        buf_printf(wb, "Port %d (%s):\n", port->index, port->tty);
+      }
+      buf_printf(wb, "Monitored PSUs:\n");
+      for (i = 0; i < ARRAY_SIZE(port->stored_data); i++) {
+        psu_datastore_t *psu = port->stored_data[i];
 
-      speed_t baudrate = rackmond_config.stored_data[i]->baudrate;
-      buf_printf(wb, "PSU addr %02x - crc errors: %d, timeouts: %d, baud rate: %s",
-                 rackmond_config.stored_data[i]->addr,
-                 rackmond_config.stored_data[i]->crc_errors,
-                 rackmond_config.stored_data[i]->timeout_errors,
-                 baud_to_str(baudrate));
-      if (rackmond_config.stored_data[i]->timeout_mode) {
-        time_t until = rackmond_config.stored_data[i]->last_comms + NON_COMMUNICATION_TIMEOUT;
-        buf_printf(wb, " (in timeout mode for the next %d seconds)", until - now);
+        if (psu == NULL) {
+          continue;
+        }
+
+        buf_printf(wb, "PSU addr %02x - crc errors: %d, timeouts: %d, baud rate: %s",
+                   psu->addr, psu->crc_errors, psu->timeout_errors,
+                   baud_to_str(psu->baudrate));
+        if (psu->timeout_mode) {
+          time_t until = psu->last_comms + NON_COMMUNICATION_TIMEOUT;
+          buf_printf(wb, " (in timeout mode for the next %d seconds)", until - now);
+        }
+        buf_printf(wb, "\n");
       }
-      buf_printf(wb, "\n");
-    }
 
-    buf_printf(wb, "Active on last scan: ");
-    for (i = 0; i < rackmond_config.num_active_addrs; i++) {
-      buf_printf(wb, "%02x ", rackmond_config.active_addrs[i]);
+      buf_printf(wb, "Active on last scan: ");
+      for (i = 0; i < port->num_active_addrs; i++) {
+        buf_printf(wb, "%02x ", port->active_addrs[i]);
+      }
+      buf_printf(wb, "\n");
+      buf_printf(wb, "Next scan in %d seconds.\n", port->search_at - now);
+      buf_printf(wb, "Last scan took %u ms.\n", port->last_scan_ms);
+      if (port->stored_data[0] != NULL) {
+        buf_printf(wb, "Data store per PSU: %u bytes\n",
+                   (unsigned int)port->stored_data[0]->size);
+      }
+      port_unlock(port);
     }
-    buf_printf(wb, "\n");
-    buf_printf(wb, "Next scan in %d seconds.\n", search_at - now);
+    buf_printf(wb, "Poll periods: status %dms, default %dms, inventory %dms\n",
+               rackmond_config.poll_period[POLL_CLASS_FAST],
+               rackmond_config.poll_period[POLL_CLASS_NORMAL],
+               rackmond_config.poll_period[POLL_CLASS_SLOW]);
   }
 
  global_unlock();
@@ -1335,7 +1744,7 @@ static int run_cmd_force_scan(rackmond_command* cmd, write_buf_t *wb)
   if (rackmond_config.config == NULL) {
     buf_printf(wb, "Unconfigured\n");
   } else {
-    TIME_UPDATE(search_at);
+    wakeup_monitoring(true);
     buf_printf(wb, "Triggering PSU scan...\n");
   }
 
@@ -1343,72 +1752,218 @@ static int run_cmd_force_scan(rackmond_command* cmd, write_buf_t *wb)
   return 0;
 }
 
-static int run_cmd_dump_json(rackmond_command* cmd, write_buf_t *wb)
+/*
+ * Copy of the stored data, taken with the global lock held only for the
+ * memcpy so that formatting and sending the data does not block the
+ * monitoring thread.
+ */
+typedef struct {
+  int num_psus;
+  uint32_t now;
+  psu_datastore_t* psus[MAX_PORTS * MAX_ACTIVE_ADDRS];
+  uint8_t port[MAX_PORTS * MAX_ACTIVE_ADDRS];
+} data_snapshot_t;
+
+static void snapshot_free(data_snapshot_t *snap)
 {
+  int i;
+
+  for (i = 0; i < snap->num_psus; i++) {
+    free(snap->psus[i]);
+  }
+  snap->num_psus = 0;
+}
+
+/*
+ * Returns 1 if unconfigured, 0 on success and -1 on errors.
+ */
+static int snapshot_take(data_snapshot_t *snap)
+{
+  int p, pos, r;
+  psu_datastore_t *orig, *copy;
+  rackmon_port_t *port;
+
+  memset(snap, 0, sizeof(*snap));
   if (global_lock() != 0) {
     return -1;
   }
-
   if (rackmond_config.config == NULL) {
+    global_unlock();
+    return 1;
+  }
+
+  TIME_UPDATE(snap->now);
+  for (p = 0; p < rackmond_config.num_ports; p++) {
+    port = &rackmond_config.ports[p];
+    if (port_lock(port) != 0) {
+      continue;
+    }
+    for (pos = 0; pos < MAX_ACTIVE_ADDRS; pos++) {
+      orig = port->stored_data[pos];
+      if (orig == NULL) {
+        break;
+      }
+      copy = malloc(orig->size);
+      if (copy == NULL) {
+        port_unlock(port);
+        global_unlock();
+        OBMC_WARN("failed to allocate data snapshot");
+        snapshot_free(snap);
+        return -1;
+      }
+      memcpy(copy, orig, orig->size);
+      // the register data lives in the same allocation, move the pointers
+      for (r = 0; r < rackmond_config.config->num_intervals; r++) {
+        copy->range_data[r].mem_begin = (char *)copy +
+            ((char *)orig->range_data[r].mem_begin - (char *)orig);
+      }
+      snap->port[snap->num_psus] = port->index;
+      snap->psus[snap->num_psus++] = copy;
+    }
+    port_unlock(port);
+  }
+  global_unlock();
+
+  return 0;
+}
+
+static int run_cmd_dump_json(rackmond_command* cmd, write_buf_t *wb)
+{
+  int ret, i, j, c, data_pos;
+  data_snapshot_t snap;
+
+  ret = snapshot_take(&snap);
+  if (ret < 0) {
+    return -1;
+  } else if (ret > 0) {
     buf_write(wb, "[]", 2);
-  } else {
-    int i, j, c;
-    uint32_t now;
-    int data_pos = 0;
+    return 0;
+  }
 
-    TIME_UPDATE(now);
-    buf_write(wb, "[", 1);
-    while (rackmond_config.stored_data[data_pos] != NULL &&
-           data_pos < MAX_ACTIVE_ADDRS) {
-      psu_datastore_t *pdata = rackmond_config.stored_data[data_pos];
-
-      buf_printf(wb, "{\"addr\":%d,\"crc_fails\":%d,\"timeouts\":%d,"
-                 "\"now\":%d,\"ranges\":[",
-                 pdata->addr, pdata->crc_errors, pdata->timeout_errors, now);
-
-      for (i = 0; i < rackmond_config.config->num_intervals; i++) {
-        uint32_t time;
-        reg_range_data_t *rd = &pdata->range_data[i];
-        char* mem_pos = rd->mem_begin;
-
-        buf_printf(wb,"{\"begin\":%d,\"readings\":[", rd->i->begin);
-        // want to cut the list off early just before
-        // the first entry with time == 0
+  buf_write(wb, "[", 1);
+  for (data_pos = 0; data_pos < snap.num_psus; data_pos++) {
+    psu_datastore_t *pdata = snap.psus[data_pos];
+
+    buf_printf(wb, "{\"addr\":%d,\"port\":%d,\"crc_fails\":%d,\"timeouts\":%d,"
+               "\"now\":%d,\"ranges\":[",
+               pdata->addr, snap.port[data_pos], pdata->crc_errors,
+               pdata->timeout_errors, snap.now);
+
+    for (i = 0; i < rackmond_config.config->num_intervals; i++) {
+      uint32_t time;
+      reg_range_data_t *rd = &pdata->range_data[i];
+      char* mem_pos = rd->mem_begin;
+
+      buf_printf(wb,"{\"begin\":%d,\"readings\":[", rd->i->begin);
+      // want to cut the list off early just before
+      // the first entry with time == 0
+      memcpy(&time, mem_pos, sizeof(time));
+      for(j = 0; j < rd->i->keep && time != 0; j++) {
+        mem_pos += sizeof(time);
+        buf_printf(wb, "{\"time\":%d,\"data\":\"", time);
+        for(c = 0; c < rd->i->len * 2; c++) {
+          buf_printf(wb, "%02x", *mem_pos);
+          mem_pos++;
+        }
+        buf_write(wb, "\"}", 2);
         memcpy(&time, mem_pos, sizeof(time));
-        for(j = 0; j < rd->i->keep && time != 0; j++) {
-          mem_pos += sizeof(time);
-          buf_printf(wb, "{\"time\":%d,\"data\":\"", time);
-          for(c = 0; c < rd->i->len * 2; c++) {
-            buf_printf(wb, "%02x", *mem_pos);
-            mem_pos++;
-          }
-          buf_write(wb, "\"}", 2);
-          memcpy(&time, mem_pos, sizeof(time));
-          if (time == 0) {
-            break;
-          }
-          if ((j+1) < rd->i->keep) {
-            buf_write(wb, ",", 1);
-          }
+        if (time == 0) {
+          break;
         }
-        buf_write(wb, "]}", 2);
-        if ((i+1) < rackmond_config.config->num_intervals) {
+        if ((j+1) < rd->i->keep) {
           buf_write(wb, ",", 1);
         }
       }
+      buf_write(wb, "]}", 2);
+      if ((i+1) < rackmond_config.config->num_intervals) {
+        buf_write(wb, ",", 1);
+      }
+    }
+
+    if ((data_pos + 1) < snap.num_psus) {
+      buf_write(wb, "]},", 3);
+    } else {
+      buf_write(wb, "]}", 2);
+    }
+  }
+  buf_write(wb, "]", 1);
 
-      data_pos++;
-      if (data_pos < MAX_ACTIVE_ADDRS &&
-          rackmond_config.stored_data[data_pos] != NULL) {
-        buf_write(wb, "]},", 3);
-      } else {
-        buf_write(wb, "]}", 2);
+  snapshot_free(&snap);
+  return 0;
+}
+
+/*
+ * Binary export of the stored data, see rackmond.h for the layout.
+ * Readings are sent oldest first, and only those newer than "since".
+ */
+static int run_cmd_dump_binary(rackmond_command* cmd, write_buf_t *wb)
+{
+  int ret, pos, r, j;
+  data_snapshot_t snap;
+  rackmond_export_hdr hdr = {
+    .magic = RACKMON_EXPORT_MAGIC,
+    .version = RACKMON_EXPORT_VERSION,
+    .since = cmd->dump_data.since,
+  };
+
+  ret = snapshot_take(&snap);
+  if (ret < 0) {
+    return -1;
+  }
+  if (ret == 0) {
+    hdr.num_psus = snap.num_psus;
+    hdr.num_ranges = rackmond_config.config->num_intervals;
+  }
+  hdr.now = snap.now;
+  /*
+   * Timestamps have a 1 second resolution, so the next delta has to
+   * include the current second again. Readings are identified by their
+   * timestamp, a reader drops the duplicates.
+   */
+  hdr.resume_since = snap.now > 0 ? snap.now - 1 : 0;
+  buf_write(wb, &hdr, sizeof(hdr));
+
+  for (pos = 0; pos < snap.num_psus; pos++) {
+    psu_datastore_t *pdata = snap.psus[pos];
+    rackmond_export_psu psu = {
+      .addr = pdata->addr,
+      .port = snap.port[pos],
+      .crc_fails = pdata->crc_errors,
+      .timeouts = pdata->timeout_errors,
+      .last_comms = pdata->last_comms,
+    };
+
+    buf_write(wb, &psu, sizeof(psu));
+    for (r = 0; r < hdr.num_ranges; r++) {
+      reg_range_data_t *rd = &pdata->range_data[r];
+      int pitch = REG_INT_DATA_SIZE(rd->i);
+      int oldest = rd->mem_pos / pitch;
+      rackmond_export_range range = {
+        .begin = rd->i->begin,
+        .len = rd->i->len,
+      };
+      uint32_t time;
+
+      for (j = 0; j < rd->i->keep; j++) {
+        memcpy(&time, rd->mem_begin + pitch * j, sizeof(time));
+        if (time != 0 && time > hdr.since) {
+          range.num_readings++;
+        }
+      }
+      buf_write(wb, &range, sizeof(range));
+
+      for (j = 0; j < rd->i->keep && range.num_readings > 0; j++) {
+        char *entry = rd->mem_begin + pitch * ((oldest + j) % rd->i->keep);
+
+        memcpy(&time, entry, sizeof(time));
+        if (time != 0 && time > hdr.since) {
+          buf_write(wb, entry, pitch);
+        }
       }
     }
-    buf_write(wb, "]", 1);
   }
 
-  global_unlock();
+  snapshot_free(&snap);
   return 0;
 }
 
@@ -1438,6 +1993,7 @@ static int run_cmd_start_monitoring(rackmond_command* cmd, write_buf_t *wb)
 
   was_started = !rackmond_config.paused;
   rackmond_config.paused = 0;
+  wakeup_monitoring(false);
   buf_write(wb, &was_started, sizeof(was_started));
 
   global_unlock();
@@ -1476,6 +2032,14 @@ static struct {
     .name = "force_scan",
     .handler = run_cmd_force_scan,
   },
+  [COMMAND_TYPE_DUMP_DATA_BINARY] = {
+    .name = "dump_data_binary",
+    .handler = run_cmd_dump_binary,
+  },
+  [COMMAND_TYPE_RAW_MODBUS_PORT] = {
+    .name = "raw_modbus_port",
+    .handler = run_cmd_raw_modbus_port,
+  },
 };
 
 static int do_command(int sock, rackmond_command* cmd) {
@@ -1630,10 +2194,99 @@ static int user_socket_init(const char *sock_path)
   return sock;
 }
 
+static void rackmon_port_cleanup(rackmon_port_t *port)
+{
+  rs485_device_cleanup(&port->rs485);
+  pthread_cond_destroy(&port->wakeup);
+  pthread_mutex_destroy(&port->lock);
+}
+
+static int rackmon_port_init(rackmon_port_t *port, int index, const char *tty)
+{
+  int ret;
+  pthread_condattr_t attr;
+
+  port->index = index;
+  port->tty = tty;
+  ret = pthread_mutex_init(&port->lock, NULL);
+  if (ret != 0) {
+    OBMC_ERROR(ret, "failed to initialize port %d mutex", index);
+    return -1;
+  }
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  ret = pthread_cond_init(&port->wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+  if (ret != 0) {
+    OBMC_ERROR(ret, "failed to initialize port %d wakeup", index);
+    pthread_mutex_destroy(&port->lock);
+    return -1;
+  }
+
+  if (rs485_device_init(tty, &port->rs485) != 0) {
+    pthread_cond_destroy(&port->wakeup);
+    pthread_mutex_destroy(&port->lock);
+    return -1;
+  }
+
+  OBMC_INFO("port %d: %s", index, tty);
+  return 0;
+}
+
+/*
+ * Open the RS-485 ports, a comma separated list of ttys in RACKMOND_TTYS
+ * or the platform default.
+ */
+static int rackmon_ports_init(void)
+{
+  char *ttys, *tty, *saveptr = NULL;
+
+  if (getenv("RACKMOND_TTYS") == NULL) {
+    if (rackmon_port_init(&rackmond_config.ports[0], 0,
+                          rackmon_io->dev_path) != 0) {
+      return -1;
+    }
+    rackmond_config.num_ports = 1;
+    return 0;
+  }
+
+  // never freed, the ports keep pointing to it
+  ttys = strdup(getenv("RACKMOND_TTYS"));
+  if (ttys == NULL) {
+    return -1;
+  }
+  for (tty = strtok_r(ttys, ",", &saveptr); tty != NULL;
+       tty = strtok_r(NULL, ",", &saveptr)) {
+    if (rackmond_config.num_ports >= MAX_PORTS) {
+      OBMC_WARN("Too many ports: %s ignored.", tty);
+      continue;
+    }
+    if (rackmon_port_init(&rackmond_config.ports[rackmond_config.num_ports],
+                          rackmond_config.num_ports, tty) != 0) {
+      goto error;
+    }
+    rackmond_config.num_ports++;
+  }
+  if (rackmond_config.num_ports == 0) {
+    OBMC_WARN("No port in RACKMOND_TTYS");
+    goto error;
+  }
+  return 0;
+
+error:
+  while (rackmond_config.num_ports > 0) {
+    rackmon_port_cleanup(&rackmond_config.ports[--rackmond_config.num_ports]);
+  }
+  free(ttys);
+  return -1;
+}
+
 int main(int argc, char** argv) {
   int error = 0;
   int sock = -1;
-  pthread_t monitoring_tid;
+  int i, num_threads = 0;
+  bool reset_baudrate = false;
   sigset_t new_mask, old_mask;
   struct sockaddr_un client;
 
@@ -1666,6 +2319,23 @@ int main(int argc, char** argv) {
   }
   verbose = getenv("RACKMOND_VERBOSE") != NULL ? 1 : 0;
 
+  {
+    static const char *period_env[POLL_CLASS_MAX] = {
+      [POLL_CLASS_FAST] = "RACKMOND_FAST_PERIOD",
+      [POLL_CLASS_NORMAL] = "RACKMOND_NORMAL_PERIOD",
+      [POLL_CLASS_SLOW] = "RACKMOND_SLOW_PERIOD",
+    };
+    int i;
+
+    for (i = 0; i < POLL_CLASS_MAX; i++) {
+      if (getenv(period_env[i]) != NULL && atoi(getenv(period_env[i])) > 0) {
+        rackmond_config.poll_period[i] = atoi(getenv(period_env[i]));
+        OBMC_INFO("set poll period to %s (%dms)", period_env[i],
+                  rackmond_config.poll_period[i]);
+      }
+    }
+  }
+
   if (getenv("RACKMOND_DESIRED_BAUDRATE") != NULL) {
     int parsed_baudrate_int = atoi(getenv("RACKMOND_DESIRED_BAUDRATE"));
     rackmond_config.desired_baudrate = int_to_baudrate(parsed_baudrate_int);
@@ -1679,21 +2349,32 @@ int main(int argc, char** argv) {
     return -1;
   }
 
-  if (rs485_device_init(DEFAULT_TTY, &rackmond_config.rs485) != 0) {
+  if (rackmon_ports_init() != 0) {
     error = -1;
     goto exit_rs485;
   }
 
-  error = pthread_create(&monitoring_tid, NULL, monitoring_loop, NULL);
-  if (error != 0) {
-    OBMC_ERROR(error, "failed to create monitor loop thread");
-    error = -1;
-    goto exit_thread;
+  rackmond_config.status_log = fopen(RACKMON_STAT_STORE, "a+");
+  if (rackmond_config.status_log == NULL) {
+    OBMC_ERROR(errno, "failed to open %s", RACKMON_STAT_STORE);
+  }
+
+  for (num_threads = 0; num_threads < rackmond_config.num_ports;
+       num_threads++) {
+    rackmon_port_t *port = &rackmond_config.ports[num_threads];
+
+    error = pthread_create(&port->monitoring_tid, NULL, monitoring_loop, port);
+    if (error != 0) {
+      OBMC_ERROR(error, "failed to create monitor loop thread of port %d",
+                 port->index);
+      error = -1;
+      goto exit_thread;
+    }
   }
 
   sock = user_socket_init(RACKMON_IPC_SOCKET);
   if (sock < 0) {
-    goto exit_sock;
+    goto exit_thread;
   }
   OBMC_INFO("rackmon is listening to user connections");
 
@@ -1729,13 +2410,26 @@ int main(int argc, char** argv) {
   }
 
   close(sock); /* ignore errors */
-  if (reset_psu_baudrate() != 0)
-    error = -1;
-exit_sock:
-  pthread_cancel(monitoring_tid);     /* ignore errors */
-  pthread_join(monitoring_tid, NULL); /* ignore errors */
+  reset_baudrate = true;
 exit_thread:
-  rs485_device_cleanup(&rackmond_config.rs485);
+  /*
+   * The monitoring threads are not cancelled, as they may be holding a
+   * port lock: they leave their loop at the next wakeup, at worst after
+   * the transaction they are waiting for.
+   */
+  should_exit = 1;
+  global_lock();
+  wakeup_monitoring(false);
+  global_unlock();
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(rackmond_config.ports[i].monitoring_tid, NULL); /* ignore errors */
+  }
+  // nothing else uses the buses from here on
+  if (reset_baudrate && reset_psu_baudrate() != 0)
+    error = -1;
+  for (i = 0; i < rackmond_config.num_ports; i++) {
+    rackmon_port_cleanup(&rackmond_config.ports[i]);
+  }
 exit_rs485:
   rackmon_plat_cleanup();
   OBMC_INFO("rackmon is terminated, exit code: %d", error);
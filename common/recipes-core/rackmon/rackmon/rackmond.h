@@ -20,6 +20,8 @@ typedef struct raw_modbus_command {
 // only store new value if different from most recent
 // (for watching changes to status flags registers)
 #define MONITOR_FLAG_ONLY_CHANGES 0x1
+// rarely changing registers (inventory), polled at the slow period
+#define MONITOR_FLAG_INVENTORY 0x2
 
 /*
  * "monitor_interval" doesn't refer to time interval, it defines a section
@@ -41,10 +43,67 @@ typedef struct monitoring_config {
   monitor_interval intervals[1];
 } monitoring_config;
 
+// Raw modbus command to a given port, COMMAND_TYPE_RAW_MODBUS is sent to
+// the port the addressed PSU was detected on
+typedef struct raw_modbus_port_command {
+  uint16_t port;
+  uint16_t reserved;
+  raw_modbus_command raw;
+} raw_modbus_port_command;
+
 typedef struct set_config_command {
   monitoring_config config;
 } set_config_command;
 
+typedef struct dump_data_command {
+  uint32_t since; // only readings newer than this, 0 for all
+} dump_data_command;
+
+/*
+ * Response of COMMAND_TYPE_DUMP_DATA_BINARY, in host byte order:
+ *
+ *   rackmond_export_hdr
+ *   num_psus x {
+ *     rackmond_export_psu
+ *     num_ranges x {
+ *       rackmond_export_range
+ *       num_readings x { uint32_t time; uint16_t regs[len]; }
+ *     }
+ *   }
+ *
+ * Readings of a range are ordered oldest first. Pass "resume_since" as
+ * "since" of the next request to only get what changed in between.
+ */
+#define RACKMON_EXPORT_MAGIC   0x524d4458 // "RMDX"
+#define RACKMON_EXPORT_VERSION 2
+
+typedef struct rackmond_export_hdr {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t num_psus;
+  uint16_t num_ranges;
+  uint16_t reserved;
+  uint32_t now;
+  uint32_t since;
+  uint32_t resume_since;
+} rackmond_export_hdr;
+
+typedef struct rackmond_export_psu {
+  uint8_t addr;
+  uint8_t port;
+  uint8_t reserved[2];
+  uint32_t crc_fails;
+  uint32_t timeouts;
+  uint32_t last_comms;
+} rackmond_export_psu;
+
+typedef struct rackmond_export_range {
+  uint16_t begin;
+  uint16_t len;
+  uint16_t num_readings;
+  uint16_t reserved;
+} rackmond_export_range;
+
 enum {
   COMMAND_TYPE_NONE = 0,
   COMMAND_TYPE_RAW_MODBUS,
@@ -54,6 +113,8 @@ enum {
   COMMAND_TYPE_START_MONITORING,
   COMMAND_TYPE_DUMP_STATUS,
   COMMAND_TYPE_FORCE_SCAN,
+  COMMAND_TYPE_DUMP_DATA_BINARY,
+  COMMAND_TYPE_RAW_MODBUS_PORT,
   COMMAND_TYPE_MAX,
 };
 
@@ -62,6 +123,8 @@ typedef struct rackmond_command {
   union {
     raw_modbus_command raw_modbus;
     set_config_command set_config;
+    dump_data_command dump_data;
+    raw_modbus_port_command raw_modbus_port;
   };
 } rackmond_command;
 
@@ -0,0 +1,718 @@
+/*
+ * rackmonsim: emulates a shelf of PSUs on a pty for load testing rackmond
+ *
+ * Copyright 2020-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include "modbus.h"
+#include "rackmond.h"
+
+#define MAX_SIM_PSUS      18
+#define SIM_REGS          0x400
+#define REGISTER_BAUDRATE 0xA3
+#define REGISTER_STATUS   0x68
+#define MAX_LATENCIES     100000
+
+// modbus exception codes
+#define ILLEGAL_FUNCTION     1
+#define ILLEGAL_DATA_ADDRESS 2
+
+typedef struct {
+  uint8_t addr;
+  uint16_t regs[SIM_REGS];
+  // last time a read covered each register, in ns
+  uint64_t last_read[SIM_REGS];
+} sim_psu_t;
+
+static struct {
+  int num_psus;
+  sim_psu_t psus[MAX_SIM_PSUS];
+  int latency_us;
+  bool wire_time;
+  int crc_error_pct;
+  int timeout_pct;
+
+  pthread_mutex_t lock;
+  uint64_t requests;
+  uint64_t probes; // requests to addresses without a PSU (scanning)
+  uint64_t crc_errors;
+  uint64_t timeouts;
+  uint64_t exceptions;
+  // per register, over all PSUs, a read counts for every register it covers
+  uint64_t polls[SIM_REGS];
+  uint64_t interval_sum[SIM_REGS];
+  uint64_t interval_max[SIM_REGS];
+  bool read_begin[SIM_REGS]; // a read started at the register
+} sim = {
+  .num_psus = 6,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static volatile sig_atomic_t done;
+
+static void usage(void)
+{
+  fprintf(stderr,
+      "rackmonsim [-v] [-n <psus>] [-m <register map>] [-l <latency us>] [-w]\n"
+      "           [-B] [-e <crc error %%>] [-t <timeout %%>] [-d <seconds>]\n"
+      "           [-q <raw command interval ms>]\n"
+      "\tEmulates <psus> PSUs (default 6) on a pty, then reports what it saw\n"
+      "\tafter <seconds> (default 60). Run rackmond as root against it:\n"
+      "\t  RACKMOND_TTYS=<pty> RACKMOND_PLAIN_TTY=1 RACKMOND_FOREGROUND=1 rackmond\n"
+      "\t  python3 rackmon-config.py\n"
+      "\t-m: lines of \"<reg> <value> [<value> ...]\" in hex, applied to every PSU\n"
+      "\t-w: add the time the frames would take on the wire at the PSU's baud rate\n"
+      "\t-B: PSUs support baud rate changes\n"
+      "\t-q: raw modbus commands sent through rackmond to measure their latency\n"
+      "\t    under monitoring load (default 100, 0 to disable)\n");
+  exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static char psu_address(int rack, int shelf, int psu)
+{
+  return 0xA0 | ((rack & 3) << 3) | ((shelf & 1) << 2) | (psu & 3);
+}
+
+static void sim_psus_init(bool baudrate)
+{
+  int rack, shelf, psu, i, n = 0;
+
+  // the first addresses in the order rackmond scans them
+  for (rack = 0; rack < 3; rack++) {
+    for (shelf = 0; shelf < 2; shelf++) {
+      for (psu = 0; psu < 3 && n < sim.num_psus; psu++) {
+        sim_psu_t *p = &sim.psus[n++];
+
+        p->addr = psu_address(rack, shelf, psu);
+        for (i = 0; i < SIM_REGS; i++) {
+          p->regs[i] = (p->addr << 8) | (i & 0xFF);
+        }
+        p->regs[REGISTER_STATUS] = 0;
+        p->regs[REGISTER_BAUDRATE] = baudrate ? (1 << 8) : 0;
+      }
+    }
+  }
+}
+
+static int sim_load_map(const char *path)
+{
+  FILE *fp;
+  char line[512], *tok, *end;
+  unsigned long reg, val;
+  int i;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if ((tok = strchr(line, '#')) != NULL) {
+      *tok = '\0';
+    }
+    tok = strtok(line, " \t\n");
+    if (tok == NULL) {
+      continue;
+    }
+    reg = strtoul(tok, &end, 16);
+    while ((tok = strtok(NULL, " \t\n")) != NULL && reg < SIM_REGS) {
+      val = strtoul(tok, &end, 16);
+      for (i = 0; i < sim.num_psus; i++) {
+        sim.psus[i].regs[reg] = (uint16_t)val;
+      }
+      reg++;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+static sim_psu_t* sim_lookup(uint8_t addr)
+{
+  int i;
+
+  for (i = 0; i < sim.num_psus; i++) {
+    if (sim.psus[i].addr == addr) {
+      return &sim.psus[i];
+    }
+  }
+  return NULL;
+}
+
+static int psu_baudrate(sim_psu_t *p)
+{
+  static const int rates[] = {19200, 19200, 38400, 57600, 115200};
+  int v = p->regs[REGISTER_BAUDRATE] >> 8;
+
+  return (v < ARRAY_SIZE(rates)) ? rates[v] : 19200;
+}
+
+/*
+ * rackmond merges the reads of neighbouring ranges, so a read polls every
+ * configured range it covers, not only the one it starts with.
+ */
+static void record_read(sim_psu_t *p, uint16_t begin, uint16_t count)
+{
+  uint64_t now = now_ns(), interval;
+  uint16_t reg;
+
+  pthread_mutex_lock(&sim.lock);
+  sim.read_begin[begin] = true;
+  for (reg = begin; reg < begin + count; reg++) {
+    if (p->last_read[reg] != 0) {
+      interval = now - p->last_read[reg];
+      sim.polls[reg]++;
+      sim.interval_sum[reg] += interval;
+      if (interval > sim.interval_max[reg]) {
+        sim.interval_max[reg] = interval;
+      }
+    }
+    p->last_read[reg] = now;
+  }
+  pthread_mutex_unlock(&sim.lock);
+}
+
+static size_t exception_reply(char *resp, uint8_t addr, uint8_t func,
+                              uint8_t code)
+{
+  resp[0] = addr;
+  resp[1] = func | 0x80;
+  resp[2] = code;
+  pthread_mutex_lock(&sim.lock);
+  sim.exceptions++;
+  pthread_mutex_unlock(&sim.lock);
+  return 3;
+}
+
+/*
+ * Build the reply (without CRC) to a request, returns its length or 0
+ * if the addressed PSU does not exist.
+ */
+static size_t sim_handle(sim_psu_t *p, char *req, size_t len, char *resp)
+{
+  uint8_t func = req[1];
+  uint16_t begin, count, i;
+
+  if (func == MODBUS_READ_HOLDING_REGISTERS) {
+    if (len < 6) {
+      return exception_reply(resp, p->addr, func, ILLEGAL_FUNCTION);
+    }
+    begin = ((uint8_t)req[2] << 8) | (uint8_t)req[3];
+    count = ((uint8_t)req[4] << 8) | (uint8_t)req[5];
+    if (count == 0 || count > 125 || begin + count > SIM_REGS) {
+      return exception_reply(resp, p->addr, func, ILLEGAL_DATA_ADDRESS);
+    }
+    record_read(p, begin, count);
+    resp[0] = p->addr;
+    resp[1] = func;
+    resp[2] = count * 2;
+    for (i = 0; i < count; i++) {
+      resp[3 + i * 2] = p->regs[begin + i] >> 8;
+      resp[4 + i * 2] = p->regs[begin + i] & 0xFF;
+    }
+    return 3 + count * 2;
+  }
+
+  if (func == MODBUS_WRITE_HOLDING_REGISTERS) {
+    if (len < 6 || (len - 4) % 2 != 0) {
+      return exception_reply(resp, p->addr, func, ILLEGAL_FUNCTION);
+    }
+    begin = ((uint8_t)req[2] << 8) | (uint8_t)req[3];
+    count = (len - 4) / 2;
+    if (begin + count > SIM_REGS) {
+      return exception_reply(resp, p->addr, func, ILLEGAL_DATA_ADDRESS);
+    }
+    for (i = 0; i < count; i++) {
+      p->regs[begin + i] = ((uint8_t)req[4 + i * 2] << 8) |
+                           (uint8_t)req[5 + i * 2];
+    }
+    // rackmond expects the request echoed back
+    memcpy(resp, req, len);
+    return len;
+  }
+
+  return exception_reply(resp, p->addr, func, ILLEGAL_FUNCTION);
+}
+
+static void* sim_serve(void *arg)
+{
+  int fd = *(int *)arg;
+  char req[256], resp[300];
+  size_t len, resp_len;
+  uint16_t crc;
+  sim_psu_t *p;
+  int wire_us;
+
+  while (!done) {
+    len = read_wait(fd, req, sizeof(req), 1000);
+    if (len == 0) {
+      continue;
+    }
+    pthread_mutex_lock(&sim.lock);
+    sim.requests++;
+    pthread_mutex_unlock(&sim.lock);
+    if (len < 4) {
+      continue;
+    }
+    crc = modbus_crc16(req, len - 2);
+    if ((uint8_t)req[len - 2] != (crc >> 8) ||
+        (uint8_t)req[len - 1] != (crc & 0xFF)) {
+      dbg("request with bad CRC dropped");
+      continue;
+    }
+    len -= 2;
+
+    p = sim_lookup(req[0]);
+    if (p == NULL) {
+      pthread_mutex_lock(&sim.lock);
+      sim.probes++;
+      pthread_mutex_unlock(&sim.lock);
+      continue;
+    }
+    if (sim.timeout_pct && rand() % 100 < sim.timeout_pct) {
+      pthread_mutex_lock(&sim.lock);
+      sim.timeouts++;
+      pthread_mutex_unlock(&sim.lock);
+      continue;
+    }
+
+    wire_us = 0;
+    if (sim.wire_time) {
+      // 11 bits per character (start, 8 data, parity, stop)
+      wire_us = (len + 2) * 11 * 1000000 / psu_baudrate(p);
+    }
+    resp_len = sim_handle(p, req, len, resp);
+    append_modbus_crc16(resp, &resp_len);
+    if (sim.crc_error_pct && rand() % 100 < sim.crc_error_pct) {
+      resp[resp_len - 1] ^= 0xFF;
+      pthread_mutex_lock(&sim.lock);
+      sim.crc_errors++;
+      pthread_mutex_unlock(&sim.lock);
+    }
+    if (sim.wire_time) {
+      wire_us += resp_len * 11 * 1000000 / psu_baudrate(p);
+    }
+    if (sim.latency_us + wire_us > 0) {
+      usleep(sim.latency_us + wire_us);
+    }
+    if (write(fd, resp, resp_len) < 0) {
+      OBMC_ERROR(errno, "failed to write reply");
+    }
+  }
+  return NULL;
+}
+
+static int rackmond_connect(void)
+{
+  int sock;
+  struct sockaddr_un addr;
+
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, RACKMON_IPC_SOCKET, sizeof(addr.sun_path) - 1);
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/*
+ * Read the status register of a PSU through rackmond, returns the
+ * round trip time in us or -1.
+ */
+static int raw_command_latency(uint8_t addr)
+{
+  char buf[sizeof(rackmond_command) + 8];
+  rackmond_command *cmd = (rackmond_command *)buf;
+  uint16_t wire_len = sizeof(buf), resp_len;
+  char resp[64];
+  uint64_t begin;
+  int sock, ret = -1;
+
+  memset(buf, 0, sizeof(buf));
+  cmd->type = COMMAND_TYPE_RAW_MODBUS;
+  cmd->raw_modbus.data[0] = addr;
+  cmd->raw_modbus.data[1] = MODBUS_READ_HOLDING_REGISTERS;
+  cmd->raw_modbus.data[2] = REGISTER_STATUS >> 8;
+  cmd->raw_modbus.data[3] = REGISTER_STATUS & 0xFF;
+  cmd->raw_modbus.data[4] = 0;
+  cmd->raw_modbus.data[5] = 1;
+  cmd->raw_modbus.length = 6;
+  cmd->raw_modbus.expected_response_length = 7;
+
+  begin = now_ns();
+  sock = rackmond_connect();
+  if (sock < 0) {
+    return -1;
+  }
+  if (send(sock, &wire_len, sizeof(wire_len), 0) < 0 ||
+      send(sock, buf, wire_len, 0) < 0) {
+    goto cleanup;
+  }
+  if (recv(sock, &resp_len, sizeof(resp_len), MSG_WAITALL) != sizeof(resp_len) ||
+      resp_len == 0) {
+    goto cleanup;
+  }
+  if (recv(sock, resp, sizeof(resp), 0) <= 0) {
+    goto cleanup;
+  }
+  ret = (now_ns() - begin) / 1000;
+
+cleanup:
+  close(sock);
+  return ret;
+}
+
+static void print_rackmond_status(void)
+{
+  rackmond_command cmd = {.type = COMMAND_TYPE_DUMP_STATUS};
+  uint16_t wire_len = sizeof(cmd);
+  char buf[1024];
+  ssize_t n;
+  int sock;
+
+  sock = rackmond_connect();
+  if (sock < 0) {
+    printf("rackmond status: not reachable\n");
+    return;
+  }
+  if (send(sock, &wire_len, sizeof(wire_len), 0) >= 0 &&
+      send(sock, &cmd, wire_len, 0) >= 0) {
+    printf("rackmond status:\n");
+    while ((n = read(sock, buf, sizeof(buf))) > 0) {
+      fwrite(buf, 1, n, stdout);
+    }
+  }
+  close(sock);
+}
+
+/*
+ * Get the configured register ranges from the binary export of rackmond,
+ * returns their number, 0 if it is not reachable or has no PSU yet.
+ */
+static int get_rackmond_ranges(rackmond_export_range *ranges, int max)
+{
+  // no reading is newer than this, only the ranges are sent
+  rackmond_command cmd = {
+    .type = COMMAND_TYPE_DUMP_DATA_BINARY,
+    .dump_data.since = UINT32_MAX,
+  };
+  uint16_t wire_len = sizeof(cmd);
+  rackmond_export_hdr hdr;
+  rackmond_export_psu psu;
+  int sock, num = 0;
+
+  sock = rackmond_connect();
+  if (sock < 0) {
+    return 0;
+  }
+  if (send(sock, &wire_len, sizeof(wire_len), 0) < 0 ||
+      send(sock, &cmd, wire_len, 0) < 0 ||
+      recv(sock, &hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr) ||
+      hdr.magic != RACKMON_EXPORT_MAGIC ||
+      hdr.version != RACKMON_EXPORT_VERSION || hdr.num_psus == 0 ||
+      recv(sock, &psu, sizeof(psu), MSG_WAITALL) != sizeof(psu)) {
+    goto cleanup;
+  }
+  // every PSU has the same ranges, take those of the first one
+  while (num < hdr.num_ranges && num < max &&
+         recv(sock, &ranges[num], sizeof(ranges[num]), MSG_WAITALL) ==
+             sizeof(ranges[num])) {
+    num++;
+  }
+
+cleanup:
+  close(sock);
+  return num;
+}
+
+static void print_rackmond_rss(void)
+{
+  char path[64], comm[32], line[128];
+  struct dirent *ent;
+  DIR *dir;
+  FILE *fp;
+  char *end;
+  long pid;
+
+  dir = opendir("/proc");
+  if (dir == NULL) {
+    return;
+  }
+  // find rackmond by name, there is only one instance
+  while ((ent = readdir(dir)) != NULL) {
+    pid = strtol(ent->d_name, &end, 10);
+    if (*end != '\0' || pid <= 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/proc/%ld/comm", pid);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+      continue;
+    }
+    if (fgets(comm, sizeof(comm), fp) == NULL ||
+        strcmp(comm, "rackmond\n") != 0) {
+      fclose(fp);
+      continue;
+    }
+    fclose(fp);
+
+    snprintf(path, sizeof(path), "/proc/%ld/status", pid);
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+      break;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      if (strncmp(line, "VmRSS:", 6) == 0) {
+        printf("rackmond (pid %ld) %s", pid, line);
+      }
+    }
+    fclose(fp);
+    break;
+  }
+  closedir(dir);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}
+
+static void print_interval(uint16_t begin, uint16_t len)
+{
+  if (begin >= SIM_REGS || sim.polls[begin] == 0) {
+    return;
+  }
+  printf("  0x%-4x ", begin);
+  if (len > 0) {
+    printf("%4u", len);
+  } else {
+    printf("%4s", "-");
+  }
+  printf(" %8llu %10.1f %10.1f\n", (unsigned long long)sim.polls[begin],
+         sim.interval_sum[begin] / 1e6 / sim.polls[begin],
+         sim.interval_max[begin] / 1e6);
+}
+
+static void report(int *lat, int num_lat, int lat_errors, double elapsed)
+{
+  static rackmond_export_range ranges[SIM_REGS];
+  int i, num_ranges;
+
+  num_ranges = get_rackmond_ranges(ranges, SIM_REGS);
+
+  pthread_mutex_lock(&sim.lock);
+  printf("elapsed:    %.1f s\n", elapsed);
+  printf("requests:   %llu (%.1f/s), to absent addresses: %llu\n",
+         (unsigned long long)sim.requests, sim.requests / elapsed,
+         (unsigned long long)sim.probes);
+  printf("injected:   %llu CRC errors, %llu timeouts, %llu exceptions\n",
+         (unsigned long long)sim.crc_errors, (unsigned long long)sim.timeouts,
+         (unsigned long long)sim.exceptions);
+  printf("poll interval per %s register range (over %d PSUs):\n",
+         num_ranges > 0 ? "configured" : "read", sim.num_psus);
+  printf("  %-6s %4s %8s %10s %10s\n", "begin", "len", "polls", "avg ms",
+         "max ms");
+  if (num_ranges > 0) {
+    for (i = 0; i < num_ranges; i++) {
+      print_interval(ranges[i].begin, ranges[i].len);
+    }
+  } else {
+    // rackmond is gone, only the reads as they were seen are known
+    for (i = 0; i < SIM_REGS; i++) {
+      if (sim.read_begin[i]) {
+        print_interval(i, 0);
+      }
+    }
+  }
+  pthread_mutex_unlock(&sim.lock);
+
+  if (num_lat > 0) {
+    uint64_t sum = 0;
+
+    qsort(lat, num_lat, sizeof(int), cmp_int);
+    for (i = 0; i < num_lat; i++) {
+      sum += lat[i];
+    }
+    printf("raw command latency: %d ok, %d failed, avg %llu us, "
+           "p50 %d us, p99 %d us, max %d us\n",
+           num_lat, lat_errors, (unsigned long long)(sum / num_lat),
+           lat[num_lat / 2], lat[(num_lat * 99) / 100], lat[num_lat - 1]);
+  } else if (lat_errors > 0) {
+    printf("raw command latency: all %d commands failed\n", lat_errors);
+  }
+
+  print_rackmond_status();
+  print_rackmond_rss();
+}
+
+static void trigger_exit(int sig)
+{
+  done = 1;
+}
+
+int main(int argc, char **argv)
+{
+  int error = 0;
+  int fd = -1, slave = -1, opt;
+  int duration = 60, interval_ms = 100;
+  bool baudrate = false;
+  const char *map = NULL;
+  struct termios tio;
+  pthread_t tid;
+  uint64_t begin, end;
+  int *lat = NULL, num_lat = 0, lat_errors = 0, next = 0;
+
+  verbose = 0;
+  while ((opt = getopt(argc, argv, "n:m:l:wBe:t:d:q:v")) != -1) {
+    switch (opt) {
+    case 'n':
+      sim.num_psus = atoi(optarg);
+      break;
+    case 'm':
+      map = optarg;
+      break;
+    case 'l':
+      sim.latency_us = atoi(optarg);
+      break;
+    case 'w':
+      sim.wire_time = true;
+      break;
+    case 'B':
+      baudrate = true;
+      break;
+    case 'e':
+      sim.crc_error_pct = atoi(optarg);
+      break;
+    case 't':
+      sim.timeout_pct = atoi(optarg);
+      break;
+    case 'd':
+      duration = atoi(optarg);
+      break;
+    case 'q':
+      interval_ms = atoi(optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    default:
+      usage();
+    }
+  }
+  if (sim.num_psus < 1 || sim.num_psus > MAX_SIM_PSUS || duration < 1) {
+    usage();
+  }
+
+  sim_psus_init(baudrate);
+  if (map != NULL && sim_load_map(map) != 0) {
+    return 1;
+  }
+
+  fd = posix_openpt(O_RDWR | O_NOCTTY);
+  ERR_LOG_EXIT(fd, "failed to open pty");
+  ERR_LOG_EXIT(grantpt(fd), "grantpt failed");
+  ERR_LOG_EXIT(unlockpt(fd), "unlockpt failed");
+  ERR_LOG_EXIT(tcgetattr(fd, &tio), "tcgetattr failed");
+  cfmakeraw(&tio);
+  ERR_LOG_EXIT(tcsetattr(fd, TCSANOW, &tio), "tcsetattr failed");
+
+  // keep the slave side open, the master reports EIO while nobody has it
+  slave = open(ptsname(fd), O_RDWR | O_NOCTTY);
+  ERR_LOG_EXIT(slave, "failed to open pty slave");
+
+  printf("Simulating %d PSUs on %s\n", sim.num_psus, ptsname(fd));
+  fflush(stdout);
+
+  signal(SIGINT, trigger_exit);
+  signal(SIGTERM, trigger_exit);
+  if (pthread_create(&tid, NULL, sim_serve, &fd) != 0) {
+    BAIL("failed to create simulator thread");
+  }
+
+  lat = calloc(MAX_LATENCIES, sizeof(int));
+  if (lat == NULL) {
+    BAIL("failed to allocate latency buffer");
+  }
+
+  begin = now_ns();
+  end = begin + (uint64_t)duration * 1000000000ULL;
+  while (!done && now_ns() < end) {
+    int us;
+
+    if (interval_ms <= 0) {
+      usleep(100000);
+      continue;
+    }
+    usleep(interval_ms * 1000);
+    // commands only count once rackmond knows the PSU
+    if (sim.psus[next].last_read[REGISTER_STATUS] == 0) {
+      continue;
+    }
+    us = raw_command_latency(sim.psus[next].addr);
+    if (us < 0) {
+      lat_errors++;
+    } else if (num_lat < MAX_LATENCIES) {
+      lat[num_lat++] = us;
+    }
+    next = (next + 1) % sim.num_psus;
+  }
+  done = 1;
+  pthread_join(tid, NULL);
+
+  report(lat, num_lat, lat_errors, (now_ns() - begin) / 1e9);
+
+cleanup:
+  free(lat);
+  if (slave >= 0) {
+    close(slave);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return error ? 1 : 0;
+}
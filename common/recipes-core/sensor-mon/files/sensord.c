@@ -43,6 +43,8 @@
 
 static thresh_sensor_t g_snr[MAX_NUM_FRUS][MAX_SENSOR_NUM] = {0};
 static thresh_sensor_t g_aggregate_snr[MAX_SENSOR_NUM] = {0};
+static sensor_fru_stats_t *g_stats[MAX_NUM_FRUS] = {0};
+static sensor_fru_stats_t *g_aggregate_stats = NULL;
 
 static void
 print_usage() {
@@ -94,6 +96,23 @@ get_struct_thresh_sensor(uint8_t fru) {
   return snr;
 }
 
+/*
+ * Returns the shared-memory polling statistics of the fru#, NULL if
+ * they are unavailable (stats are best-effort and never block polling)
+ */
+static sensor_fru_stats_t *
+get_struct_sensor_stats(uint8_t fru) {
+
+  if (fru == AGGREGATE_SENSOR_FRU_ID) {
+    return g_aggregate_stats;
+  }
+
+  if (fru < 1 || fru > MAX_NUM_FRUS) {
+    return NULL;
+  }
+  return g_stats[fru-1];
+}
+
 /* Initialize all thresh_sensor_t structs for all the Yosemite sensors */
 static int
 init_fru_snr_thresh(uint8_t fru) {
@@ -148,6 +167,7 @@ static int
 sensor_raw_read_helper(uint8_t fru, uint8_t snr_num, float *val)
 {
   int ret = 0;
+  uint64_t start = sensor_stats_timestamp();
 
   if (fru == AGGREGATE_SENSOR_FRU_ID) {
     ret = aggregate_sensor_read(snr_num, val);
@@ -167,6 +187,7 @@ sensor_raw_read_helper(uint8_t fru, uint8_t snr_num, float *val)
   } else {
     ret = sensor_raw_read(fru, snr_num, val);
   }
+  sensor_stats_record_read(get_struct_sensor_stats(fru), snr_num, start, ret != 0);
   return ret;
 }
 
@@ -480,8 +501,12 @@ snr_monitor(void *arg) {
   float curr_val;
   uint8_t *sensor_list, *discrete_list;
   thresh_sensor_t *snr;
+  sensor_fru_stats_t *stats;
+  uint64_t loop_start;
   uint32_t snr_poll_interval[MAX_SENSOR_NUM] = {0};
   uint8_t snr_read_fail[MAX_SENSOR_NUM] = {0};
+  uint8_t due_list[MAX_SENSOR_NUM];
+  int due_cnt;
 
   ret = pal_get_fru_sensor_list(fru, &sensor_list, &sensor_cnt);
   if (ret < 0) {
@@ -505,6 +530,7 @@ snr_monitor(void *arg) {
     syslog(LOG_WARNING, "snr_monitor: get_struct_thresh_sensor failed");
     exit(-1);
   }
+  stats = get_struct_sensor_stats(fru);
 
   for (i = 0; i < discrete_cnt; i++) {
     snr_num = discrete_list[i];
@@ -532,6 +558,23 @@ snr_monitor(void *arg) {
     if (ret < 0)
       syslog(LOG_ERR, "%s: Fail to reinit sensor threshold for fru%d",__func__,fru);
 
+    loop_start = sensor_stats_timestamp();
+
+    // Let the platform fetch everything this sweep reads in one go
+    due_cnt = 0;
+    for (i = 0; i < sensor_cnt; i++) {
+      snr_num = sensor_list[i];
+      if (snr[snr_num].flag && snr_poll_interval[snr_num] <= MIN_POLL_INTERVAL) {
+        due_list[due_cnt++] = snr_num;
+      }
+    }
+    for (i = 0; i < discrete_cnt && due_cnt < MAX_SENSOR_NUM; i++) {
+      due_list[due_cnt++] = discrete_list[i];
+    }
+    if (due_cnt > 0) {
+      sensor_raw_prefetch(fru, due_list, due_cnt);
+    }
+
     for (i = 0; i < sensor_cnt; i++) {
       snr_num = sensor_list[i];
       curr_val = 0;
@@ -542,6 +585,7 @@ snr_monitor(void *arg) {
           continue;
         }
         snr_poll_interval[snr_num] = snr[snr_num].poll_interval;
+        sensor_stats_record_poll(stats, snr_num, snr[snr_num].poll_interval);
         if (!(ret = sensor_raw_read_helper(fru, snr_num, &curr_val))) {
           sensor_fail_assert_clear(&snr_read_fail[snr_num], fru, snr_num, snr[snr_num].name);
           check_thresh_assert(fru, snr_num, UNC_THRESH, &curr_val);
@@ -580,6 +624,7 @@ snr_monitor(void *arg) {
     }
 #endif
 
+    sensor_stats_record_loop(stats, loop_start);
     sleep(MIN_POLL_INTERVAL);
   } /* while loop*/
 } /* function definition */
@@ -654,6 +699,7 @@ aggregate_snr_monitor(void *unused)
   uint8_t fru = AGGREGATE_SENSOR_FRU_ID;
   uint8_t snr_num;
   thresh_sensor_t *snr;
+  uint64_t loop_start;
   uint8_t snr_read_fail[MAX_SENSOR_NUM] = {0};
 
   if(aggregate_sensor_init(NULL)) {
@@ -673,12 +719,15 @@ aggregate_snr_monitor(void *unused)
     syslog(LOG_WARNING, "agg_snr_monitor: get_struct_thresh_sensor failed");
     pthread_exit(NULL);
   }
+  g_aggregate_stats = sensor_stats_open(fru);
 
   while(1) {
+    loop_start = sensor_stats_timestamp();
     for (i = 0; i < cnt; i++) {
       snr_num = (uint8_t)i;
       curr_val = 0;
       if (snr[snr_num].flag) {
+        sensor_stats_record_poll(g_aggregate_stats, snr_num, MIN_POLL_INTERVAL);
         if (!(ret = sensor_raw_read_helper(fru, snr_num, &curr_val))) {
           sensor_fail_assert_clear(&snr_read_fail[snr_num], fru, snr_num, snr[snr_num].name);
           check_thresh_assert(fru, snr_num, UNC_THRESH, &curr_val);
@@ -699,6 +748,7 @@ aggregate_snr_monitor(void *unused)
         } /* pal_sensor_read return check */
       } /* flag check */
     } /* loop for all sensors */
+    sensor_stats_record_loop(g_aggregate_stats, loop_start);
     sleep(MIN_POLL_INTERVAL);
   }
   pthread_exit(NULL);
@@ -735,6 +785,10 @@ run_sensord(int argc, char **argv) {
       if (init_fru_snr_thresh(fru) < 0)
         continue;
 
+      g_stats[fru-1] = sensor_stats_open(fru);
+      if (g_stats[fru-1] == NULL)
+        syslog(LOG_WARNING, "Polling statistics for FRU %d unavailable\n", fru);
+
       /* Threshold Sensors */
       if (pthread_create(&thread_snr[fru-1], NULL, snr_monitor,
           (void*)(uintptr_t)fru) < 0) {
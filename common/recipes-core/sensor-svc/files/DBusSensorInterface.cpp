@@ -19,6 +19,10 @@
  */
 
 #include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <glog/logging.h>
 #include <gio/gio.h>
 #include "DBusSensorInterface.h"
@@ -27,6 +31,46 @@
 namespace openbmc {
 namespace qin {
 
+/*
+ * A sensorRawRead call, waiting in its read queue or running on a
+ * GTask worker thread.
+ */
+struct RawReadRequest {
+  std::mutex             mutex;       // held by the worker during the read
+  Sensor*                sensor;      // nullptr once cancelled
+  GDBusMethodInvocation* invocation;
+  std::string            queue;
+  gint64                 start;       // monotonic time of the call
+  ReadResult             readStatus = READING_NA;
+  float                  value = 0;
+};
+
+struct ReadQueue {
+  RawReadRequest*             running = nullptr;
+  std::deque<RawReadRequest*> waiting;
+};
+
+struct MethodLatency {
+  guint64 calls = 0;
+  guint64 totalUs = 0;
+  guint64 maxUs = 0;
+};
+
+// Both are only touched from the main loop, the worker threads see
+// nothing but their own RawReadRequest.
+static std::unordered_map<std::string, ReadQueue> readQueues;
+static std::map<std::string, MethodLatency> methodLatency;
+
+static void recordLatency(const char* methodName, gint64 start) {
+  guint64 us = g_get_monotonic_time() - start;
+  MethodLatency &latency = methodLatency[methodName];
+  latency.calls++;
+  latency.totalUs += us;
+  if (us > latency.maxUs) {
+    latency.maxUs = us;
+  }
+}
+
 static const char* xml =
 "<!DOCTYPE node PUBLIC"
 " \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\" "
@@ -79,15 +123,112 @@ void DBusSensorInterface::sensorRead(GDBusMethodInvocation* invocation,
                                         obj->getValue()));
 }
 
+static void rawReadThread(GTask*        task,
+                          gpointer      source,
+                          gpointer      taskData,
+                          GCancellable* cancellable) {
+  RawReadRequest* req = static_cast<RawReadRequest*>(taskData);
+  std::lock_guard<std::mutex> lock(req->mutex);
+  if (req->sensor != nullptr) {
+    req->readStatus = req->sensor->sensorRawRead(&req->value);
+  }
+  g_task_return_boolean(task, TRUE);
+}
+
+static void startRawRead(RawReadRequest* req);
+
+static void rawReadDone(GObject*      source,
+                        GAsyncResult* result,
+                        gpointer      arg) {
+  RawReadRequest* req = static_cast<RawReadRequest*>(
+                          g_task_get_task_data(G_TASK(result)));
+
+  g_dbus_method_invocation_return_value(req->invocation,
+                                        g_variant_new("(id)",
+                                        req->readStatus,
+                                        req->value));
+  recordLatency("sensorRawRead", req->start);
+
+  // hand the queue to the next call waiting on it
+  auto it = readQueues.find(req->queue);
+  if (it->second.waiting.empty()) {
+    readQueues.erase(it);
+  }
+  else {
+    RawReadRequest* next = it->second.waiting.front();
+    it->second.waiting.pop_front();
+    it->second.running = next;
+    startRawRead(next);
+  }
+  delete req;
+}
+
+static void startRawRead(RawReadRequest* req) {
+  GTask* task = g_task_new(nullptr, nullptr, rawReadDone, nullptr);
+  g_task_set_task_data(task, req, nullptr);
+  g_task_run_in_thread(task, rawReadThread);
+  g_object_unref(task);
+}
+
 void DBusSensorInterface::sensorRawRead(GDBusMethodInvocation* invocation,
-                                        gpointer               arg) {
+                                        gpointer               arg,
+                                        gint64                 start) {
   Sensor* obj = static_cast<Sensor*>(arg);
   LOG(INFO) << "sensorRawRead of " << obj->getName();
-  obj->sensorRawRead();
-  g_dbus_method_invocation_return_value(invocation,
-                                        g_variant_new("(id)",
-                                        obj->getLastReadStatus(),
-                                        obj->getValue()));
+
+  RawReadRequest* req = new RawReadRequest();
+  req->sensor = obj;
+  req->invocation = invocation;
+  req->queue = obj->getReadQueue();
+  req->start = start;
+
+  ReadQueue &queue = readQueues[req->queue];
+  if (queue.running != nullptr) {
+    queue.waiting.push_back(req);
+  }
+  else {
+    queue.running = req;
+    startRawRead(req);
+  }
+}
+
+void DBusSensorInterface::cancelRawReads(const Sensor* sensor) {
+  for (auto &it : readQueues) {
+    ReadQueue &queue = it.second;
+    if (queue.running->sensor == sensor) {
+      // waits for the read if it has already started
+      std::lock_guard<std::mutex> lock(queue.running->mutex);
+      queue.running->sensor = nullptr;
+    }
+    for (auto req = queue.waiting.begin(); req != queue.waiting.end();) {
+      if ((*req)->sensor != sensor) {
+        ++req;
+        continue;
+      }
+      g_dbus_method_invocation_return_value((*req)->invocation,
+                                            g_variant_new("(id)",
+                                            READING_NA,
+                                            0.0));
+      recordLatency("sensorRawRead", (*req)->start);
+      delete *req;
+      req = queue.waiting.erase(req);
+    }
+  }
+}
+
+GVariant* DBusSensorInterface::getMethodLatency() {
+  GVariantBuilder* builder = g_variant_builder_new(G_VARIANT_TYPE("a(sttt)"));
+  for (auto &it : methodLatency) {
+    g_variant_builder_add(builder,
+                          "(sttt)",
+                          it.first.c_str(),
+                          it.second.calls,
+                          it.second.totalUs / it.second.calls,
+                          it.second.maxUs);
+  }
+  GVariant* latency = g_variant_new("(a(sttt))", builder);
+  g_variant_builder_unref(builder);
+  return latency;
 }
 
 void DBusSensorInterface::getSensorObject(GDBusMethodInvocation* invocation,
@@ -124,12 +265,15 @@ void DBusSensorInterface::methodCallBack(
                           gpointer               arg) {
   // arg should be a pointer to Sensor
   DCHECK(arg != nullptr) << "Empty object passed to callback";
+  gint64 start = g_get_monotonic_time();
 
   if (g_strcmp0(methodName, "sensorRead") == 0) {
     sensorRead(invocation, arg);
   }
   else if (g_strcmp0(methodName, "sensorRawRead") == 0) {
-    sensorRawRead(invocation, arg);
+    // latency is recorded when the read completes
+    sensorRawRead(invocation, arg, start);
+    return;
   }
   else if (g_strcmp0(methodName, "getSensorObject") == 0) {
     getSensorObject(invocation, arg);
@@ -137,6 +281,10 @@ void DBusSensorInterface::methodCallBack(
   else if (g_strcmp0(methodName, "getSensorId") == 0) {
     getSensorId(invocation, arg);
   }
+  else {
+    return;
+  }
+  recordLatency(methodName, start);
 }
 
 } // namespace qin
@@ -25,6 +25,8 @@
 namespace openbmc {
 namespace qin {
 
+class Sensor;
+
 class DBusSensorInterface: public DBusInterfaceBase {
   public:
     /**
@@ -54,6 +56,20 @@ class DBusSensorInterface: public DBusInterfaceBase {
                                GDBusMethodInvocation* invocation,
                                gpointer               arg);
 
+    /**
+     * Answers the sensorRawRead calls on sensor that wait for their turn
+     * and detaches the one in flight from sensor. To be called from the
+     * main loop before sensor is deleted.
+     */
+    static void cancelRawReads(const Sensor* sensor);
+
+    /**
+     * Returns the latency of the methods of this interface since start
+     * as an a(sttt) of method name, calls, average and maximum latency
+     * in microseconds.
+     */
+    static GVariant* getMethodLatency();
+
   private:
     /**
      * Callback for sensorRead method
@@ -71,10 +87,13 @@ class DBusSensorInterface: public DBusInterfaceBase {
 
     /**
      * Callback for sensorRawRead method
-     * Invokes rawRead on sensor and returns value and read status
+     * Invokes rawRead on sensor in a worker thread and returns value
+     * and read status once it completes. Reads sharing a read queue
+     * run one at a time in the order of the calls.
     */
     static void sensorRawRead(GDBusMethodInvocation* invocation,
-                              gpointer               arg);
+                              gpointer               arg,
+                              gint64                 start);
 
     /**
      * Callback for getSensorId method
@@ -23,6 +23,7 @@
 #include <gio/gio.h>
 #include <nlohmann/json.hpp>
 #include "DBusSensorServiceInterface.h"
+#include "DBusSensorInterface.h"
 #include "SensorJsonParser.h"
 
 namespace openbmc {
@@ -72,6 +73,9 @@ static const char* xml =
   "      <arg type='s' name='fruPath' direction='in'/>"
   "      <arg type='b' name='status' direction='out'/>"
   "    </method>"
+  "    <method name='getMethodLatency'>"
+  "      <arg type='a(sttt)' name='latency' direction='out'/>"
+  "    </method>"
   "  </interface>"
   "</node>";
 
@@ -224,6 +228,11 @@ void DBusSensorServiceInterface::methodCallBack(
   else if (g_strcmp0(methodName, "removeFRU") == 0) {
     removeFRU(invocation, parameters, sensorTree, objectPath);
   }
+  else if (g_strcmp0(methodName, "getMethodLatency") == 0) {
+    g_dbus_method_invocation_return_value(
+                                invocation,
+                                DBusSensorInterface::getMethodLatency());
+  }
   else {
     // For remaining methods call DBusSensorTreeInterface::methodCallBack
     // Pass SensorService object (sensorTree->getObject(objectPath)) as arg
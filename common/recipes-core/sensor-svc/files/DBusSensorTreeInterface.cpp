@@ -23,12 +23,13 @@
 #include <glog/logging.h>
 #include <gio/gio.h>
 #include "DBusSensorTreeInterface.h"
-#include "FRU.h"
-#include "Sensor.h"
+#include "SensorObjectTree.h"
 
 namespace openbmc {
 namespace qin {
 
+SensorObjectTree* DBusSensorTreeInterface::sensorTree_ = nullptr;
+
 static const char* xml =
   "<!DOCTYPE node PUBLIC"
   " \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\" "
@@ -75,29 +76,18 @@ DBusSensorTreeInterface::~DBusSensorTreeInterface() {
   g_dbus_node_info_unref(info_);
 }
 
-/*
-* Helper function, returns path of Object obj
-*/
-static std::string getPathToCurrentObject(Object* obj){
-  if (obj->getParent() == nullptr){
-    return "/" + obj->getName();
-  }
-  else {
-    return getPathToCurrentObject(obj->getParent()) + "/" + obj->getName();
-  }
-}
-
 /*
 * Helper function, returns vector of FRU names of
 * all FRUs under Object obj subtree
 */
-static std::vector<std::string> getFRUListRec(Object* obj) {
+static std::vector<std::string> getFRUListRec(const SensorObjectTree* tree,
+                                              Object*                 obj) {
   std::vector<std::string> sensorObjectPaths;
 
   for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr){
+    if (tree->findFRU(it.second) != nullptr){
       sensorObjectPaths.push_back(it.second->getName());
-      std::vector<std::string> childSubtree = getFRUListRec(it.second);
+      std::vector<std::string> childSubtree = getFRUListRec(tree, it.second);
       if (!childSubtree.empty()){
         for (auto &itVec : childSubtree) {
           sensorObjectPaths.push_back(itVec);
@@ -115,8 +105,7 @@ void DBusSensorTreeInterface::getFRUList(GDBusMethodInvocation* invocation,
   Object* obj = static_cast<Object*>(arg);
   LOG(INFO) << "getFRUList " << obj->getName();
 
-  std::vector<std::string> fruList = getFRUListRec(obj);
-  std::string objectPath = getPathToCurrentObject(obj);
+  std::vector<std::string> fruList = getFRUListRec(sensorTree_, obj);
 
   for (auto &it : fruList) {
     g_variant_builder_add(builder, "s", it.c_str());
@@ -127,33 +116,12 @@ void DBusSensorTreeInterface::getFRUList(GDBusMethodInvocation* invocation,
   g_variant_builder_unref(builder);
 }
 
-
 /*
-* Helper function, locates FRU with fruName under subtree and returns its path
+* Helper function, returns path of the object found by a lookup,
+* empty if there is none
 */
-static std::string getFruPathByNameRec(Object* obj, std::string fruName) {
-  std::string path;
-
-  for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr) {
-      //Child is FRU
-      if (fruName.compare(it.first) == 0){
-        // FRU found
-        path = it.first;
-        break;
-      }
-      else {
-        path = getFruPathByNameRec(it.second, fruName);
-        if (!path.empty()){
-          // If sensor is located no need to search more
-          path = it.first + "/" + path;
-          break;
-        }
-      }
-    }
-  }
-
-  return path;
+static std::string getPathOrEmpty(const Object* obj) {
+  return obj == nullptr ? std::string() : obj->getObjectPath();
 }
 
 void DBusSensorTreeInterface::getFruPathByName(
@@ -165,91 +133,28 @@ void DBusSensorTreeInterface::getFruPathByName(
   g_variant_get(parameters, "(&s)", &fruName);
 
   LOG(INFO) << "getFruPathByName of " << fruName << " from " << obj->getName();
-  std::string path = getFruPathByNameRec(obj, std::string(fruName));
-
-  if (!path.empty()) {
-    path = getPathToCurrentObject(obj) + "/" + path;
-  }
+  std::string path =
+    getPathOrEmpty(sensorTree_->findFRUByName(obj, std::string(fruName)));
 
   g_dbus_method_invocation_return_value(invocation,
                                         g_variant_new("(s)", path.c_str()));
 }
 
-/*
-* Helper function, locates FRU with fruId under subtree and returns its path
-*/
-static std::string getFruPathByIdRec(Object* obj, uint8_t fruId) {
-  std::string path;
-
-  for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr) {
-      //Child is sensor device
-      if (fruId == ((FRU*)it.second)->getId()){
-        // FRU found
-        path = it.first;
-        break;
-      }
-      else {
-        path = getFruPathByIdRec(it.second, fruId);
-        if (!path.empty()){
-          // If sensor is located no need to search more
-          path = it.first + "/" + path;
-          break;
-        }
-      }
-    }
-  }
-  return path;
-}
-
 void DBusSensorTreeInterface::getFruPathById(GDBusMethodInvocation* invocation,
                                              GVariant*              parameters,
                                              gpointer               arg){
   Object* obj = static_cast<Object*>(arg);
-  gchar fruId;
+  guchar fruId;
   g_variant_get(parameters, "(y)", &fruId);
 
-  LOG(INFO) << "getFruPathById of " << fruId << " from " << obj->getName();
-  std::string path = getFruPathByIdRec(obj, fruId);
-
-  if (!path.empty()) {
-    path = getPathToCurrentObject(obj) + "/" + path;
-  }
+  LOG(INFO) << "getFruPathById of " << (int)fruId
+            << " from " << obj->getName();
+  std::string path = getPathOrEmpty(sensorTree_->findFRUById(obj, fruId));
 
   g_dbus_method_invocation_return_value(invocation,
                                         g_variant_new("(s)", path.c_str()));
 }
 
-/*
-* Helper function, locates Sensor with sensorName under subtree and
-* returns its path
-*/
-static std::string getSensorPathByNameRec(Object* obj,
-                                          std::string sensorName) {
-  std::string path;
-
-  for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr) {
-      //Child is FRU
-      path = getSensorPathByNameRec(it.second, sensorName);
-      if (!path.empty()){
-        // If sensor is located no need to search more
-        path = it.first + "/" + path;
-        break;
-      }
-    }
-    else if (dynamic_cast<Sensor*>(it.second) != nullptr) {
-      //Child is sensor object
-      if (sensorName.compare(it.second->getName()) == 0) {
-        path = it.second->getName();
-        break;
-      }
-    }
-  }
-
-  return path;
-}
-
 void DBusSensorTreeInterface::getSensorPathByName(
                                              GDBusMethodInvocation* invocation,
                                              GVariant*              parameters,
@@ -259,44 +164,13 @@ void DBusSensorTreeInterface::getSensorPathByName(
   g_variant_get(parameters, "(&s)", &sensorName);
 
   LOG(INFO) << "getSensorPath of " << sensorName << " from " << obj->getName();
-  std::string path = getSensorPathByNameRec(obj, std::string(sensorName));
-
-  if (!path.empty()) {
-    path = getPathToCurrentObject(obj) + "/" + path;
-  }
+  std::string path =
+    getPathOrEmpty(sensorTree_->findSensorByName(obj, std::string(sensorName)));
 
   g_dbus_method_invocation_return_value(invocation,
                                         g_variant_new("(s)", path.c_str()));
 }
 
-/*
-* Helper function, locates Sensor with id under subtree and returns its path
-*/
-static std::string getSensorPathByIdRec(Object* obj, uint16_t id) {
-  std::string path;
-
-  for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr) {
-      //Child is FRU
-      path = getSensorPathByIdRec(it.second, id);
-      if (!path.empty()){
-        // If sensor is located no need to search more
-        path = it.first + "/" + path;
-        break;
-      }
-    }
-    else if (dynamic_cast<Sensor*>(it.second) != nullptr) {
-      //Child is sensor object
-      if (((Sensor*) it.second)->getId() == id) {
-        path = it.second->getName();
-        break;
-      }
-    }
-  }
-
-  return path;
-}
-
 void DBusSensorTreeInterface::getSensorPathById(
                                              GDBusMethodInvocation* invocation,
                                              GVariant*              parameters,
@@ -309,11 +183,7 @@ void DBusSensorTreeInterface::getSensorPathById(
   LOG(INFO) << "getSensorPathById of " << (int)id
             << " from " << obj->getName();
 
-  std::string path = getSensorPathByIdRec(obj, id);
-
-  if (!path.empty()) {
-    path = getPathToCurrentObject(obj) + "/" + path;
-  }
+  std::string path = getPathOrEmpty(sensorTree_->findSensorById(obj, id));
 
   g_dbus_method_invocation_return_value(invocation,
                                         g_variant_new("(s)", path.c_str()));
@@ -323,10 +193,12 @@ void DBusSensorTreeInterface::getSensorPathById(
  * Recursively traverses through subtree under Object obj and
  * adds all sensor objects to GVariantBuilder* builder
  */
-static void addSensorObjects(GVariantBuilder* builder, Object* obj) {
+static void addSensorObjects(const SensorObjectTree* tree,
+                             GVariantBuilder*        builder,
+                             Object*                 obj) {
   for (auto &it : obj->getChildMap()) {
     Sensor* sensor;
-    if ((sensor = dynamic_cast<Sensor*>(it.second)) != nullptr) {
+    if ((sensor = tree->findSensor(it.second)) != nullptr) {
       //child is Sensor, add it to builder
       g_variant_builder_add(builder,
                             "(syids)",
@@ -339,9 +211,9 @@ static void addSensorObjects(GVariantBuilder* builder, Object* obj) {
   }
 
   for (auto &it : obj->getChildMap()) {
-    if (dynamic_cast<FRU*>(it.second) != nullptr) {
+    if (tree->findFRU(it.second) != nullptr) {
       //Recursively call on child FRU
-      addSensorObjects(builder, it.second);
+      addSensorObjects(tree, builder, it.second);
     }
   }
 }
@@ -354,7 +226,7 @@ void DBusSensorTreeInterface::getSensorObjects(
 
   GVariantBuilder* builder = g_variant_builder_new(G_VARIANT_TYPE("a(syids)"));
 
-  addSensorObjects(builder, obj);
+  addSensorObjects(sensorTree_, builder, obj);
 
   g_dbus_method_invocation_return_value(invocation,
                                         g_variant_new("(a(syids))", builder));
@@ -372,6 +244,7 @@ void DBusSensorTreeInterface::methodCallBack(
                           gpointer               arg) {
   // arg should be a pointer to Object in object-tree
   DCHECK(arg != nullptr) << "Empty object passed to callback";
+  DCHECK(sensorTree_ != nullptr) << "No SensorObjectTree to look up in";
 
   if (g_strcmp0(methodName, "getSensorPathByName") == 0) {
     getSensorPathByName(invocation, parameters, arg);
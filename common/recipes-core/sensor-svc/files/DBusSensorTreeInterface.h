@@ -25,7 +25,13 @@
 namespace openbmc {
 namespace qin {
 
+class SensorObjectTree;
+
 class DBusSensorTreeInterface: public DBusInterfaceBase {
+  private:
+    // tree whose indexes serve the path lookups
+    static SensorObjectTree* sensorTree_;
+
   public:
     /**
      * Constructor to initialize the member variables
@@ -39,6 +45,14 @@ class DBusSensorTreeInterface: public DBusInterfaceBase {
      */
     ~DBusSensorTreeInterface();
 
+    /**
+     * Set the SensorObjectTree the objects served by this interface
+     * belong to.
+     */
+    static void setSensorTree(SensorObjectTree* sensorTree) {
+      sensorTree_ = sensorTree;
+    }
+
     /**
      * Handles the callback by matching the method names in the DBus message
      * to the functions. The above callbacks should be invoked here with
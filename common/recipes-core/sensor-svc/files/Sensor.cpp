@@ -64,13 +64,28 @@ ReadResult Sensor::getLastReadStatus() {
   return sensorAccess_->getLastReadResult();
 }
 
+std::string Sensor::getReadQueue() {
+  std::string queue = sensorAccess_->getReadQueue();
+  if (queue.empty()) {
+    queue = getParent()->getObjectPath();
+  }
+  return queue;
+}
+
 ReadResult Sensor::sensorRawRead(){
+  float val;
+  return sensorRawRead(&val);
+}
+
+ReadResult Sensor::sensorRawRead(float* value){
+  std::lock_guard<std::mutex> lock(readMutex_);
   float val;
   ReadResult readResult = sensorAccess_->sensorRawRead(this, &val);
   if (readResult == READING_SUCCESS){
     value_ = val;
   }
 
+  *value = value_;
   return readResult;
 }
 
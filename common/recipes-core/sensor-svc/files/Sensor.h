@@ -21,6 +21,8 @@
 #pragma once
 #include <string>
 #include <cstdint>
+#include <atomic>
+#include <mutex>
 #include <stdlib.h>
 #include <stdio.h>
 #include <object-tree/Object.h>
@@ -33,10 +35,11 @@ namespace qin {
 class Sensor : public Object{
   private:
     uint8_t id_ = 0xFF;                           // Sensor Id
-    float value_;                                 // Last Read Sensor Value
+    std::atomic<float> value_{0};                 // Last Read Sensor Value
     std::string unit_;                            // Unit of Sensor
     std::unique_ptr<SensorAccessMechanism> sensorAccess_;
                                                   // sensorAccess mechanism
+    std::mutex readMutex_;                        // held across a raw read
 
   public:
     /*
@@ -80,10 +83,22 @@ class Sensor : public Object{
      */
     ReadResult getLastReadStatus();
 
+    /*
+     * Returns the read queue of the sensor, see
+     * SensorAccessMechanism::getReadQueue
+     */
+    std::string getReadQueue();
+
     /*
      * sensorRaw
      */
     ReadResult sensorRawRead();
+
+    /*
+     * sensorRaw, also returns the value as of the end of the read. Safe
+     * to call off the main loop thread.
+     */
+    ReadResult sensorRawRead(float* value);
 };
 
 } // namespace qin
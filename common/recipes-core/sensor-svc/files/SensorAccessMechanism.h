@@ -20,6 +20,8 @@
 
 #pragma once
 #include <cstdint>
+#include <atomic>
+#include <string>
 
 namespace openbmc {
 namespace qin {
@@ -43,7 +45,7 @@ protected:
 
   int8_t maxNofRetry_ = -1; // -1 if no limit
   uint8_t totalRetry_ = 0;
-  ReadResult readResult_ = READING_NA;
+  std::atomic<ReadResult> readResult_{READING_NA};
   uint8_t accessCondition_ = 0; // Allways accessible
 
   virtual void rawRead(Sensor* s, float *value);
@@ -98,6 +100,15 @@ public:
     return readResult_;
   }
 
+  /*
+   * Returns the queue the raw reads go through, reads on the same queue
+   * never run concurrently. Empty selects the queue of the sensor's FRU,
+   * which suits the platform reads that share state of the FRU.
+   */
+  virtual std::string getReadQueue() const {
+    return "";
+  }
+
   void setmaxNofRetry (uint8_t maxNofRetry) {
     this->maxNofRetry_ = maxNofRetry;
   }
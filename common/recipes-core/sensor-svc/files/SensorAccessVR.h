@@ -68,6 +68,11 @@ class SensorAccessVR : public SensorAccessMechanism {
 
     bool preRawRead(Sensor* s, float* value) override;
 
+    // transactions on the bus must not interleave
+    std::string getReadQueue() const override {
+      return "/dev/i2c-" + std::to_string(busId_);
+    }
+
     void rawRead(Sensor* s, float *value) override{
       int fd;
       char fn[32];
@@ -36,13 +36,18 @@ class SensorAccessViaPath : public SensorAccessMechanism {
   private:
     std::string path_;          //sensor path
     float unitDiv_ = 1;         //divisor for value read from path
+    const std::string queue_;   //path_ before it is resolved by rawRead
 
   public:
     SensorAccessViaPath(std::string path)
-      : path_(path) {}
+      : path_(path), queue_(path) {}
 
     SensorAccessViaPath(std::string path, float unitDiv)
-      : path_(path), unitDiv_(unitDiv) {}
+      : path_(path), unitDiv_(unitDiv), queue_(path) {}
+
+    std::string getReadQueue() const override {
+      return queue_;
+    }
 
     void rawRead(Sensor* s, float *value) override {
       int pos = path_.find('*');
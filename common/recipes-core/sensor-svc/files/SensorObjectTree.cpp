@@ -32,6 +32,42 @@ static DBusSensorTreeInterface sensorTreeInterface;
 static DBusSensorInterface sensorInterface;
 static DBusSensorServiceInterface sensorServiceInterface;
 
+/*
+ * Returns true if obj is in the subtree under scope, scope excluded.
+ */
+static bool isUnder(const Object* obj, const Object* scope) {
+  for (obj = obj->getParent(); obj != nullptr; obj = obj->getParent()) {
+    if (obj == scope) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Removes the entry key -> value from a multimap index.
+ */
+template <typename Map, typename Key, typename Value>
+static void eraseEntry(Map &map, const Key &key, const Value* value) {
+  auto range = map.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == value) {
+      map.erase(it);
+      return;
+    }
+  }
+}
+
+SensorObjectTree::SensorObjectTree(const std::shared_ptr<Ipc> &ipc,
+                                   const std::string          &rootName)
+  : ObjectTree(ipc, rootName) {
+  DBusSensorTreeInterface::setSensorTree(this);
+}
+
+SensorObjectTree::~SensorObjectTree() {
+  DBusSensorTreeInterface::setSensorTree(nullptr);
+}
+
 Object* SensorObjectTree::addObject(std::unique_ptr<Object> upObj,
                                     const std::string       &parentPath) {
   bool isSensorObject = false;
@@ -54,7 +90,115 @@ Object* SensorObjectTree::addObject(std::unique_ptr<Object> upObj,
       throw std::invalid_argument("Invalid parent type");
     }
   }
-  return ObjectTree::addObject(std::move(upObj), parentPath);
+  Object* object = ObjectTree::addObject(std::move(upObj), parentPath);
+  indexObject(object);
+  return object;
+}
+
+void SensorObjectTree::deleteObjectByPath(const std::string &path) {
+  Object* object = getObject(path);
+  if (object != nullptr) {
+    Sensor* sensor = findSensor(object);
+    if (sensor != nullptr) {
+      DBusSensorInterface::cancelRawReads(sensor);
+    }
+    unindexObject(object);
+  }
+  try {
+    ObjectTree::deleteObjectByPath(path);
+  } catch (...) {
+    if (object != nullptr) {
+      indexObject(object);
+    }
+    throw;
+  }
+}
+
+void SensorObjectTree::indexObject(Object* object) {
+  FRU* fru;
+  Sensor* sensor;
+
+  if ((fru = dynamic_cast<FRU*>(object)) != nullptr) {
+    fruMap_.emplace(object, fru);
+    fruIdIndex_.emplace(fru->getId(), fru);
+    fruNameIndex_.emplace(fru->getName(), fru);
+  }
+  else if ((sensor = dynamic_cast<Sensor*>(object)) != nullptr) {
+    sensorMap_.emplace(object, sensor);
+    // the first sensor added with an id keeps it, as the tree walk did
+    sensorIdIndex_.emplace(SensorIdKey(sensor->getParent(), sensor->getId()),
+                           sensor);
+    sensorNameIndex_.emplace(sensor->getName(), sensor);
+  }
+}
+
+void SensorObjectTree::unindexObject(Object* object) {
+  FRU* fru;
+  Sensor* sensor;
+
+  if ((fru = findFRU(object)) != nullptr) {
+    fruMap_.erase(object);
+    eraseEntry(fruIdIndex_, fru->getId(), fru);
+    eraseEntry(fruNameIndex_, fru->getName(), fru);
+  }
+  else if ((sensor = findSensor(object)) != nullptr) {
+    sensorMap_.erase(object);
+    auto it = sensorIdIndex_.find(SensorIdKey(sensor->getParent(),
+                                              sensor->getId()));
+    if (it != sensorIdIndex_.end() && it->second == sensor) {
+      sensorIdIndex_.erase(it);
+    }
+    eraseEntry(sensorNameIndex_, sensor->getName(), sensor);
+  }
+}
+
+FRU* SensorObjectTree::findFRUById(const Object* scope, uint8_t id) const {
+  auto range = fruIdIndex_.equal_range(id);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (isUnder(it->second, scope)) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+FRU* SensorObjectTree::findFRUByName(const Object*      scope,
+                                     const std::string &name) const {
+  auto range = fruNameIndex_.equal_range(name);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (isUnder(it->second, scope)) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+Sensor* SensorObjectTree::findSensorById(const Object* scope,
+                                         uint8_t       id) const {
+  auto it = sensorIdIndex_.find(SensorIdKey(scope, id));
+  if (it != sensorIdIndex_.end()) {
+    return it->second;
+  }
+  // scope is not the sensor's FRU, try the FRUs below it
+  for (auto &fru : fruMap_) {
+    if (isUnder(fru.first, scope) &&
+        (it = sensorIdIndex_.find(SensorIdKey(fru.first, id))) !=
+          sensorIdIndex_.end()) {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+Sensor* SensorObjectTree::findSensorByName(const Object*      scope,
+                                           const std::string &name) const {
+  auto range = sensorNameIndex_.equal_range(name);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (isUnder(it->second, scope)) {
+      return it->second;
+    }
+  }
+  return nullptr;
 }
 
 SensorService* SensorObjectTree::addSensorService(
@@ -21,6 +21,8 @@
 #pragma once
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <ipc-interface/Ipc.h>
 #include <object-tree/ObjectTree.h>
 #include <object-tree/Object.h>
@@ -39,11 +41,40 @@ namespace qin {
  * and bridges them with the interprocess communicaton (IPC).
  */
 class SensorObjectTree : public ObjectTree {
+  private:
+    // key of the sensor id index, a sensor id is unique within its FRU
+    typedef std::pair<const Object*, uint8_t> SensorIdKey;
+
+    struct SensorIdKeyHash {
+      size_t operator()(const SensorIdKey &key) const {
+        return std::hash<const Object*>()(key.first) ^ key.second;
+      }
+    };
+
+    // Secondary indexes over objectMap_, kept in sync by addObject and
+    // deleteObjectByPath so that D-Bus lookups neither walk the tree
+    // nor need RTTI.
+    std::unordered_map<const Object*, FRU*>            fruMap_;
+    std::unordered_map<const Object*, Sensor*>         sensorMap_;
+    std::unordered_multimap<uint8_t, FRU*>             fruIdIndex_;
+    std::unordered_multimap<std::string, FRU*>         fruNameIndex_;
+    std::unordered_map<SensorIdKey, Sensor*, SensorIdKeyHash>
+                                                       sensorIdIndex_;
+    std::unordered_multimap<std::string, Sensor*>      sensorNameIndex_;
+
   public:
-    using ObjectTree::ObjectTree; // inherit base constructor
     // prevent compiler from mistaking addObject defined in base and derived
     using ObjectTree::addObject;
 
+    /**
+     * Constructor. Makes the tree the one used by the SensorTree DBus
+     * interface for its lookups.
+     */
+    SensorObjectTree(const std::shared_ptr<Ipc> &ipc,
+                     const std::string          &rootName);
+
+    ~SensorObjectTree();
+
     /**
      * Get the FRU with specified path.
      */
@@ -100,8 +131,49 @@ class SensorObjectTree : public ObjectTree {
                        const std::string &unit,
                        std::unique_ptr<SensorAccessMechanism> upSensorAccess);
 
+    /**
+     * Delete the object from the tree and from the lookup indexes.
+     */
+    void deleteObjectByPath(const std::string &path) override;
+
+    /**
+     * Returns the FRU if object is one, nullptr otherwise.
+     */
+    FRU* findFRU(const Object* object) const {
+      auto it = fruMap_.find(object);
+      return it == fruMap_.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Returns the Sensor if object is one, nullptr otherwise.
+     */
+    Sensor* findSensor(const Object* object) const {
+      auto it = sensorMap_.find(object);
+      return it == sensorMap_.end() ? nullptr : it->second;
+    }
+
+    /**
+     * Lookups of FRUs and Sensors within the subtree under scope.
+     * Return nullptr if there is no match.
+     */
+    FRU* findFRUById(const Object* scope, uint8_t id) const;
+    FRU* findFRUByName(const Object* scope, const std::string &name) const;
+    Sensor* findSensorById(const Object* scope, uint8_t id) const;
+    Sensor* findSensorByName(const Object* scope,
+                             const std::string &name) const;
+
   private:
 
+    /**
+     * Add object to the lookup indexes if it is a FRU or a Sensor.
+     */
+    void indexObject(Object* object);
+
+    /**
+     * Remove object from the lookup indexes.
+     */
+    void unindexObject(Object* object);
+
     /**
      * Get the FRU from object.
      */
@@ -174,6 +246,7 @@ class SensorObjectTree : public ObjectTree {
       else {
         dbus->registerObject(path, interface, object);
       }
+      indexObject(object);
       return object;
     }
 };
@@ -120,6 +120,7 @@ print_usage() {
   printf("         --history <period>[m/h/d] show max, min and average values of last <period> minutes/hours/days\n");
   printf("              example --history 4d means history of 4 days\n");
   printf("         --history-clear           clear history values\n");
+  printf("         --stats                   show sensord polling statistics (read latency, scheduling lag, failures)\n");
   printf("         --force                   read the sensor directly from the h/w (not cache).Ensure sensord is killed before executing this command\n");
   printf("         --json                    JSON representation\n");
   printf("         --filter <sensor name with slot name>  filtered by <sensor name with slot name> for fscd usage.\n");
@@ -572,6 +573,135 @@ get_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, i
   }
 }
 
+/* Upper bound of the histogram bucket reached by the given percentile */
+static uint32_t
+stats_hist_percentile(const uint32_t *hist, uint32_t total, int percent) {
+  uint64_t acc = 0;
+  int i;
+
+  if (total == 0)
+    return 0;
+  for (i = 0; i < SENSOR_STATS_BUCKETS - 1; i++) {
+    acc += hist[i];
+    if (acc * 100 >= (uint64_t)total * percent)
+      break;
+  }
+  return sensor_stats_bucket_floor(i + 1);
+}
+
+static json_t *
+get_stats_hist_json_obj(const uint32_t *hist) {
+  json_t *hist_obj = json_object();
+  char key[16];
+  int i;
+
+  for (i = 0; i < SENSOR_STATS_BUCKETS; i++) {
+    if (hist[i] == 0)
+      continue;
+    snprintf(key, sizeof(key), "%u", sensor_stats_bucket_floor(i));
+    json_object_set_new(hist_obj, key, json_integer(hist[i]));
+  }
+  return hist_obj;
+}
+
+static void
+get_sensor_stats(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num, bool json, json_t *fru_sensor_obj) {
+
+  int i;
+  uint8_t snr_num;
+  char fruname[32] = {0};
+  char snr_name[32];
+  thresh_sensor_t thresh;
+  sensor_fru_stats_t *stats;
+  sensor_stats_t *s;
+  json_t *fru_obj = NULL, *loop_obj, *snrs_obj = NULL, *snr_obj;
+  uint32_t avg_read, avg_lag, lag_cnt;
+
+  if (fru == AGGREGATE_SENSOR_FRU_ID) {
+    strcpy(fruname, AGGREGATE_SENSOR_FRU_NAME);
+  } else if (pal_get_fru_name(fru, fruname)) {
+    sprintf(fruname, "fru%d", fru);
+  }
+
+  stats = malloc(sizeof(sensor_fru_stats_t));
+  if (!stats) {
+    return;
+  }
+  if (sensor_stats_get(fru, stats)) {
+    if (json == 0)
+      printf("%s polling statistics are not available\n", fruname);
+    free(stats);
+    return;
+  }
+
+  if (json) {
+    fru_obj = json_object();
+    loop_obj = json_object();
+    snrs_obj = json_object();
+    json_object_set_new(loop_obj, "count", json_integer(stats->loop_cnt));
+    json_object_set_new(loop_obj, "last_ms", json_integer(stats->last_loop_ms));
+    json_object_set_new(loop_obj, "max_ms", json_integer(stats->max_loop_ms));
+    json_object_set_new(loop_obj, "total_ms", json_integer(stats->total_loop_ms));
+    json_object_set_new(loop_obj, "hist_ms", get_stats_hist_json_obj(stats->loop_hist));
+    json_object_set_new(fru_obj, "loop", loop_obj);
+    json_object_set_new(fru_obj, "sensors", snrs_obj);
+    json_object_set_new(fru_sensor_obj, fruname, fru_obj);
+  } else {
+    printf("%s loop: count = %u, last = %u ms, average = %u ms, max = %u ms\n", fruname,
+        stats->loop_cnt, stats->last_loop_ms,
+        stats->loop_cnt ? (uint32_t)(stats->total_loop_ms / stats->loop_cnt) : 0,
+        stats->max_loop_ms);
+  }
+
+  for (i = 0; i < sensor_cnt; i++) {
+    snr_num = sensor_list[i];
+    if (num != SENSOR_ALL && snr_num != num) {
+      continue;
+    }
+    s = &stats->snr[snr_num];
+
+    snr_name[0] = '\0';
+    if (fru == AGGREGATE_SENSOR_FRU_ID) {
+      if (aggregate_sensor_threshold(snr_num, &thresh)) {
+        continue;
+      }
+      strcpy(snr_name, thresh.name);
+    } else if (pal_get_sensor_name(fru, snr_num, snr_name) || snr_name[0] == '\0') {
+      sprintf(snr_name, "0x%X", snr_num);
+    }
+
+    avg_read = s->read_cnt ? (uint32_t)(s->total_read_us / s->read_cnt) : 0;
+    lag_cnt = s->poll_cnt > 1 ? s->poll_cnt - 1 : 0;
+    avg_lag = lag_cnt ? (uint32_t)(s->total_lag_ms / lag_cnt) : 0;
+
+    if (json) {
+      snr_obj = json_object();
+      json_object_set_new(snr_obj, "num", json_integer(snr_num));
+      json_object_set_new(snr_obj, "polls", json_integer(s->poll_cnt));
+      json_object_set_new(snr_obj, "reads", json_integer(s->read_cnt));
+      json_object_set_new(snr_obj, "failures", json_integer(s->fail_cnt));
+      json_object_set_new(snr_obj, "read_last_us", json_integer(s->last_read_us));
+      json_object_set_new(snr_obj, "read_avg_us", json_integer(avg_read));
+      json_object_set_new(snr_obj, "read_max_us", json_integer(s->max_read_us));
+      json_object_set_new(snr_obj, "read_hist_us", get_stats_hist_json_obj(s->read_hist));
+      json_object_set_new(snr_obj, "lag_last_ms", json_integer(s->last_lag_ms));
+      json_object_set_new(snr_obj, "lag_avg_ms", json_integer(avg_lag));
+      json_object_set_new(snr_obj, "lag_max_ms", json_integer(s->max_lag_ms));
+      json_object_set_new(snr_obj, "lag_hist_ms", get_stats_hist_json_obj(s->lag_hist));
+      json_object_set_new(snrs_obj, snr_name, snr_obj);
+      continue;
+    }
+
+    printf("%-18s (0x%X) polls = %u, reads = %u, failures = %u, "
+        "read avg = %u us, p99 < %u us, max = %u us, "
+        "lag avg = %u ms, p99 < %u ms, max = %u ms\n",
+        snr_name, snr_num, s->poll_cnt, s->read_cnt, s->fail_cnt,
+        avg_read, stats_hist_percentile(s->read_hist, s->read_cnt, 99), s->max_read_us,
+        avg_lag, stats_hist_percentile(s->lag_hist, lag_cnt, 99), s->max_lag_ms);
+  }
+  free(stats);
+}
+
 static void clear_sensor_history(uint8_t fru, uint8_t *sensor_list, int sensor_cnt, int num) {
   int i;
   uint8_t snr_num;
@@ -667,7 +797,7 @@ void get_sensor_reading_timer(struct timespec *timeout, get_sensor_reading_struc
 }
 
 static int
-print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool threshold, bool force, bool json, bool history_clear, bool filter, char** filter_list, int filter_len,long period, json_t *fru_sensor_obj) {
+print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool threshold, bool force, bool json, bool history_clear, bool stats, bool filter, char** filter_list, int filter_len,long period, json_t *fru_sensor_obj) {
   int ret;
   uint8_t status;
   int sensor_cnt;
@@ -741,6 +871,8 @@ print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool
     clear_sensor_history(fru, sensor_list, sensor_cnt, sensor_num);
   } else if (history) {
     get_sensor_history(fru, sensor_list, sensor_cnt, sensor_num, period);
+  } else if (stats) {
+    get_sensor_stats(fru, sensor_list, sensor_cnt, sensor_num, json, fru_sensor_obj);
   } else {
     data.fru = fru;
     data.sensor_cnt = sensor_cnt;
@@ -768,7 +900,7 @@ print_sensor(uint8_t fru, int sensor_num, bool allow_absent, bool history, bool
 }
 
 int parse_args(int argc, char *argv[], char *fruname,
-    bool *history_clear, bool *history, bool *threshold, bool *force, bool *json, bool *filter, long *period, int *snr)
+    bool *history_clear, bool *history, bool *threshold, bool *force, bool *json, bool *stats, bool *filter, long *period, int *snr)
 {
   int ret;
   int num, options = 0;
@@ -781,6 +913,7 @@ int parse_args(int argc, char *argv[], char *fruname,
     {"force", no_argument, 0, 'f'},
     {"json", no_argument, 0, 'j'},
     {"filter", no_argument, 0, 'i'},
+    {"stats", no_argument, 0, 's'},
     {0,0,0,0},
   };
 
@@ -791,6 +924,7 @@ int parse_args(int argc, char *argv[], char *fruname,
   *force = false;
   *json = false;
   *filter = false;
+  *stats = false;
   *period = 60;
   *snr = -1;
 
@@ -799,6 +933,10 @@ int parse_args(int argc, char *argv[], char *fruname,
       case 'f':
         *force = true;
         break;
+      case 's':
+        *stats = true;
+        options |= (1 << 5);
+        break;
       case 'i':
         *filter = true;
         options |= (1 << 4);
@@ -855,8 +993,8 @@ int parse_args(int argc, char *argv[], char *fruname,
     }
   }
 
-  num = (int)*threshold + (int)*history_clear + (int)*history + (int)*json + (int)*filter;
-  if ((num > 1) && (options != 0x0A)) {  // threshold + json
+  num = (int)*threshold + (int)*history_clear + (int)*history + (int)*json + (int)*filter + (int)*stats;
+  if ((num > 1) && (options != 0x0A) && (options != 0x28)) {  // threshold + json, stats + json
     return -1;
   }
 
@@ -875,6 +1013,7 @@ main(int argc, char **argv) {
   bool force;
   bool json;
   bool filter;
+  bool stats;
   long period;
   char fruname[32];
   int filter_len = argc - 3;
@@ -883,7 +1022,7 @@ main(int argc, char **argv) {
 
   if (parse_args(argc, argv, fruname,
         &history_clear, &history,
-        &threshold, &force, &json, &filter, &period, &num)) {
+        &threshold, &force, &json, &stats, &filter, &period, &num)) {
     print_usage();
     exit(-1);
   }
@@ -907,14 +1046,14 @@ main(int argc, char **argv) {
 
   if (fru == 0) {
     for (fru = 1; fru <= MAX_NUM_FRUS; fru++) {
-      ret |= print_sensor(fru, num, true, history, threshold, force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+      ret |= print_sensor(fru, num, true, history, threshold, force, json, history_clear, stats, filter, filter_list, filter_len, period, fru_sensor_obj);
     }
-    ret |= print_sensor(AGGREGATE_SENSOR_FRU_ID, num, true, history, threshold, false, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    ret |= print_sensor(AGGREGATE_SENSOR_FRU_ID, num, true, history, threshold, false, json, history_clear, stats, filter, filter_list, filter_len, period, fru_sensor_obj);
   } else if (pal_get_pair_fru(fru, &pair_fru)) {
-    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
-    ret = print_sensor(pair_fru, num, false, history, threshold, pair_fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len ,period, fru_sensor_obj);
+    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, stats, filter, filter_list, filter_len, period, fru_sensor_obj);
+    ret = print_sensor(pair_fru, num, false, history, threshold, pair_fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, stats, filter, filter_list, filter_len ,period, fru_sensor_obj);
   } else {
-    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, filter, filter_list, filter_len, period, fru_sensor_obj);
+    ret = print_sensor(fru, num, false, history, threshold, fru == AGGREGATE_SENSOR_FRU_ID ? false : force, json, history_clear, stats, filter, filter_list, filter_len, period, fru_sensor_obj);
   }
 
   if (json) {
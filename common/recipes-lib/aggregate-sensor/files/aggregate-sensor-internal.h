@@ -51,11 +51,29 @@ typedef enum{
   KEY_PATH
 } cond_key_type;
 
+/* A source of the sensor, either read from a physical sensor
+ * or computed from the sources before it */
+typedef struct {
+  struct sensor_src src;
+  expression_code *code; /* NULL for physical sensors */
+} source_type;
+
+/* The sources a linear expression depends on, in the order they
+ * have to be computed, followed by the expression itself */
+typedef struct {
+  size_t num_steps;
+  size_t *steps;
+  expression_code *code;
+} formula_type;
+
 typedef struct {
   thresh_sensor_t sensor;
   size_t idx;
   size_t num_expressions;
   expression_type **expressions;
+  size_t num_sources;
+  source_type *sources;
+  formula_type *formulas;
   bool conditional;
   char cond_key[MAX_KEY_LEN];
   cond_key_type cond_type;
@@ -204,6 +204,96 @@ bail:
   return NULL;
 }
 
+static void destroy_programs(aggregate_sensor_t *snr)
+{
+  size_t i;
+
+  if (snr->sources) {
+    for (i = 0; i < snr->num_sources; i++) {
+      expression_code_destroy(snr->sources[i].code);
+    }
+    free(snr->sources);
+    snr->sources = NULL;
+  }
+  if (snr->formulas) {
+    for (i = 0; i < snr->num_expressions; i++) {
+      free(snr->formulas[i].steps);
+      expression_code_destroy(snr->formulas[i].code);
+    }
+    free(snr->formulas);
+    snr->formulas = NULL;
+  }
+}
+
+/* Compile the sources and linear expressions of the sensor, so that
+ * every source is read or computed once per aggregate_sensor_read no
+ * matter how many expressions refer to it. load_variables() leaves
+ * the sources in dependency order, expression sources refer only to
+ * the ones before them. */
+static int compile_programs(aggregate_sensor_t *snr, variable_type *vars, size_t num_vars)
+{
+  size_t i, j, f, num;
+  const size_t *refs;
+  bool *needed;
+
+  snr->num_sources = num_vars;
+  snr->sources = calloc(num_vars, sizeof(source_type));
+  snr->formulas = calloc(snr->num_expressions, sizeof(formula_type));
+  needed = calloc(num_vars, sizeof(bool));
+  if (!snr->sources || !snr->formulas || !needed) {
+    goto bail;
+  }
+
+  for (i = 0; i < num_vars; i++) {
+    if (vars[i].value == logical_expression_parse) {
+      snr->sources[i].code = expression_compile(vars[i].state, vars, i);
+      if (!snr->sources[i].code) {
+        goto bail;
+      }
+    } else {
+      snr->sources[i].src = *(struct sensor_src *)vars[i].state;
+    }
+  }
+
+  for (f = 0; f < snr->num_expressions; f++) {
+    formula_type *formula = &snr->formulas[f];
+
+    formula->code = expression_compile(snr->expressions[f], vars, num_vars);
+    if (!formula->code) {
+      goto bail;
+    }
+    memset(needed, 0, num_vars * sizeof(bool));
+    refs = expression_code_refs(formula->code, &num);
+    for (j = 0; j < num; j++) {
+      needed[refs[j]] = true;
+    }
+    for (i = num_vars; i-- > 0;) {
+      if (!needed[i] || !snr->sources[i].code) {
+        continue;
+      }
+      refs = expression_code_refs(snr->sources[i].code, &num);
+      for (j = 0; j < num; j++) {
+        needed[refs[j]] = true;
+      }
+    }
+    formula->steps = calloc(num_vars, sizeof(size_t));
+    if (!formula->steps) {
+      goto bail;
+    }
+    for (i = 0; i < num_vars; i++) {
+      if (needed[i]) {
+        formula->steps[formula->num_steps++] = i;
+      }
+    }
+  }
+  free(needed);
+  return 0;
+bail:
+  free(needed);
+  destroy_programs(snr);
+  return -1;
+}
+
 /* Parse SENSORS[X]::composition if it is of type
  * "linear_expression". */
 static int load_linear_eq(aggregate_sensor_t *snr, json_t *obj)
@@ -236,6 +326,11 @@ static int load_linear_eq(aggregate_sensor_t *snr, json_t *obj)
     DEBUG("Expression parsing failed!\n");
     goto bail_linear_exp;
   }
+  if (compile_programs(snr, vars, num_vars)) {
+    DEBUG("Expression compilation failed!\n");
+    expression_destroy(snr->expressions[0]);
+    goto bail_linear_exp;
+  }
 
   /* We don't need vars anymore */
   free(vars);
@@ -299,6 +394,10 @@ static int load_linear_cond_eq(aggregate_sensor_t *snr, json_t *obj)
   }
   /* This should never happen */
   assert(!iter);
+  if (compile_programs(snr, vars, num_vars)) {
+    DEBUG("Expression compilation failed!\n");
+    goto bail_exp_parse;
+  }
   
   tmp = json_object_get(obj, "condition");
   if (!tmp) {
@@ -362,6 +461,7 @@ static int load_linear_cond_eq(aggregate_sensor_t *snr, json_t *obj)
   free(vars);
   return 0;
 bail_exp_parse:
+  destroy_programs(snr);
   for (i = 0; i < snr->num_expressions; i++) {
     if (snr->expressions[i]) {
       expression_destroy(snr->expressions[i]);
@@ -88,6 +88,28 @@ int get_key(cond_key_type type, const char *cond_key, char *cond_value)
 }
 
 
+/* Run the compiled formula: compute the sources it depends on in
+ * order, each one exactly once, then the formula itself. */
+static int formula_evaluate(aggregate_sensor_t *snr, size_t f_idx, float *value)
+{
+  formula_type *formula = &snr->formulas[f_idx];
+  float values[snr->num_sources];
+  size_t i;
+  int ret;
+
+  for (i = 0; i < formula->num_steps; i++) {
+    size_t s = formula->steps[i];
+    source_type *src = &snr->sources[s];
+
+    ret = src->code ? expression_code_run(src->code, values, &values[s]) :
+      get_sensor_value(&src->src, &values[s]);
+    if (ret) {
+      return ret;
+    }
+  }
+  return expression_code_run(formula->code, values, value);
+}
+
 int
 aggregate_sensor_read(size_t index, float *value)
 {
@@ -121,7 +143,7 @@ aggregate_sensor_read(size_t index, float *value)
   } else {
     f_idx = 0;
   }
-  return expression_evaluate(snr->expressions[f_idx], value);
+  return formula_evaluate(snr, f_idx, value);
 }
 
 int
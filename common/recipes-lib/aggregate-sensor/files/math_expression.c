@@ -47,6 +47,32 @@ typedef enum {
   OP_POWER /* L / R */
 } operator_type;
 
+typedef enum {
+  INS_CONSTANT,
+  INS_VARIABLE,
+  INS_ADD,
+  INS_SUBTRACT,
+  INS_MULTIPLY,
+  INS_DIVIDE,
+  INS_POWER
+} instruction_type;
+
+typedef struct {
+  instruction_type op;
+  union {
+    float  constant;
+    size_t var;
+  } arg;
+} instruction;
+
+struct expression_code_s {
+  size_t      depth;    /* Stack slots needed by run */
+  size_t      num_refs;
+  size_t      *refs;    /* Sorted variable indices referred to */
+  size_t      len;
+  instruction ins[];
+};
+
 struct expression_type_s {
   operator_type type;
   expression_term_type *left_exp_term;
@@ -349,6 +375,198 @@ void expression_print(expression_type *exp)
   printf(") ");
 }
 
+/* Number of instructions needed for the expression */
+static size_t expression_code_len(expression_type *exp)
+{
+  size_t len;
+
+  len = exp->left_exp_term ? 1 : expression_code_len(exp->left_exp_group);
+  if (exp->right_exp_term) {
+    len += 2;
+  } else if (exp->right_exp_group) {
+    len += expression_code_len(exp->right_exp_group) + 1;
+  }
+  return len;
+}
+
+static float apply_operator(instruction_type op, float l_val, float r_val)
+{
+  switch(op) {
+    case INS_ADD:
+      return l_val + r_val;
+    case INS_SUBTRACT:
+      return l_val - r_val;
+    case INS_MULTIPLY:
+      return l_val * r_val;
+    case INS_DIVIDE:
+      return l_val / r_val;
+    case INS_POWER:
+      return powf(l_val, r_val);
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+static instruction_type operator_instruction(operator_type op)
+{
+  switch(op) {
+    case OP_ADD:
+      return INS_ADD;
+    case OP_SUBTRACT:
+      return INS_SUBTRACT;
+    case OP_MULTIPLY:
+      return INS_MULTIPLY;
+    case OP_DIVIDE:
+      return INS_DIVIDE;
+    case OP_POWER:
+      return INS_POWER;
+    default:
+      return INS_CONSTANT;
+  }
+}
+
+static int emit_term(expression_code *code, size_t *sp,
+    expression_term_type *term, variable_type *vars, size_t num)
+{
+  instruction *ins = &code->ins[code->len];
+  size_t i;
+
+  if (term->type == TERM_CONSTANT) {
+    ins->op = INS_CONSTANT;
+    ins->arg.constant = term->term.constant;
+  } else {
+    for (i = 0; i < num; i++) {
+      if (!strncmp(term->term.var.name, vars[i].name, sizeof(vars[i].name))) {
+        break;
+      }
+    }
+    if (i == num) {
+      return -1;
+    }
+    ins->op = INS_VARIABLE;
+    ins->arg.var = i;
+  }
+  code->len++;
+  if (++(*sp) > code->depth) {
+    code->depth = *sp;
+  }
+  return 0;
+}
+
+/* Emit the expression in postfix order, folding operations on
+ * two constants into one constant */
+static int emit_expression(expression_code *code, size_t *sp,
+    expression_type *exp, variable_type *vars, size_t num)
+{
+  instruction *l, *r;
+  instruction_type op;
+  int ret;
+
+  ret = exp->left_exp_term ? emit_term(code, sp, exp->left_exp_term, vars, num) :
+    emit_expression(code, sp, exp->left_exp_group, vars, num);
+  if (ret || (!exp->right_exp_term && !exp->right_exp_group)) {
+    return ret;
+  }
+  ret = exp->right_exp_term ? emit_term(code, sp, exp->right_exp_term, vars, num) :
+    emit_expression(code, sp, exp->right_exp_group, vars, num);
+  op = operator_instruction(exp->type);
+  if (ret || op == INS_CONSTANT) {
+    return -1;
+  }
+
+  l = &code->ins[code->len - 2];
+  r = &code->ins[code->len - 1];
+  (*sp)--;
+  if (l->op == INS_CONSTANT && r->op == INS_CONSTANT) {
+    l->arg.constant = apply_operator(op, l->arg.constant, r->arg.constant);
+    code->len--;
+    return 0;
+  }
+  code->ins[code->len].op = op;
+  code->len++;
+  return 0;
+}
+
+expression_code *expression_compile(expression_type *exp, variable_type *vars, size_t num)
+{
+  expression_code *code;
+  size_t i, j, sp = 0;
+  bool *used;
+
+  code = calloc(1, sizeof(*code) + expression_code_len(exp) * sizeof(instruction));
+  if (!code) {
+    return NULL;
+  }
+  used = calloc(num ? num : 1, sizeof(bool));
+  if (!used || emit_expression(code, &sp, exp, vars, num)) {
+    goto bail;
+  }
+  assert(sp == 1);
+
+  for (i = 0; i < code->len; i++) {
+    if (code->ins[i].op == INS_VARIABLE && !used[code->ins[i].arg.var]) {
+      used[code->ins[i].arg.var] = true;
+      code->num_refs++;
+    }
+  }
+  code->refs = calloc(code->num_refs ? code->num_refs : 1, sizeof(size_t));
+  if (!code->refs) {
+    goto bail;
+  }
+  for (i = 0, j = 0; i < num; i++) {
+    if (used[i]) {
+      code->refs[j++] = i;
+    }
+  }
+  free(used);
+  return code;
+bail:
+  free(used);
+  expression_code_destroy(code);
+  return NULL;
+}
+
+int expression_code_run(expression_code *code, const float *values, float *value)
+{
+  float stack[code->depth];
+  size_t i, sp = 0;
+
+  for (i = 0; i < code->len; i++) {
+    instruction *ins = &code->ins[i];
+
+    switch(ins->op) {
+      case INS_CONSTANT:
+        stack[sp++] = ins->arg.constant;
+        break;
+      case INS_VARIABLE:
+        stack[sp++] = values[ins->arg.var];
+        break;
+      default:
+        sp--;
+        stack[sp - 1] = apply_operator(ins->op, stack[sp - 1], stack[sp]);
+        break;
+    }
+  }
+  *value = stack[0];
+  return 0;
+}
+
+const size_t *expression_code_refs(expression_code *code, size_t *num)
+{
+  *num = code->num_refs;
+  return code->refs;
+}
+
+void expression_code_destroy(expression_code *code)
+{
+  if (!code) {
+    return;
+  }
+  free(code->refs);
+  free(code);
+}
+
 #ifdef __EXPRESSION_TEST__
 int test_get_value(void *state, float *value)
 {
@@ -69,4 +69,26 @@ void expression_destroy(expression_type *exp);
 /* Prints the expression with information on the order of evaluation */
 void expression_print(expression_type *exp);
 
+/* Opaque object with the expression compiled for a stack machine */
+struct expression_code_s;
+typedef struct expression_code_s expression_code;
+
+/* Compile a parsed expression. Variables are referred to by their
+ * index in 'vars' (looked up by name), the values of which are
+ * passed to expression_code_run rather than fetched with value().
+ * This lets the caller read every variable once, however often it
+ * is used. Constant sub-expressions are folded. */
+expression_code *expression_compile(expression_type *exp, variable_type *vars, size_t num);
+
+/* Evaluate the compiled expression with 'values' indexed like the
+ * 'vars' passed to expression_compile */
+int expression_code_run(expression_code *code, const float *values, float *value);
+
+/* Returns the sorted list of variable indices the compiled expression
+ * refers to, and their count in 'num' */
+const size_t *expression_code_refs(expression_code *code, size_t *num);
+
+/* Destroy the object created in expression_compile */
+void expression_code_destroy(expression_code *code);
+
 #endif
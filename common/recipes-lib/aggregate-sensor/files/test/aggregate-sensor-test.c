@@ -274,6 +274,29 @@ DEFINE_TEST(test_lexp_source_exp)
   ret = aggregate_sensor_read(0, &val);
   ASSERT_NEQ(ret, 0, "agg-read should fail");
   ASSERT_CALL_COUNT(sensor_cache_read, 1, 2, "cache read called at least once");
+  MOCK_END(sensor_cache_read);
+}
+
+DEFINE_TEST(test_lexp_shared_source)
+{
+  float val;
+  int ret;
+
+  init_sensors("./test_lexp_shared.json", 1);
+
+  int mocked_read1(uint8_t fru, uint8_t snr, float *value) {
+    ASSERT((fru == 1 && snr == 1) || (fru == 2 && snr == 2), "Expected FRU/SNRID");
+    *value = snr == 1 ? 3.0 : 1.0;
+    return 0;
+  }
+  MOCK(sensor_cache_read, mocked_read1);
+  ret = aggregate_sensor_read(0, &val);
+  ASSERT_EQ(ret, 0, "agg-read success");
+  /* Each source is read once even though it is used by many expressions */
+  ASSERT_CALL_COUNT(sensor_cache_read, 2, 2, "Expected sensor reads");
+  /* (3 + 1) * ((3 + 1) - (2 * 1)) + (3 * 5) = 4 * 2 + 15 = 23 */
+  ASSERT_EQ_FLT(val, 23.0, "Correct value read");
+  MOCK_END(sensor_cache_read);
 }
 
 int main(int argc, char *argv[])
@@ -288,5 +311,6 @@ int main(int argc, char *argv[])
   CALL_TEST(test_lexp);
   CALL_TEST(test_cond_lexp);
   CALL_TEST(test_lexp_source_exp);
+  CALL_TEST(test_lexp_shared_source);
   return 0;
 }
@@ -42,6 +42,9 @@
 
 #define SIZE_IANA_ID 3
 #define SDR_READ_COUNT_MAX 0x1A
+#define SDR_READ_ENTIRE_RECORD 0xFF
+#define FRUID_READ_COUNT_LARGE 0x80
+#define FRUID_PIPELINE_BATCH 16
 #define FRUID_WRITE_COUNT_MAX 0x30
 #define GPIO_MAX 31
 
@@ -67,6 +70,11 @@
 
 #define FRU_SCM 1
 
+/* Sensors per OEM Get Multiple Sensor Reading request, the response
+ * carries 5 bytes per sensor after the IANA ID and count */
+#define BIC_SENSORS_PER_REQ 32
+#define MULTI_SNR_ENTRY_SIZE 5
+
 #pragma pack(push, 1)
 typedef struct _sdr_rec_hdr_t {
   uint16_t rec_id;
@@ -110,6 +118,16 @@ static const char *gpio_pin_names[BIC_GPIO_MAX] = {
  *   - if the function returns successfully, "rxlen" would be set to the
  *     actual response length.
  */
+static void bic_fill_req(ipmb_req_t* req, uint8_t netfn, uint8_t cmd) {
+  req->res_slave_addr = BRIDGE_SLAVE_ADDR << 1;
+  req->netfn_lun = netfn << LUN_OFFSET;
+  req->hdr_cksum = req->res_slave_addr + req->netfn_lun;
+  req->hdr_cksum = ZERO_CKSUM_CONST - req->hdr_cksum;
+  req->req_slave_addr = BMC_SLAVE_ADDR << 1;
+  req->seq_lun = 0x00;
+  req->cmd = cmd;
+}
+
 int bic_ipmb_wrapper(uint8_t slot_id, uint8_t netfn, uint8_t cmd,
                      uint8_t* txbuf, size_t txlen, uint8_t* rxbuf,
                      size_t* rxlen) {
@@ -128,13 +146,7 @@ int bic_ipmb_wrapper(uint8_t slot_id, uint8_t netfn, uint8_t cmd,
     }
     memcpy(req->data, txbuf, txlen);
   }
-  req->res_slave_addr = BRIDGE_SLAVE_ADDR << 1;
-  req->netfn_lun = netfn << LUN_OFFSET;
-  req->hdr_cksum = req->res_slave_addr + req->netfn_lun;
-  req->hdr_cksum = ZERO_CKSUM_CONST - req->hdr_cksum;
-  req->req_slave_addr = BMC_SLAVE_ADDR << 1;
-  req->seq_lun = 0x00;
-  req->cmd = cmd;
+  bic_fill_req(req, netfn, cmd);
 
   // Invoke IPMB library handler
   tlen = IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE + txlen;
@@ -487,6 +499,47 @@ int bic_get_sdr(uint8_t slot_id, ipmi_sel_sdr_req_t* req,
   return 0;
 }
 
+int bic_reserve_sdr(uint8_t slot_id, uint16_t* rsv_id) {
+  if (rsv_id == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  return _get_sdr_rsv(slot_id, rsv_id);
+}
+
+/*
+ * Read a whole SDR record in one transfer with the reservation in
+ * req->rsv_id, so a walk of the repository needs one round trip per
+ * record. BICs which can not return an entire record are read in
+ * chunks through bic_get_sdr().
+ */
+int bic_get_sdr_record(uint8_t slot_id, ipmi_sel_sdr_req_t* req,
+                       ipmi_sel_sdr_res_t* res, size_t* rlen) {
+  uint8_t tbuf[MAX_IPMB_RES_LEN] = {0};
+  size_t tlen = sizeof(tbuf);
+  ipmi_sel_sdr_res_t* tres = (ipmi_sel_sdr_res_t*)tbuf;
+  sdr_rec_hdr_t* hdr;
+
+  if (req == NULL || res == NULL || rlen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  req->offset = 0;
+  req->nbytes = SDR_READ_ENTIRE_RECORD;
+  if (_get_sdr(slot_id, req, tres, &tlen) == 0 &&
+      tlen >= sizeof(tres->next_rec_id) + sizeof(sdr_rec_hdr_t)) {
+    hdr = (sdr_rec_hdr_t*)tres->data;
+    if (tlen - sizeof(tres->next_rec_id) == sizeof(sdr_rec_hdr_t) + hdr->len) {
+      res->next_rec_id = tres->next_rec_id;
+      *rlen = tlen - sizeof(tres->next_rec_id);
+      memcpy(res->data, tres->data, *rlen);
+      return 0;
+    }
+  }
+  return bic_get_sdr(slot_id, req, res, rlen);
+}
+
 // Get Device ID
 int bic_get_dev_id(uint8_t slot_id, ipmi_dev_id_t* dev_id) {
   size_t rlen = sizeof(*dev_id);
@@ -520,6 +573,153 @@ int bic_read_sensor(uint8_t slot_id, uint8_t sensor_num,
   return ret;
 }
 
+/*
+ * Whether the BIC of a slot implements Get Multiple Sensor Reading. It is
+ * only marked unsupported once the BIC answered the command with Invalid
+ * Command, other errors and lost responses are retried on the next call.
+ */
+enum {
+  MULTI_SNR_UNKNOWN = 0,
+  MULTI_SNR_SUPPORTED,
+  MULTI_SNR_UNSUPPORTED,
+};
+static uint8_t multi_snr_cap[UINT8_MAX + 1];
+
+static int _read_sensors_oem(uint8_t slot_id, const uint8_t* list, size_t num,
+                             ipmi_sensor_reading_t* out) {
+  uint8_t iana[BIC_IANA_ID_SIZE] = BIC_IANA_ID;
+  uint8_t tbuf[IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE + BIC_IANA_ID_SIZE + 1 +
+               BIC_SENSORS_PER_REQ] = {0};
+  uint8_t rbuf[MAX_IPMB_RES_LEN] = {0};
+  ipmb_req_t* req = (ipmb_req_t*)tbuf;
+  ipmb_res_t* res = (ipmb_res_t*)rbuf;
+  unsigned short tlen;
+  unsigned char rlen = 0;
+  uint8_t* data;
+  uint8_t* entry;
+  size_t i, j, dlen;
+
+  // Not through bic_ipmb_wrapper(), the completion code is needed below
+  bic_fill_req(req, NETFN_OEM_1S_REQ, CMD_OEM_1S_GET_MULTI_SENSOR_READING);
+  memcpy(req->data, iana, BIC_IANA_ID_SIZE);
+  req->data[BIC_IANA_ID_SIZE] = num;
+  memcpy(&req->data[BIC_IANA_ID_SIZE + 1], list, num);
+  tlen = IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE + BIC_IANA_ID_SIZE + 1 + num;
+  if (lib_ipmb_handle(slot_id, tbuf, tlen, rbuf, &rlen) != 0 ||
+      rlen < IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE) {
+    return -1;
+  }
+  if (res->cc != CC_SUCCESS) {
+    if (res->cc == CC_INVALID_CMD &&
+        multi_snr_cap[slot_id] == MULTI_SNR_UNKNOWN) {
+      multi_snr_cap[slot_id] = MULTI_SNR_UNSUPPORTED;
+    }
+    return -1;
+  }
+  multi_snr_cap[slot_id] = MULTI_SNR_SUPPORTED;
+
+  // The BIC may skip sensors it can not read, match entries by number
+  data = res->data;
+  dlen = rlen - (IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE);
+  if (dlen < BIC_IANA_ID_SIZE + 1) {
+    return -1;
+  }
+  entry = &data[BIC_IANA_ID_SIZE + 1];
+  for (i = 0; i < data[BIC_IANA_ID_SIZE] &&
+       entry + MULTI_SNR_ENTRY_SIZE <= data + dlen;
+       i++, entry += MULTI_SNR_ENTRY_SIZE) {
+    for (j = 0; j < num; j++) {
+      if (list[j] == entry[0]) {
+        memcpy(&out[j], &entry[1], sizeof(ipmi_sensor_reading_t));
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+static int _read_sensors_pipelined(uint8_t slot_id, const uint8_t* list,
+                                   size_t num, ipmi_sensor_reading_t* out) {
+  uint8_t tbuf[BIC_SENSORS_PER_REQ][IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE + 1];
+  ipmb_xfer_t xfer[BIC_SENSORS_PER_REQ];
+  uint8_t* rbuf;
+  ipmb_res_t* res;
+  size_t i, rlen;
+
+  rbuf = malloc(num * MAX_IPMB_RES_LEN);
+  if (rbuf == NULL) {
+    return -1;
+  }
+  for (i = 0; i < num; i++) {
+    bic_fill_req((ipmb_req_t*)tbuf[i], NETFN_SENSOR_REQ,
+                 CMD_SENSOR_GET_SENSOR_READING);
+    ((ipmb_req_t*)tbuf[i])->data[0] = list[i];
+    xfer[i].request = tbuf[i];
+    xfer[i].req_len = sizeof(tbuf[i]);
+    xfer[i].response = &rbuf[i * MAX_IPMB_RES_LEN];
+  }
+
+  lib_ipmb_handle_many(slot_id, xfer, num);
+
+  for (i = 0; i < num; i++) {
+    res = (ipmb_res_t*)xfer[i].response;
+    if (xfer[i].res_len < IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE || res->cc) {
+      continue;
+    }
+    rlen = xfer[i].res_len - (IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE);
+    if (rlen > sizeof(ipmi_sensor_reading_t)) {
+      rlen = sizeof(ipmi_sensor_reading_t);
+    }
+    memcpy(&out[i], res->data, rlen);
+  }
+  free(rbuf);
+  return 0;
+}
+
+/*
+ * Read several sensors of a slot with as few IPMB round trips as
+ * possible: one OEM Get Multiple Sensor Reading per BIC_SENSORS_PER_REQ
+ * sensors when the BIC supports it, otherwise pipelined Get Sensor
+ * Reading requests. Sensors which could not be read are flagged with
+ * BIC_SENSOR_FLAG_NA; returns 0 only if every sensor was read.
+ */
+int bic_read_sensors(uint8_t slot_id, const uint8_t* list, size_t num,
+                     ipmi_sensor_reading_t* out) {
+  size_t i, cnt;
+  int ret = 0;
+
+  if (list == NULL || out == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (i = 0; i < num; i++) {
+    memset(&out[i], 0, sizeof(out[i]));
+    out[i].flags = BIC_SENSOR_FLAG_NA;
+  }
+
+  for (i = 0; i < num; i += cnt) {
+    cnt = num - i;
+    if (cnt > BIC_SENSORS_PER_REQ) {
+      cnt = BIC_SENSORS_PER_REQ;
+    }
+    if (multi_snr_cap[slot_id] == MULTI_SNR_UNSUPPORTED ||
+        _read_sensors_oem(slot_id, &list[i], cnt, &out[i]) != 0) {
+      _read_sensors_pipelined(slot_id, &list[i], cnt, &out[i]);
+    }
+  }
+
+  for (i = 0; i < num; i++) {
+    if (out[i].flags & BIC_SENSOR_FLAG_NA) {
+      ret = -1;
+    }
+  }
+  if (ret) {
+    errno = EIO;
+  }
+  return ret;
+}
+
 static int _read_fruid(uint8_t slot_id, uint8_t fru_id, uint32_t offset,
                        uint8_t count, uint8_t* rbuf, size_t* rlen) {
   int ret;
@@ -536,6 +736,88 @@ static int _read_fruid(uint8_t slot_id, uint8_t fru_id, uint32_t offset,
   return ret;
 }
 
+int bic_read_fruid_data(uint8_t slot_id, uint8_t fru_id, uint32_t offset,
+                        uint8_t count, uint8_t* buf, size_t* len) {
+  uint8_t rbuf[MAX_IPMI_MSG_SIZE] = {0};
+  size_t rlen = sizeof(rbuf);
+
+  if (buf == NULL || len == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (_read_fruid(slot_id, fru_id, offset, count, rbuf, &rlen) != 0) {
+    return -1;
+  }
+  if (rlen < 1) {
+    errno = EBADMSG;
+    return -1;
+  }
+
+  // Ignore the first byte as it indicates length of response
+  rlen -= 1;
+  if (rlen > *len) {
+    rlen = *len;
+  }
+  memcpy(buf, &rbuf[1], rlen);
+  *len = rlen;
+  return 0;
+}
+
+/*
+ * Read up to FRUID_PIPELINE_BATCH chunks starting at offset with the
+ * requests pipelined to ipmbd, and append them to fd. Returns the number
+ * of bytes written, which is short when the BIC returned a short chunk
+ * or a chunk failed.
+ */
+static int _read_fruid_batch(uint8_t slot_id, uint8_t fru_id, int fd,
+                             uint32_t offset, uint32_t nread, uint8_t count) {
+  uint8_t tbuf[FRUID_PIPELINE_BATCH][IPMB_HDR_SIZE + IPMI_REQ_HDR_SIZE + 4];
+  ipmb_xfer_t xfer[FRUID_PIPELINE_BATCH];
+  uint8_t* rbuf;
+  ipmb_req_t* req;
+  ipmb_res_t* res;
+  uint32_t done = 0;
+  size_t len;
+  int i, num = 0;
+
+  rbuf = malloc(FRUID_PIPELINE_BATCH * MAX_IPMB_RES_LEN);
+  if (rbuf == NULL) {
+    return -1;
+  }
+
+  for (num = 0; num < FRUID_PIPELINE_BATCH && num * count < nread; num++) {
+    req = (ipmb_req_t*)tbuf[num];
+    bic_fill_req(req, NETFN_STORAGE_REQ, CMD_STORAGE_READ_FRUID_DATA);
+    req->data[0] = fru_id;
+    req->data[1] = (offset + num * count) & 0xFF;
+    req->data[2] = ((offset + num * count) >> 8) & 0xFF;
+    req->data[3] = (nread - num * count > count) ? count : nread - num * count;
+    xfer[num].request = tbuf[num];
+    xfer[num].req_len = sizeof(tbuf[num]);
+    xfer[num].response = &rbuf[num * MAX_IPMB_RES_LEN];
+  }
+
+  lib_ipmb_handle_many(slot_id, xfer, num);
+
+  for (i = 0; i < num; i++) {
+    res = (ipmb_res_t*)xfer[i].response;
+    if (xfer[i].res_len < IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE + 1 || res->cc) {
+      break;
+    }
+    // Ignore the first byte as it indicates length of response
+    len = xfer[i].res_len - (IPMB_HDR_SIZE + IPMI_RESP_HDR_SIZE + 1);
+    if (len == 0 || write(fd, &res->data[1], len) != (ssize_t)len) {
+      break;
+    }
+    done += len;
+    if (len != ((ipmb_req_t*)tbuf[i])->data[3]) {
+      break;
+    }
+  }
+  free(rbuf);
+  return done;
+}
+
 int bic_read_fruid(uint8_t slot_id, uint8_t fru_id, const char* path,
                    int* fru_size) {
   int ret = 0;
@@ -573,37 +855,35 @@ int bic_read_fruid(uint8_t slot_id, uint8_t fru_id, const char* path,
   if (*fru_size == 0)
     goto error_exit;
 
-  // Read chunks of FRUID binary data in a loop
-  offset = 0;
-  while (nread > 0) {
-    if (nread > FRUID_READ_COUNT_MAX) {
-      count = FRUID_READ_COUNT_MAX;
-    } else {
-      count = nread;
-    }
-
-    rlen = sizeof(rbuf);
-    ret = _read_fruid(slot_id, fru_id, offset, count, rbuf, &rlen);
-    if (ret) {
+  // Probe for large reads with the first chunk, BICs which only
+  // return the IPMB standard size are read in FRUID_READ_COUNT_MAX chunks.
+  count = (nread > FRUID_READ_COUNT_LARGE) ? FRUID_READ_COUNT_LARGE : nread;
+  rlen = sizeof(rbuf);
+  ret = _read_fruid(slot_id, fru_id, 0, count, rbuf, &rlen);
+  if (ret || rlen < 2) {
+    count = FRUID_READ_COUNT_MAX;
+    offset = 0;
+  } else {
+    if (write(fd, &rbuf[1], rlen - 1) != (ssize_t)(rlen - 1)) {
+      OBMC_ERROR(errno, "failed to write %s", path);
       goto error_exit;
     }
+    offset = rlen - 1;
+    nread -= rlen - 1;
+    // A short first chunk is the most this BIC returns per request
+    if (rlen - 1 < count) {
+      count = rlen - 1;
+    }
+  }
 
-    // Ignore the first byte as it indicates length of response
-    ret = write(fd, &rbuf[1], rlen - 1);
-    if (ret < 0) {
-      OBMC_ERROR(errno, "failed to write %s", path);
+  // Read the remaining chunks of FRUID binary data in pipelined batches
+  while (nread > 0) {
+    ret = _read_fruid_batch(slot_id, fru_id, fd, offset, nread, count);
+    if (ret <= 0) {
       goto error_exit;
-    } else if (ret != rlen - 1) {
-      OBMC_WARN("data truncated (write %s): expect %u, actual %d\n",
-                path, rlen - 1, ret);
-      /*
-       * XXX shall we exit or continue?
-       */
     }
-
-    // Update offset
-    offset += (rlen - 1);
-    nread -= (rlen - 1);
+    offset += ret;
+    nread -= ret;
   }
 
   close(fd);
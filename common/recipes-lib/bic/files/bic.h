@@ -30,6 +30,9 @@ extern "C" {
 
 #define FRUID_READ_COUNT_MAX 0x20
 
+/* Sensor reading flag: reading/state unavailable (IPMI/Section 35.14) */
+#define BIC_SENSOR_FLAG_NA 0x20
+
 #define BIC_GPIO_LIST                                                       \
   BIC_GPIO_DEF(PWRGOOD_CPU, "XDP_CPU_SYSPWROK"),  /* 0 */                   \
   BIC_GPIO_DEF(PWRGD_PCH_PWROK, "PWRGD_PCH_PWROK"),                         \
@@ -180,9 +183,16 @@ int bic_get_sel(uint8_t slot_id, ipmi_sel_sdr_req_t *req,
 int bic_get_sdr_info(uint8_t slot_id, ipmi_sel_sdr_info_t *info);
 int bic_get_sdr(uint8_t slot_id, ipmi_sel_sdr_req_t *req,
                 ipmi_sel_sdr_res_t *res, size_t *rlen);
+int bic_reserve_sdr(uint8_t slot_id, uint16_t *rsv_id);
+int bic_get_sdr_record(uint8_t slot_id, ipmi_sel_sdr_req_t *req,
+                       ipmi_sel_sdr_res_t *res, size_t *rlen);
 int bic_get_dev_id(uint8_t slot_id, ipmi_dev_id_t *dev_id);
 int bic_read_sensor(uint8_t slot_id, uint8_t sensor_num, ipmi_sensor_reading_t *sensor);
+int bic_read_sensors(uint8_t slot_id, const uint8_t *list, size_t num,
+                     ipmi_sensor_reading_t *out);
 int bic_read_fruid(uint8_t slot_id, uint8_t fru_id, const char *path, int *fru_size);
+int bic_read_fruid_data(uint8_t slot_id, uint8_t fru_id, uint32_t offset,
+                        uint8_t count, uint8_t *buf, size_t *len);
 int bic_read_mac(uint8_t slot_id, char *rbuf, size_t rlen);
 int bic_update_fw(uint8_t slot_id, uint8_t comp, const char *path);
 int bic_get_fw_cksum(uint8_t slot_id, uint8_t comp, uint32_t offset, uint32_t len, uint8_t *ver);
@@ -16,13 +16,18 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
+#define _GNU_SOURCE
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <syslog.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -56,6 +61,17 @@
 #define WAIT_CLIENT_RETRIES 5
 #define ACCEPT_RECOVER_RETRIES 5
 
+/* Event-loop service defaults */
+#define POOL_BACKLOG 64
+#define POOL_WORKERS 8
+#define POOL_PENDING 64
+#define POOL_MAX_REQ 4096
+#define POOL_MAX_EVENTS 16
+/* Seconds a worker waits for a peer to take a response */
+#define POOL_SEND_TIMEOUT 2
+/* Persistent connections live on a SOCK_SEQPACKET twin of the endpoint */
+#define PKT_SUFFIX ".pkt"
+
 #define SAVE_ERRNO_RUN(exp)  \
   do {                       \
     int saved_errno = errno; \
@@ -63,6 +79,28 @@
     errno = saved_errno;     \
   } while (0)
 
+/* Every message on a persistent connection is prefixed by this header */
+typedef struct {
+  uint32_t tag;
+} pkt_hdr_t;
+
+struct ipc_conn_s {
+  int fd;
+  bool packet;
+  int refcnt;
+  time_t last_active;
+  struct ipc_conn_s *prev, *next;
+};
+
+struct ipc_client_s {
+  char endpoint[MAX_ENDPOINT_LEN];
+  pid_t pid;
+  int fd;
+  int timeout;
+  uint32_t next_tag;
+  pthread_mutex_t mutex;
+};
+
 struct service_s {
   ipc_handle_req_t handle_req;
   client_t base_cli;
@@ -70,6 +108,18 @@ struct service_s {
   pthread_cond_t  cond;
   int             num_active;
   int             active_limit;
+
+  /* Event-loop mode */
+  ipc_svc_attr_t  attr;
+  client_t        **queue;
+  int             q_head;
+  int             q_count;
+  pthread_cond_t  q_space;
+  int             num_workers;
+  int             idle_workers;
+  int             stream_sock;
+  int             pkt_sock;
+  struct ipc_conn_s *conns;
 };
 
 static void set_sock_timeout(int sock, int timeout)
@@ -148,6 +198,17 @@ int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout)
     return -1;
   }
 
+  if (cli->conn) {
+    /* The event loop already read the whole request */
+    if (cli->req_len > *req_len) {
+      DEBUG("%s(%s) request truncated", __func__, cli->endpoint);
+      return -1;
+    }
+    memcpy(req, cli->req, cli->req_len);
+    *req_len = cli->req_len;
+    return 0;
+  }
+
   set_sock_timeout(cli->fd, timeout);
   
   for (r = 0; r < MAX_RETRIES; r++) {
@@ -166,9 +227,16 @@ int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout)
   return ret;
 }
 
+static void conn_cli_done(client_t *cli);
+static int conn_send_resp(client_t *cli, uint8_t *resp, size_t resp_len);
+
 static void cli_done(client_t *cli)
 {
   service_t *svc = cli->svc;
+  if (cli->conn) {
+    conn_cli_done(cli);
+    return;
+  }
   cli->svc = NULL;
   if (svc) {
     close(cli->fd);
@@ -186,6 +254,9 @@ int ipc_send_resp(client_t *cli, uint8_t *resp, size_t resp_len)
   if (!cli || !resp || !resp_len) {
     return -1;
   }
+  if (cli->conn) {
+    return conn_send_resp(cli, resp, resp_len);
+  }
   if (send(cli->fd, resp, resp_len, MSG_NOSIGNAL) < 0) {
     DEBUG("%s(%s) failed to recv (%s)", __func__, cli->endpoint, strerror(errno));
     ret = -1;
@@ -353,6 +424,640 @@ int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_act
   return ret;
 }
 
+static time_t mono_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static int bind_endpoint(const char *endpoint, const char *suffix, int type, int backlog)
+{
+  struct sockaddr_un local;
+  int sock, len;
+
+  if ((sock = socket(AF_UNIX, type | SOCK_CLOEXEC, 0)) == -1) {
+    DEBUG("%s(%s) failed to create socket (%s)", __func__, endpoint, strerror(errno));
+    return -1;
+  }
+
+  local.sun_family = AF_UNIX;
+  snprintf(local.sun_path, sizeof(local.sun_path), "/tmp/%s%s", endpoint, suffix);
+  unlink(local.sun_path);
+  len = strlen(local.sun_path) + sizeof(local.sun_family);
+  if (bind(sock, (struct sockaddr *)&local, len) == -1) {
+    DEBUG("%s(%s) failed to bind (%s)", __func__, endpoint, strerror(errno));
+    goto close_bail;
+  }
+
+  if (listen(sock, backlog) == -1) {
+    DEBUG("%s(%s) failed to listen (%s)", __func__, endpoint, strerror(errno));
+    goto close_bail;
+  }
+  return sock;
+
+close_bail:
+  SAVE_ERRNO_RUN(close(sock));
+  return -1;
+}
+
+static void conn_put(service_t *svc, struct ipc_conn_s *conn)
+{
+  int refcnt;
+
+  pthread_mutex_lock(&svc->mutex);
+  refcnt = --conn->refcnt;
+  pthread_mutex_unlock(&svc->mutex);
+  if (refcnt == 0) {
+    close(conn->fd);
+    free(conn);
+  }
+}
+
+static void conn_cli_release(client_t *cli)
+{
+  conn_put(cli->svc, cli->conn);
+  free(cli);
+}
+
+/* A peer which does not take its responses, or got part of one, is
+ * disconnected. The event loop sees the hangup and closes it, workers
+ * sending to it fail right away. */
+static void conn_drop(client_t *cli)
+{
+  DEBUG("%s(%s) failed to send (%s), dropping connection", __func__, cli->endpoint, strerror(errno));
+  shutdown(cli->conn->fd, SHUT_RDWR);
+}
+
+static int conn_send_resp(client_t *cli, uint8_t *resp, size_t resp_len)
+{
+  struct ipc_conn_s *conn = cli->conn;
+  pkt_hdr_t hdr = { .tag = cli->tag };
+  struct iovec iov[2];
+  struct msghdr msg;
+  size_t len;
+
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = resp;
+  iov[1].iov_len = resp_len;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = conn->packet ? &iov[0] : &iov[1];
+  msg.msg_iovlen = conn->packet ? 2 : 1;
+  len = conn->packet ? sizeof(hdr) + resp_len : resp_len;
+
+  if (sendmsg(conn->fd, &msg, MSG_NOSIGNAL) != (ssize_t)len) {
+    conn_drop(cli);
+    return -1;
+  }
+  conn_cli_release(cli);
+  return 0;
+}
+
+static void conn_cli_done(client_t *cli)
+{
+  struct ipc_conn_s *conn = cli->conn;
+  pkt_hdr_t hdr = { .tag = cli->tag };
+
+  /* A persistent peer waits for every tag, so a request that got no
+   * response is answered empty, as closing a one-shot connection does */
+  if (conn->packet) {
+    if (send(conn->fd, &hdr, sizeof(hdr), MSG_NOSIGNAL) != sizeof(hdr)) {
+      conn_drop(cli);
+    }
+  }
+  conn_cli_release(cli);
+}
+
+static void *pool_worker(void *param)
+{
+  service_t *svc = (service_t *)param;
+  client_t *cli;
+
+  while (1) {
+    pthread_mutex_lock(&svc->mutex);
+    svc->idle_workers++;
+    while (svc->q_count == 0) {
+      pthread_cond_wait(&svc->cond, &svc->mutex);
+    }
+    svc->idle_workers--;
+    cli = svc->queue[svc->q_head];
+    svc->q_head = (svc->q_head + 1) % svc->attr.max_pending;
+    svc->q_count--;
+    pthread_cond_signal(&svc->q_space);
+    pthread_mutex_unlock(&svc->mutex);
+
+    if (svc->handle_req(cli)) {
+      cli_done(cli);
+    }
+  }
+  pthread_exit(NULL);
+  return NULL;
+}
+
+static void pool_dispatch(service_t *svc, client_t *cli)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+
+  pthread_mutex_lock(&svc->mutex);
+  while (svc->q_count >= svc->attr.max_pending) {
+    pthread_cond_wait(&svc->q_space, &svc->mutex);
+  }
+  svc->queue[(svc->q_head + svc->q_count) % svc->attr.max_pending] = cli;
+  svc->q_count++;
+
+  /* Workers are only created once the existing ones are all busy */
+  if (svc->idle_workers < svc->q_count && svc->num_workers < svc->attr.num_workers) {
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, STACK_SIZE);
+    if (pthread_create(&tid, &attr, pool_worker, svc)) {
+      if (svc->num_workers == 0) {
+        CRITICAL("%s(%s) failed to create worker (%s)", __func__, cli->endpoint, strerror(errno));
+      }
+    } else {
+      svc->num_workers++;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  pthread_cond_signal(&svc->cond);
+  pthread_mutex_unlock(&svc->mutex);
+}
+
+static void pool_close(service_t *svc, int epfd, struct ipc_conn_s *conn)
+{
+  epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  if (conn->prev)
+    conn->prev->next = conn->next;
+  else
+    svc->conns = conn->next;
+  if (conn->next)
+    conn->next->prev = conn->prev;
+  conn_put(svc, conn);
+}
+
+static void pool_accept(service_t *svc, int epfd, int sock, bool packet)
+{
+  struct ipc_conn_s *conn;
+  struct epoll_event ev;
+  struct timeval tv = { .tv_sec = POOL_SEND_TIMEOUT };
+  int fd;
+
+  if ((fd = accept4(sock, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+    ERROR("%s(%s) failed to accept (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
+    /* Out of descriptors stays readable, do not spin on it */
+    usleep(100 * 1000);
+    return;
+  }
+  /* Responses are sent from the workers, never let a peer which stopped
+   * reading hold one of them */
+  if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv))) {
+    DEBUG("%s(%s) failed to set send timeout (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
+  }
+
+  conn = calloc(1, sizeof(*conn));
+  if (!conn) {
+    close(fd);
+    return;
+  }
+  conn->fd = fd;
+  conn->packet = packet;
+  conn->refcnt = 1;
+  conn->last_active = mono_sec();
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = conn;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev)) {
+    ERROR("%s(%s) failed to watch connection (%s)", __func__, svc->base_cli.endpoint, strerror(errno));
+    close(fd);
+    free(conn);
+    return;
+  }
+  conn->next = svc->conns;
+  if (svc->conns)
+    svc->conns->prev = conn;
+  svc->conns = conn;
+}
+
+static void pool_read(service_t *svc, int epfd, struct ipc_conn_s *conn)
+{
+  size_t max_req = svc->attr.max_req_len;
+  pkt_hdr_t hdr;
+  struct iovec iov[2];
+  struct msghdr msg;
+  client_t *cli;
+  uint8_t *buf;
+  ssize_t len;
+
+  /* The client and its request buffer are a single allocation */
+  cli = malloc(sizeof(*cli) + max_req);
+  if (!cli) {
+    return;
+  }
+  memcpy(cli, &svc->base_cli, sizeof(*cli));
+  buf = (uint8_t *)(cli + 1);
+
+  if (conn->packet) {
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = max_req;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    len = recvmsg(conn->fd, &msg, MSG_DONTWAIT);
+    if (len > 0 && (len < (ssize_t)sizeof(hdr) || (msg.msg_flags & MSG_TRUNC))) {
+      ERROR("%s(%s) dropping malformed request", __func__, cli->endpoint);
+      len = -1;
+      errno = EPROTO;
+    }
+  } else {
+    len = recv(conn->fd, buf, max_req, MSG_DONTWAIT);
+  }
+
+  if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    free(cli);
+    return;
+  }
+  if (len <= 0) {
+    if (len < 0) {
+      DEBUG("%s(%s) failed to recv (%s)", __func__, cli->endpoint, strerror(errno));
+    }
+    free(cli);
+    pool_close(svc, epfd, conn);
+    return;
+  }
+
+  cli->conn = conn;
+  cli->fd = conn->fd;
+  cli->req = buf;
+  if (conn->packet) {
+    cli->tag = hdr.tag;
+    cli->req_len = len - sizeof(hdr);
+    conn->last_active = mono_sec();
+    pthread_mutex_lock(&svc->mutex);
+    conn->refcnt++;
+    pthread_mutex_unlock(&svc->mutex);
+  } else {
+    /* A one-shot connection carries a single request, hand the
+     * loop's reference over to it */
+    cli->req_len = len;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    if (conn->prev)
+      conn->prev->next = conn->next;
+    else
+      svc->conns = conn->next;
+    if (conn->next)
+      conn->next->prev = conn->prev;
+  }
+  pool_dispatch(svc, cli);
+}
+
+/* One-shot connections which never send their request are dropped after
+ * the same timeout the thread-per-connection service applies to recv */
+static void pool_expire(service_t *svc, int epfd)
+{
+  struct ipc_conn_s *conn, *next;
+  time_t now = mono_sec();
+
+  for (conn = svc->conns; conn; conn = next) {
+    next = conn->next;
+    if (!conn->packet && (now - conn->last_active) > CLIENT_TIMEOUT) {
+      pool_close(svc, epfd, conn);
+    }
+  }
+}
+
+static void *pool_thread(void *param)
+{
+  service_t *svc = (service_t *)param;
+  client_t *base_cli = &svc->base_cli;
+  struct epoll_event ev, events[POOL_MAX_EVENTS];
+  int stream_sock = svc->stream_sock;
+  int pkt_sock = svc->pkt_sock;
+  time_t last_expire = mono_sec();
+  int epfd, i, n;
+
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    CRITICAL("%s(%s) failed to create epoll (%s)", __func__, base_cli->endpoint, strerror(errno));
+    goto bail;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = &stream_sock;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, stream_sock, &ev)) {
+    CRITICAL("%s(%s) failed to watch endpoint (%s)", __func__, base_cli->endpoint, strerror(errno));
+    goto close_bail;
+  }
+  ev.data.ptr = &pkt_sock;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, pkt_sock, &ev)) {
+    CRITICAL("%s(%s) failed to watch endpoint (%s)", __func__, base_cli->endpoint, strerror(errno));
+    goto close_bail;
+  }
+
+  while (1) {
+    n = epoll_wait(epfd, events, POOL_MAX_EVENTS, 1000);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      CRITICAL("%s(%s) epoll failed (%s)", __func__, base_cli->endpoint, strerror(errno));
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      if (events[i].data.ptr == &stream_sock) {
+        pool_accept(svc, epfd, stream_sock, false);
+      } else if (events[i].data.ptr == &pkt_sock) {
+        pool_accept(svc, epfd, pkt_sock, true);
+      } else {
+        pool_read(svc, epfd, (struct ipc_conn_s *)events[i].data.ptr);
+      }
+    }
+    if (mono_sec() != last_expire) {
+      last_expire = mono_sec();
+      pool_expire(svc, epfd);
+    }
+  }
+close_bail:
+  close(epfd);
+bail:
+  close(stream_sock);
+  close(pkt_sock);
+  pthread_exit(NULL);
+  return NULL;
+}
+
+int ipc_start_svc_pool(const char *endpoint, ipc_handle_req_t handle_req, const ipc_svc_attr_t *attr, void *svc_cookie, pthread_t *waiter)
+{
+  pthread_t tid;
+  pthread_attr_t tattr;
+  int stream_sock, pkt_sock;
+  service_t *svc;
+
+  if (strlen(endpoint) >= MAX_ENDPOINT_LEN - 1) {
+    return -1;
+  }
+
+  svc = calloc(1, sizeof(*svc));
+  if (!svc) {
+    return -1;
+  }
+  if (attr) {
+    memcpy(&svc->attr, attr, sizeof(svc->attr));
+  }
+  if (svc->attr.backlog <= 0)
+    svc->attr.backlog = POOL_BACKLOG;
+  if (svc->attr.num_workers <= 0)
+    svc->attr.num_workers = POOL_WORKERS;
+  if (svc->attr.max_pending <= 0)
+    svc->attr.max_pending = POOL_PENDING;
+  if (svc->attr.max_req_len == 0)
+    svc->attr.max_req_len = POOL_MAX_REQ;
+
+  svc->queue = calloc(svc->attr.max_pending, sizeof(client_t *));
+  if (!svc->queue) {
+    free(svc);
+    return -1;
+  }
+
+  stream_sock = bind_endpoint(endpoint, "", SOCK_STREAM, svc->attr.backlog);
+  if (stream_sock < 0) {
+    goto free_bail;
+  }
+  pkt_sock = bind_endpoint(endpoint, PKT_SUFFIX, SOCK_SEQPACKET, svc->attr.backlog);
+  if (pkt_sock < 0) {
+    close(stream_sock);
+    goto free_bail;
+  }
+
+  strcpy(svc->base_cli.endpoint, endpoint);
+  svc->base_cli.svc_cookie = svc_cookie;
+  svc->base_cli.fd = -1;
+  svc->base_cli.svc = svc;
+  svc->stream_sock = stream_sock;
+  svc->pkt_sock = pkt_sock;
+  svc->handle_req = handle_req;
+  pthread_mutex_init(&svc->mutex, NULL);
+  pthread_cond_init(&svc->cond, NULL);
+  pthread_cond_init(&svc->q_space, NULL);
+
+  pthread_attr_init(&tattr);
+  if (!waiter)
+    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+
+  if (pthread_create(&tid, &tattr, pool_thread, svc)) {
+    DEBUG("%s(%s) failed to start thread (%s)", __func__, endpoint, strerror(errno));
+    pthread_attr_destroy(&tattr);
+    close(stream_sock);
+    close(pkt_sock);
+    goto free_bail;
+  }
+  pthread_attr_destroy(&tattr);
+
+  if (waiter)
+    *waiter = tid;
+  return 0;
+
+free_bail:
+  free(svc->queue);
+  free(svc);
+  return -1;
+}
+
+static int client_connect(ipc_client_t *cli)
+{
+  struct sockaddr_un remote;
+  int len, sockfd;
+
+  if ((sockfd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1) {
+    DEBUG("%s(%s) failed to create socket (%s)", __func__, cli->endpoint, strerror(errno));
+    return -1;
+  }
+
+  set_sock_timeout(sockfd, cli->timeout);
+
+  remote.sun_family = AF_UNIX;
+  snprintf(remote.sun_path, sizeof(remote.sun_path), "/tmp/%s%s", cli->endpoint, PKT_SUFFIX);
+  len = strlen(remote.sun_path) + sizeof(remote.sun_family);
+
+  if (connect(sockfd, (struct sockaddr *)&remote, len) == -1) {
+    DEBUG("%s(%s) failed to connect (%s)", __func__, cli->endpoint, strerror(errno));
+    SAVE_ERRNO_RUN(close(sockfd));
+    return -1;
+  }
+  cli->fd = sockfd;
+  cli->pid = getpid();
+  return 0;
+}
+
+ipc_client_t *ipc_client_open(const char *endpoint, int timeout)
+{
+  ipc_client_t *cli;
+
+  if (strlen(endpoint) >= MAX_ENDPOINT_LEN - 1) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  cli = calloc(1, sizeof(*cli));
+  if (!cli) {
+    return NULL;
+  }
+  strcpy(cli->endpoint, endpoint);
+  cli->timeout = timeout;
+  cli->fd = -1;
+  pthread_mutex_init(&cli->mutex, NULL);
+
+  if (client_connect(cli)) {
+    SAVE_ERRNO_RUN(pthread_mutex_destroy(&cli->mutex); free(cli));
+    return NULL;
+  }
+  return cli;
+}
+
+void ipc_client_close(ipc_client_t *cli)
+{
+  if (!cli) {
+    return;
+  }
+  if (cli->fd >= 0) {
+    close(cli->fd);
+  }
+  pthread_mutex_destroy(&cli->mutex);
+  free(cli);
+}
+
+int ipc_client_send(ipc_client_t *cli, uint8_t *req, size_t req_len, uint32_t *tag)
+{
+  pkt_hdr_t hdr;
+  struct iovec iov[2];
+  struct msghdr msg;
+
+  if (!cli || !req || !req_len) {
+    errno = EINVAL;
+    return -1;
+  }
+  /* A forked child must not share the parent's connection and tags */
+  if (cli->fd >= 0 && cli->pid != getpid()) {
+    close(cli->fd);
+    cli->fd = -1;
+  }
+  if (cli->fd < 0 && client_connect(cli)) {
+    return -1;
+  }
+
+  hdr.tag = cli->next_tag++;
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = req;
+  iov[1].iov_len = req_len;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  if (sendmsg(cli->fd, &msg, MSG_NOSIGNAL) != (ssize_t)(sizeof(hdr) + req_len)) {
+    DEBUG("%s(%s) failed to send (%s)", __func__, cli->endpoint, strerror(errno));
+    return -1;
+  }
+  if (tag)
+    *tag = hdr.tag;
+  return 0;
+}
+
+int ipc_client_recv(ipc_client_t *cli, uint32_t *tag, uint8_t *resp, size_t *resp_len)
+{
+  pkt_hdr_t hdr;
+  struct iovec iov[2];
+  struct msghdr msg;
+  ssize_t len;
+  int retry = 0;
+
+  if (!cli || !resp || !resp_len || !*resp_len) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (cli->fd < 0) {
+    errno = ENOTCONN;
+    return -1;
+  }
+
+  iov[0].iov_base = &hdr;
+  iov[0].iov_len = sizeof(hdr);
+  iov[1].iov_base = resp;
+  iov[1].iov_len = *resp_len;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  while ((len = recvmsg(cli->fd, &msg, 0)) < 0) {
+    if ((errno != EINTR && errno != EWOULDBLOCK && errno != EAGAIN) ||
+        (retry++ >= MAX_RETRIES)) {
+      DEBUG("%s(%s) failed to recv (%s)", __func__, cli->endpoint, strerror(errno));
+      return -1;
+    }
+    DEBUG("%s(%s) recv interrupted (%s)", __func__, cli->endpoint, strerror(errno));
+    usleep(20 * 1000);
+  }
+  if (len == 0) {
+    /* The service went away, reconnect on the next request */
+    close(cli->fd);
+    cli->fd = -1;
+    errno = ECONNRESET;
+    return -1;
+  }
+  if (len < (ssize_t)sizeof(hdr)) {
+    errno = EPROTO;
+    return -1;
+  }
+  if (msg.msg_flags & MSG_TRUNC) {
+    DEBUG("%s(%s) response truncated", __func__, cli->endpoint);
+    len = sizeof(hdr) + *resp_len;
+  }
+
+  if (tag)
+    *tag = hdr.tag;
+  *resp_len = len - sizeof(hdr);
+  return 0;
+}
+
+int ipc_client_req(ipc_client_t *cli, uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len)
+{
+  uint32_t tag, rtag;
+  size_t max_resp;
+  int ret = -1;
+
+  if (!cli || !resp_len) {
+    errno = EINVAL;
+    return -1;
+  }
+  max_resp = *resp_len;
+
+  pthread_mutex_lock(&cli->mutex);
+  if (ipc_client_send(cli, req, req_len, &tag) != 0) {
+    if (errno == EINVAL) {
+      goto unlock_bail;
+    }
+    /* A restarted service shows up as a broken connection on send,
+     * retry once on a fresh one */
+    if (cli->fd >= 0) {
+      close(cli->fd);
+      cli->fd = -1;
+    }
+    if (ipc_client_send(cli, req, req_len, &tag) != 0) {
+      goto unlock_bail;
+    }
+  }
+
+  /* Late responses to requests which timed out earlier are dropped */
+  do {
+    *resp_len = max_resp;
+    ret = ipc_client_recv(cli, &rtag, resp, resp_len);
+  } while (ret == 0 && rtag != tag);
+
+unlock_bail:
+  pthread_mutex_unlock(&cli->mutex);
+  return ret;
+}
+
 #ifdef __TEST__
 #include <assert.h>
 char *svc_cookie = "test_cookie";
@@ -382,9 +1087,73 @@ int test_handle_req(client_t *cli)
   return 0;
 }
 
+int test_echo_req(client_t *cli)
+{
+  uint8_t req[32] = {0};
+  size_t len = 32;
+
+  assert(strcmp(cli->endpoint, "test_pool") == 0);
+  assert(cli->svc_cookie == svc_cookie);
+  if (ipc_recv_req(cli, req, &len, 1) != 0) {
+    return -1;
+  }
+  /* Requests starting with 0xff get no response */
+  if (req[0] == 0xff) {
+    return -1;
+  }
+  return ipc_send_resp(cli, req, len);
+}
+
+void test_pool(void)
+{
+  int rc, i;
+  ipc_client_t *cli;
+  uint8_t req[32] = {1,2,3,4};
+  uint8_t resp[32] = {0};
+  size_t resp_len = 32;
+  uint32_t tags[4], tag;
+  ipc_svc_attr_t attr = { .num_workers = 2, .max_pending = 4 };
+
+  rc = ipc_start_svc_pool("test_pool", test_echo_req, &attr, svc_cookie, NULL);
+  assert(rc == 0);
+
+  rc = ipc_send_req("test_pool", req, 4, resp, &resp_len, 2);
+  assert(rc == 0 && resp_len == 4);
+  assert(memcmp(req, resp, 4) == 0);
+  printf("One-shot request to pool succeeded!\n");
+
+  cli = ipc_client_open("test_pool", 2);
+  assert(cli != NULL);
+  resp_len = 32;
+  rc = ipc_client_req(cli, req, 4, resp, &resp_len);
+  assert(rc == 0 && resp_len == 4);
+  assert(memcmp(req, resp, 4) == 0);
+
+  for (i = 0; i < 4; i++) {
+    req[0] = i;
+    rc = ipc_client_send(cli, req, 4, &tags[i]);
+    assert(rc == 0);
+  }
+  for (i = 0; i < 4; i++) {
+    resp_len = 32;
+    rc = ipc_client_recv(cli, &tag, resp, &resp_len);
+    assert(rc == 0 && resp_len == 4);
+    assert(tag == tags[resp[0]]);
+  }
+  printf("Pipelined requests succeeded!\n");
+
+  req[0] = 0xff;
+  resp_len = 32;
+  rc = ipc_client_req(cli, req, 4, resp, &resp_len);
+  assert(rc == 0 && resp_len == 0);
+  printf("Failed request got an empty response!\n");
+  ipc_client_close(cli);
+}
+
 int main(int argc, char *argv[])
 {
   int rc;
+  test_pool();
   rc = ipc_start_svc("test_svc", test_handle_req, 1, svc_cookie, NULL);
   assert(rc == 0);
   sleep(1);
@@ -14,16 +14,59 @@ typedef int (*ipc_handle_req_t)(client_t *cli);
 struct service_s;
 typedef struct service_s service_t;
 
+struct ipc_conn_s;
+
 struct client_s {
   char endpoint[MAX_ENDPOINT_LEN];
   void *svc_cookie;
   int fd;
   service_t *svc;
+  /* Only used by requests dispatched from an event-loop service,
+   * where the request has already been read by the loop. */
+  struct ipc_conn_s *conn;
+  uint8_t *req;
+  size_t req_len;
+  uint32_t tag;
 };
 
+/* Attributes of an event-loop service. Zero fields take the defaults. */
+typedef struct {
+  int backlog;       /* listen() backlog of the endpoints */
+  int num_workers;   /* upper bound of worker threads (created on demand) */
+  int max_pending;   /* requests queued for a worker before the loop stalls */
+  size_t max_req_len; /* largest request accepted */
+} ipc_svc_attr_t;
+
+/* Persistent client connection to an event-loop service */
+struct ipc_client_s;
+typedef struct ipc_client_s ipc_client_t;
+
 int ipc_send_req(const char *endpoint, uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len, int timeout);
 int ipc_recv_req(client_t *cli, uint8_t *req, size_t *req_len, int timeout);
 int ipc_send_resp(client_t *cli, uint8_t *resp, size_t resp_len);
 int ipc_start_svc(const char *endpoint, ipc_handle_req_t handle_req, int max_active, void *cookie, pthread_t *waiter);
 
+/* Start a service where a single epoll thread owns every connection and
+ * hands complete requests to a bounded pool of worker threads. Besides the
+ * one-shot endpoint used by ipc_send_req(), it also serves persistent,
+ * pipelined connections opened with ipc_client_open(). The handler is the
+ * same as for ipc_start_svc(). */
+int ipc_start_svc_pool(const char *endpoint, ipc_handle_req_t handle_req, const ipc_svc_attr_t *attr, void *cookie, pthread_t *waiter);
+
+/* Open a persistent connection to an event-loop service. timeout is the
+ * receive timeout in seconds for every response (< 0 waits forever). */
+ipc_client_t *ipc_client_open(const char *endpoint, int timeout);
+void ipc_client_close(ipc_client_t *cli);
+
+/* Send a request and wait for its response. Serialized per client and
+ * reconnects when the service was restarted. */
+int ipc_client_req(ipc_client_t *cli, uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len);
+
+/* Pipelining: queue several requests with ipc_client_send() and collect
+ * the responses with ipc_client_recv(). Responses may complete out of
+ * order, the tag identifies the request each one belongs to. The caller
+ * must not mix these with ipc_client_req() from other threads. */
+int ipc_client_send(ipc_client_t *cli, uint8_t *req, size_t req_len, uint32_t *tag);
+int ipc_client_recv(ipc_client_t *cli, uint32_t *tag, uint8_t *resp, size_t *resp_len);
+
 #endif
@@ -37,7 +37,7 @@
 #include "ipmb.h"
 #include <openbmc/ipmi.h>
 
-static pthread_key_t rxkey, txkey;
+static pthread_key_t rxkey, txkey, clikey;
 static pthread_once_t key_once = PTHREAD_ONCE_INIT;
 
 static void
@@ -47,11 +47,25 @@ destructor(void *buf)
     free(buf);
 }
 
+static void
+cli_destructor(void *buf)
+{
+  ipc_client_t **clis = (ipc_client_t **)buf;
+  int i;
+
+  if (!clis)
+    return;
+  for (i = 0; i <= UCHAR_MAX; i++)
+    ipc_client_close(clis[i]);
+  free(clis);
+}
+
 static void
 make_key()
 {
   (void) pthread_key_create(&rxkey, destructor);
   (void) pthread_key_create(&txkey, destructor);
+  (void) pthread_key_create(&clikey, cli_destructor);
 }
 
 /*
@@ -88,6 +102,27 @@ ipmb_txb()
   return (ipmb_req_t*)buf;
 }
 
+/*
+ *  Return thread specific persistent connection to ipmbd of the bus
+ */
+static ipc_client_t*
+ipmb_client(unsigned char bus_id, const char *sock_path)
+{
+  ipc_client_t **clis;
+
+  pthread_once(&key_once, make_key);
+  if ((clis = pthread_getspecific(clikey)) == NULL) {
+    clis = calloc(UCHAR_MAX + 1, sizeof(ipc_client_t *));
+    if (clis == NULL)
+      return NULL;
+    pthread_setspecific(clikey, clis);
+  }
+  if (clis[bus_id] == NULL) {
+    clis[bus_id] = ipc_client_open(sock_path, TIMEOUT_IPMB);
+  }
+  return clis[bus_id];
+}
+
 /*
  * Function to handle IPMB messages
  */
@@ -98,10 +133,18 @@ lib_ipmb_handle(unsigned char bus_id,
 
   size_t resp_len = MAX_IPMB_RES_LEN;
   char sock_path[64];
+  ipc_client_t *cli;
 
   sprintf(sock_path, "%s_%d", SOCK_PATH_IPMB, bus_id);
 
-  if (ipc_send_req(sock_path, request, (size_t)req_len, response,
+  // Requests go over a persistent connection per thread and bus, a
+  // one-shot connection is only used when ipmbd does not offer one.
+  cli = ipmb_client(bus_id, sock_path);
+  if (cli) {
+    if (ipc_client_req(cli, request, (size_t)req_len, response, &resp_len) != 0) {
+      return -1;
+    }
+  } else if (ipc_send_req(sock_path, request, (size_t)req_len, response,
                    &resp_len, TIMEOUT_IPMB) != 0) {
     return -1;
   }
@@ -114,6 +157,112 @@ lib_ipmb_handle(unsigned char bus_id,
   return 0;
 }
 
+/*
+ * Function to handle a batch of IPMB messages to the same bus. Up to
+ * IPMB_PIPELINE_DEPTH requests are kept outstanding on the persistent
+ * connection so that ipmbd can work on them while earlier ones are
+ * still on the wire. Returns 0 when every request got a response.
+ */
+int
+lib_ipmb_handle_many(unsigned char bus_id, ipmb_xfer_t *xfer, int num)
+{
+  uint8_t resp[MAX_IPMB_RES_LEN];
+  size_t resp_len;
+  uint32_t tags[IPMB_PIPELINE_DEPTH], tag;
+  int slots[IPMB_PIPELINE_DEPTH];
+  int sent = 0, pending = 0, failed = 0;
+  char sock_path[64];
+  ipc_client_t *cli;
+  int i;
+
+  if (!xfer || num <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (i = 0; i < num; i++) {
+    xfer[i].res_len = 0;
+  }
+
+  sprintf(sock_path, "%s_%d", SOCK_PATH_IPMB, bus_id);
+  cli = ipmb_client(bus_id, sock_path);
+  if (cli == NULL) {
+    for (i = 0; i < num; i++) {
+      if (lib_ipmb_handle(bus_id, xfer[i].request, xfer[i].req_len,
+                          xfer[i].response, &xfer[i].res_len) != 0) {
+        failed++;
+      }
+    }
+    return failed ? -1 : 0;
+  }
+
+  while (sent < num || pending > 0) {
+    while (sent < num && pending < IPMB_PIPELINE_DEPTH) {
+      if (ipc_client_send(cli, xfer[sent].request, xfer[sent].req_len,
+                          &tags[pending]) != 0) {
+        failed++;
+        sent++;
+        continue;
+      }
+      slots[pending++] = sent++;
+    }
+    if (pending == 0) {
+      break;
+    }
+
+    resp_len = sizeof(resp);
+    if (ipc_client_recv(cli, &tag, resp, &resp_len) != 0) {
+      // Whatever is outstanding is lost, late responses are dropped by
+      // their tag on the next request.
+      failed += pending;
+      pending = 0;
+      continue;
+    }
+    for (i = 0; i < pending && tags[i] != tag; i++)
+      ;
+    if (i == pending) {
+      continue;
+    }
+    if (resp_len > UCHAR_MAX) {
+      syslog(LOG_ERR, "ipmb response buffer truncated: %lu -> %u\n",
+             (unsigned long)resp_len, UCHAR_MAX);
+      resp_len = UCHAR_MAX;
+    }
+    memcpy(xfer[slots[i]].response, resp, resp_len);
+    xfer[slots[i]].res_len = (unsigned char)resp_len;
+    if (resp_len == 0) {
+      failed++;
+    }
+    pending--;
+    tags[i] = tags[pending];
+    slots[i] = slots[pending];
+  }
+  return failed ? -1 : 0;
+}
+
+/*
+ * Fetch the bus statistics of ipmbd as a JSON string
+ */
+int
+lib_ipmb_get_stats(unsigned char bus_id, char *buf, size_t *len)
+{
+  uint8_t req[IPMB_STATS_LEN] = {0};
+  char sock_path[64];
+
+  if (!buf || !len || *len == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  sprintf(sock_path, "%s_%d", SOCK_PATH_IPMB, bus_id);
+  if (ipc_send_req(sock_path, req, sizeof(req), (uint8_t *)buf, len, TIMEOUT_IPMB) != 0) {
+    return -1;
+  }
+  if (*len == 0) {
+    return -1;
+  }
+  buf[*len - 1] = '\0';
+  return 0;
+}
+
 int
 ipmb_send_buf (unsigned char bus_id, unsigned char tlen)
 {
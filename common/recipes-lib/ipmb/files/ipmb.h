@@ -21,6 +21,8 @@
 #ifndef __IPMB_H__
 #define __IPMB_H__
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -51,6 +53,10 @@ extern "C" {
 #define MAX_IPMB_REQ_LEN 2080
 #define MIN_IPMB_RES_LEN 8
 #define IPMB_PING_LEN 3
+// A request of this length asks ipmbd for its bus statistics in JSON
+#define IPMB_STATS_LEN 1
+#define MAX_IPMB_STATS_LEN 65536
+#define IPMB_PIPELINE_DEPTH 8
 
 typedef struct _ipmb_req_t {
   uint8_t res_slave_addr;
@@ -73,9 +79,20 @@ typedef struct _ipmb_res_t {
   uint8_t data[];
 } ipmb_res_t;
 
+/* One request of a batch for lib_ipmb_handle_many(). response must hold
+ * MAX_IPMB_RES_LEN bytes, res_len is 0 when the request failed. */
+typedef struct _ipmb_xfer_t {
+  unsigned char *request;
+  unsigned int req_len;
+  unsigned char *response;
+  unsigned char res_len;
+} ipmb_xfer_t;
+
 int lib_ipmb_handle(unsigned char bus_id,
                     unsigned char *request, unsigned int req_len,
                     unsigned char *response, unsigned char *res_len);
+int lib_ipmb_handle_many(unsigned char bus_id, ipmb_xfer_t *xfer, int num);
+int lib_ipmb_get_stats(unsigned char bus_id, char *buf, size_t *len);
 int
 lib_ipmb_send_request(uint8_t ipmi_cmd, uint8_t netfn,
               uint8_t *txbuf, uint8_t txlen, 
@@ -30,10 +30,42 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <pthread.h>
 #include <openbmc/ipc.h>
 
 #define MAX_IPMI_RES_LEN 300
 
+static pthread_key_t clikey;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static void
+cli_destructor(void *cli)
+{
+  ipc_client_close((ipc_client_t *)cli);
+}
+
+static void
+make_key()
+{
+  (void) pthread_key_create(&clikey, cli_destructor);
+}
+
+/*
+ *  Return thread specific persistent connection to ipmid
+ */
+static ipc_client_t*
+ipmi_client()
+{
+  ipc_client_t *cli;
+
+  pthread_once(&key_once, make_key);
+  if ((cli = pthread_getspecific(clikey)) == NULL) {
+    cli = ipc_client_open(SOCK_PATH_IPMI, TIMEOUT_IPMI + 1);
+    pthread_setspecific(clikey, cli);
+  }
+  return cli;
+}
+
 /*
  * Function to handle IPMI messages
  */
@@ -42,9 +74,18 @@ lib_ipmi_handle(unsigned char *request, unsigned char req_len,
             unsigned char *response, unsigned short *res_len) {
 
   size_t resp_len = MAX_IPMI_RES_LEN;
+  ipc_client_t *cli = ipmi_client();
+  int ret;
 
   *res_len = 0;
-  if (ipc_send_req(SOCK_PATH_IPMI, request, (size_t)req_len, response, &resp_len, TIMEOUT_IPMI + 1) == 0) {
+  // Fall back to a one-shot connection when ipmid does not offer
+  // persistent ones
+  if (cli) {
+    ret = ipc_client_req(cli, request, (size_t)req_len, response, &resp_len);
+  } else {
+    ret = ipc_send_req(SOCK_PATH_IPMI, request, (size_t)req_len, response, &resp_len, TIMEOUT_IPMI + 1);
+  }
+  if (ret == 0) {
     *res_len = (unsigned short)resp_len;
   }
 }
@@ -524,6 +524,7 @@ enum
   CMD_OEM_1S_4BYTE_POST_BUF = 0x33,
   CMD_OEM_1S_DEV_POWER = 0x34,
   CMD_OEM_1S_GET_DEVICE_SENSOR_READING = 0x35,
+  CMD_OEM_1S_GET_MULTI_SENSOR_READING = 0x36,
   CMD_OEM_1S_GET_PCIE_SWITCH_STATUS = 0x38,
   CMD_OEM_1S_GET_SYS_FW_VER = 0x40,
   CMD_OEM_1S_GET_SHA256 = 0x43,
@@ -2,8 +2,12 @@
  * Copyright 2020-present Facebook. All Rights Reserved.
  */
 
+#include <array>
+#include <atomic>
 #include <limits>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "fileops.hpp"
 #include "kv.hpp"
@@ -132,4 +136,35 @@ void FileHandle::remove(const std::string& key, region r)
   std::filesystem::remove(fpath);
 }
 
+uint64_t FileHandle::generation(const std::string& key, region r)
+{
+  // Generations of recently modified keys, see below.
+  static std::atomic<uint64_t> unstable{0};
+  struct stat st;
+  struct timespec now;
+
+  auto fpath = get_key_path(key, r);
+  if (stat(fpath.c_str(), &st) != 0) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    throw std::filesystem::filesystem_error(
+        "kv: error calling stat", fpath,
+        std::error_code(errno, std::system_category()));
+  }
+
+  // File timestamps come from a coarse clock, a key written twice within
+  // the same tick (with values of the same length) would keep its
+  // generation. So a key modified in the last second gets a new
+  // generation every time, which callers will never find unchanged.
+  clock_gettime(CLOCK_REALTIME, &now);
+  if (now.tv_sec <= st.st_mtim.tv_sec + 1) {
+    return (1ULL << 63) | ++unstable;
+  }
+
+  uint64_t gen = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+  gen ^= ((uint64_t)st.st_ino << 32) ^ (uint64_t)st.st_size;
+  return (gen & ~(1ULL << 63)) | 1;
+}
+
 } // namespace kv
@@ -137,6 +137,28 @@ int kv_del(const char *key, unsigned int flags)
   return 0;
 }
 
+/*
+*  get the generation of key, 0 if the key does not exist.
+*  flags is bitmask of options.
+*
+*  return 0 on success, negative error code on failure.
+*/
+int kv_generation(const char *key, uint64_t *gen, unsigned int flags)
+{
+  if (key == nullptr || gen == nullptr) {
+    errno = EINVAL;
+    return -1;
+  }
+  try {
+    auto r = flags & KV_FPERSIST ? region::persist : region::temp;
+    *gen = kv::generation(key, r);
+  } catch(std::exception& e) {
+    KV_WARN("kv_generation: %s", e.what());
+    return -1;
+  }
+  return 0;
+}
+
 namespace kv {
 
 void set(const std::string& key, const std::string& value,
@@ -173,4 +195,9 @@ void del(const std::string& key, region r)
   FileHandle::remove(key, r);
 }
 
+uint64_t generation(const std::string& key, region r)
+{
+  return FileHandle::generation(key, r);
+}
+
 } // namespace kv
@@ -30,6 +30,12 @@ int kv_get(const char *key, char *value, size_t *len, unsigned int flags);
 int kv_set(const char *key, const char *value, size_t len, unsigned int flags);
 int kv_del(const char *key, unsigned int flags);
 
+/* Get a generation number of the key, which changes whenever the key is
+ * set or deleted. Callers caching something derived from the value can
+ * compare it instead of reading the key every time. The generation of a
+ * key which does not exist is 0. */
+int kv_generation(const char *key, uint64_t *gen, unsigned int flags);
+
 #ifdef __cplusplus
 }
 #endif
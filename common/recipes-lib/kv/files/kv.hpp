@@ -17,6 +17,7 @@ std::string get(const std::string& key, region r = region::temp);
 void set(const std::string& key, const std::string& value,
          region r = region::temp, bool require_create = false);
 void del(const std::string& key, region r = region::temp);
+uint64_t generation(const std::string& key, region r = region::temp);
 
 struct key_already_exists : public std::logic_error {
     using logic_error::logic_error;
@@ -4,7 +4,10 @@
 
 #include <array>
 #include <cassert>
+#include <ctime>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include "kv.hpp"
 
@@ -123,6 +126,42 @@ int main(int argc, char *argv[])
     printf("SUCCESS: Read and write using C++ interface.\n");
   }
 
+  {
+    constexpr auto key = "test6";
+    uint64_t gen1, gen2;
+
+    assert(kv_generation(key, &gen1, 0) == 0);
+    assert(gen1 == 0);
+    printf("SUCCESS: Non-existent key has generation 0.\n");
+
+    assert(kv_set(key, "val1", 0, 0) == 0);
+    assert(kv_generation(key, &gen1, 0) == 0);
+    assert(kv_set(key, "val2", 0, 0) == 0);
+    assert(kv_generation(key, &gen2, 0) == 0);
+    assert(gen1 != 0 && gen2 != 0 && gen1 != gen2);
+    printf("SUCCESS: Generation changes when a key is set.\n");
+
+    assert(kv_generation(key, &gen1, 0) == 0);
+    assert(gen1 != gen2);
+    printf("SUCCESS: Generation of a just written key is never reused.\n");
+
+    // Age the key past the window of coarse file timestamps.
+    struct timespec times[2];
+    clock_gettime(CLOCK_REALTIME, &times[0]);
+    times[0].tv_sec -= 10;
+    times[1] = times[0];
+    assert(utimensat(AT_FDCWD, "./test/tmp/test6", times, 0) == 0);
+    assert(kv_generation(key, &gen1, 0) == 0);
+    assert(kv_generation(key, &gen2, 0) == 0);
+    assert(gen1 == gen2);
+    printf("SUCCESS: Generation is stable while a key is unchanged.\n");
+
+    assert(kv_del(key, 0) == 0);
+    assert(kv_generation(key, &gen1, 0) == 0);
+    assert(gen1 == 0);
+    printf("SUCCESS: Generation of deleted key is 0.\n");
+  }
+
   assert(system("rm -rf ./test") == 0);
 
   return 0;
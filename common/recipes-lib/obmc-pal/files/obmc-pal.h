@@ -410,6 +410,7 @@ int pal_dev_fruid_write(uint8_t fru, uint8_t dev_id, char *path);
 int pal_get_fru_devtty(uint8_t fru, char *devtty);
 bool pal_sensor_is_cached(uint8_t fru, uint8_t sensor_num);
 int pal_sensor_read_raw(uint8_t fru, uint8_t sensor_num, void *value);
+int pal_sensor_read_prefetch(uint8_t fru, uint8_t *sensor_list, int cnt);
 int pal_sensor_threshold_flag(uint8_t fru, uint8_t snr_num, uint16_t *flag);
 int pal_alter_sensor_thresh_flag(uint8_t fru, uint8_t snr_num, uint16_t *flag);
 int pal_get_sensor_name(uint8_t fru, uint8_t sensor_num, char *name);
@@ -48,6 +48,7 @@
 #define MAX_DATA_NUM    2000
 
 #define CACHE_READ_RETRY 5
+#define STATS_READ_RETRY 10
 
 typedef struct {
   long log_time;
@@ -304,6 +305,15 @@ int sensor_raw_read(uint8_t fru, uint8_t sensor_num, float *value)
   return ret;
 }
 
+int sensor_raw_prefetch(uint8_t fru, uint8_t *sensor_list, int cnt)
+{
+#ifdef DBUS_SENSOR_SVC
+  return 0;
+#else
+  return pal_sensor_read_prefetch(fru, sensor_list, cnt);
+#endif
+}
+
 static int
 sensor_read_short_history(uint8_t fru, uint8_t sensor_num, float *min,
     float *average, float *max, int start_time)
@@ -549,6 +559,224 @@ int sensor_clear_history(uint8_t fru, uint8_t sensor_num)
   return ret1 || ret2 ? ERR_FAILURE : 0;
 }
 
+static int
+sensor_stats_key_get(uint8_t fru, char *key)
+{
+  char fruname[32];
+
+  if (fru == AGGREGATE_SENSOR_FRU_ID) {
+    strcpy(fruname, AGGREGATE_SENSOR_FRU_NAME);
+  } else {
+    if (pal_get_fru_name(fru, fruname))
+      return -1;
+  }
+  sprintf(key, "%s_sensor_stats", fruname);
+  return 0;
+}
+
+static int
+stats_bucket(uint64_t val)
+{
+  int bucket = 0;
+
+  while (val && bucket < (SENSOR_STATS_BUCKETS - 1)) {
+    val >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+/* The stats region has a single writer (the thread polling the fru) and
+ * lock-less readers, so updates are wrapped in a sequence counter which
+ * is odd while an update is in progress. */
+static void
+stats_write_begin(sensor_fru_stats_t *stats)
+{
+  __atomic_add_fetch(&stats->seq, 1, __ATOMIC_ACQ_REL);
+}
+
+static void
+stats_write_end(sensor_fru_stats_t *stats)
+{
+  __atomic_add_fetch(&stats->seq, 1, __ATOMIC_RELEASE);
+}
+
+sensor_fru_stats_t *
+sensor_stats_open(uint8_t fru)
+{
+  char key[MAX_KEY_LEN] = {0};
+  int fd;
+  void *ptr;
+
+  if (sensor_stats_key_get(fru, key))
+    return NULL;
+
+  fd = shm_open(key, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
+    return NULL;
+  }
+
+  if (ftruncate(fd, sizeof(sensor_fru_stats_t)) != 0) {
+    syslog(LOG_INFO, "%s: truncate %s failed errno = %d\n", __FUNCTION__, key, errno);
+    close(fd);
+    return NULL;
+  }
+
+  ptr = mmap(NULL, sizeof(sensor_fru_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
+    return NULL;
+  }
+
+  memset(ptr, 0, sizeof(sensor_fru_stats_t));
+  return (sensor_fru_stats_t *)ptr;
+}
+
+uint64_t
+sensor_stats_timestamp(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void
+sensor_stats_record_read(sensor_fru_stats_t *stats, uint8_t sensor_num,
+    uint64_t start_us, bool failed)
+{
+  sensor_stats_t *s;
+  uint32_t read_us;
+
+  if (stats == NULL)
+    return;
+
+  read_us = (uint32_t)(sensor_stats_timestamp() - start_us);
+  s = &stats->snr[sensor_num];
+
+  stats_write_begin(stats);
+  s->read_cnt++;
+  if (failed)
+    s->fail_cnt++;
+  s->last_read_us = read_us;
+  if (read_us > s->max_read_us)
+    s->max_read_us = read_us;
+  s->total_read_us += read_us;
+  s->read_hist[stats_bucket(read_us)]++;
+  stats_write_end(stats);
+}
+
+void
+sensor_stats_record_poll(sensor_fru_stats_t *stats, uint8_t sensor_num,
+    uint32_t interval)
+{
+  sensor_stats_t *s;
+  uint64_t now, elapsed;
+  uint64_t interval_us = (uint64_t)interval * 1000000;
+  uint32_t lag_ms;
+
+  if (stats == NULL)
+    return;
+
+  now = sensor_stats_timestamp();
+  s = &stats->snr[sensor_num];
+
+  stats_write_begin(stats);
+  s->poll_cnt++;
+  /* The first poll has no previous one to be late against */
+  if (s->last_poll_us != 0) {
+    elapsed = now - s->last_poll_us;
+    lag_ms = elapsed > interval_us ? (uint32_t)((elapsed - interval_us) / 1000) : 0;
+    s->last_lag_ms = lag_ms;
+    if (lag_ms > s->max_lag_ms)
+      s->max_lag_ms = lag_ms;
+    s->total_lag_ms += lag_ms;
+    s->lag_hist[stats_bucket(lag_ms)]++;
+  }
+  s->last_poll_us = now;
+  stats_write_end(stats);
+}
+
+void
+sensor_stats_record_loop(sensor_fru_stats_t *stats, uint64_t start_us)
+{
+  uint32_t loop_ms;
+
+  if (stats == NULL)
+    return;
+
+  loop_ms = (uint32_t)((sensor_stats_timestamp() - start_us) / 1000);
+
+  stats_write_begin(stats);
+  stats->loop_cnt++;
+  stats->last_loop_ms = loop_ms;
+  if (loop_ms > stats->max_loop_ms)
+    stats->max_loop_ms = loop_ms;
+  stats->total_loop_ms += loop_ms;
+  stats->loop_hist[stats_bucket(loop_ms)]++;
+  stats_write_end(stats);
+}
+
+int
+sensor_stats_get(uint8_t fru, sensor_fru_stats_t *stats)
+{
+  char key[MAX_KEY_LEN] = {0};
+  int fd, retry;
+  struct stat st;
+  void *ptr;
+  sensor_fru_stats_t *shm;
+  uint32_t seq;
+
+  if (sensor_stats_key_get(fru, key))
+    return ERR_UNKNOWN_FRU;
+
+  fd = shm_open(key, O_RDONLY, S_IRUSR | S_IWUSR);
+  if (fd < 0) {
+    DEBUG_STR("%s: shm_open %s failed, errno = %d", __FUNCTION__, key, errno);
+    return ERR_SENSOR_NA;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(sensor_fru_stats_t)) {
+    close(fd);
+    return ERR_SENSOR_NA;
+  }
+
+  ptr = mmap(NULL, sizeof(sensor_fru_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    syslog(LOG_INFO, "%s: mmap %s failed, errno = %d", __FUNCTION__, key, errno);
+    return ERR_FAILURE;
+  }
+
+  shm = (sensor_fru_stats_t *)ptr;
+  for (retry = 0; retry < STATS_READ_RETRY; retry++) {
+    seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+      continue;
+    memcpy(stats, shm, sizeof(sensor_fru_stats_t));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (seq == __atomic_load_n(&shm->seq, __ATOMIC_RELAXED))
+      break;
+  }
+  /* A busy writer only makes a single sample slightly inconsistent,
+   * so the last copy is still returned after running out of retries */
+  if (retry == STATS_READ_RETRY)
+    memcpy(stats, shm, sizeof(sensor_fru_stats_t));
+
+  munmap(ptr, sizeof(sensor_fru_stats_t));
+  return 0;
+}
+
+uint32_t
+sensor_stats_bucket_floor(int bucket)
+{
+  if (bucket <= 0)
+    return 0;
+  return 1U << (bucket - 1);
+}
+
 int __attribute__((weak))
 pal_get_fru_sensor_list(uint8_t fru, uint8_t **sensor_list, int *cnt)
 {
@@ -612,6 +840,12 @@ pal_sensor_read_raw(uint8_t fru, uint8_t sensor_num, void *value)
   return PAL_EOK;
 }
 
+int __attribute__((weak))
+pal_sensor_read_prefetch(uint8_t fru, uint8_t *sensor_list, int cnt)
+{
+  return PAL_ENOTSUP;
+}
+
 int __attribute__((weak))
 pal_sensor_threshold_flag(uint8_t fru, uint8_t snr_num, uint16_t *flag)
 {
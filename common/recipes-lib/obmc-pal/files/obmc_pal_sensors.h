@@ -75,6 +75,38 @@ typedef struct {
  * it starts to get accounted in the COARSE grained calculations */
 #define COARSE_THRESHOLD ((double)3600)
 
+/* Polling statistics kept by sensord in shared memory, one region per FRU.
+ * Histograms are log2 scaled: bucket 0 counts zero, bucket i counts values
+ * in [2^(i-1), 2^i) and the last bucket counts everything above. Read
+ * latencies are in microseconds, scheduling lag and loop time in ms. */
+#define SENSOR_STATS_NUM      256
+#define SENSOR_STATS_BUCKETS  24
+
+typedef struct {
+  uint32_t poll_cnt;
+  uint32_t read_cnt;
+  uint32_t fail_cnt;
+  uint32_t last_read_us;
+  uint32_t max_read_us;
+  uint32_t last_lag_ms;
+  uint32_t max_lag_ms;
+  uint64_t total_read_us;
+  uint64_t total_lag_ms;
+  uint64_t last_poll_us;
+  uint32_t read_hist[SENSOR_STATS_BUCKETS];
+  uint32_t lag_hist[SENSOR_STATS_BUCKETS];
+} sensor_stats_t;
+
+typedef struct {
+  uint32_t seq;
+  uint32_t loop_cnt;
+  uint32_t last_loop_ms;
+  uint32_t max_loop_ms;
+  uint64_t total_loop_ms;
+  uint32_t loop_hist[SENSOR_STATS_BUCKETS];
+  sensor_stats_t snr[SENSOR_STATS_NUM];
+} sensor_fru_stats_t;
+
 /* Functions */
 
 /* Read a cached value of the given sensor */
@@ -95,6 +127,37 @@ int sensor_clear_history(uint8_t fru, uint8_t sensor_num);
  * exclusivity. The simplest method being limiting all calls to this
  * function to a single daemon. */
 int sensor_raw_read(uint8_t fru, uint8_t sensor_num, float *value);
+
+/* Hint that the given sensors are about to be read with sensor_raw_read().
+ * Platforms whose sensors sit behind a bridge can fetch them in one batch
+ * here; it is always safe to skip the call. */
+int sensor_raw_prefetch(uint8_t fru, uint8_t *sensor_list, int cnt);
+
+/* Create (or reset) the polling statistics of the fru and map them for
+ * writing. Only the daemon polling the fru should call this. */
+sensor_fru_stats_t *sensor_stats_open(uint8_t fru);
+
+/* Monotonic timestamp in microseconds, used to time reads and loops */
+uint64_t sensor_stats_timestamp(void);
+
+/* Record a read which was started at start_us */
+void sensor_stats_record_read(sensor_fru_stats_t *stats, uint8_t sensor_num,
+               uint64_t start_us, bool failed);
+
+/* Record a scheduled poll of a sensor with the given poll interval in
+ * seconds. The lag is how late the poll fired relative to the previous one */
+void sensor_stats_record_poll(sensor_fru_stats_t *stats, uint8_t sensor_num,
+               uint32_t interval);
+
+/* Record one full polling loop over the fru which was started at start_us */
+void sensor_stats_record_loop(sensor_fru_stats_t *stats, uint64_t start_us);
+
+/* Take a consistent copy of the polling statistics of the fru */
+int sensor_stats_get(uint8_t fru, sensor_fru_stats_t *stats);
+
+/* Lower bound of the values counted in the histogram bucket */
+uint32_t sensor_stats_bucket_floor(int bucket);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -24,6 +24,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 #ifndef __TEST__
 #include <syslog.h>
 #endif
@@ -65,6 +66,10 @@ typedef struct {
   char name[32];
   size_t num;
   correction_element_t *corr_table;
+  /* bound[i] is the largest cond_value of entries 0..i, the entry
+   * applied is the last one whose bound is not above the condition
+   * value (the first one if none), searched for in bound. */
+  float *bound;
 } correction_table_t;
 
 typedef enum {
@@ -83,10 +88,15 @@ typedef struct {
   char    cond_key[MAX_KEY_LEN];
   size_t  value_map_size;
   value_map_element_t value_map[MAX_NUM_CONDITIONS];
+  /* Table selected by the condition key at generation cond_gen */
+  bool    cond_cached;
+  uint64_t cond_gen;
+  size_t  cond_table;
 } sensor_correction_t;
 
 static sensor_correction_t *g_sensors = NULL;
 static size_t g_sensors_count = 0;
+static pthread_mutex_t g_cond_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int get_table(value_map_element_t *value_map, size_t num, char *value, size_t *idx)
 {
@@ -145,9 +155,35 @@ static int load_table(json_t *obj, correction_table_t *tbl)
     tbl->corr_table[i].cond_value = get_float(cond_value_o);
     tbl->corr_table[i].correction = get_float(correction_o);
   }
+
+  tbl->bound = calloc(tbl->num, sizeof(float));
+  if (!tbl->bound) {
+    free(tbl->corr_table);
+    return -1;
+  }
+  tbl->bound[0] = tbl->corr_table[0].cond_value;
+  for (i = 1; i < tbl->num; i++) {
+    tbl->bound[i] = tbl->corr_table[i].cond_value > tbl->bound[i - 1] ?
+      tbl->corr_table[i].cond_value : tbl->bound[i - 1];
+  }
   return 0;
 }
 
+static float table_correction(correction_table_t *table, float cond_value)
+{
+  size_t lo = 0, hi = table->num;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cond_value < table->bound[mid]) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return table->corr_table[lo ? lo - 1 : 0].correction;
+}
+
 static int search_table(const char *table_name, sensor_correction_t *snr, size_t *idx)
 {
   size_t i;
@@ -353,14 +389,47 @@ bail:
   return -1;
 }
 
-int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, float *sensor_reading)
+/* Get the table selected by the condition key. The key is read again
+ * only when its generation changed, 'gen' is the one of the key if the
+ * caller already got it. */
+static size_t get_cond_table(sensor_correction_t *snr, uint64_t *gen)
 {
   char value[MAX_VALUE_LEN] = {0};
   size_t table_idx = 0;
-  correction_table_t *table;
-  size_t i;
-  float correction;
   unsigned int flags;
+  uint64_t cur_gen = 0;
+  bool have_gen = true;
+
+  flags = snr->cond_key_type == KEY_PERSISTENT ? KV_FPERSIST : 0;
+  if (gen) {
+    cur_gen = *gen;
+  } else if (kv_generation(snr->cond_key, &cur_gen, flags)) {
+    have_gen = false;
+  }
+  pthread_mutex_lock(&g_cond_lock);
+  if (have_gen && snr->cond_cached && snr->cond_gen == cur_gen) {
+    table_idx = snr->cond_table;
+    pthread_mutex_unlock(&g_cond_lock);
+    return table_idx;
+  }
+  pthread_mutex_unlock(&g_cond_lock);
+
+  if (kv_get(snr->cond_key, value, NULL, flags) ||
+      get_table(snr->value_map, snr->value_map_size, value, &table_idx)) {
+    table_idx = snr->default_table;
+  }
+
+  pthread_mutex_lock(&g_cond_lock);
+  snr->cond_cached = have_gen;
+  snr->cond_gen = cur_gen;
+  snr->cond_table = table_idx;
+  pthread_mutex_unlock(&g_cond_lock);
+  return table_idx;
+}
+
+int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, float *sensor_reading)
+{
+  size_t table_idx;
 
   sensor_correction_t *snr = get_correction(fru, sensor_id);
   if (!snr) {
@@ -368,20 +437,46 @@ int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, fl
      * manipulating it */
     return 0;
   }
-  flags = snr->cond_key_type == KEY_PERSISTENT ? KV_FPERSIST : 0;
-  if (kv_get(snr->cond_key, value, NULL, flags) ||
-      get_table(snr->value_map, snr->value_map_size, value, &table_idx)) {
-    table_idx = snr->default_table;
-  }
-  table = &snr->tables[table_idx];
-  correction = table->corr_table[0].correction;
-  for (i = 0; i < table->num; i++) {
-    if (cond_value < table->corr_table[i].cond_value) {
-      break;
+  table_idx = get_cond_table(snr, NULL);
+  *sensor_reading = *sensor_reading - table_correction(&snr->tables[table_idx], cond_value);
+  return 0;
+}
+
+int sensor_correction_apply_many(sensor_correction_req_t *reqs, size_t num)
+{
+  /* Condition keys seen in this batch and their generations */
+  struct {
+    const char *key;
+    key_type type;
+    uint64_t gen;
+  } keys[MAX_NUM_CONDITIONS];
+  size_t num_keys = 0;
+  size_t i, k;
+
+  for (i = 0; i < num; i++) {
+    sensor_correction_t *snr = get_correction(reqs[i].fru, reqs[i].sensor_id);
+    uint64_t *gen = NULL;
+    size_t table_idx;
+
+    if (!snr) {
+      continue;
+    }
+    for (k = 0; k < num_keys; k++) {
+      if (keys[k].type == snr->cond_key_type && !strcmp(keys[k].key, snr->cond_key)) {
+        gen = &keys[k].gen;
+        break;
+      }
+    }
+    if (!gen && num_keys < MAX_NUM_CONDITIONS &&
+        !kv_generation(snr->cond_key, &keys[num_keys].gen,
+          snr->cond_key_type == KEY_PERSISTENT ? KV_FPERSIST : 0)) {
+      keys[num_keys].key = snr->cond_key;
+      keys[num_keys].type = snr->cond_key_type;
+      gen = &keys[num_keys++].gen;
     }
-    correction = table->corr_table[i].correction;
+    table_idx = get_cond_table(snr, gen);
+    reqs[i].sensor_reading -= table_correction(&snr->tables[table_idx], reqs[i].cond_value);
   }
-  *sensor_reading = *sensor_reading - correction;
   return 0;
 }
 
@@ -25,4 +25,15 @@
 int sensor_correction_init(const char *file);
 int sensor_correction_apply(uint8_t fru, uint8_t sensor_id, float cond_value, float *sensor_reading);
 
+typedef struct {
+  uint8_t fru;
+  uint8_t sensor_id;
+  float cond_value;
+  float sensor_reading; /* Corrected in place */
+} sensor_correction_req_t;
+
+/* Same as sensor_correction_apply for a batch of readings, the
+ * condition keys are looked up once for the whole batch. */
+int sensor_correction_apply_many(sensor_correction_req_t *reqs, size_t num);
+
 #endif
@@ -0,0 +1,262 @@
+/*
+ *
+ * Copyright 2017-present Facebook. All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <assert.h>
+#include "sensor-correction.h"
+#include <openbmc/kv.h>
+
+/* In memory kv store, the generation of a key changes with every
+ * kv_set/kv_del so the tests do not depend on file timestamps. */
+#define MAX_TEST_KEYS 8
+
+static struct {
+  char key[MAX_KEY_LEN];
+  unsigned int flags;
+  char value[MAX_VALUE_LEN];
+  uint64_t gen;
+} g_kv[MAX_TEST_KEYS];
+static uint64_t g_next_gen = 1;
+static int g_kv_get_calls;
+static int g_kv_gen_calls;
+
+static int find_key(const char *key, unsigned int flags)
+{
+  int i;
+  for (i = 0; i < MAX_TEST_KEYS; i++) {
+    if (g_kv[i].gen && g_kv[i].flags == (flags & KV_FPERSIST) &&
+        !strcmp(g_kv[i].key, key)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int kv_get(const char *key, char *value, size_t *len, unsigned int flags)
+{
+  int i = find_key(key, flags);
+
+  g_kv_get_calls++;
+  if (i < 0) {
+    return -1;
+  }
+  strcpy(value, g_kv[i].value);
+  if (len) {
+    *len = strlen(value);
+  }
+  return 0;
+}
+
+int kv_set(const char *key, const char *value, size_t len, unsigned int flags)
+{
+  int i = find_key(key, flags);
+
+  (void)len;
+  if (i < 0) {
+    for (i = 0; i < MAX_TEST_KEYS && g_kv[i].gen; i++)
+      ;
+    assert(i < MAX_TEST_KEYS);
+    strcpy(g_kv[i].key, key);
+    g_kv[i].flags = flags & KV_FPERSIST;
+  }
+  strcpy(g_kv[i].value, value);
+  g_kv[i].gen = g_next_gen++;
+  return 0;
+}
+
+int kv_del(const char *key, unsigned int flags)
+{
+  int i = find_key(key, flags);
+  if (i < 0) {
+    return -1;
+  }
+  g_kv[i].gen = 0;
+  return 0;
+}
+
+int kv_generation(const char *key, uint64_t *gen, unsigned int flags)
+{
+  int i = find_key(key, flags);
+
+  g_kv_gen_calls++;
+  *gen = i < 0 ? 0 : g_kv[i].gen;
+  return 0;
+}
+
+static float corrected(uint8_t fru, uint8_t id, float cond_value, float reading)
+{
+  assert(sensor_correction_apply(fru, id, cond_value, &reading) == 0);
+  return reading;
+}
+
+/* The lookup the tables are compiled from: the correction of the entry
+ * before the first one whose condition value is above cond_value. */
+static float linear_correction(const float tbl[][2], size_t num, float cond_value)
+{
+  float correction = tbl[0][1];
+  size_t i;
+
+  for (i = 0; i < num; i++) {
+    if (cond_value < tbl[i][0]) {
+      break;
+    }
+    correction = tbl[i][1];
+  }
+  return correction;
+}
+
+static void test_table_search(void)
+{
+  static const float tbl_a[][2] = {{0, 1.0}, {10, 2.0}, {20, 3.0}};
+  static const float tbl_c[][2] = {{0, 1.0}, {30, 2.0}, {10, 3.0}, {40, 4.0}, {35, 5.0}};
+  float c;
+
+  for (c = -5.0; c <= 50.0; c += 0.5) {
+    assert(corrected(1, 1, c, 100.0) == 100.0 - linear_correction(tbl_a, 3, c));
+  }
+  assert(corrected(1, 1, 9.99, 100.0) == 99.0);
+  assert(corrected(1, 1, 10.0, 100.0) == 98.0);
+
+  /* Unsorted table, the entries past a larger condition value are
+   * only reached above it. */
+  kv_set("test_cond1", "c", 0, 0);
+  for (c = -5.0; c <= 50.0; c += 0.5) {
+    assert(corrected(1, 1, c, 100.0) == 100.0 - linear_correction(tbl_c, 5, c));
+  }
+  assert(corrected(1, 1, 20.0, 100.0) == 99.0);
+  assert(corrected(1, 1, 36.0, 100.0) == 97.0);
+  assert(corrected(1, 1, 45.0, 100.0) == 95.0);
+  kv_del("test_cond1", 0);
+  printf("SUCCESS: Correction table search.\n");
+}
+
+static void test_cond_cache(void)
+{
+  /* Default table while the key is not set */
+  g_kv_get_calls = 0;
+  assert(corrected(1, 1, 15.0, 100.0) == 98.0);
+  assert(corrected(1, 1, 15.0, 100.0) == 98.0);
+  assert(g_kv_get_calls == 1);
+
+  kv_set("test_cond1", "b", 0, 0);
+  g_kv_get_calls = 0;
+  assert(corrected(1, 1, 15.0, 100.0) == 80.0);
+  assert(corrected(1, 1, 15.0, 100.0) == 80.0);
+  assert(corrected(1, 1, 2.0, 100.0) == 90.0);
+  assert(g_kv_get_calls == 1);
+
+  /* Unknown value, back to the default table */
+  kv_set("test_cond1", "z", 0, 0);
+  assert(corrected(1, 1, 15.0, 100.0) == 98.0);
+  kv_set("test_cond1", "a", 0, 0);
+  assert(corrected(1, 1, 15.0, 100.0) == 98.0);
+  assert(g_kv_get_calls == 3);
+
+  /* Regular and persistent keys are different keys */
+  g_kv_get_calls = 0;
+  assert(corrected(2, 1, 0.0, 300.0) == 200.0);
+  kv_set("test_cond2", "y", 0, 0);
+  assert(corrected(2, 1, 0.0, 300.0) == 200.0);
+  kv_set("test_cond2", "y", 0, KV_FPERSIST);
+  assert(corrected(2, 1, 0.0, 300.0) == 100.0);
+  assert(g_kv_get_calls == 2);
+
+  kv_del("test_cond1", 0);
+  kv_del("test_cond2", 0);
+  kv_del("test_cond2", KV_FPERSIST);
+  assert(corrected(1, 1, 15.0, 100.0) == 98.0);
+  assert(corrected(2, 1, 0.0, 300.0) == 200.0);
+  printf("SUCCESS: Condition table cached per key generation.\n");
+}
+
+static void test_apply_many(void)
+{
+  sensor_correction_req_t reqs[] = {
+    {1, 1, 15.0, 100.0},
+    {1, 2, 60.0, 100.0},
+    {3, 3, 15.0, 100.0}, /* No correction */
+    {2, 1, 0.0, 300.0},
+    {1, 1, 25.0, 100.0},
+  };
+  size_t num = sizeof(reqs) / sizeof(reqs[0]);
+  float single[sizeof(reqs) / sizeof(reqs[0])];
+  size_t i;
+
+  kv_set("test_cond1", "b", 0, 0);
+  kv_set("test_cond2", "y", 0, KV_FPERSIST);
+  for (i = 0; i < num; i++) {
+    single[i] = reqs[i].sensor_reading;
+    assert(sensor_correction_apply(reqs[i].fru, reqs[i].sensor_id,
+          reqs[i].cond_value, &single[i]) == 0);
+  }
+
+  /* One generation lookup per condition key of the batch */
+  g_kv_gen_calls = 0;
+  g_kv_get_calls = 0;
+  assert(sensor_correction_apply_many(reqs, num) == 0);
+  assert(g_kv_gen_calls == 2);
+  assert(g_kv_get_calls == 0);
+  for (i = 0; i < num; i++) {
+    assert(reqs[i].sensor_reading == single[i]);
+  }
+  assert(reqs[0].sensor_reading == 80.0);
+  assert(reqs[1].sensor_reading == 93.0);
+  assert(reqs[2].sensor_reading == 100.0);
+  assert(reqs[3].sensor_reading == 100.0);
+  assert(reqs[4].sensor_reading == 80.0);
+
+  /* A key changed since the last batch is read again, once */
+  kv_set("test_cond1", "a", 0, 0);
+  for (i = 0; i < num; i++) {
+    reqs[i].sensor_reading = i == 3 ? 300.0 : 100.0;
+  }
+  g_kv_get_calls = 0;
+  assert(sensor_correction_apply_many(reqs, num) == 0);
+  assert(g_kv_get_calls == 2);
+  assert(reqs[0].sensor_reading == 98.0);
+  assert(reqs[1].sensor_reading == 98.5);
+  assert(reqs[2].sensor_reading == 100.0);
+  assert(reqs[3].sensor_reading == 100.0);
+  assert(reqs[4].sensor_reading == 97.0);
+
+  assert(sensor_correction_apply_many(reqs, 0) == 0);
+  kv_del("test_cond1", 0);
+  kv_del("test_cond2", KV_FPERSIST);
+  printf("SUCCESS: Batch correction.\n");
+}
+
+int main(int argc, char *argv[])
+{
+  (void)argc;
+  if (chdir(dirname(argv[0])) != 0) {
+    printf("Cannot chdir into %s\n", dirname(argv[0]));
+    return -1;
+  }
+  assert(sensor_correction_init("./test_conf.json") == 0);
+  assert(corrected(9, 9, 15.0, 100.0) == 100.0);
+
+  test_table_search();
+  test_cond_cache();
+  test_apply_many();
+  return 0;
+}
@@ -602,6 +602,10 @@ size_t psu1_sensor_cnt = sizeof(psu1_sensor_list)/sizeof(uint8_t);
 size_t psu2_sensor_cnt = sizeof(psu2_sensor_list)/sizeof(uint8_t);
 
 static sensor_info_t g_sinfo[MAX_NUM_FRUS][MAX_SENSOR_NUM] = {0};
+/* BIC readings fetched in one batch by pal_sensor_read_prefetch(),
+ * each one is consumed by the next read of that sensor */
+static ipmi_sensor_reading_t g_bic_prefetch[MAX_SENSOR_NUM];
+static bool g_bic_prefetch_valid[MAX_SENSOR_NUM] = {false};
 
 static float hsc_rsense[MAX_NUM_FRUS] = {0};
 
@@ -2451,9 +2455,14 @@ bic_read_sensor_wrapper(uint8_t fru, uint8_t sensor_num, bool discrete,
   ipmi_sensor_reading_t sensor;
   sdr_full_t *sdr;
 
-  ret = bic_read_sensor(IPMB_BUS, sensor_num, &sensor);
-  if (ret) {
-    return ret;
+  if (g_bic_prefetch_valid[sensor_num]) {
+    sensor = g_bic_prefetch[sensor_num];
+    g_bic_prefetch_valid[sensor_num] = false;
+  } else {
+    ret = bic_read_sensor(IPMB_BUS, sensor_num, &sensor);
+    if (ret) {
+      return ret;
+    }
   }
 
   if (sensor.flags & BIC_SENSOR_READ_NA) {
@@ -3570,6 +3579,51 @@ psu_sensor_read(uint8_t sensor_num, float *value) {
   return ret;
 }
 
+int
+pal_sensor_read_prefetch(uint8_t fru, uint8_t *sensor_list, int cnt) {
+
+  uint8_t bic_list[MAX_SENSOR_NUM];
+  ipmi_sensor_reading_t readings[MAX_SENSOR_NUM];
+  int i, j, num = 0;
+
+  if (fru != FRU_SCM) {
+    return PAL_ENOTSUP;
+  }
+
+  memset(g_bic_prefetch_valid, 0, sizeof(g_bic_prefetch_valid));
+  if (!is_server_on() || bic_sdr_init(FRU_SCM, false) < 0) {
+    return 0;
+  }
+
+  for (i = 0; i < cnt && num < MAX_SENSOR_NUM; i++) {
+    if (sensor_list[i] >= MAX_SENSOR_NUM ||
+        !g_sinfo[FRU_SCM-1][sensor_list[i]].valid) {
+      continue;
+    }
+    for (j = 0; j < scm_sensor_cnt; j++) {
+      if (sensor_list[i] == scm_sensor_list[j]) {
+        break;
+      }
+    }
+    if (j == scm_sensor_cnt) {
+      bic_list[num++] = sensor_list[i];
+    }
+  }
+  if (num == 0) {
+    return 0;
+  }
+
+  // Sensors the BIC could not read are retried one by one
+  bic_read_sensors(IPMB_BUS, bic_list, num, readings);
+  for (i = 0; i < num; i++) {
+    if (!(readings[i].flags & BIC_SENSOR_FLAG_NA)) {
+      g_bic_prefetch[bic_list[i]] = readings[i];
+      g_bic_prefetch_valid[bic_list[i]] = true;
+    }
+  }
+  return 0;
+}
+
 int
 pal_sensor_read_raw(uint8_t fru, uint8_t sensor_num, void *value) {
 
@@ -3606,10 +3660,13 @@ pal_sensor_read_raw(uint8_t fru, uint8_t sensor_num, void *value) {
   sprintf(key, "%s_sensor%d", fru_name, sensor_num);
   switch(fru) {
     case FRU_SCM:
-      ret = scm_sensor_read(sensor_num, value);
-      if (sensor_num == SCM_SENSOR_INLET_TEMP) {
+      // A prefetched BIC reading did not touch the bus
+      if (sensor_num < MAX_SENSOR_NUM && g_bic_prefetch_valid[sensor_num]) {
+        delay = 0;
+      } else if (sensor_num == SCM_SENSOR_INLET_TEMP) {
         delay = 100;
       }
+      ret = scm_sensor_read(sensor_num, value);
       break;
     case FRU_SMB:
       ret = smb_sensor_read(sensor_num, value);
@@ -3635,7 +3692,9 @@ pal_sensor_read_raw(uint8_t fru, uint8_t sensor_num, void *value) {
   if (ret == READING_NA || ret == -1) {
     return READING_NA;
   }
-  msleep(delay);
+  if (delay) {
+    msleep(delay);
+  }
 
   return 0;
 }